@@ -0,0 +1,423 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+We hope that this plugin will be useful to others, but its source code
+and functionality are subject to a non-disclosure agreement (NDA) with
+Neuralynx, Inc. If you or your institution have not signed the appropriate
+NDA, STOP and do not read or execute this plugin until you have done so.
+Do not share this plugin with other parties who have not signed the NDA.
+
+*/
+
+#include "CaptureFile.h"
+
+#include <cerrno>
+#include <cstring>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace CaptureFile;
+
+namespace
+{
+    const intptr_t noHandle = -1;
+
+    uint64_t padded(uint64_t bytes)
+    {
+        return (bytes + 7) & ~uint64_t(7);
+    }
+
+    // (capture files are little-endian; all supported platforms are too)
+    uint32_t readU32(const char* p)
+    {
+        uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    uint64_t readU64(const char* p)
+    {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    std::string lastErrorString()
+    {
+#ifdef _WIN32
+        return "error " + std::to_string(GetLastError());
+#else
+        return std::strerror(errno);
+#endif
+    }
+
+    void closeHandle(intptr_t& h)
+    {
+        if (h == noHandle)
+        {
+            return;
+        }
+#ifdef _WIN32
+        CloseHandle(reinterpret_cast<HANDLE>(h));
+#else
+        ::close(int(h));
+#endif
+        h = noHandle;
+    }
+}
+
+
+/*** Writer ***/
+
+Writer::Writer()
+    : handle     (noHandle)
+    , mapping    (noHandle)
+    , base       (nullptr)
+    , mappedBytes(0)
+    , usedBytes  (0)
+    , numRecords (0)
+{}
+
+
+Writer::~Writer()
+{
+    close();
+}
+
+
+bool Writer::open(const std::string& filePath)
+{
+    close();
+    error.clear();
+
+#ifdef _WIN32
+    HANDLE h = CreateFileA(filePath.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ,
+        nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE)
+    {
+        error = "can't create " + filePath + ": " + lastErrorString();
+        return false;
+    }
+    handle = reinterpret_cast<intptr_t>(h);
+#else
+    int fd = ::open(filePath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        error = "can't create " + filePath + ": " + lastErrorString();
+        return false;
+    }
+    handle = fd;
+#endif
+
+    if (!mapSize(growBytes))
+    {
+        close();
+        return false;
+    }
+
+    std::memcpy(base, magic, sizeof(magic));
+    std::memcpy(base + 8, &version, sizeof(version));
+    uint32_t headerBytes = fileHeaderBytes;
+    std::memcpy(base + 12, &headerBytes, sizeof(headerBytes));
+
+    usedBytes = fileHeaderBytes;
+    numRecords = 0;
+    return true;
+}
+
+
+bool Writer::isOpen() const
+{
+    return base != nullptr;
+}
+
+
+bool Writer::append(const void* packet, uint32_t bytes, uint64_t arrivalNs)
+{
+    if (base == nullptr || bytes == 0)
+    {
+        return false;
+    }
+
+    uint64_t recordBytes = recordHeaderBytes + padded(bytes);
+    if (usedBytes + recordBytes > mappedBytes && !mapSize(mappedBytes + growBytes))
+    {
+        close();
+        return false;
+    }
+
+    // (the new part of the file is already zero, so padding needs no writes)
+    char* record = base + usedBytes;
+    std::memcpy(record + 8, &arrivalNs, sizeof(arrivalNs));
+    std::memcpy(record + recordHeaderBytes, packet, bytes);
+
+    // write the length last, since a nonzero length is what makes the record visible to readers
+    std::memcpy(record, &bytes, sizeof(bytes));
+
+    usedBytes += recordBytes;
+    ++numRecords;
+    return true;
+}
+
+
+void Writer::close()
+{
+    unmap();
+
+    if (handle != noHandle)
+    {
+        // trim the unused part of the last chunk
+#ifdef _WIN32
+        LARGE_INTEGER size;
+        size.QuadPart = LONGLONG(usedBytes);
+        HANDLE h = reinterpret_cast<HANDLE>(handle);
+        if (SetFilePointerEx(h, size, nullptr, FILE_BEGIN))
+        {
+            SetEndOfFile(h);
+        }
+#else
+        if (ftruncate(int(handle), off_t(usedBytes)) != 0)
+        {
+            error = "can't trim capture file: " + lastErrorString();
+        }
+#endif
+        closeHandle(handle);
+    }
+
+    mappedBytes = 0;
+    usedBytes = 0;
+}
+
+
+bool Writer::mapSize(uint64_t newSize)
+{
+    unmap();
+
+#ifdef _WIN32
+    // creating a mapping larger than the file extends it with zeros
+    HANDLE m = CreateFileMappingA(reinterpret_cast<HANDLE>(handle), nullptr, PAGE_READWRITE,
+        DWORD(newSize >> 32), DWORD(newSize & 0xffffffff), nullptr);
+    if (m == nullptr)
+    {
+        error = "can't extend capture file: " + lastErrorString();
+        return false;
+    }
+    mapping = reinterpret_cast<intptr_t>(m);
+
+    void* view = MapViewOfFile(m, FILE_MAP_WRITE, 0, 0, size_t(newSize));
+    if (view == nullptr)
+    {
+        error = "can't map capture file: " + lastErrorString();
+        closeHandle(mapping);
+        return false;
+    }
+#else
+    if (ftruncate(int(handle), off_t(newSize)) != 0)
+    {
+        error = "can't extend capture file: " + lastErrorString();
+        return false;
+    }
+
+    void* view = mmap(nullptr, size_t(newSize), PROT_READ | PROT_WRITE, MAP_SHARED, int(handle), 0);
+    if (view == MAP_FAILED)
+    {
+        error = "can't map capture file: " + lastErrorString();
+        return false;
+    }
+#endif
+
+    base = static_cast<char*>(view);
+    mappedBytes = newSize;
+    return true;
+}
+
+
+void Writer::unmap()
+{
+    if (base != nullptr)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(base);
+#else
+        munmap(base, size_t(mappedBytes));
+#endif
+        base = nullptr;
+    }
+    closeHandle(mapping);
+}
+
+
+/*** Reader ***/
+
+Reader::Reader()
+    : handle   (noHandle)
+    , mapping  (noHandle)
+    , base     (nullptr)
+    , fileBytes(0)
+    , position (0)
+{}
+
+
+Reader::~Reader()
+{
+    close();
+}
+
+
+bool Reader::open(const std::string& filePath)
+{
+    close();
+    error.clear();
+
+#ifdef _WIN32
+    HANDLE h = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+        nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER size;
+    if (h == INVALID_HANDLE_VALUE || !GetFileSizeEx(h, &size))
+    {
+        error = "can't open " + filePath + ": " + lastErrorString();
+        if (h != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(h);
+        }
+        return false;
+    }
+    handle = reinterpret_cast<intptr_t>(h);
+    fileBytes = uint64_t(size.QuadPart);
+#else
+    int fd = ::open(filePath.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        error = "can't open " + filePath + ": " + lastErrorString();
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+        return false;
+    }
+    handle = fd;
+    fileBytes = uint64_t(st.st_size);
+#endif
+
+    if (fileBytes < uint64_t(fileHeaderBytes))
+    {
+        error = filePath + " is not a capture file";
+        close();
+        return false;
+    }
+
+#ifdef _WIN32
+    HANDLE m = CreateFileMappingA(h, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const void* view = m != nullptr ? MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (m != nullptr)
+    {
+        mapping = reinterpret_cast<intptr_t>(m);
+    }
+#else
+    const void* view = mmap(nullptr, size_t(fileBytes), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (view == MAP_FAILED)
+    {
+        view = nullptr;
+    }
+    else
+    {
+        // records are read in order
+        madvise(const_cast<void*>(view), size_t(fileBytes), MADV_SEQUENTIAL);
+    }
+#endif
+
+    if (view == nullptr)
+    {
+        error = "can't map " + filePath + ": " + lastErrorString();
+        close();
+        return false;
+    }
+    base = static_cast<const char*>(view);
+
+    if (std::memcmp(base, magic, sizeof(magic)) != 0 || readU32(base + 8) > version)
+    {
+        error = filePath + " is not a capture file, or was written by a newer version";
+        close();
+        return false;
+    }
+
+    path = filePath;
+    position = readU32(base + 12);
+    return true;
+}
+
+
+bool Reader::isOpen() const
+{
+    return base != nullptr;
+}
+
+
+void Reader::close()
+{
+    if (base != nullptr)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(base);
+#else
+        munmap(const_cast<char*>(base), size_t(fileBytes));
+#endif
+        base = nullptr;
+    }
+    closeHandle(mapping);
+    closeHandle(handle);
+
+    fileBytes = 0;
+    position = 0;
+    path.clear();
+}
+
+
+bool Reader::readNext(Record& record)
+{
+    if (base == nullptr || position + recordHeaderBytes > fileBytes)
+    {
+        return false;
+    }
+
+    const char* header = base + position;
+    uint32_t bytes = readU32(header);
+    uint64_t recordBytes = recordHeaderBytes + padded(bytes);
+
+    // a zero length is the end of a capture that wasn't closed; a record that runs past the end of the file
+    // means the file was cut off
+    if (bytes == 0 || position + recordBytes > fileBytes)
+    {
+        return false;
+    }
+
+    record.data = reinterpret_cast<const uint32_t*>(header + recordHeaderBytes);
+    record.bytes = bytes;
+    record.arrivalNs = readU64(header + 8);
+
+    position += recordBytes;
+    return true;
+}
+
+
+void Reader::rewind()
+{
+    if (base != nullptr)
+    {
+        position = readU32(base + 12);
+    }
+}
@@ -0,0 +1,128 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+We hope that this plugin will be useful to others, but its source code
+and functionality are subject to a non-disclosure agreement (NDA) with
+Neuralynx, Inc. If you or your institution have not signed the appropriate
+NDA, STOP and do not read or execute this plugin until you have done so.
+Do not share this plugin with other parties who have not signed the NDA.
+
+*/
+
+#ifndef CAPTURE_FILE_H_INCLUDED
+#define CAPTURE_FILE_H_INCLUDED
+
+// Does not depend on JUCE, so it can also be used by tools outside the plugin.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * Raw packet capture files (.nlxcap).
+ *
+ * Layout: a 32-byte file header, then one record per datagram:
+ *   uint32 length     (bytes of payload; 0 marks the end of the data)
+ *   uint32 reserved   (0)
+ *   uint64 arrivalNs  (kernel arrival time if available, otherwise time received; ns since the Unix epoch)
+ *   payload           (the datagram as received, padded with zeros to a multiple of 8 bytes)
+ * All fields are little-endian. The file grows in large zero-filled chunks while writing and is
+ * trimmed when closed, so a capture that was not closed properly still reads up to its last record.
+ */
+namespace CaptureFile
+{
+    static const char magic[8] = { 'N', 'L', 'X', 'C', 'A', 'P', '\0', '\0' };
+    static const uint32_t version = 1;
+    static const int fileHeaderBytes = 32;
+    static const int recordHeaderBytes = 16;
+
+    static const char* const extension = ".nlxcap";
+
+    struct Record
+    {
+        const uint32_t* data;
+        uint32_t bytes;
+        uint64_t arrivalNs;
+    };
+
+    // Appends records to a memory-mapped capture file. Not thread-safe; use from one thread at a time.
+    class Writer
+    {
+    public:
+        Writer();
+        ~Writer();
+
+        // Creates (or replaces) the file at path. Returns false on failure (see getError).
+        bool open(const std::string& path);
+        bool isOpen() const;
+
+        // Returns false if the file could not be extended (the writer is then closed).
+        bool append(const void* packet, uint32_t bytes, uint64_t arrivalNs);
+
+        // Trims the file to the data written and closes it
+        void close();
+
+        uint64_t getNumRecords() const { return numRecords; }
+        const std::string& getError() const { return error; }
+
+    private:
+        bool mapSize(uint64_t newSize);
+        void unmap();
+
+        // reserve this much more space at a time
+        static const uint64_t growBytes = uint64_t(256) << 20;
+
+        intptr_t handle;
+        intptr_t mapping;
+        char* base;
+        uint64_t mappedBytes;
+        uint64_t usedBytes;
+        uint64_t numRecords;
+        std::string error;
+
+        Writer(const Writer&) = delete;
+        Writer& operator=(const Writer&) = delete;
+    };
+
+    // Reads records from a memory-mapped capture file, in order.
+    class Reader
+    {
+    public:
+        Reader();
+        ~Reader();
+
+        // Returns false if the file can't be opened or is not a capture file (see getError).
+        bool open(const std::string& path);
+        bool isOpen() const;
+        void close();
+
+        // Gets the next record (whose data stays valid until the reader is closed).
+        // Returns false at the end of the data.
+        bool readNext(Record& record);
+
+        // Go back to the first record
+        void rewind();
+
+        const std::string& getPath() const { return path; }
+        const std::string& getError() const { return error; }
+
+    private:
+        intptr_t handle;
+        intptr_t mapping;
+        const char* base;
+        uint64_t fileBytes;
+        uint64_t position;
+        std::string path;
+        std::string error;
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+    };
+}
+
+#endif // CAPTURE_FILE_H_INCLUDED
@@ -0,0 +1,180 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+We hope that this plugin will be useful to others, but its source code
+and functionality are subject to a non-disclosure agreement (NDA) with
+Neuralynx, Inc. If you or your institution have not signed the appropriate
+NDA, STOP and do not read or execute this plugin until you have done so.
+Do not share this plugin with other parties who have not signed the NDA.
+
+*/
+
+#ifndef LATENCY_HISTOGRAM_H_INCLUDED
+#define LATENCY_HISTOGRAM_H_INCLUDED
+
+// Header-only and does not depend on JUCE, so it can also be used by tools outside the plugin.
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Streaming histogram of durations in ns, in the style of HdrHistogram: values below
+ * 2^subBucketBits have a bucket each, and above that each power of 2 is split into
+ * 2^(subBucketBits - 1) buckets, so any value is known to within 1% with a fixed, small
+ * number of buckets and no allocation while recording. Like ReceiveTelemetry's counters,
+ * it has a single writer, which just does a relaxed load and store per value; any thread
+ * can read it (through Counts) at any time.
+ */
+class LatencyHistogram
+{
+public:
+    static const int subBucketBits = 7;
+    static const int subBuckets = 1 << subBucketBits;
+    static const int halfSubBuckets = subBuckets / 2;
+
+    // (covers values up to 2^37 ns, about 2 minutes; longer ones are counted in the last bucket)
+    static const int numBuckets = 2048;
+
+    LatencyHistogram()
+    {
+        reset();
+    }
+
+    // (only call from the writer thread)
+    void record(uint64_t ns)
+    {
+        std::atomic<uint64_t>& count = counts[getBucket(ns)];
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    // Only call while the writer isn't running
+    void reset()
+    {
+        for (std::atomic<uint64_t>& count : counts)
+        {
+            count.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    static int getBucket(uint64_t ns)
+    {
+        if (ns < uint64_t(subBuckets))
+        {
+            return int(ns);
+        }
+
+#if defined(__GNUC__) || defined(__clang__)
+        int msb = 63 - __builtin_clzll(ns);
+#else
+        int msb = subBucketBits;
+        while ((ns >> msb) > 1)
+        {
+            ++msb;
+        }
+#endif
+
+        // ns >> shift is in [halfSubBuckets, subBuckets)
+        int shift = msb - subBucketBits + 1;
+        int bucket = shift * halfSubBuckets + int(ns >> shift);
+        return bucket < numBuckets ? bucket : numBuckets - 1;
+    }
+
+    // Smallest value in a bucket
+    static uint64_t getBucketStart(int bucket)
+    {
+        if (bucket < subBuckets)
+        {
+            return uint64_t(bucket);
+        }
+        int shift = bucket / halfSubBuckets - 1;
+        return uint64_t(bucket - shift * halfSubBuckets) << shift;
+    }
+
+    // The bucket counts of one histogram, or of several added together, at one time
+    class Counts
+    {
+    public:
+        Counts() : buckets(numBuckets, 0), total(0) {}
+
+        void add(const LatencyHistogram& histogram)
+        {
+            for (int b = 0; b < numBuckets; ++b)
+            {
+                uint64_t n = histogram.counts[b].load(std::memory_order_relaxed);
+                buckets[b] += n;
+                total += n;
+            }
+        }
+
+        // What was recorded between earlier (counts of the same histograms) and these
+        // (if the histograms were reset in between, everything since the reset)
+        Counts since(const Counts& earlier) const
+        {
+            bool wasReset = earlier.total > total;
+            Counts interval;
+            for (int b = 0; b < numBuckets; ++b)
+            {
+                interval.buckets[b] = wasReset || earlier.buckets[b] > buckets[b] ? buckets[b]
+                    : buckets[b] - earlier.buckets[b];
+                interval.total += interval.buckets[b];
+            }
+            return interval;
+        }
+
+        uint64_t getTotal() const { return total; }
+
+        // Value in ns that p percent of the values recorded are no greater than (to within
+        // the bucket width); 0 if nothing was recorded
+        double getPercentile(double p) const
+        {
+            if (total == 0)
+            {
+                return 0;
+            }
+
+            uint64_t rank = uint64_t(p / 100 * total + 0.5);
+            rank = rank < 1 ? 1 : rank > total ? total : rank;
+
+            uint64_t seen = 0;
+            for (int b = 0; b < numBuckets; ++b)
+            {
+                seen += buckets[b];
+                if (seen >= rank)
+                {
+                    return getBucketMiddle(b);
+                }
+            }
+            return getBucketMiddle(numBuckets - 1);
+        }
+
+        double getMax() const
+        {
+            return getPercentile(100);
+        }
+
+    private:
+        static double getBucketMiddle(int bucket)
+        {
+            uint64_t start = getBucketStart(bucket);
+            uint64_t end = bucket + 1 < numBuckets ? getBucketStart(bucket + 1) : start + 1;
+            return start + (end - start - 1) / 2.0;
+        }
+
+        std::vector<uint64_t> buckets;
+        uint64_t total;
+    };
+
+private:
+    std::atomic<uint64_t> counts[numBuckets];
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+};
+
+#endif // LATENCY_HISTOGRAM_H_INCLUDED
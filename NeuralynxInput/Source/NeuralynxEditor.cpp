@@ -20,8 +20,9 @@ Do not share this plugin with other parties who have not signed the NDA.
 NeuralynxEditor::NeuralynxEditor(SourceNode* sn, NeuralynxThread* t)
     : GenericEditor(sn, false)
     , thread(t)
+    , telemetryTimer(*this)
 {
-    desiredWidth = 210;
+    desiredWidth = 850;
     
     // connection controls
 
@@ -45,7 +46,7 @@ NeuralynxEditor::NeuralynxEditor(SourceNode* sn, NeuralynxThread* t)
     portLabel->setFont(portLabel->getFont().boldened());
     addAndMakeVisible(portLabel);
 
-    portEditable = new Label("PortE", String(t->port));
+    portEditable = new Label("PortE", String(t->getStreamPort(0)));
     portEditable->setBounds(145, 45, 45, 20);
     portEditable->setTooltip("Port of this computer's connection to the Digital Lynx SX or ATLAS system. "
         "This should be 26090 unless you have an advanced setup that is not using the default.");
@@ -54,12 +55,307 @@ NeuralynxEditor::NeuralynxEditor(SourceNode* sn, NeuralynxThread* t)
     portEditable->addListener(t);
     addAndMakeVisible(portEditable);
 
+    receiveModeLabel = new Label("ReceiveModeL", "Receive:");
+    receiveModeLabel->setBounds(203, 25, 100, 20);
+    addAndMakeVisible(receiveModeLabel);
+
+    receiveModeBox = new ComboBox("ReceiveModeBox");
+    receiveModeBox->setBounds(205, 45, 95, 20);
+    receiveModeBox->setTooltip("How packets are read from the socket. \"Single\" reads one packet per call. "
+        "\"Batched\" (Linux only) uses recvmmsg to read all queued packets in one call, which reduces "
+        "the number of system calls with many boards or high sample rates. \"Packet ring\" (Linux only) "
+        "reads packets in place from a memory-mapped AF_PACKET ring shared with the kernel, without copying, "
+        "and also receives packets addressed to another MAC address, so the MAC doesn't need to be cloned. "
+        "It needs the CAP_NET_RAW capability, and adds a few ms of latency at low data rates because "
+        "the kernel hands packets over in blocks.");
+    receiveModeBox->addItem("Single", NeuralynxThread::RECEIVE_SINGLE);
+    receiveModeBox->addItem("Batched", NeuralynxThread::RECEIVE_BATCHED);
+    receiveModeBox->addItem("Packet ring", NeuralynxThread::RECEIVE_PACKET_RING);
+    receiveModeBox->setItemEnabled(NeuralynxThread::RECEIVE_BATCHED,
+        NeuralynxThread::receiveModeAvailable(NeuralynxThread::RECEIVE_BATCHED));
+    receiveModeBox->setItemEnabled(NeuralynxThread::RECEIVE_PACKET_RING,
+        NeuralynxThread::receiveModeAvailable(NeuralynxThread::RECEIVE_PACKET_RING));
+    receiveModeBox->setSelectedId(t->receiveMode, dontSendNotification);
+    receiveModeBox->addListener(t);
+    addAndMakeVisible(receiveModeBox);
+
+    waitModeBox = new ComboBox("WaitModeBox");
+    waitModeBox->setBounds(205, 70, 95, 20);
+    waitModeBox->setTooltip("How the receiver waits for packets. \"Spin\" polls the socket continuously, "
+        "which has the lowest latency but uses a full CPU core. \"Poll\" sleeps until a packet arrives. "
+        "\"Hybrid\" spins for a short time (set below) before sleeping.");
+    waitModeBox->addItem("Spin", NeuralynxThread::WAIT_SPIN);
+    waitModeBox->addItem("Poll", NeuralynxThread::WAIT_POLL);
+    waitModeBox->addItem("Hybrid", NeuralynxThread::WAIT_HYBRID);
+    waitModeBox->setSelectedId(t->waitMode, dontSendNotification);
+    waitModeBox->addListener(t);
+    waitModeBox->addListener(this);
+    addAndMakeVisible(waitModeBox);
+
+    busyPollLabel = new Label("BusyPollL", "Spin us:");
+    busyPollLabel->setBounds(203, 95, 55, 20);
+    addAndMakeVisible(busyPollLabel);
+
+    busyPollEditable = new Label("BusyPollE", String(t->busyPollUs));
+    busyPollEditable->setBounds(258, 95, 42, 20);
+    busyPollEditable->setTooltip("Time to spin before sleeping in \"Hybrid\" wait mode, and for decode helper "
+        "threads between blocks (see \"THREADS\"), in microseconds");
+    busyPollEditable->setEditable(true);
+    busyPollEditable->setColour(Label::ColourIds::backgroundColourId, Colours::lightgrey);
+    busyPollEditable->addListener(t);
+    addAndMakeVisible(busyPollEditable);
+    updateBusyPollEnabled();
+
+    blockPolicyLabel = new Label("BlockPolicyL", "Block:");
+    blockPolicyLabel->setBounds(308, 25, 100, 20);
+    addAndMakeVisible(blockPolicyLabel);
+
+    blockPolicyBox = new ComboBox("BlockPolicyBox");
+    blockPolicyBox->setBounds(310, 45, 95, 20);
+    blockPolicyBox->setTooltip("How many packets (samples) are passed to the signal chain at a time. "
+        "\"Fixed\" always waits for the same number of packets. \"Deadline\" passes on whatever has "
+        "arrived a set time after the first packet of a block. \"Adaptive\" passes on everything that has "
+        "arrived (up to a maximum), for the lowest latency while keeping up and larger blocks under load.");
+    blockPolicyBox->addItem("Fixed", NeuralynxThread::BLOCK_FIXED);
+    blockPolicyBox->addItem("Deadline", NeuralynxThread::BLOCK_DEADLINE);
+    blockPolicyBox->addItem("Adaptive", NeuralynxThread::BLOCK_ADAPTIVE);
+    blockPolicyBox->setSelectedId(t->getBlockPolicy(), dontSendNotification);
+    blockPolicyBox->addListener(this);
+    addAndMakeVisible(blockPolicyBox);
+
+    blockParamLabel = new Label("BlockParamL");
+    blockParamLabel->setBounds(308, 70, 60, 20);
+    addAndMakeVisible(blockParamLabel);
+
+    blockParamEditable = new Label("BlockParamE");
+    blockParamEditable->setBounds(365, 70, 40, 20);
+    blockParamEditable->setEditable(true);
+    blockParamEditable->setColour(Label::ColourIds::backgroundColourId, Colours::lightgrey);
+    blockParamEditable->addListener(t);
+    addAndMakeVisible(blockParamEditable);
+    updateBlockParamLabels();
+
+    lossPolicyBox = new ComboBox("LossPolicyBox");
+    lossPolicyBox->setBounds(310, 95, 60, 20);
+    lossPolicyBox->setTooltip("What to do when packets are lost. \"Stop\" stops acquisition if a block "
+        "can't be completed in time. The other options keep going, detect gaps from the hardware "
+        "timestamps and fill missing samples by repeating the last sample (\"Hold\"), with zeros "
+        "(\"Zero\") or by linear interpolation (\"Linear\"), and only stop after a sustained outage.");
+    lossPolicyBox->addItem("Stop", NeuralynxThread::LOSS_STOP);
+    lossPolicyBox->addItem("Hold", NeuralynxThread::LOSS_HOLD);
+    lossPolicyBox->addItem("Zero", NeuralynxThread::LOSS_ZERO);
+    lossPolicyBox->addItem("Linear", NeuralynxThread::LOSS_LINEAR);
+    lossPolicyBox->setSelectedId(t->lossPolicy, dontSendNotification);
+    lossPolicyBox->addListener(t);
+    lossPolicyBox->addListener(this);
+    addAndMakeVisible(lossPolicyBox);
+
+    outageLimitEditable = new Label("OutageLimitE", String(t->outageLimitMs));
+    outageLimitEditable->setBounds(372, 95, 33, 20);
+    outageLimitEditable->setTooltip("When not using \"Stop\", how long no packets can arrive before "
+        "acquisition stops (or, with RECOVER on, before the socket is recreated), in ms");
+    outageLimitEditable->setEditable(true);
+    outageLimitEditable->setColour(Label::ColourIds::backgroundColourId, Colours::lightgrey);
+    outageLimitEditable->addListener(t);
+    addAndMakeVisible(outageLimitEditable);
+
+    recoverButton = new UtilityButton("RECOVER", Font("Small Text", 12, Font::plain));
+    recoverButton->setBounds(143, 107, 55, 18);
+    recoverButton->setClickingTogglesState(true);
+    recoverButton->setToggleState(t->getRecoveryEnabled(), dontSendNotification);
+    recoverButton->setTooltip("When on, a socket error or an outage (no packets for the time set next to the loss "
+        "policy) doesn't stop acquisition: the socket is recreated and acquisition continues from the next valid "
+        "packet, with sample numbers following the amplifier's timestamps. Outages are marked on TTL line 33 and "
+        "counted in the receive stats. Acquisition still stops if packets haven't resumed 10 s after the "
+        "socket is recreated, or come back with a different number of boards.");
+    recoverButton->addListener(this);
+    addAndMakeVisible(recoverButton);
+    updateOutageLimitEnabled();
+
+    // telemetry
+
+    telemetryTitleLabel = new Label("TelemetryL", "Receive stats:");
+    telemetryTitleLabel->setBounds(413, 25, 145, 20);
+    addAndMakeVisible(telemetryTitleLabel);
+
+    Font statsFont("Small Text", 11, Font::plain);
+
+    rateLabel = new Label("RateL");
+    rateLabel->setBounds(413, 45, 145, 15);
+    rateLabel->setFont(statsFont);
+    rateLabel->setTooltip("Packets per second and megabytes per second received");
+    addAndMakeVisible(rateLabel);
+
+    errorLabel = new Label("ErrorL");
+    errorLabel->setBounds(413, 60, 145, 15);
+    errorLabel->setFont(statsFont);
+    errorLabel->setTooltip("Invalid packets (wrong size, header or checksum) and timeouts waiting for a block");
+    addAndMakeVisible(errorLabel);
+
+    dropLabel = new Label("DropL");
+    dropLabel->setBounds(413, 75, 145, 15);
+    dropLabel->setFont(statsFont);
+    dropLabel->setTooltip("Packets dropped by the kernel because the socket buffer was full (Linux only), "
+        "packets dropped because the receive ring was full, and gaps in the hardware timestamps");
+    addAndMakeVisible(dropLabel);
+
+    decodeLabel = new Label("DecodeL");
+    decodeLabel->setBounds(413, 90, 145, 15);
+    decodeLabel->setFont(statsFont);
+    decodeLabel->setTooltip("Average time to decode a block and pass it to the signal chain, and how much "
+        "faster the amplifier's clock runs than this computer's, in parts per million (stream 1; "
+        "estimated from the hardware timestamps, after a few seconds of acquisition)");
+    addAndMakeVisible(decodeLabel);
+
+    logButton = new UtilityButton("LOG", Font("Small Text", 12, Font::plain));
+    logButton->setBounds(415, 107, 40, 18);
+    logButton->setClickingTogglesState(true);
+    logButton->setTooltip("When on, receive stats are written once per second to a CSV file "
+        "in your documents folder during acquisition");
+    addAndMakeVisible(logButton);
+
+    updateTelemetry();
+
+    // capture and replay
+
+    captureButton = new UtilityButton("CAPTURE", Font("Small Text", 12, Font::plain));
+    captureButton->setBounds(458, 107, 52, 18);
+    captureButton->setClickingTogglesState(true);
+    captureButton->setTooltip("When on, every packet received during acquisition is saved, with its arrival "
+        "time, to a capture file (.nlxcap) in your documents folder, which can be replayed later");
+    captureButton->addListener(this);
+    addAndMakeVisible(captureButton);
+
+    replayButton = new UtilityButton("REPLAY", Font("Small Text", 12, Font::plain));
+    replayButton->setBounds(513, 107, 45, 18);
+    replayButton->setTooltip("Replay a capture file instead of receiving from the network, either at the "
+        "recorded pace or as fast as possible");
+    replayButton->addListener(this);
+    addAndMakeVisible(replayButton);
+
+    // further streams
+
+    streamsButton = new UtilityButton("STREAMS", Font("Small Text", 12, Font::plain));
+    streamsButton->setBounds(563, 107, 60, 18);
+    streamsButton->addListener(this);
+    addAndMakeVisible(streamsButton);
+    updateStreamsButton();
+
+    // channel subset and order
+
+    channelMapButton = new UtilityButton("CHANNELS", Font("Small Text", 12, Font::plain));
+    channelMapButton->setBounds(626, 107, 66, 18);
+    channelMapButton->addListener(this);
+    addAndMakeVisible(channelMapButton);
+    updateChannelMapButton();
+
+    // compressed raw recording
+
+    rawRecordButton = new UtilityButton("RAW", Font("Small Text", 12, Font::plain));
+    rawRecordButton->setBounds(695, 107, 40, 18);
+    rawRecordButton->setClickingTogglesState(true);
+    rawRecordButton->setTooltip("When on, the raw samples of every channel are compressed losslessly during "
+        "acquisition and saved, with their sample numbers and TTL words, to a file (.nlxraw) in your documents "
+        "folder. Compression runs on background threads and doesn't hold up acquisition.");
+    rawRecordButton->addListener(this);
+    addAndMakeVisible(rawRecordButton);
+
+    // shared memory output
+
+    sharedMemoryButton = new UtilityButton("SHM", Font("Small Text", 12, Font::plain));
+    sharedMemoryButton->setBounds(738, 107, 40, 18);
+    sharedMemoryButton->setClickingTogglesState(true);
+    sharedMemoryButton->setTooltip("When on, each stream's output is also published during acquisition to a "
+        "shared memory ring (\"nlx_input\", \"nlx_input_stream2\", ...) that other programs on this computer, "
+        "such as a closed-loop controller, can read with low latency");
+    sharedMemoryButton->addListener(this);
+    addAndMakeVisible(sharedMemoryButton);
+
+    // multi-threaded decoding
+
+    decodeThreadsButton = new UtilityButton("THREADS", Font("Small Text", 12, Font::plain));
+    decodeThreadsButton->setBounds(781, 107, 62, 18);
+    decodeThreadsButton->addListener(this);
+    addAndMakeVisible(decodeThreadsButton);
+    updateDecodeThreadsButton();
+
+    // OS tuning
+
+    tuningTitleLabel = new Label("TuningL", "OS tuning:");
+    tuningTitleLabel->setBounds(563, 25, 135, 20);
+    tuningTitleLabel->setTooltip("Operating system settings for the receive path, applied when acquisition "
+        "starts. The mark next to each one shows whether it took effect: \"ok\" if it did, \"cap\" if the OS "
+        "limited it, \"NO\" if the OS refused it and \"n/a\" if it isn't available here. Hover over the mark "
+        "for details.");
+    addAndMakeVisible(tuningTitleLabel);
+
+    const char* tuningNames[ReceiveTuning::numSettings] = { "Rcv buf KB:", "Sock poll us:", "RT priority:", "CPU:" };
+    const char* tuningTooltips[ReceiveTuning::numSettings] = {
+        "Size of the socket receive buffer (SO_RCVBUF) in KB, which holds packets while the receiver is "
+        "not running. 0 leaves the OS default. On Linux, values above net.core.rmem_max are capped unless "
+        "running with CAP_NET_ADMIN.",
+        "Time the kernel busy-polls the network device for packets on this socket (SO_BUSY_POLL) in "
+        "microseconds; Linux only. Lowers latency at the cost of CPU time. 0 turns it off.",
+        "Real-time (SCHED_FIFO) priority of the receiver thread, 1-99, so that it isn't preempted by the GUI "
+        "and other processes. 0 leaves normal scheduling. On Linux this needs CAP_SYS_NICE or an rtprio limit; "
+        "on Windows, any value gives the thread time-critical priority. Avoid combining with \"Spin\" waiting "
+        "on a machine with few cores.",
+        "CPU (numbered from 0) to pin the receiver thread to, or \"any\". Works best with a core that "
+        "is kept free of other work."
+    };
+
+    for (int i = 0; i < ReceiveTuning::numSettings; ++i)
+    {
+        int y = 45 + 15 * i;
+
+        Label* name = tuningNameLabels.add(new Label("TuningNameL", tuningNames[i]));
+        name->setBounds(563, y, 72, 15);
+        name->setFont(statsFont);
+        name->setTooltip(tuningTooltips[i]);
+        addAndMakeVisible(name);
+
+        Label* editable = tuningEditables.add(new Label("TuningE"));
+        editable->setBounds(635, y, 38, 14);
+        editable->setFont(statsFont);
+        editable->setTooltip(tuningTooltips[i]);
+        editable->setEditable(true);
+        editable->setColour(Label::ColourIds::backgroundColourId, Colours::lightgrey);
+        editable->addListener(this);
+        addAndMakeVisible(editable);
+
+        Label* status = tuningStatusLabels.add(new Label("TuningStatusL"));
+        status->setBounds(673, y, 27, 15);
+        status->setFont(statsFont.boldened());
+        addAndMakeVisible(status);
+    }
+
+    updateTuningEditables();
+    updateTuningStatus();
+
+    // latency
+
+    latencyTitleLabel = new Label("LatencyL", "Latency us:");
+    latencyTitleLabel->setBounds(703, 25, 95, 20);
+    latencyTitleLabel->setTooltip("Time from each packet's arrival (the kernel's receive timestamp on Linux) "
+        "until its sample was passed to the signal chain, in microseconds, and the parts of it: waiting to be "
+        "decoded, decoding and handing off to the signal chain. Each row shows the median and 99th percentile "
+        "over the last second; hover over a row for the rest of the acquisition.");
+    addAndMakeVisible(latencyTitleLabel);
+
+    for (int stage = 0; stage < ReceiveTelemetry::numLatencyStages; ++stage)
+    {
+        Label* label = latencyLabels.add(new Label("LatencyStageL"));
+        label->setBounds(703, 45 + 15 * stage, 95, 15);
+        label->setFont(statsFont);
+        addAndMakeVisible(label);
+    }
+
     // status indicators
 
     channelsLabel = new Label("ChannelsL");
     channelsLabel->setBounds(8, 85, 85, 18);
     t->numBoardsValue.addListener(this);
-    updateChannelsLabel(t->numBoards);
+    updateChannelsLabel(t->numBoardsValue.getValue());
     addChildComponent(channelsLabel);
 
     hzLabel = new Label("HzL");
@@ -94,25 +390,103 @@ NeuralynxEditor::NeuralynxEditor(SourceNode* sn, NeuralynxThread* t)
     
     updateReceivingLabel(receiving);
     addAndMakeVisible(receivingLabel);
+
+    updateSourceControls();
 }
 
 
-NeuralynxEditor::~NeuralynxEditor() {}
+NeuralynxEditor::~NeuralynxEditor()
+{
+    telemetryTimer.stopTimer();
+}
 
 
 void NeuralynxEditor::startAcquisition()
 {
+    startSnapshot = thread->getTelemetrySnapshot();
+    lastSnapshot = startSnapshot;
+    for (int stage = 0; stage < ReceiveTelemetry::numLatencyStages; ++stage)
+    {
+        lastLatency[stage] = thread->getLatencyCounts(stage);
+    }
+
+    if (logButton->getToggleState())
+    {
+        File logFile = File::getSpecialLocation(File::userDocumentsDirectory).getChildFile(
+            "neuralynx_telemetry_" + Time::getCurrentTime().formatted("%Y-%m-%d_%H-%M-%S") + ".csv");
+
+        telemetryLog = new FileOutputStream(logFile);
+        if (telemetryLog->openedOk())
+        {
+            *telemetryLog << ReceiveTelemetry::getCsvHeader() << "\n";
+            std::cout << "Neuralynx Input: logging receive stats to " << logFile.getFullPathName() << std::endl;
+        }
+        else
+        {
+            CoreServices::sendStatusMessage("Neuralynx Input: could not open stats log");
+            telemetryLog = nullptr;
+        }
+    }
+
+    logButton->setEnabled(false);
+    captureButton->setEnabled(false);
+    rawRecordButton->setEnabled(false);
+    sharedMemoryButton->setEnabled(false);
+    decodeThreadsButton->setEnabled(false);
+    recoverButton->setEnabled(false);
+    replayButton->setEnabled(false);
+    channelMapButton->setEnabled(false);
+    telemetryTimer.startTimer(telemetryIntervalMs);
+
     addressBox->setEnabled(false);
     portEditable->setEnabled(false);
+    receiveModeBox->setEnabled(false);
+    waitModeBox->setEnabled(false);
+    busyPollEditable->setEnabled(false);
+    blockPolicyBox->setEnabled(false);
+    blockParamEditable->setEnabled(false);
+    lossPolicyBox->setEnabled(false);
+    outageLimitEditable->setEnabled(false);
     refreshButton->setEnabled(false);
+
+    for (auto editable : tuningEditables)
+    {
+        editable->setEnabled(false);
+    }
 }
 
 
 void NeuralynxEditor::stopAcquisition()
 {
+    telemetryTimer.stopTimer();
+    updateTelemetry();
+    telemetryLog = nullptr;
+    logButton->setEnabled(true);
+    replayButton->setEnabled(true);
+
     addressBox->setEnabled(true);
     portEditable->setEnabled(true);
+    receiveModeBox->setEnabled(true);
+    waitModeBox->setEnabled(true);
+    updateBusyPollEnabled();
+    blockPolicyBox->setEnabled(true);
+    blockParamEditable->setEnabled(true);
+    lossPolicyBox->setEnabled(true);
+    updateOutageLimitEnabled();
     refreshButton->setEnabled(true);
+    updateSourceControls();
+
+    for (auto editable : tuningEditables)
+    {
+        editable->setEnabled(true);
+    }
+    updateTuningStatus();
+    updateStreamsButton();
+    channelMapButton->setEnabled(true);
+    rawRecordButton->setEnabled(true);
+    sharedMemoryButton->setEnabled(true);
+    decodeThreadsButton->setEnabled(true);
+    recoverButton->setEnabled(true);
 }
 
 
@@ -222,11 +596,783 @@ void NeuralynxEditor::valueChanged(Value& value)
 }
 
 
+void NeuralynxEditor::comboBoxChanged(ComboBox* comboBox)
+{
+    if (comboBox == waitModeBox)
+    {
+        updateBusyPollEnabled();
+    }
+    else if (comboBox == blockPolicyBox)
+    {
+        thread->setBlockPolicy(NeuralynxThread::BlockPolicy(blockPolicyBox->getSelectedId()));
+        updateBlockParamLabels();
+    }
+    else if (comboBox == lossPolicyBox)
+    {
+        updateOutageLimitEnabled();
+    }
+}
+
+
+void NeuralynxEditor::buttonEvent(Button* button)
+{
+    if (button == captureButton)
+    {
+        thread->setCaptureEnabled(captureButton->getToggleState());
+    }
+    else if (button == rawRecordButton)
+    {
+        thread->setRawRecordingEnabled(rawRecordButton->getToggleState());
+    }
+    else if (button == sharedMemoryButton)
+    {
+        thread->setSharedMemoryEnabled(sharedMemoryButton->getToggleState());
+    }
+    else if (button == recoverButton)
+    {
+        thread->setRecoveryEnabled(recoverButton->getToggleState());
+        updateOutageLimitEnabled();
+    }
+    else if (button == replayButton)
+    {
+        chooseSource();
+    }
+    else if (button == streamsButton)
+    {
+        chooseStreams();
+        updateChannelMapButton();
+    }
+    else if (button == channelMapButton)
+    {
+        chooseChannelMap();
+    }
+    else if (button == decodeThreadsButton)
+    {
+        chooseDecodeThreads();
+    }
+}
+
+
+void NeuralynxEditor::labelTextChanged(Label* label)
+{
+    // must be one of the tuning editables
+    int index = tuningEditables.indexOf(label);
+    if (index < 0)
+    {
+        return;
+    }
+
+    ReceiveTuning::Settings settings = thread->getTuning();
+    String text = label->getText().trim();
+    int value = text.getIntValue();
+
+    switch (index)
+    {
+    case ReceiveTuning::RCVBUF:       settings.rcvBufKB = value; break;
+    case ReceiveTuning::BUSY_POLL:    settings.busyPollUs = value; break;
+    case ReceiveTuning::RT_PRIORITY:  settings.rtPriority = value; break;
+    default:
+        settings.cpu = (text.isEmpty() || text.equalsIgnoreCase("any")) ? -1 : value;
+        break;
+    }
+
+    if (!thread->setTuning(settings))
+    {
+        String range;
+        switch (index)
+        {
+        case ReceiveTuning::RCVBUF:      range = "0 to " + String(ReceiveTuning::maxRcvBufKB) + " KB"; break;
+        case ReceiveTuning::BUSY_POLL:   range = "0 to " + String(ReceiveTuning::maxBusyPollUs) + " us"; break;
+        case ReceiveTuning::RT_PRIORITY: range = "0 to " + String(ReceiveTuning::maxRtPriority); break;
+        default:                         range = "\"any\" or 0 to " + String(ReceiveTuning::getNumCpus() - 1); break;
+        }
+        CoreServices::sendStatusMessage("Neuralynx Input: " + String(ReceiveTuning::getSettingName(
+            ReceiveTuning::Setting(index))) + " must be " + range);
+    }
+
+    updateTuningEditables();
+    updateTuningStatus();
+}
+
+
+void NeuralynxEditor::saveCustomParameters(XmlElement* xml)
+{
+    xml->setAttribute("Type", "NeuralynxEditor");
+
+    const ReceiveTuning::Settings& tuning = thread->getTuning();
+    XmlElement* tuningXml = xml->createNewChildElement("TUNING");
+    tuningXml->setAttribute("rcvbuf_kb", tuning.rcvBufKB);
+    tuningXml->setAttribute("busy_poll_us", tuning.busyPollUs);
+    tuningXml->setAttribute("rt_priority", tuning.rtPriority);
+    tuningXml->setAttribute("cpu", tuning.cpu);
+
+    XmlElement* receiveXml = xml->createNewChildElement("RECEIVE");
+    receiveXml->setAttribute("mode", thread->getReceiveMode());
+
+    XmlElement* waitXml = xml->createNewChildElement("WAIT");
+    waitXml->setAttribute("mode", thread->getWaitMode());
+    waitXml->setAttribute("spin_us", thread->getBusyPollUs());
+
+    // (each policy keeps its own parameter)
+    XmlElement* blockXml = xml->createNewChildElement("BLOCK");
+    blockXml->setAttribute("policy", thread->getBlockPolicy());
+    blockXml->setAttribute("fixed_packets", thread->fixedBlockPackets);
+    blockXml->setAttribute("deadline_us", thread->deadlineUs);
+    blockXml->setAttribute("adaptive_packets", thread->adaptiveMaxPackets);
+
+    XmlElement* lossXml = xml->createNewChildElement("LOSS");
+    lossXml->setAttribute("policy", thread->getLossPolicy());
+    lossXml->setAttribute("outage_limit_ms", thread->getOutageLimitMs());
+
+    for (int i = 1; i < thread->getNumStreams(); ++i)
+    {
+        XmlElement* streamXml = xml->createNewChildElement("STREAM");
+        streamXml->setAttribute("address", thread->getStreamAddress(i).toString());
+        streamXml->setAttribute("port", thread->getStreamPort(i));
+    }
+
+    for (int i = 0; i < thread->getNumStreams(); ++i)
+    {
+        if (thread->getChannelMap(i).size() > 0)
+        {
+            XmlElement* channelsXml = xml->createNewChildElement("CHANNELS");
+            channelsXml->setAttribute("stream", i);
+            channelsXml->setAttribute("map", NeuralynxThread::formatChannelList(thread->getChannelMap(i)));
+        }
+    }
+
+    if (thread->getLfpFactor() > 1)
+    {
+        XmlElement* lfpXml = xml->createNewChildElement("LFP");
+        lfpXml->setAttribute("factor", thread->getLfpFactor());
+        lfpXml->setAttribute("channels", NeuralynxThread::formatChannelList(thread->getLfpChannels()));
+    }
+
+    if (thread->getDecodeThreads() > 1)
+    {
+        XmlElement* decodeXml = xml->createNewChildElement("DECODE");
+        decodeXml->setAttribute("threads", thread->getDecodeThreads());
+    }
+
+    if (thread->getRecoveryEnabled())
+    {
+        xml->createNewChildElement("RECOVERY");
+    }
+}
+
+
+void NeuralynxEditor::loadCustomParameters(XmlElement* xml)
+{
+    forEachXmlChildElementWithTagName(*xml, tuningXml, "TUNING")
+    {
+        ReceiveTuning::Settings tuning;
+        tuning.rcvBufKB = tuningXml->getIntAttribute("rcvbuf_kb", tuning.rcvBufKB);
+        tuning.busyPollUs = tuningXml->getIntAttribute("busy_poll_us", tuning.busyPollUs);
+        tuning.rtPriority = tuningXml->getIntAttribute("rt_priority", tuning.rtPriority);
+        tuning.cpu = tuningXml->getIntAttribute("cpu", tuning.cpu);
+
+        if (!thread->setTuning(tuning))
+        {
+            // e.g. pinned to a CPU this machine doesn't have
+            std::cout << "Neuralynx Input: ignoring saved OS tuning settings that are out of range here" << std::endl;
+        }
+    }
+
+    updateTuningEditables();
+    updateTuningStatus();
+
+    thread->setReceiveMode(NeuralynxThread::RECEIVE_SINGLE);
+    forEachXmlChildElementWithTagName(*xml, receiveXml, "RECEIVE")
+    {
+        auto mode = NeuralynxThread::ReceiveMode(receiveXml->getIntAttribute("mode", NeuralynxThread::RECEIVE_SINGLE));
+        if (!thread->setReceiveMode(mode))
+        {
+            // e.g. "Packet ring" without CAP_NET_RAW, or saved on Linux
+            std::cout << "Neuralynx Input: ignoring saved receive mode, which isn't available here" << std::endl;
+        }
+    }
+    receiveModeBox->setSelectedId(thread->getReceiveMode(), dontSendNotification);
+
+    thread->setWaitMode(NeuralynxThread::WAIT_SPIN);
+    thread->setBusyPollUs(NeuralynxThread::defaultBusyPollUs);
+    forEachXmlChildElementWithTagName(*xml, waitXml, "WAIT")
+    {
+        if (!thread->setWaitMode(NeuralynxThread::WaitMode(waitXml->getIntAttribute("mode", NeuralynxThread::WAIT_SPIN)))
+            || !thread->setBusyPollUs(waitXml->getIntAttribute("spin_us", NeuralynxThread::defaultBusyPollUs)))
+        {
+            std::cout << "Neuralynx Input: ignoring an invalid saved wait mode or spin time" << std::endl;
+        }
+    }
+    waitModeBox->setSelectedId(thread->getWaitMode(), dontSendNotification);
+    busyPollEditable->setText(String(thread->getBusyPollUs()), dontSendNotification);
+    updateBusyPollEnabled();
+
+    // (parameters of the fixed, deadline and adaptive policies in turn)
+    const int defaultBlockParams[] = { NeuralynxThread::defaultBlockPackets, NeuralynxThread::defaultDeadlineUs,
+        NeuralynxThread::defaultBlockPackets };
+    const char* blockParamNames[] = { "fixed_packets", "deadline_us", "adaptive_packets" };
+    int blockParams[] = { defaultBlockParams[0], defaultBlockParams[1], defaultBlockParams[2] };
+    int blockPolicy = NeuralynxThread::BLOCK_FIXED;
+    forEachXmlChildElementWithTagName(*xml, blockXml, "BLOCK")
+    {
+        blockPolicy = blockXml->getIntAttribute("policy", blockPolicy);
+        for (int i = 0; i < 3; ++i)
+        {
+            blockParams[i] = blockXml->getIntAttribute(blockParamNames[i], blockParams[i]);
+        }
+    }
+
+    bool blockValid = blockPolicy >= NeuralynxThread::BLOCK_FIXED && blockPolicy <= NeuralynxThread::BLOCK_ADAPTIVE;
+    for (int i = 0; i < 3; ++i)
+    {
+        thread->setBlockPolicy(NeuralynxThread::BlockPolicy(NeuralynxThread::BLOCK_FIXED + i));
+        thread->setBlockParam(defaultBlockParams[i]);
+        if (!thread->setBlockParam(blockParams[i]))
+        {
+            blockValid = false;
+        }
+    }
+    thread->setBlockPolicy(blockValid ? NeuralynxThread::BlockPolicy(blockPolicy) : NeuralynxThread::BLOCK_FIXED);
+    if (!blockValid)
+    {
+        std::cout << "Neuralynx Input: ignoring invalid saved block settings" << std::endl;
+    }
+    blockPolicyBox->setSelectedId(thread->getBlockPolicy(), dontSendNotification);
+    updateBlockParamLabels();
+
+    thread->setLossPolicy(NeuralynxThread::LOSS_STOP);
+    thread->setOutageLimitMs(NeuralynxThread::defaultOutageLimitMs);
+    forEachXmlChildElementWithTagName(*xml, lossXml, "LOSS")
+    {
+        auto policy = NeuralynxThread::LossPolicy(lossXml->getIntAttribute("policy", NeuralynxThread::LOSS_STOP));
+        int limitMs = lossXml->getIntAttribute("outage_limit_ms", NeuralynxThread::defaultOutageLimitMs);
+        if (!thread->setLossPolicy(policy) || !thread->setOutageLimitMs(limitMs))
+        {
+            std::cout << "Neuralynx Input: ignoring an invalid saved loss policy or outage limit" << std::endl;
+        }
+    }
+    lossPolicyBox->setSelectedId(thread->getLossPolicy(), dontSendNotification);
+    outageLimitEditable->setText(String(thread->getOutageLimitMs()), dontSendNotification);
+
+    while (thread->getNumStreams() > 1)
+    {
+        thread->removeStream(thread->getNumStreams() - 1);
+    }
+
+    forEachXmlChildElementWithTagName(*xml, streamXml, "STREAM")
+    {
+        IPAddress address(streamXml->getStringAttribute("address"));
+        if (!thread->addStream(address, streamXml->getIntAttribute("port", NeuralynxThread::defaultPort)))
+        {
+            std::cout << "Neuralynx Input: ignoring saved stream " << address.toString() << ":"
+                << streamXml->getIntAttribute("port") << ", which duplicates another one" << std::endl;
+        }
+    }
+    updateStreamsButton();
+
+    thread->setChannelMap(0, Array<int>());
+    forEachXmlChildElementWithTagName(*xml, channelsXml, "CHANNELS")
+    {
+        int stream = channelsXml->getIntAttribute("stream", -1);
+        Array<int> map;
+        if (stream < 0 || stream >= thread->getNumStreams()
+            || !NeuralynxThread::parseChannelList(channelsXml->getStringAttribute("map"), map)
+            || !thread->setChannelMap(stream, map))
+        {
+            std::cout << "Neuralynx Input: ignoring invalid saved channel map \""
+                << channelsXml->getStringAttribute("map") << "\"" << std::endl;
+        }
+    }
+
+    thread->setLfp(1, Array<int>());
+    forEachXmlChildElementWithTagName(*xml, lfpXml, "LFP")
+    {
+        Array<int> channels;
+        if (!NeuralynxThread::parseChannelList(lfpXml->getStringAttribute("channels"), channels)
+            || !thread->setLfp(lfpXml->getIntAttribute("factor", 1), channels))
+        {
+            std::cout << "Neuralynx Input: ignoring invalid saved LFP settings" << std::endl;
+        }
+    }
+    updateChannelMapButton();
+    updateChannelsLabel(thread->numBoardsValue.getValue());
+
+    thread->setDecodeThreads(1);
+    forEachXmlChildElementWithTagName(*xml, decodeXml, "DECODE")
+    {
+        if (!thread->setDecodeThreads(decodeXml->getIntAttribute("threads", 1)))
+        {
+            std::cout << "Neuralynx Input: ignoring invalid saved number of decode threads" << std::endl;
+        }
+    }
+    updateDecodeThreadsButton();
+
+    thread->setRecoveryEnabled(xml->getChildByName("RECOVERY") != nullptr);
+    recoverButton->setToggleState(thread->getRecoveryEnabled(), dontSendNotification);
+    updateOutageLimitEnabled();
+}
+
+
+void NeuralynxEditor::chooseStreams()
+{
+    const int addId = 1;
+    const int removeIdBase = 100;
+
+    bool editable = !CoreServices::getAcquisitionStatus();
+
+    PopupMenu menu;
+    menu.addItem(removeIdBase, "Stream 1: " + getStreamDescription(0), false);
+    for (int i = 1; i < thread->getNumStreams(); ++i)
+    {
+        menu.addItem(removeIdBase + i, "Stream " + String(i + 1) + ": " + getStreamDescription(i)
+            + (editable ? " - click to remove" : ""), editable);
+    }
+    menu.addSeparator();
+    menu.addItem(addId, "Add stream...", editable);
+
+    int result = menu.show();
+    if (result == 0)
+    {
+        return; // dismissed
+    }
+
+    if (result > removeIdBase)
+    {
+        thread->removeStream(result - removeIdBase);
+    }
+    else if (result == addId)
+    {
+        AlertWindow window("Add stream", "Local IP address and port of the data connection "
+            "to another Digital Lynx SX or ATLAS system, e.g. 192.168.4.100:26090", AlertWindow::NoIcon);
+        window.addTextEditor("endpoint", "", "Address:port");
+        window.addButton("Add", 1, KeyPress(KeyPress::returnKey));
+        window.addButton("Cancel", 0, KeyPress(KeyPress::escapeKey));
+
+        if (window.runModalLoop() != 1)
+        {
+            return;
+        }
+
+        String text = window.getTextEditorContents("endpoint").trim();
+        String addressText = text.containsChar(':') ? text.upToLastOccurrenceOf(":", false, false) : text;
+        int port = text.containsChar(':') ? text.fromLastOccurrenceOf(":", false, false).getIntValue()
+            : int(NeuralynxThread::defaultPort);
+
+        IPAddress address(addressText);
+        if (address == IPAddress() || !thread->addStream(address, port))
+        {
+            CoreServices::sendStatusMessage("Neuralynx Input: invalid or duplicate stream address");
+            return;
+        }
+    }
+
+    updateStreamsButton();
+}
+
+
+String NeuralynxEditor::getStreamDescription(int stream) const
+{
+    String description = stream == 0 ? String("connection above")
+        : thread->getStreamAddress(stream).toString() + ":" + String(thread->getStreamPort(stream));
+
+    if (stream > 0 && thread->getSource() != NeuralynxThread::SOURCE_NETWORK)
+    {
+        return description + " (inactive while replaying)";
+    }
+
+    description += thread->isStreamReceiving(stream) ? " (receiving" : " (not receiving";
+
+    int64 offsetUs;
+    if (stream > 0 && thread->getStreamOffsetUs(stream, offsetUs))
+    {
+        description += ", clock " + String(offsetUs >= 0 ? "+" : "") + String(offsetUs) + " us";
+    }
+    return description + ")";
+}
+
+
+void NeuralynxEditor::updateStreamsButton()
+{
+    int numStreams = thread->getNumStreams();
+    streamsButton->setToggleState(numStreams > 1, dontSendNotification);
+
+    String tooltip = "Receive from further amplifier systems on other addresses or ports. Each stream "
+        "becomes a separate subprocessor, and the offsets of their hardware clocks from stream 1's "
+        "are shown here during acquisition.";
+    for (int i = 1; i < numStreams; ++i)
+    {
+        tooltip += "\nStream " + String(i + 1) + ": " + getStreamDescription(i);
+    }
+    streamsButton->setTooltip(tooltip);
+}
+
+
+void NeuralynxEditor::chooseChannelMap()
+{
+    const int lfpId = 1000;
+
+    PopupMenu menu;
+    for (int i = 0; i < thread->getNumStreams(); ++i)
+    {
+        const Array<int>& map = thread->getChannelMap(i);
+        menu.addItem(i + 1, (thread->getNumStreams() > 1 ? "Stream " + String(i + 1) : String("Output channels"))
+            + ": " + (map.isEmpty() ? String("all channels") : NeuralynxThread::formatChannelList(map)));
+    }
+    menu.addSeparator();
+    menu.addItem(lfpId, "LFP subprocessor: " + getLfpDescription() + "...");
+
+    int result = menu.show();
+    if (result == 0)
+    {
+        return; // dismissed
+    }
+    if (result == lfpId)
+    {
+        chooseLfp();
+        return;
+    }
+    int stream = result - 1;
+
+    AlertWindow window("Channels", "Channels to output, in order, as numbers and ranges, e.g. "
+        "1-32, 40, 48-41. Leave empty to output all channels.", AlertWindow::NoIcon);
+    window.addTextEditor("map", NeuralynxThread::formatChannelList(thread->getChannelMap(stream)), "Channels");
+    window.addButton("OK", 1, KeyPress(KeyPress::returnKey));
+    window.addButton("Cancel", 0, KeyPress(KeyPress::escapeKey));
+
+    if (window.runModalLoop() != 1)
+    {
+        return;
+    }
+
+    Array<int> map;
+    if (!NeuralynxThread::parseChannelList(window.getTextEditorContents("map"), map)
+        || !thread->setChannelMap(stream, map))
+    {
+        CoreServices::sendStatusMessage("Neuralynx Input: invalid channel list (or a channel is repeated)");
+        return;
+    }
+
+    updateChannelMapButton();
+    updateChannelsLabel(thread->numBoardsValue.getValue());
+}
+
+
+void NeuralynxEditor::chooseLfp()
+{
+    int factor = thread->getLfpFactor();
+
+    AlertWindow window("LFP subprocessor", "Also output a low-pass filtered copy of some channels, decimated "
+        "by a factor of " + String(PolyphaseDecimator::minFactor) + " to " + String(PolyphaseDecimator::maxFactor)
+        + " (1 = off), as a second subprocessor. Leave the channels empty to decimate all output channels.",
+        AlertWindow::NoIcon);
+    window.addTextEditor("factor", String(factor > 1 ? factor : int(NeuralynxThread::defaultLfpFactor)), "Factor");
+    window.addTextEditor("channels", NeuralynxThread::formatChannelList(thread->getLfpChannels()), "Channels");
+    window.addButton("OK", 1, KeyPress(KeyPress::returnKey));
+    window.addButton("Cancel", 0, KeyPress(KeyPress::escapeKey));
+
+    if (window.runModalLoop() != 1)
+    {
+        return;
+    }
+
+    String factorText = window.getTextEditorContents("factor").trim();
+    Array<int> channels;
+    if (!factorText.containsOnly("0123456789")
+        || !NeuralynxThread::parseChannelList(window.getTextEditorContents("channels"), channels)
+        || !thread->setLfp(factorText.getIntValue(), channels))
+    {
+        CoreServices::sendStatusMessage("Neuralynx Input: invalid LFP factor or channel list");
+        return;
+    }
+
+    updateChannelMapButton();
+}
+
+
+String NeuralynxEditor::getLfpDescription() const
+{
+    if (thread->getLfpFactor() <= 1)
+    {
+        return "off";
+    }
+
+    const Array<int>& channels = thread->getLfpChannels();
+    return "1/" + String(thread->getLfpFactor()) + ", "
+        + (channels.isEmpty() ? String("all channels") : NeuralynxThread::formatChannelList(channels));
+}
+
+
+void NeuralynxEditor::updateChannelMapButton()
+{
+    String tooltip = "Output a subset of the channels, in any order. Channels that aren't selected "
+        "are not decoded at all. Can also add an LFP subprocessor.";
+
+    bool mapped = false;
+    for (int i = 0; i < thread->getNumStreams(); ++i)
+    {
+        const Array<int>& map = thread->getChannelMap(i);
+        if (map.size() > 0)
+        {
+            mapped = true;
+            tooltip += "\nStream " + String(i + 1) + ": " + NeuralynxThread::formatChannelList(map);
+        }
+    }
+
+    if (thread->getLfpFactor() > 1)
+    {
+        tooltip += "\nLFP: " + getLfpDescription();
+    }
+
+    channelMapButton->setToggleState(mapped || thread->getLfpFactor() > 1, dontSendNotification);
+    channelMapButton->setTooltip(tooltip);
+}
+
+
+void NeuralynxEditor::chooseDecodeThreads()
+{
+    int current = thread->getDecodeThreads();
+    int numCpus = jmax(1, SystemStats::getNumCpus());
+
+    PopupMenu menu;
+    menu.addItem(1, "1 thread per stream (boards decoded in turn)", true, current == 1);
+    for (int n : { 2, 3, 4, 6, 8, 12, 16 })
+    {
+        if (n <= numCpus || n == current)
+        {
+            menu.addItem(n, String(n) + " threads per stream (boards shared out)", true, n == current);
+        }
+    }
+
+    int result = menu.show();
+    if (result == 0)
+    {
+        return; // dismissed
+    }
+
+    thread->setDecodeThreads(result);
+    updateDecodeThreadsButton();
+}
+
+
+void NeuralynxEditor::updateDecodeThreadsButton()
+{
+    int numThreads = thread->getDecodeThreads();
+    decodeThreadsButton->setToggleState(numThreads > 1, dontSendNotification);
+    decodeThreadsButton->setTooltip("Number of threads that decode each stream (currently " + String(numThreads)
+        + "). With more than 1, the boards of each block are shared out among the threads, for when one core "
+        "can't keep up with many boards at a high sample rate. Between blocks, helper threads spin for the "
+        "\"Spin us\" time and then sleep, and they get the OS tuning's priority and CPUs of their own. Streams "
+        "with one board or a channel map are decoded on one thread.");
+    updateBusyPollEnabled();
+}
+
+
+void NeuralynxEditor::chooseSource()
+{
+    NeuralynxThread::Source current = thread->getSource();
+
+    PopupMenu menu;
+    menu.addItem(NeuralynxThread::SOURCE_NETWORK, "Network (no replay)", true, current == NeuralynxThread::SOURCE_NETWORK);
+    menu.addItem(NeuralynxThread::SOURCE_REPLAY_PACED, "Replay file at recorded pace...", true,
+        current == NeuralynxThread::SOURCE_REPLAY_PACED);
+    menu.addItem(NeuralynxThread::SOURCE_REPLAY_FAST, "Replay file as fast as possible...", true,
+        current == NeuralynxThread::SOURCE_REPLAY_FAST);
+
+    int result = menu.show();
+    if (result == 0)
+    {
+        return; // dismissed
+    }
+
+    auto newSource = NeuralynxThread::Source(result);
+    File file;
+    if (newSource != NeuralynxThread::SOURCE_NETWORK)
+    {
+        File start = thread->getReplayFile();
+        if (!start.exists())
+        {
+            start = File::getSpecialLocation(File::userDocumentsDirectory);
+        }
+
+        FileChooser chooser("Select a capture file to replay", start, String("*") + CaptureFile::extension);
+        if (!chooser.browseForFileToOpen())
+        {
+            return;
+        }
+        file = chooser.getResult();
+    }
+
+    thread->setSource(newSource, file);
+    updateSourceControls();
+}
+
+
+void NeuralynxEditor::updateSourceControls()
+{
+    bool replaying = thread->getSource() != NeuralynxThread::SOURCE_NETWORK;
+
+    replayButton->setToggleState(replaying, dontSendNotification);
+    replayButton->setTooltip(replaying
+        ? "Replaying " + thread->getReplayFile().getFullPathName() + ". Click to change."
+        : "Replay a capture file instead of receiving from the network, either at the recorded pace "
+          "or as fast as possible");
+
+    // only packets from the network are captured
+    captureButton->setEnabled(!replaying);
+    addressBox->setEnabled(!replaying);
+    portEditable->setEnabled(!replaying);
+
+    updateReceivingLabel(thread->receivingData.getValue());
+}
+
+
+void NeuralynxEditor::updateTuningEditables()
+{
+    const ReceiveTuning::Settings& tuning = thread->getTuning();
+    tuningEditables[ReceiveTuning::RCVBUF]->setText(String(tuning.rcvBufKB), dontSendNotification);
+    tuningEditables[ReceiveTuning::BUSY_POLL]->setText(String(tuning.busyPollUs), dontSendNotification);
+    tuningEditables[ReceiveTuning::RT_PRIORITY]->setText(String(tuning.rtPriority), dontSendNotification);
+    tuningEditables[ReceiveTuning::CPU_AFFINITY]->setText(tuning.cpu < 0 ? String("any") : String(tuning.cpu),
+        dontSendNotification);
+}
+
+
+void NeuralynxEditor::updateTuningStatus()
+{
+    for (int i = 0; i < ReceiveTuning::numSettings; ++i)
+    {
+        auto setting = ReceiveTuning::Setting(i);
+        ReceiveTuning::Result result = thread->getTuningResult(setting);
+
+        String mark;
+        Colour colour = Colours::grey;
+        switch (result.state)
+        {
+        case ReceiveTuning::PENDING:     mark = "...";                                 break;
+        case ReceiveTuning::APPLIED:     mark = "ok";  colour = Colours::darkgreen;    break;
+        case ReceiveTuning::LIMITED:     mark = "cap"; colour = Colours::orange;       break;
+        case ReceiveTuning::REFUSED:     mark = "NO";  colour = Colours::red;          break;
+        case ReceiveTuning::UNSUPPORTED: mark = "n/a";                                 break;
+        default:                                                                       break;
+        }
+
+        Label* status = tuningStatusLabels[i];
+        status->setText(mark, dontSendNotification);
+        status->setColour(Label::ColourIds::textColourId, colour);
+        status->setTooltip(String(ReceiveTuning::getSettingName(setting)) + ": "
+            + ReceiveTuning::getStateName(result.state)
+            + (result.detail.empty() ? String() : " (" + String(result.detail) + ")"));
+    }
+}
+
+
+void NeuralynxEditor::updateOutageLimitEnabled()
+{
+    // (with recovery on, it is also how long an outage lasts before the socket is recreated)
+    outageLimitEditable->setEnabled(lossPolicyBox->getSelectedId() != NeuralynxThread::LOSS_STOP
+        || recoverButton->getToggleState());
+}
+
+
+void NeuralynxEditor::updateBusyPollEnabled()
+{
+    // (decode helper threads spin for this long in any wait mode)
+    busyPollEditable->setEnabled(waitModeBox->getSelectedId() == NeuralynxThread::WAIT_HYBRID
+        || thread->getDecodeThreads() > 1);
+}
+
+
+void NeuralynxEditor::updateBlockParamLabels()
+{
+    if (thread->getBlockPolicy() == NeuralynxThread::BLOCK_DEADLINE)
+    {
+        blockParamLabel->setText("Max us:", dontSendNotification);
+        blockParamEditable->setTooltip("Time to wait after the first packet of a block before passing "
+            "the block on, in microseconds");
+    }
+    else if (thread->getBlockPolicy() == NeuralynxThread::BLOCK_ADAPTIVE)
+    {
+        blockParamLabel->setText("Max pkts:", dontSendNotification);
+        blockParamEditable->setTooltip("Maximum number of packets to pass on at once");
+    }
+    else
+    {
+        blockParamLabel->setText("Packets:", dontSendNotification);
+        blockParamEditable->setTooltip("Number of packets to pass on at once. Each packet in a block waits for the "
+            "ones after it, e.g. 20 packets at 30 kHz add up to 0.6 ms of latency.");
+    }
+
+    blockParamEditable->setText(String(thread->getBlockParam()), dontSendNotification);
+}
+
+
+NeuralynxEditor::TelemetryTimer::TelemetryTimer(NeuralynxEditor& e)
+    : editor(e)
+{}
+
+
+void NeuralynxEditor::TelemetryTimer::timerCallback()
+{
+    editor.updateTelemetry();
+    editor.updateTuningStatus();
+    editor.updateStreamsButton();
+}
+
+
+void NeuralynxEditor::updateTelemetry()
+{
+    auto current = thread->getTelemetrySnapshot();
+    auto rates = ReceiveTelemetry::getRates(lastSnapshot, current);
+
+    rateLabel->setText(String(rates.packetsPerSecond, 0) + " pkt/s, "
+        + String(rates.megabytesPerSecond, 2) + " MB/s", dontSendNotification);
+    rateLabel->setTooltip("Packets per second and megabytes per second received\nTTL edge events: "
+        + String(rates.ttlEdgesPerSecond, 1) + " per second, for " + String(rates.samplesPerSecond, 0)
+        + " samples per second");
+    errorLabel->setText("invalid " + String(current.invalidPackets) + ", timeouts "
+        + String(current.timeouts), dontSendNotification);
+    errorLabel->setTooltip("Invalid packets (wrong size, header or checksum) and timeouts waiting for a block\n"
+        "Recovery: " + String(current.socketErrors) + " socket errors, " + String(current.outages) + " outages, "
+        + String(current.socketRebinds) + " sockets recreated, " + String(current.resyncs) + " resyncs ("
+        + String(current.clockRebases) + " after the amplifier's timestamps restarted), "
+        + String(current.outageMs) + " ms without data");
+    dropLabel->setText("drops " + String(current.kernelDrops) + " / " + String(current.ringOverruns)
+        + ", gaps " + String(current.gaps), dontSendNotification);
+    decodeLabel->setText("decode " + String(rates.decodeUsPerBlock, 1) + " us/blk, drift "
+        + String(current.clockDriftPpm, 1) + " ppm", dontSendNotification);
+
+    for (int stage = 0; stage < ReceiveTelemetry::numLatencyStages; ++stage)
+    {
+        auto counts = thread->getLatencyCounts(stage);
+        auto interval = counts.since(lastLatency[stage]);
+        auto us = [](double ns) { return String(ns / 1e3, ns < 1e5 ? 1 : 0); };
+
+        String name = ReceiveTelemetry::getLatencyStageName(stage);
+        latencyLabels[stage]->setText(interval.getTotal() == 0 ? name + " -"
+            : name + " " + us(interval.getPercentile(50)) + " / " + us(interval.getPercentile(99)), dontSendNotification);
+        latencyLabels[stage]->setTooltip(counts.getTotal() == 0 ? "No samples with a known arrival time yet"
+            : "Since acquisition started (us): p50 " + us(counts.getPercentile(50)) + ", p90 "
+                + us(counts.getPercentile(90)) + ", p99 " + us(counts.getPercentile(99)) + ", p99.9 "
+                + us(counts.getPercentile(99.9)) + ", max " + us(counts.getMax()));
+        lastLatency[stage] = counts;
+    }
+
+    if (telemetryLog != nullptr && current.seconds > lastSnapshot.seconds)
+    {
+        *telemetryLog << ReceiveTelemetry::getCsvRow(startSnapshot, lastSnapshot, current) << "\n";
+        telemetryLog->flush();
+    }
+
+    lastSnapshot = current;
+}
+
+
 void NeuralynxEditor::updateReceivingLabel(bool isReceiving)
 {
     if (isReceiving)
     {
-        receivingLabel->setText("Receiving:", dontSendNotification);
+        receivingLabel->setText(thread->getSource() == NeuralynxThread::SOURCE_NETWORK
+            ? "Receiving:" : "Replaying:", dontSendNotification);
     }
     else
     {
@@ -237,7 +1383,16 @@ void NeuralynxEditor::updateReceivingLabel(bool isReceiving)
 
 void NeuralynxEditor::updateChannelsLabel(int numBoards)
 {
-    channelsLabel->setText(String(numBoards * thread->boardChannels) + " channels", dontSendNotification);
+    int numReceived = numBoards * thread->boardChannels;
+
+    int numOutput = 0;
+    for (int i = 0; i < thread->getNumActiveStreams(); ++i)
+    {
+        numOutput += thread->getNumOutputChannels(i);
+    }
+
+    channelsLabel->setText(numOutput == numReceived ? String(numReceived) + " channels"
+        : String(numOutput) + " of " + String(numReceived) + " ch", dontSendNotification);
 }
 
 
@@ -21,7 +21,11 @@ Do not share this plugin with other parties who have not signed the NDA.
 #include "NeuralynxThread.h"
 
 
-class NeuralynxEditor : public GenericEditor, public Value::Listener
+class NeuralynxEditor
+    : public GenericEditor
+    , public Value::Listener
+    , public ComboBox::Listener
+    , public Label::Listener
 {
 public:
     NeuralynxEditor(SourceNode* sn, NeuralynxThread* t);
@@ -33,6 +37,12 @@ public:
     IPAddress updateAndGetIPAddress();
 
     void valueChanged(Value& value) override;
+    void comboBoxChanged(ComboBox* comboBox) override;
+    void buttonEvent(Button* button) override;
+    void labelTextChanged(Label* label) override;
+
+    void saveCustomParameters(XmlElement* xml) override;
+    void loadCustomParameters(XmlElement* xml) override;
 
 private:
     NeuralynxThread* thread;
@@ -45,6 +55,11 @@ private:
     ScopedPointer<ComboBox> addressBox;
     ScopedPointer<Label> portLabel;
     ScopedPointer<Label> portEditable;
+    ScopedPointer<Label> receiveModeLabel;
+    ScopedPointer<ComboBox> receiveModeBox;
+    ScopedPointer<ComboBox> waitModeBox;
+    ScopedPointer<Label> busyPollLabel;
+    ScopedPointer<Label> busyPollEditable;
 
     // status
     ScopedPointer<Label> receivingLabel;
@@ -56,9 +71,106 @@ private:
     ScopedPointer<Label> hzLabel;
     void updateHzLabel(float sampleRate);
 
+    void updateBusyPollEnabled();
+
+    ScopedPointer<Label> blockPolicyLabel;
+    ScopedPointer<ComboBox> blockPolicyBox;
+    ScopedPointer<Label> blockParamLabel;
+    ScopedPointer<Label> blockParamEditable;
+    void updateBlockParamLabels();
+
+    ScopedPointer<ComboBox> lossPolicyBox;
+    ScopedPointer<Label> outageLimitEditable;
+    void updateOutageLimitEnabled();
+
+    // recovery from socket errors and outages
+    ScopedPointer<UtilityButton> recoverButton;
+
     ScopedPointer<UtilityButton> refreshButton;
     ScopedPointer<Label> refreshingLabel;
 
+    // telemetry
+    class TelemetryTimer : public Timer
+    {
+    public:
+        TelemetryTimer(NeuralynxEditor& e);
+        void timerCallback() override;
+
+    private:
+        NeuralynxEditor& editor;
+    };
+
+    TelemetryTimer telemetryTimer;
+
+    // update the telemetry labels and write a line to the log, if it is open
+    void updateTelemetry();
+
+    ScopedPointer<Label> telemetryTitleLabel;
+    ScopedPointer<Label> rateLabel;
+    ScopedPointer<Label> errorLabel;
+    ScopedPointer<Label> dropLabel;
+    ScopedPointer<Label> decodeLabel;
+    ScopedPointer<UtilityButton> logButton;
+
+    // capture and replay
+    ScopedPointer<UtilityButton> captureButton;
+    ScopedPointer<UtilityButton> replayButton;
+
+    // asks for the source (network or a capture file to replay) and passes it to the thread
+    void chooseSource();
+    void updateSourceControls();
+
+    // compressed raw recording
+    ScopedPointer<UtilityButton> rawRecordButton;
+
+    // shared memory output
+    ScopedPointer<UtilityButton> sharedMemoryButton;
+
+    // multi-threaded decoding
+    ScopedPointer<UtilityButton> decodeThreadsButton;
+
+    // lets the user choose the number of decode threads per stream
+    void chooseDecodeThreads();
+    void updateDecodeThreadsButton();
+
+    // further streams
+    ScopedPointer<UtilityButton> streamsButton;
+
+    // lists the streams and lets the user add or remove ones after the first
+    void chooseStreams();
+    String getStreamDescription(int stream) const;
+    void updateStreamsButton();
+
+    // channel subset and order
+    ScopedPointer<UtilityButton> channelMapButton;
+
+    // asks which stream's channel map to change, or whether to set up the LFP subprocessor
+    void chooseChannelMap();
+    void chooseLfp();
+    String getLfpDescription() const;
+    void updateChannelMapButton();
+
+    // latency percentiles per stage (indexed by ReceiveTelemetry::LatencyStage)
+    ScopedPointer<Label> latencyTitleLabel;
+    OwnedArray<Label> latencyLabels;
+
+    // OS tuning
+    ScopedPointer<Label> tuningTitleLabel;
+    OwnedArray<Label> tuningNameLabels;
+    OwnedArray<Label> tuningEditables;    // indexed by ReceiveTuning::Setting
+    OwnedArray<Label> tuningStatusLabels; // ditto
+
+    // set the editables from the thread's settings / the status labels from its results
+    void updateTuningEditables();
+    void updateTuningStatus();
+
+    ScopedPointer<FileOutputStream> telemetryLog;
+    ReceiveTelemetry::Snapshot startSnapshot;
+    ReceiveTelemetry::Snapshot lastSnapshot;
+    LatencyHistogram::Counts lastLatency[ReceiveTelemetry::numLatencyStages];
+
+    static const int telemetryIntervalMs = 1000;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(NeuralynxEditor);
 };
 
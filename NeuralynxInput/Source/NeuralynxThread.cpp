@@ -17,447 +17,3063 @@ Do not share this plugin with other parties who have not signed the NDA.
 #include "NeuralynxThread.h"
 #include "NeuralynxEditor.h"
 
+#include <chrono>
 #include <sstream> // for reading port label
 
+#if JUCE_LINUX
+#include <sys/socket.h> // for recvmmsg
+#include <sys/ioctl.h>
+#include <linux/sockios.h> // for SIOCGSTAMPNS
+#include <linux/sock_diag.h> // for SK_MEMINFO_DROPS
+#include <poll.h>
+#include <errno.h>
+#include <time.h>
+#elif JUCE_WINDOWS
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+
+namespace
+{
+#if JUCE_LINUX
+    // room for the drop count (SO_RXQ_OVFL) and arrival time (SO_TIMESTAMPNS) control messages
+    const size_t controlBytes = CMSG_SPACE(sizeof(uint32)) + CMSG_SPACE(sizeof(timespec));
+#endif
+
+    uint64 getRealTimeNs()
+    {
+        return uint64(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+
+    // CPU time used so far by the calling thread
+    double getThreadCpuSeconds()
+    {
+#if JUCE_WINDOWS
+        FILETIME creation, exit, kernel, user;
+        if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+        {
+            return 0;
+        }
+        auto toTicks = [](const FILETIME& ft) { return (uint64(ft.dwHighDateTime) << 32) | ft.dwLowDateTime; };
+        return (toTicks(kernel) + toTicks(user)) * 1e-7; // 100 ns units
+#else
+        timespec ts;
+        if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+        {
+            return 0;
+        }
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+    }
+}
+
 NeuralynxThread::NeuralynxThread(SourceNode* s)
     : DataThread        (s)
-    , numBoards         (1)
     , numBoardsValue    (1)
     , sampleRate        (s->getDefaultSampleRate())
     , updateBoardsAndHz (var(false))
-    , port              (defaultPort)
+    , receiveMode       (RECEIVE_SINGLE)
+    , waitMode          (WAIT_SPIN)
+    , busyPollUs        (defaultBusyPollUs)
+    , blockPolicy       (BLOCK_FIXED)
+    , fixedBlockPackets (defaultBlockPackets)
+    , deadlineUs        (defaultDeadlineUs)
+    , adaptiveMaxPackets(defaultBlockPackets)
+    , lossPolicy        (LOSS_STOP)
+    , outageLimitMs     (defaultOutageLimitMs)
     , receivingData     (var(false))
-    , invalidPackets    (0)
+    , source            (SOURCE_NETWORK)
+    , replayNextValid   (false)
+    , replayFinished    (false)
+    , replayStartTicks  (-1)
+    , replayFirstNs     (0)
+    , captureEnabled    (false)
+    , rawRecording      (false)
+    , sharedMemory      (false)
+    , decodeThreads     (1)
+    , recoveryEnabled   (false)
+    , captureDirectory  (File::getSpecialLocation(File::userDocumentsDirectory))
+    , lfpFactor         (1)
+    , prober            (*this)
+    , probeUpdate       (false)
+    , probeFinished     (0)
+    , streamFailed      (0)
+{
+    // stream 0's address comes from the editor
+    streams.add(new Stream(*this, 0, IPAddress(), defaultPort));
+    resizeBuffers();
+}
+
+
+NeuralynxThread::~NeuralynxThread()
+{
+    stopProbe();
+    streams.clear();
+}
+
+
+void NeuralynxThread::resizeBuffers()
+{
+    int numActive = getNumActiveStreams();
+    int numBuffers = getNumSubProcessors();
+
+    while (sourceBuffers.size() > numBuffers)
+    {
+        sourceBuffers.removeLast();
+    }
+
+    // the wideband buffers, then the LFP ones (if any) in the same order
+    for (int i = 0; i < numBuffers; ++i)
+    {
+        Stream* stream = streams[i % numActive];
+        int numChans = i < numActive ? stream->getNumOutputChannels() : stream->getNumLfpChannels();
+        if (i < sourceBuffers.size())
+        {
+            sourceBuffers[i]->resize(numChans, srcBufferSize);
+        }
+        else
+        {
+            sourceBuffers.add(new DataBuffer(numChans, srcBufferSize));
+        }
+    }
+
+    for (int i = 0; i < numActive; ++i)
+    {
+        streams[i]->resizeBlockBuffers();
+    }
+}
+
+
+void NeuralynxThread::Stream::resizeBlockBuffers()
+{
+    int capacity = owner.getBlockCapacity();
+
+    thisBlock.malloc(capacity * getNumOutputChannels());
+    timestamps.resize(capacity);
+    ttlEventWords.resize(capacity);
+    ttlChanges.malloc(capacity);
+    ttlEdges.malloc(capacity);
+    arrivals.malloc(capacity);
+
+    if (owner.decodeThreads > 1)
+    {
+        shardPackets.malloc(capacity);
+        shardValid.malloc(capacity);
+        shardSpill.malloc(capacity * getNumOutputChannels());
+    }
+    else
+    {
+        shardPackets.free();
+        shardValid.free();
+        shardSpill.free();
+    }
+
+    if (getNumLfpChannels() > 0)
+    {
+        int lfpCapacity = decimator.getMaxOutputRows(capacity);
+        lfpBlock.malloc(lfpCapacity * getNumLfpChannels());
+        lfpTimestamps.resize(lfpCapacity);
+        lfpTtlWords.clearQuick();
+        lfpTtlWords.insertMultiple(0, 0, lfpCapacity);
+    }
+}
+
+
+const float NeuralynxThread::atlasRawBitVolts = NeuralynxThread::atlasMaxInputUv / float(1 << 23);
+
+bool NeuralynxThread::updateBuffer()
+{
+    // the other streams are decoded by their own threads
+    return streamFailed.get() == 0 && streams[0]->decodeBlock();
+}
+
+
+bool NeuralynxThread::Stream::decodeBlock()
+{
+    int numPackets = waitForBlock();
+    if (numPackets < 0)
+    {
+        return false;
+    }
+
+    // (the receiver has recreated the socket)
+    if (resyncRequested.compareAndSetBool(0, 1))
+    {
+        resyncing = true;
+    }
+
+    int64 decodeStart = Time::getHighResolutionTicks();
+    decodeStartNs = getRealTimeNs();
+
+    bool resilient = owner.lossPolicy != LOSS_STOP;
+    int numChans = getNumOutputChannels();
+    bool gathering = !gather.isEmpty();
+    int packetBytes = PacketKernel::wordsInPacketWithBoards(numBoards) * 4;
+    int capacity = owner.getBlockCapacity();
+    int64 lastHardwareUs = -1;
+
+    // decode the whole block at once, on several threads, into rows 0.. of thisBlock (packet sIn's
+    // samples are then in row sIn of shardRows)
+    bool sharded = shardedDecoder.isRunning();
+    const float* shardRows = thisBlock;
+    if (sharded)
+    {
+        for (int sIn = 0; sIn < numPackets; ++sIn)
+        {
+            shardPackets[sIn] = packetRing.getReadLength(sIn) == packetBytes ? packetRing.getReadSlot(sIn) : nullptr;
+        }
+        shardedDecoder.decode(shardPackets, numPackets, numBoards, atlasRawBitVolts, thisBlock, numChans, shardValid);
+    }
+
+    int sOut = 0;
+    for (int sIn = 0; sIn < numPackets; ++sIn)
+    {
+        int length = packetRing.getReadLength(sIn);
+        if (length != packetBytes)
+        {
+            if (isResyncPoint(sIn) && length >= owner.minPacketSize)
+            {
+                // a valid packet with another # of boards: the amplifier came back configured differently,
+                // which needs a new signal chain
+                const uint32* packetStart = packetRing.getReadSlot(sIn);
+                int boards = PacketKernel::readNumBoards(packetStart);
+                if (boards > 0 && length == PacketKernel::wordsInPacketWithBoards(boards) * 4
+                    && PacketKernel::packetValid(packetStart, boards))
+                {
+                    std::cout << getLogPrefix() << "stopping: after the outage, packets have " << boards
+                        << " boards instead of " << numBoards << std::endl;
+                    return false;
+                }
+            }
+
+            if (!resilient)
+            {
+                // wrong # of boards
+                return false;
+            }
+            telemetry.invalidPackets.add();
+            continue;
+        }
+
+        if (sOut == capacity) // (only after filling a gap)
+        {
+            sOut = flushBlock(sOut);
+        }
+
+        const uint32* packetStart = packetRing.getReadSlot(sIn);
+        float* out = thisBlock + numChans * sOut;
+
+        // check header and checksum and get data (only the mapped channels, if any) in one pass
+        if (!PacketKernel::headerValid(packetStart, numBoards)
+            || !(sharded ? shardValid[sIn]
+                : gathering ? gatherDecoder(packetStart, numBoards, gatherTable, atlasRawBitVolts, out)
+                : decoder(packetStart, atlasRawBitVolts, out)))
+        {
+            // skip, don't stop acquiring though since it might just be a randomly flipped bit
+            telemetry.invalidPackets.add();
+            continue;
+        }
+
+        // (rows only move up until a gap is filled, and after that they come from shardSpill)
+        const float* decoded = shardRows + numChans * sIn;
+        if (sharded && decoded != out)
+        {
+            std::memcpy(out, decoded, numChans * sizeof(float));
+        }
+
+        // get timestamp
+        lastHardwareUs = int64(PacketKernel::readTimestamp(packetStart));
+        int64 ts = isResyncPoint(sIn) ? resync(uint64(lastHardwareUs))
+            : tsConverter.toSampleNumber(uint64(lastHardwareUs));
+
+        if (resilient && lastTs >= 0)
+        {
+            if (ts <= lastTs)
+            {
+                telemetry.reorderedPackets.add();
+                continue;
+            }
+
+            if (ts > lastTs + 1)
+            {
+                // filling the gap writes past row sIn, where the rest of the block was decoded
+                if (sharded && shardRows == thisBlock && sIn + 1 < numPackets)
+                {
+                    std::memcpy(shardSpill + numChans * (sIn + 1), thisBlock + numChans * (sIn + 1),
+                        size_t(numChans) * (numPackets - sIn - 1) * sizeof(float));
+                    shardRows = shardSpill;
+                }
+                sOut = fillGap(sOut, ts);
+            }
+        }
+
+        // get ttl
+        uint32 ttl = PacketKernel::readTtl(packetStart);
+
+        timestamps.setUnchecked(sOut, ts);
+        ttlEventWords.setUnchecked(sOut, ttl | outageMark);
+        arrivals[sOut] = packetRing.getReadArrival(sIn);
+        lastTs = ts;
+        lastTtl = ttl;
+        outageMark = 0;
+
+        if (rawWriter.isOpen())
+        {
+            rawWriter.append(packetStart + PacketKernel::headerWords, ts, ttl);
+        }
+
+        ++sOut;
+    }
+
+    packetRing.finishRead(numPackets);
+
+    flushBlock(sOut);
+
+    if (lastHardwareUs >= 0)
+    {
+        updateClockOffset(lastHardwareUs);
+        lastSampleMs = Time::getMillisecondCounter();
+    }
+
+    if (numPackets > 0)
+    {
+        uint64 decodeNs = uint64(Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - decodeStart) * 1e9);
+        telemetry.blocks.add();
+        telemetry.decodeNs.add(decodeNs);
+        telemetry.maxDecodeNs.setMax(decodeNs);
+    }
+    return true;
+}
+
+
+bool NeuralynxThread::Stream::isResyncPoint(int sIn) const
+{
+    return resyncing && packetRing.getReadCount() + uint64(sIn) >= resyncFrom;
+}
+
+
+int64 NeuralynxThread::Stream::resync(uint64 hardwareUs)
+{
+    resyncing = false;
+    outageMark = uint64(1) << outageTtlLine;
+
+    uint32 outageMs = Time::getMillisecondCounter() - lastSampleMs;
+    telemetry.resyncs.add();
+    telemetry.outageMs.add(outageMs);
+
+    if (lastTs < 0)
+    {
+        // nothing was passed on before the outage; start counting here
+        std::cout << getLogPrefix() << "receiving again" << std::endl;
+        return tsConverter.toSampleNumber(hardwareUs);
+    }
+
+    bool rebased;
+    int64 ts = tsConverter.resync(hardwareUs, lastTs, int64(outageMs) * 1000, int64(resyncToleranceMs) * 1000,
+        rebased);
+    if (rebased)
+    {
+        // (the offset from the other streams' clocks has to be estimated again)
+        clockOffsetValid = 0;
+        telemetry.clockRebases.add();
+    }
+
+    std::cout << getLogPrefix() << "receiving again after " << outageMs << " ms; " << (ts - lastTs - 1)
+        << " samples missing" << (rebased ? " (the amplifier's timestamps restarted, so sample numbers continue "
+            "from this computer's clock)" : "") << std::endl;
+    return ts;
+}
+
+
+void NeuralynxThread::Stream::updateClockOffset(int64 hardwareUs)
+{
+    int64 localUs = int64(Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks()) * 1e6);
+
+    if (tsConverter.addClockSample(uint64(hardwareUs), localUs))
+    {
+        clockOffsetUs = tsConverter.getClockOffsetUs();
+        clockOffsetValid = 1;
+        telemetry.clockDriftPpm.set(tsConverter.getClockDriftPpm());
+    }
+}
+
+
+int NeuralynxThread::Stream::flushBlock(int numSamples)
+{
+    if (numSamples > 0)
+    {
+        // (the DataBuffer copies this into its per-channel storage one sample at a time, as its storage
+        // isn't accessible)
+        int numChans = getNumOutputChannels();
+
+        // (JUCE's 64-bit types are long long, which the <cstdint> ones needn't be)
+        const int64_t* sampleNumbers = reinterpret_cast<const int64_t*>(&timestamps.getReference(0));
+        const uint64_t* words = reinterpret_cast<const uint64_t*>(&ttlEventWords.getReference(0));
+        int numChanges = PacketKernel::findChanges(words, numSamples, flushedTtl, ttlChanges);
+
+        // external readers first, as they are waiting for it (each edge before the samples it's in)
+        if (sharedRing.isOpen())
+        {
+            for (int i = 0; i < numChanges; ++i)
+            {
+                const int sample = ttlChanges[i];
+                const uint64_t previous = sample > 0 ? words[sample - 1] : uint64_t(flushedTtl);
+                ttlEdges[i].sampleNumber = sampleNumbers[sample];
+                ttlEdges[i].word = words[sample];
+                ttlEdges[i].changed = words[sample] ^ previous;
+            }
+            sharedRing.publishEdges(ttlEdges, numChanges);
+            sharedRing.publish(thisBlock, sampleNumbers, words, numSamples);
+        }
+        flushedTtl = words[numSamples - 1];
+
+        uint64 handoffStartNs = getRealTimeNs();
+        owner.sourceBuffers[index]->addToBuffer(thisBlock, &timestamps.getReference(0), &ttlEventWords.getReference(0), numSamples);
+        recordLatency(numSamples, handoffStartNs, getRealTimeNs());
+        std::memcpy(lastSample, thisBlock + numChans * (numSamples - 1), numChans * sizeof(float));
+
+        telemetry.samples.add(numSamples);
+        telemetry.ttlEdges.add(numChanges);
+
+        if (getNumLfpChannels() > 0)
+        {
+            int numLfp = decimator.process(thisBlock, numSamples, numChans, sampleNumbers, lfpBlock,
+                reinterpret_cast<int64_t*>(&lfpTimestamps.getReference(0)));
+            if (numLfp > 0)
+            {
+                owner.sourceBuffers[owner.getNumActiveStreams() + index]->addToBuffer(lfpBlock,
+                    &lfpTimestamps.getReference(0), &lfpTtlWords.getReference(0), numLfp);
+            }
+        }
+    }
+    return 0;
+}
+
+
+void NeuralynxThread::Stream::recordLatency(int numSamples, uint64 handoffStartNs, uint64 deliveredNs)
+{
+    // (the arrival times are from the wall clock, so an adjustment could make a difference negative)
+    auto since = [](uint64 from, uint64 to) { return to > from ? to - from : uint64(0); };
+
+    uint64 decodeNs = since(decodeStartNs, handoffStartNs);
+    uint64 handoffNs = since(handoffStartNs, deliveredNs);
+    for (int s = 0; s < numSamples; ++s)
+    {
+        if (arrivals[s] != 0)
+        {
+            telemetry.latency[ReceiveTelemetry::LATENCY_TOTAL].record(since(arrivals[s], deliveredNs));
+            telemetry.latency[ReceiveTelemetry::LATENCY_QUEUEING].record(since(arrivals[s], decodeStartNs));
+            telemetry.latency[ReceiveTelemetry::LATENCY_DECODE].record(decodeNs);
+            telemetry.latency[ReceiveTelemetry::LATENCY_HANDOFF].record(handoffNs);
+        }
+    }
+}
+
+
+int NeuralynxThread::Stream::fillGap(int sOut, int64 ts)
+{
+    int numChans = getNumOutputChannels();
+    int capacity = owner.getBlockCapacity();
+    int64 missing = ts - lastTs - 1;
+    int64 toFill = jmin(missing, int64(maxGapFill));
+
+    telemetry.gaps.add();
+    telemetry.samplesFilled.add(toFill);
+    telemetry.samplesUnfilled.add(missing - toFill);
+
+    // move the new sample out of the way, and keep the one before the gap where flushing won't overwrite it
+    std::memcpy(gapEndSample, thisBlock + numChans * sOut, numChans * sizeof(float));
+    if (sOut > 0)
+    {
+        std::memcpy(lastSample, thisBlock + numChans * (sOut - 1), numChans * sizeof(float));
+    }
+
+    for (int64 k = 1; k <= toFill; ++k)
+    {
+        if (sOut == capacity)
+        {
+            sOut = flushBlock(sOut);
+        }
+
+        float* out = thisBlock + numChans * sOut;
+        switch (owner.lossPolicy)
+        {
+        case LOSS_ZERO:
+            std::fill(out, out + numChans, 0.0f);
+            break;
+
+        case LOSS_LINEAR:
+        {
+            float frac = float(k) / float(missing + 1);
+            for (int c = 0; c < numChans; ++c)
+            {
+                out[c] = lastSample[c] + (gapEndSample[c] - lastSample[c]) * frac;
+            }
+            break;
+        }
+
+        default: // LOSS_HOLD
+            std::memcpy(out, lastSample, numChans * sizeof(float));
+            break;
+        }
+
+        timestamps.setUnchecked(sOut, lastTs + k);
+        ttlEventWords.setUnchecked(sOut, lastTtl | outageMark);
+        arrivals[sOut] = 0;
+        ++sOut;
+    }
+
+    if (sOut == capacity)
+    {
+        sOut = flushBlock(sOut);
+    }
+
+    std::memcpy(thisBlock + numChans * sOut, gapEndSample, numChans * sizeof(float));
+    return sOut;
+}
+
+
+bool NeuralynxThread::foundInputSource()
+{
+    auto ed = static_cast<NeuralynxEditor*>(sn->getEditor());
+    if (ed == nullptr)
+    {
+        receivingData = false;
+        return false;
+    }
+
+    if (!prober.isThreadRunning())
+    {
+        if (source != SOURCE_NETWORK)
+        {
+            // probe the start of the capture file instead
+            replayReader.rewind();
+        }
+        else
+        {
+            IPAddress newIP = ed->updateAndGetIPAddress();
+
+            if (newIP == IPAddress())
+            {
+                receivingData = false;
+                return false;
+            }
+
+            if (streams[0]->ipAddress != newIP)
+            {
+                // (the socket is rebound in probe)
+                streams[0]->ipAddress = newIP;
+                streams[0]->socket = nullptr;
+            }
+        }
+
+        probeUpdate = updateBoardsAndHz.getValue() || !receivingData.getValue();
+        probeFinished = 0;
+        prober.startThread();
+    }
+
+    // a probe normally takes a few ms; if this one takes longer (e.g. nothing is arriving),
+    // return the previous result and pick this one up next time
+    if (prober.waitForThreadToExit(probeWaitMs) && probeFinished.get() != 0)
+    {
+        probeFinished = 0;
+
+        bool valid = true;
+        for (int i = 0; i < getNumActiveStreams(); ++i)
+        {
+            streams[i]->applyProbe();
+            valid = streams[i]->receiving && valid;
+        }
+
+        updateBoardsAndHz = false;
+        receivingData = valid;
+    }
+
+    return receivingData.getValue();
+}
+
+
+void NeuralynxThread::stopProbe()
+{
+    prober.stopThread(500);
+    probeFinished = 0;
+}
+
+
+NeuralynxThread::Prober::Prober(NeuralynxThread& o)
+    : Thread("Neuralynx Prober")
+    , owner (o)
+{}
+
+
+void NeuralynxThread::Prober::run()
 {
-    sourceBuffers.add(new DataBuffer(numBoards * boardChannels, srcBufferSize));
+    for (int i = 0; i < owner.getNumActiveStreams(); ++i)
+    {
+        if (threadShouldExit())
+        {
+            return;
+        }
+        owner.streams[i]->probe(owner.probeUpdate);
+    }
+    owner.probeFinished = 1;
 }
 
 
-NeuralynxThread::~NeuralynxThread()
-{}
+void NeuralynxThread::Stream::probe(bool update)
+{
+    probedValid = false;
+    probedRate = 0;
+
+    if (owner.source == SOURCE_NETWORK)
+    {
+        if (socket == nullptr || socket->getBoundPort() != port)
+        {
+            // make and bind a new socket
+            createAndBindSocket();
+
+            if (socket == nullptr)
+            {
+                return;
+            }
+        }
+
+        jassert(socket->getBoundPort() == port);
+
+        flushSocket();
+
+        if (!updatePacketRingSocket())
+        {
+            return;
+        }
+        mmapSocket.flush();
+    }
+
+    // receive a test packet and check the number of boards
+    int boards = rcvPacket();
+    if (boards == 0 || !PacketKernel::packetValid(socketBuffer, boards))
+    {
+        return;
+    }
+    probedBoards = boards;
+
+    if (receiving && !update)
+    {
+        probedValid = true;
+        return;
+    }
+
+    // infer the sample rate from the timestamps of the next packets (skipping any that are corrupt)
+    uint64_t ts[ratePackets];
+    int numTs = 0;
+    while (numTs < ratePackets && !owner.prober.threadShouldExit())
+    {
+        if (!rcvPacket(boards))
+        {
+            return;
+        }
+
+        if (PacketKernel::packetValid(socketBuffer, boards))
+        {
+            ts[numTs++] = PacketKernel::readTimestamp(socketBuffer);
+        }
+    }
+
+    probedRate = float(TimestampConverter::inferSampleRate(ts, numTs));
+    probedValid = probedRate > 0;
+}
+
+
+void NeuralynxThread::Stream::applyProbe()
+{
+    if (probedValid)
+    {
+        setNumBoards(probedBoards);
+        if (probedRate > 0)
+        {
+            setSampleRate(probedRate);
+        }
+    }
+    receiving = probedValid;
+}
+
+
+bool NeuralynxThread::startAcquisition()
+{
+    // (the results of the last completed probe have been applied)
+    stopProbe();
+
+    updateBoardsAndHz = false;
+    streamFailed = 0;
+
+    if (source != SOURCE_NETWORK)
+    {
+        replayReader.rewind();
+        replayNextValid = false;
+        replayFinished = false;
+        replayStartTicks = -1;
+        std::cout << "Neuralynx Input: replaying " << replayReader.getPath() << std::endl;
+    }
+
+    std::cout << "Neuralynx Input: using " << PacketKernel::getImplementationName() << " packet decoder" << std::endl;
+
+    for (int i = 0; i < getNumActiveStreams(); ++i)
+    {
+        if (!streams[i]->start())
+        {
+            for (int j = 0; j < i; ++j)
+            {
+                streams[j]->stop();
+            }
+            receivingData = false;
+            return false;
+        }
+    }
+
+    startThread();
+    return true;
+}
+
+
+bool NeuralynxThread::Stream::start()
+{
+    lastTs = -1;
+    lastTtl = 0;
+    flushedTtl = 0;
+    lastPacketMs = Time::getMillisecondCounter();
+    lastSampleMs = lastPacketMs;
+    tsConverter.reset(sampleRate);
+    // the block policy may have changed since the last chain update
+    resizeBlockBuffers();
+    decimator.clear();
+
+    telemetry.reset();
+    receiverCpuSeconds = 0;
+    receiverWallSeconds = 0;
+    wakeLatencySamples = 0;
+    wakeLatencySumUs = 0;
+    wakeLatencyMaxUs = 0;
+
+    clockOffsetValid = 0;
+
+    packetRing.reset();
+    packetsAvailable.reset();
+    receiverFailed = 0;
+    rebindRequested = 0;
+    resyncRequested = 0;
+    resyncing = false;
+    rebindSent = false;
+    outageMark = 0;
+    kernelDropsBefore = 0;
+
+    if (owner.source == SOURCE_NETWORK)
+    {
+        // (the receive mode may have changed since foundInputSource)
+        if (!updatePacketRingSocket())
+        {
+            return false;
+        }
+
+        // (if a recovery couldn't recreate the socket, there is none)
+        if (socket == nullptr
+            || owner.getTuningResult(ReceiveTuning::RCVBUF).state == ReceiveTuning::PENDING
+            || owner.getTuningResult(ReceiveTuning::BUSY_POLL).state == ReceiveTuning::PENDING)
+        {
+            // socket options have changed; start from a fresh socket so that ones turned off revert too
+            createAndBindSocket();
+            if (socket == nullptr)
+            {
+                CoreServices::sendStatusMessage("Neuralynx Input: could not recreate socket");
+                return false;
+            }
+        }
+
+        // flush socket one last time before starting acquisition
+        flushSocket();
+        mmapSocket.flush();
+        mmapReleaseBase = 0;
+
+        // packets dropped while nobody was reading shouldn't count
+        kernelDropsBase = getKernelDropCount();
+
+        if (owner.captureEnabled)
+        {
+            captureFile = owner.captureDirectory.getChildFile("neuralynx_capture_"
+                + Time::getCurrentTime().formatted("%Y-%m-%d_%H-%M-%S")
+                + (index > 0 ? "_stream" + String(index + 1) : String()) + CaptureFile::extension);
+
+            if (captureWriter.open(captureFile.getFullPathName().toStdString()))
+            {
+                std::cout << getLogPrefix() << "capturing packets to " << captureFile.getFullPathName() << std::endl;
+            }
+            else
+            {
+                CoreServices::sendStatusMessage("Neuralynx Input: could not create capture file");
+                std::cout << getLogPrefix() << captureWriter.getError() << std::endl;
+            }
+        }
+    }
+
+    if (owner.rawRecording)
+    {
+        rawFile = owner.captureDirectory.getChildFile("neuralynx_raw_"
+            + Time::getCurrentTime().formatted("%Y-%m-%d_%H-%M-%S")
+            + (index > 0 ? "_stream" + String(index + 1) : String()) + RawRecording::extension);
+
+        // leave at least half of the cores to acquisition and the rest of the chain
+        int numWorkers = jlimit(1, 4, SystemStats::getNumCpus() / 2);
+        if (rawWriter.open(rawFile.getFullPathName().toStdString(), numBoards * PacketKernel::boardChannels,
+            sampleRate, atlasRawBitVolts, numWorkers))
+        {
+            std::cout << getLogPrefix() << "recording raw samples to " << rawFile.getFullPathName()
+                << " (" << numWorkers << " compression threads)" << std::endl;
+        }
+        else
+        {
+            CoreServices::sendStatusMessage("Neuralynx Input: could not create raw recording file");
+            std::cout << getLogPrefix() << rawWriter.getError() << std::endl;
+        }
+    }
+
+    if (owner.sharedMemory)
+    {
+        std::string ringName = SharedMemoryRing::getStreamName(index);
+        if (sharedRing.create(ringName, getNumOutputChannels(), sharedRingSamples, sampleRate))
+        {
+            std::cout << getLogPrefix() << "publishing to shared memory ring " << ringName << std::endl;
+        }
+        else
+        {
+            CoreServices::sendStatusMessage("Neuralynx Input: could not create shared memory ring");
+            std::cout << getLogPrefix() << sharedRing.getError() << std::endl;
+        }
+    }
+
+    decoder = PacketKernel::getDecoder(numBoards);
+
+    // (with a channel map, the outputs don't follow the boards, so it is decoded on one thread)
+    if (owner.decodeThreads > 1 && numBoards > 1 && gather.isEmpty())
+    {
+        // (helpers spin for the busy-poll time whatever the wait mode, so they never keep cores busy between
+        // blocks for longer than that)
+        int numThreads = jmin(owner.decodeThreads, numBoards);
+        shardedDecoder.start(numThreads, owner.busyPollUs, [this](int helper) { applyHelperTuning(helper); });
+        std::cout << getLogPrefix() << "decoding on " << numThreads << " threads" << std::endl;
+    }
+
+    // the receive stage must keep up with the network, so it gets a higher priority than decoding
+    receiver.startThread(9);
+    if (index > 0)
+    {
+        decodeThread.startThread();
+    }
+    return true;
+}
+
+
+bool NeuralynxThread::stopAcquisition()
+{
+    bool ok = true;
+
+    if (getCurrentThread() != this) // if an acquisition error occurs, will be called from the thread
+    {
+        ok = stopThread(500);
+    }
+
+    for (int i = 0; i < getNumActiveStreams(); ++i)
+    {
+        Stream* stream = streams[i];
+        ok = stream->stop() && ok;
+
+        if (getCurrentThread() == this && source == SOURCE_NETWORK)
+        {
+            // if an error ocurred, we should refresh the sockets.
+            stream->createAndBindSocket();
+        }
+
+        stream->report();
+        sourceBuffers[i]->clear();
+    }
+
+    for (int i = getNumActiveStreams(); i < sourceBuffers.size(); ++i)
+    {
+        sourceBuffers[i]->clear(); // (LFP)
+    }
+
+    for (int i = 1; i < getNumActiveStreams(); ++i)
+    {
+        int64 offsetUs;
+        if (getStreamOffsetUs(i, offsetUs))
+        {
+            std::cout << "Neuralynx Input: stream " << (i + 1) << " hardware clock is " << offsetUs
+                << " us ahead of stream 1" << std::endl;
+        }
+    }
+
+    return ok;
+}
+
+
+bool NeuralynxThread::Stream::stop()
+{
+    bool ok = true;
+
+    Thread* current = Thread::getCurrentThread();
+    if (current != &decodeThread)
+    {
+        ok = decodeThread.stopThread(500);
+    }
+    if (current != &receiver)
+    {
+        ok = receiver.stopThread(500) && ok;
+    }
+
+    if (captureWriter.isOpen())
+    {
+        uint64 numCaptured = captureWriter.getNumRecords();
+        captureWriter.close();
+        std::cout << getLogPrefix() << "captured " << numCaptured << " packets to "
+            << captureFile.getFullPathName() << std::endl;
+    }
+
+    sharedRing.close();
+
+    if (shardedDecoder.isRunning())
+    {
+        uint64_t numTasks = shardedDecoder.getNumTasks();
+        std::cout << getLogPrefix() << "decoded " << numTasks << " board slices on " << shardedDecoder.getNumThreads()
+            << " threads, " << (numTasks > 0 ? shardedDecoder.getNumSteals() * 100.0 / numTasks : 0)
+            << "% of them stolen from another thread's share" << std::endl;
+        shardedDecoder.stop();
+    }
+
+    if (rawWriter.isOpen())
+    {
+        rawWriter.close();
+        auto stats = rawWriter.getStats();
+
+        std::cout << getLogPrefix() << "recorded " << stats.samples << " samples to " << rawFile.getFullPathName()
+            << std::endl;
+        if (stats.fileBytes > 0 && stats.wallSeconds > 0)
+        {
+            std::cout << getLogPrefix() << "compressed to " << stats.fileBytes << " bytes ("
+                << double(stats.packedBytes) / stats.fileBytes << " times smaller than 24-bit samples), "
+                << "compression used " << 100 * stats.encodeCpuSeconds / stats.wallSeconds << "% of a core"
+                << std::endl;
+        }
+        if (stats.droppedSamples > 0)
+        {
+            std::cout << getLogPrefix() << stats.droppedSamples
+                << " samples were not recorded because compression couldn't keep up" << std::endl;
+        }
+        if (!rawWriter.getError().empty())
+        {
+            std::cout << getLogPrefix() << rawWriter.getError() << std::endl;
+        }
+    }
+    return ok;
+}
+
+
+void NeuralynxThread::Stream::report() const
+{
+    auto stats = telemetry.getSnapshot();
+
+    if (stats.syscalls > 0)
+    {
+        std::cout << getLogPrefix() << "received " << stats.packets << " packets in " << stats.syscalls
+            << " receive calls (" << owner.getPacketsPerSyscall(index) << " per call), " << stats.invalidPackets
+            << " invalid, " << stats.kernelDrops << " dropped by the kernel" << std::endl;
+        std::cout << getLogPrefix() << "receive ring peaked at " << packetRing.getMaxOccupancy() << " of "
+            << packetRing.getCapacity() << " packets, " << stats.ringOverruns << " packets dropped (ring full)" << std::endl;
+        std::cout << getLogPrefix() << "receiver used " << owner.getReceiverCpuUsage(index) * 100 << "% CPU";
+        if (wakeLatencySamples > 0)
+        {
+            std::cout << ", wake-up latency mean " << owner.getMeanWakeLatencyUs(index) << " us, max "
+                << wakeLatencyMaxUs << " us";
+        }
+        std::cout << std::endl;
+    }
+
+    if (owner.lossPolicy != LOSS_STOP)
+    {
+        std::cout << getLogPrefix() << stats.shortBlocks << " incomplete blocks, " << stats.gaps << " gaps ("
+            << stats.samplesFilled << " samples filled, " << stats.samplesUnfilled << " not filled), "
+            << stats.reorderedPackets << " out-of-order packets dropped" << std::endl;
+    }
+
+    if (owner.recoveryEnabled)
+    {
+        std::cout << getLogPrefix() << stats.socketErrors << " socket errors and " << stats.outages << " outages, "
+            << stats.socketRebinds << " sockets recreated, " << stats.resyncs << " resyncs (" << stats.clockRebases
+            << " after the amplifier's timestamps restarted), " << stats.outageMs << " ms without data" << std::endl;
+    }
+
+    if (stats.samples > 0)
+    {
+        std::cout << getLogPrefix() << stats.ttlEdges << " TTL edges in " << stats.samples << " samples ("
+            << double(stats.ttlEdges) / stats.samples * 1e6 << " per million)" << std::endl;
+    }
+
+    for (int stage = 0; stage < ReceiveTelemetry::numLatencyStages; ++stage)
+    {
+        LatencyHistogram::Counts counts;
+        counts.add(telemetry.latency[stage]);
+        if (counts.getTotal() > 0)
+        {
+            std::cout << getLogPrefix() << ReceiveTelemetry::getLatencyStageName(stage) << " latency (us): p50 "
+                << counts.getPercentile(50) / 1e3 << ", p90 " << counts.getPercentile(90) / 1e3 << ", p99 "
+                << counts.getPercentile(99) / 1e3 << ", p99.9 " << counts.getPercentile(99.9) / 1e3 << ", max "
+                << counts.getMax() / 1e3 << " (" << counts.getTotal() << " samples)" << std::endl;
+        }
+    }
+}
+
+
+String NeuralynxThread::Stream::getLogPrefix() const
+{
+    return index == 0 ? "Neuralynx Input: " : "Neuralynx Input (stream " + String(index + 1) + "): ";
+}
+
+
+unsigned int NeuralynxThread::getNumSubProcessors() const
+{
+    // a wideband subprocessor per stream, then an LFP one per stream if enabled
+    return getNumActiveStreams() * (lfpFactor > 1 ? 2 : 1);
+}
+
+
+int NeuralynxThread::getNumDataOutputs(DataChannel::DataChannelTypes type, int subProcessorIdx) const
+{
+    int numActive = getNumActiveStreams();
+    if (type != DataChannel::HEADSTAGE_CHANNEL)
+    {
+        return 0;
+    }
+
+    if (subProcessorIdx < numActive)
+    {
+        return streams[subProcessorIdx]->getNumOutputChannels();
+    }
+    if (subProcessorIdx < int(getNumSubProcessors()))
+    {
+        return streams[subProcessorIdx - numActive]->getNumLfpChannels();
+    }
+    return 0;
+}
+
+
+int NeuralynxThread::getNumTTLOutputs(int subprocessorIdx) const
+{
+    if (subprocessorIdx < getNumActiveStreams())
+    {
+        return recoveryEnabled ? outageTtlLine + 1 : 32;
+    }
+    return 0;
+}
+
+
+float NeuralynxThread::getSampleRate(int subprocessorIdx) const
+{
+    int numActive = getNumActiveStreams();
+    if (subprocessorIdx < numActive)
+    {
+        return streams[subprocessorIdx]->sampleRate;
+    }
+    if (subprocessorIdx < int(getNumSubProcessors()))
+    {
+        return streams[subprocessorIdx - numActive]->sampleRate / lfpFactor;
+    }
+    return 0;
+}
+
+
+float NeuralynxThread::getBitVolts(const DataChannel* chan) const
+{
+    // Even though technically the input to ATLAS can be in the range +/-131,072 uV,
+    // and the data sent over UDP are scaled to reflect that, the processed data are stored
+    // in the CSC files as int16s in uV, i.e. with a bit(u)volts value of 1 and range of
+    // +/-32,767 uV. Thus it should be safe to use the same bitvolts of 1 when saving data from OEP.
+    return 1;
+}
+
+
+bool NeuralynxThread::usesCustomNames() const
+{
+    return true;
+}
+
+
+GenericEditor* NeuralynxThread::createEditor(SourceNode* sn)
+{
+    return new NeuralynxEditor(sn, this);
+}
+
+
+String NeuralynxThread::getChannelUnits(int chanIndex) const
+{
+    return "uV";
+}
+
+
+
+void NeuralynxThread::labelTextChanged(Label* label)
+{
+    if (label->getName() == "OutageLimitE")
+    {
+        if (!setOutageLimitMs(label->getText().getIntValue()))
+        {
+            CoreServices::sendStatusMessage("Neuralynx Input: outage limit must be " + String(int(timeoutMs))
+                + " to " + String(maxOutageLimitMs) + " ms");
+            label->setText(String(outageLimitMs), dontSendNotification);
+        }
+        return;
+    }
+
+    if (label->getName() == "BlockParamE")
+    {
+        if (!setBlockParam(label->getText().getIntValue()))
+        {
+            CoreServices::sendStatusMessage("Neuralynx Input: invalid block setting");
+            label->setText(String(getBlockParam()), dontSendNotification);
+        }
+        return;
+    }
+
+    if (label->getName() == "BusyPollE")
+    {
+        if (!setBusyPollUs(label->getText().getIntValue()))
+        {
+            CoreServices::sendStatusMessage("Neuralynx Input: busy-poll time must be 1 to "
+                + String(maxBusyPollUs) + " us");
+            label->setText(String(busyPollUs), dontSendNotification);
+        }
+        return;
+    }
+
+    // otherwise, must be the portLabel
+    std::istringstream portInput(label->getText().toStdString());
+    uint16 newPort;
+    portInput >> newPort;
+    if (portInput.good() && newPort != 0)
+    {
+        streams[0]->port = newPort;
+    }
+    else
+    {
+        CoreServices::sendStatusMessage("Neuralynx Input: invalid port");
+        label->setText(String(streams[0]->port), dontSendNotification);
+    }
+}
+
+
+void NeuralynxThread::buttonClicked(Button* button)
+{
+    // must be the refresh button
+    if (!CoreServices::getAcquisitionStatus())
+    {
+        updateBoardsAndHz = true;
+    }
+}
+
+
+void NeuralynxThread::comboBoxChanged(ComboBox* comboBox)
+{
+    if (comboBox->getName() == "LossPolicyBox")
+    {
+        setLossPolicy(LossPolicy(comboBox->getSelectedId()));
+        return;
+    }
+
+    if (comboBox->getName() == "WaitModeBox")
+    {
+        setWaitMode(WaitMode(comboBox->getSelectedId()));
+        return;
+    }
+
+    // otherwise, must be the receive mode box
+    if (!setReceiveMode(ReceiveMode(comboBox->getSelectedId())))
+    {
+        comboBox->setSelectedId(receiveMode, dontSendNotification);
+    }
+}
+
+
+bool NeuralynxThread::receiveModeAvailable(ReceiveMode mode)
+{
+    switch (mode)
+    {
+    case RECEIVE_SINGLE:
+        return true;
+
+    case RECEIVE_BATCHED:
+#if JUCE_LINUX
+        return true;
+#else
+        return false;
+#endif
+
+    case RECEIVE_PACKET_RING:
+        return PacketMmapSocket::isAvailable();
+
+    default:
+        return false;
+    }
+}
+
+
+bool NeuralynxThread::setReceiveMode(ReceiveMode mode)
+{
+    if (CoreServices::getAcquisitionStatus())
+    {
+        jassertfalse;
+        return false;
+    }
+
+    if (!receiveModeAvailable(mode))
+    {
+        return false;
+    }
+
+    receiveMode = mode;
+    return true;
+}
+
+
+NeuralynxThread::ReceiveMode NeuralynxThread::getReceiveMode() const
+{
+    return receiveMode;
+}
+
+
+bool NeuralynxThread::setLossPolicy(LossPolicy policy)
+{
+    if (CoreServices::getAcquisitionStatus())
+    {
+        jassertfalse;
+        return false;
+    }
+
+    if (policy < LOSS_STOP || policy > LOSS_LINEAR)
+    {
+        return false;
+    }
+
+    lossPolicy = policy;
+    return true;
+}
+
+
+NeuralynxThread::LossPolicy NeuralynxThread::getLossPolicy() const
+{
+    return lossPolicy;
+}
+
+
+bool NeuralynxThread::setOutageLimitMs(int ms)
+{
+    if (CoreServices::getAcquisitionStatus())
+    {
+        jassertfalse;
+        return false;
+    }
+
+    if (ms < timeoutMs || ms > maxOutageLimitMs)
+    {
+        return false;
+    }
+
+    outageLimitMs = ms;
+    return true;
+}
+
+
+int NeuralynxThread::getOutageLimitMs() const
+{
+    return outageLimitMs;
+}
+
+
+bool NeuralynxThread::setWaitMode(WaitMode mode)
+{
+    if (CoreServices::getAcquisitionStatus())
+    {
+        jassertfalse;
+        return false;
+    }
+
+    if (mode < WAIT_SPIN || mode > WAIT_HYBRID)
+    {
+        return false;
+    }
+
+    waitMode = mode;
+    return true;
+}
+
+
+NeuralynxThread::WaitMode NeuralynxThread::getWaitMode() const
+{
+    return waitMode;
+}
+
+
+bool NeuralynxThread::setBusyPollUs(int us)
+{
+    if (CoreServices::getAcquisitionStatus())
+    {
+        jassertfalse;
+        return false;
+    }
+
+    if (us < 1 || us > maxBusyPollUs)
+    {
+        return false;
+    }
+
+    busyPollUs = us;
+    return true;
+}
+
+
+int NeuralynxThread::getBusyPollUs() const
+{
+    return busyPollUs;
+}
+
+
+double NeuralynxThread::getPacketsPerSyscall(int stream) const
+{
+    const ReceiveTelemetry& telemetry = streams[stream]->telemetry;
+    uint64 syscalls = telemetry.syscalls.get();
+    return syscalls > 0 ? double(telemetry.packets.get()) / syscalls : 0;
+}
+
+
+int NeuralynxThread::getRingOccupancy(int stream) const
+{
+    return streams[stream]->packetRing.getOccupancy();
+}
+
+
+int NeuralynxThread::getMaxRingOccupancy(int stream) const
+{
+    return streams[stream]->packetRing.getMaxOccupancy();
+}
+
+
+int NeuralynxThread::getRingCapacity() const
+{
+    return ringPackets;
+}
+
+
+uint64 NeuralynxThread::getRingOverruns(int stream) const
+{
+    return streams[stream]->telemetry.ringOverruns.get();
+}
+
+
+const ReceiveTelemetry& NeuralynxThread::getTelemetry(int stream) const
+{
+    return streams[stream]->telemetry;
+}
+
+
+ReceiveTelemetry::Snapshot NeuralynxThread::getTelemetrySnapshot() const
+{
+    auto total = streams[0]->telemetry.getSnapshot();
+    for (int i = 1; i < getNumActiveStreams(); ++i)
+    {
+        total = ReceiveTelemetry::combine(total, streams[i]->telemetry.getSnapshot());
+    }
+    return total;
+}
+
+
+LatencyHistogram::Counts NeuralynxThread::getLatencyCounts(int stage) const
+{
+    LatencyHistogram::Counts total;
+    for (int i = 0; i < getNumActiveStreams(); ++i)
+    {
+        total.add(streams[i]->telemetry.latency[stage]);
+    }
+    return total;
+}
+
+
+int NeuralynxThread::getNumStreams() const
+{
+    return streams.size();
+}
+
+
+int NeuralynxThread::getNumActiveStreams() const
+{
+    return source == SOURCE_NETWORK ? streams.size() : 1;
+}
+
+
+bool NeuralynxThread::addStream(const IPAddress& address, int port)
+{
+    if (CoreServices::getAcquisitionStatus() || port <= 0 || port > 65535)
+    {
+        jassertfalse;
+        return false;
+    }
+
+    stopProbe();
+
+    for (auto stream : streams)
+    {
+        // (stream 0's address isn't known until it is probed)
+        if (stream->port == port && (stream->ipAddress == address || stream->index == 0))
+        {
+            return false;
+        }
+    }
+
+    streams.add(new Stream(*this, streams.size(), address, port));
+    receivingData = false;
+    resizeBuffers();
+    updateNumBoardsValue();
+    sn->requestChainUpdate();
+    return true;
+}
+
+
+void NeuralynxThread::removeStream(int stream)
+{
+    if (CoreServices::getAcquisitionStatus() || stream <= 0 || stream >= streams.size())
+    {
+        jassertfalse;
+        return;
+    }
+
+    stopProbe();
+    streams.remove(stream);
+
+    // streams are numbered by their position
+    for (int i = stream; i < streams.size(); ++i)
+    {
+        streams[i]->index = i;
+    }
+
+    resizeBuffers();
+    updateNumBoardsValue();
+    sn->requestChainUpdate();
+}
+
+
+IPAddress NeuralynxThread::getStreamAddress(int stream) const
+{
+    return streams[stream]->ipAddress;
+}
+
+
+int NeuralynxThread::getStreamPort(int stream) const
+{
+    return streams[stream]->port;
+}
+
+
+bool NeuralynxThread::isStreamReceiving(int stream) const
+{
+    return streams[stream]->receiving;
+}
+
+
+bool NeuralynxThread::getStreamOffsetUs(int stream, int64& offsetUs) const
+{
+    const Stream* reference = streams[0];
+    const Stream* other = streams[stream];
+    if (reference->clockOffsetValid.get() == 0 || other->clockOffsetValid.get() == 0)
+    {
+        return false;
+    }
+
+    offsetUs = other->clockOffsetUs.get() - reference->clockOffsetUs.get();
+    return true;
+}
+
+
+bool NeuralynxThread::setChannelMap(int stream, const Array<int>& map)
+{
+    if (CoreServices::getAcquisitionStatus())
+    {
+        jassertfalse;
+        return false;
+    }
+
+    for (int i = 0; i < map.size(); ++i)
+    {
+        if (map[i] < 0 || map.indexOf(map[i]) != i)
+        {
+            return false;
+        }
+    }
+
+    Stream* s = streams[stream];
+    if (map == s->channelMap)
+    {
+        return true;
+    }
+
+    s->channelMap = map;
+    s->updateGather();
+    resizeBuffers();
+    sn->requestChainUpdate();
+    return true;
+}
+
+
+const Array<int>& NeuralynxThread::getChannelMap(int stream) const
+{
+    return streams[stream]->channelMap;
+}
+
+
+int NeuralynxThread::getNumOutputChannels(int stream) const
+{
+    return streams[stream]->getNumOutputChannels();
+}
+
+
+bool NeuralynxThread::setLfp(int factor, const Array<int>& channels)
+{
+    if (CoreServices::getAcquisitionStatus())
+    {
+        jassertfalse;
+        return false;
+    }
+
+    if (factor != 1 && (factor < PolyphaseDecimator::minFactor || factor > PolyphaseDecimator::maxFactor))
+    {
+        return false;
+    }
+
+    for (int i = 0; i < channels.size(); ++i)
+    {
+        if (channels[i] < 0 || channels.indexOf(channels[i]) != i)
+        {
+            return false;
+        }
+    }
+
+    if (factor == lfpFactor && channels == lfpChannels)
+    {
+        return true;
+    }
+
+    lfpFactor = factor;
+    lfpChannels = channels;
+    for (Stream* stream : streams)
+    {
+        stream->updateGather();
+    }
+    resizeBuffers();
+    sn->requestChainUpdate();
+    return true;
+}
+
+
+int NeuralynxThread::getLfpFactor() const
+{
+    return lfpFactor;
+}
+
+
+const Array<int>& NeuralynxThread::getLfpChannels() const
+{
+    return lfpChannels;
+}
+
+
+bool NeuralynxThread::parseChannelList(const String& text, Array<int>& map)
+{
+    map.clearQuick();
+
+    StringArray items;
+    items.addTokens(text.removeCharacters(" \t"), ",", "");
+    items.removeEmptyStrings();
+
+    for (const String& item : items)
+    {
+        String first = item.upToFirstOccurrenceOf("-", false, false);
+        String last = item.containsChar('-') ? item.fromFirstOccurrenceOf("-", false, false) : first;
+        if (!first.containsOnly("0123456789") || !last.containsOnly("0123456789")
+            || first.isEmpty() || last.isEmpty())
+        {
+            return false;
+        }
+
+        int from = first.getIntValue() - 1;
+        int to = last.getIntValue() - 1;
+        if (from < 0 || to < 0 || from >= maxChannels || to >= maxChannels)
+        {
+            return false;
+        }
+
+        int step = to >= from ? 1 : -1;
+        for (int c = from; ; c += step)
+        {
+            map.add(c);
+            if (c == to)
+            {
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+
+String NeuralynxThread::formatChannelList(const Array<int>& map)
+{
+    // collapse runs of consecutive channels (in either direction) into ranges
+    StringArray items;
+    int i = 0;
+    while (i < map.size())
+    {
+        int end = i + 1;
+        int step = end < map.size() && std::abs(map[end] - map[i]) == 1 ? map[end] - map[i] : 0;
+        while (step != 0 && end < map.size() && map[end] - map[end - 1] == step)
+        {
+            ++end;
+        }
+
+        items.add(end - i > 1 ? String(map[i] + 1) + "-" + String(map[end - 1] + 1) : String(map[i] + 1));
+        i = end;
+    }
+    return items.joinIntoString(", ");
+}
+
+
+void NeuralynxThread::updateNumBoardsValue()
+{
+    int total = 0;
+    for (int i = 0; i < getNumActiveStreams(); ++i)
+    {
+        total += streams[i]->numBoards;
+    }
+    numBoardsValue = total;
+}
+
+
+NeuralynxThread::Source NeuralynxThread::getSource() const
+{
+    return source;
+}
+
+
+bool NeuralynxThread::setSource(Source newSource, const File& file)
+{
+    if (CoreServices::getAcquisitionStatus() || newSource < SOURCE_NETWORK || newSource > SOURCE_REPLAY_FAST)
+    {
+        jassertfalse;
+        return false;
+    }
+
+    // (the prober may be reading the capture file)
+    stopProbe();
+
+    bool ok = true;
+    if (newSource == SOURCE_NETWORK)
+    {
+        replayReader.close();
+    }
+    else if (file.getFullPathName().toStdString() != replayReader.getPath()
+        && !replayReader.open(file.getFullPathName().toStdString()))
+    {
+        CoreServices::sendStatusMessage("Neuralynx Input: could not open capture file");
+        std::cout << "Neuralynx Input: " << replayReader.getError() << std::endl;
+        newSource = SOURCE_NETWORK;
+        ok = false;
+    }
+
+    if (newSource != source)
+    {
+        // only stream 0 is active while replaying
+        bool streamsChanged = streams.size() > 1 && (source == SOURCE_NETWORK) != (newSource == SOURCE_NETWORK);
+
+        // re-probe the number of boards and sample rate from the new source
+        source = newSource;
+        receivingData = false;
+
+        if (streamsChanged)
+        {
+            resizeBuffers();
+            updateNumBoardsValue();
+            sn->requestChainUpdate();
+        }
+    }
+    return ok;
+}
+
+
+File NeuralynxThread::getReplayFile() const
+{
+    return replayReader.isOpen() ? File(replayReader.getPath()) : File();
+}
+
+
+void NeuralynxThread::setCaptureEnabled(bool enable)
+{
+    captureEnabled = enable;
+}
+
+
+bool NeuralynxThread::getCaptureEnabled() const
+{
+    return captureEnabled;
+}
+
+
+void NeuralynxThread::setRawRecordingEnabled(bool enable)
+{
+    rawRecording = enable;
+}
+
+
+bool NeuralynxThread::getRawRecordingEnabled() const
+{
+    return rawRecording;
+}
+
+
+void NeuralynxThread::setSharedMemoryEnabled(bool enable)
+{
+    sharedMemory = enable;
+}
+
+
+bool NeuralynxThread::getSharedMemoryEnabled() const
+{
+    return sharedMemory;
+}
+
+
+bool NeuralynxThread::setDecodeThreads(int n)
+{
+    if (CoreServices::getAcquisitionStatus())
+    {
+        jassertfalse;
+        return false;
+    }
+
+    if (n < 1 || n > ShardedDecoder::maxThreads)
+    {
+        return false;
+    }
+
+    decodeThreads = n; // (the block buffers are resized when acquisition starts)
+    return true;
+}
+
+
+int NeuralynxThread::getDecodeThreads() const
+{
+    return decodeThreads;
+}
+
+
+void NeuralynxThread::setRecoveryEnabled(bool enable)
+{
+    if (CoreServices::getAcquisitionStatus())
+    {
+        jassertfalse;
+        return;
+    }
+
+    if (enable == recoveryEnabled)
+    {
+        return;
+    }
+
+    // (adds or removes the outage TTL line)
+    recoveryEnabled = enable;
+    sn->requestChainUpdate();
+}
+
+
+bool NeuralynxThread::getRecoveryEnabled() const
+{
+    return recoveryEnabled;
+}
+
+
+const ReceiveTuning::Settings& NeuralynxThread::getTuning() const
+{
+    return tuning;
+}
+
+
+bool NeuralynxThread::setTuning(const ReceiveTuning::Settings& settings)
+{
+    if (!ReceiveTuning::isValid(settings))
+    {
+        return false;
+    }
+
+    auto markChanged = [this](ReceiveTuning::Setting setting, bool changed, bool requested)
+    {
+        if (changed)
+        {
+            ReceiveTuning::Result result;
+            result.state = requested ? ReceiveTuning::PENDING : ReceiveTuning::NOT_REQUESTED;
+            result.detail = requested ? "takes effect when acquisition starts" : "";
+            setTuningResult(setting, result, false);
+        }
+    };
+
+    // (a socket option that was turned off is still pending, since the socket keeps it until recreated)
+    markChanged(ReceiveTuning::RCVBUF, settings.rcvBufKB != tuning.rcvBufKB, true);
+    markChanged(ReceiveTuning::BUSY_POLL, settings.busyPollUs != tuning.busyPollUs, true);
+    markChanged(ReceiveTuning::RT_PRIORITY, settings.rtPriority != tuning.rtPriority, settings.rtPriority > 0);
+    markChanged(ReceiveTuning::CPU_AFFINITY, settings.cpu != tuning.cpu, settings.cpu >= 0);
+
+    tuning = settings;
+    return true;
+}
+
+
+ReceiveTuning::Result NeuralynxThread::getTuningResult(ReceiveTuning::Setting setting) const
+{
+    const ScopedLock lock(tuningLock);
+    return tuningResults[setting];
+}
+
+
+NeuralynxThread::BlockPolicy NeuralynxThread::getBlockPolicy() const
+{
+    return blockPolicy;
+}
+
+
+void NeuralynxThread::setBlockPolicy(BlockPolicy policy)
+{
+    if (CoreServices::getAcquisitionStatus() || policy < BLOCK_FIXED || policy > BLOCK_ADAPTIVE)
+    {
+        jassertfalse;
+        return;
+    }
+
+    blockPolicy = policy;
+}
+
+
+int NeuralynxThread::getBlockParam() const
+{
+    switch (blockPolicy)
+    {
+    case BLOCK_DEADLINE: return deadlineUs;
+    case BLOCK_ADAPTIVE: return adaptiveMaxPackets;
+    default:             return fixedBlockPackets;
+    }
+}
+
+
+bool NeuralynxThread::setBlockParam(int value)
+{
+    if (CoreServices::getAcquisitionStatus())
+    {
+        jassertfalse;
+        return false;
+    }
+
+    switch (blockPolicy)
+    {
+    case BLOCK_DEADLINE:
+        if (value < 1 || value > maxDeadlineUs) { return false; }
+        deadlineUs = value;
+        return true;
+
+    case BLOCK_ADAPTIVE:
+        if (value < 1 || value > maxBlockPackets) { return false; }
+        adaptiveMaxPackets = value;
+        return true;
+
+    default:
+        if (value < 1 || value > maxBlockPackets) { return false; }
+        fixedBlockPackets = value;
+        return true;
+    }
+}
+
+
+int NeuralynxThread::getBlockCapacity() const
+{
+    switch (blockPolicy)
+    {
+    case BLOCK_DEADLINE: return maxBlockPackets;
+    case BLOCK_ADAPTIVE: return adaptiveMaxPackets;
+    default:             return fixedBlockPackets;
+    }
+}
+
+
+double NeuralynxThread::getReceiverCpuUsage(int stream) const
+{
+    const Stream* st = streams[stream];
+    return st->receiverWallSeconds > 0 ? st->receiverCpuSeconds / st->receiverWallSeconds : 0;
+}
+
+
+double NeuralynxThread::getMeanWakeLatencyUs(int stream) const
+{
+    const Stream* st = streams[stream];
+    return st->wakeLatencySamples > 0 ? st->wakeLatencySumUs / st->wakeLatencySamples : 0;
+}
+
+
+double NeuralynxThread::getMaxWakeLatencyUs(int stream) const
+{
+    return streams[stream]->wakeLatencyMaxUs;
+}
+
+
+void NeuralynxThread::setDefaultChannelNames()
+{
+    // channels of streams after the first are prefixed with the stream number; mapped channels
+    // keep the number they have on the amplifier
+    int c = 0;
+    for (int i = 0; i < getNumActiveStreams(); ++i)
+    {
+        const Stream* stream = streams[i];
+        String prefix = i == 0 ? "CH" : "S" + String(i + 1) + "_CH";
+        for (int k = 0; k < stream->getNumOutputChannels(); ++k, ++c)
+        {
+            ChannelCustomInfo info;
+            info.name = prefix + String((stream->gather.isEmpty() ? k : stream->gather[k]) + 1);
+            info.gain = getBitVolts(sn->getDataChannel(c));
+            channelInfo.set(c, info);
+        }
+    }
+
+    // then the LFP subprocessors, e.g. LFP_CH5 for the decimated copy of CH5
+    for (int i = 0; i < getNumActiveStreams(); ++i)
+    {
+        const Stream* stream = streams[i];
+        String prefix = i == 0 ? "LFP_CH" : "S" + String(i + 1) + "_LFP_CH";
+        for (int k = 0; k < stream->getNumLfpChannels(); ++k, ++c)
+        {
+            int output = stream->lfpGather[k];
+            ChannelCustomInfo info;
+            info.name = prefix + String((stream->gather.isEmpty() ? output : stream->gather[output]) + 1);
+            info.gain = getBitVolts(sn->getDataChannel(c));
+            channelInfo.set(c, info);
+        }
+    }
+}
+
+
+NeuralynxThread::Stream::Stream(NeuralynxThread& o, int i, const IPAddress& address, int p)
+    : owner             (o)
+    , index             (i)
+    , numBoards         (1)
+    , sampleRate        (o.sampleRate.getValue())
+    , receiving         (false)
+    , probedBoards      (1)
+    , probedRate        (0)
+    , probedValid       (false)
+    , decoder           (PacketKernel::getDecoder(1))
+    , gatherDecoder     (PacketKernel::getGatherDecoder())
+    , ipAddress         (address)
+    , port              (p)
+    , mmapReleaseBase   (0)
+    , receiverCpuSeconds  (0)
+    , receiverWallSeconds (0)
+    , wakeLatencySamples(0)
+    , wakeLatencySumUs  (0)
+    , wakeLatencyMaxUs  (0)
+    , receiver          (*this)
+    , decodeThread      (*this)
+    , receiverFailed    (0)
+    , rebindRequested   (0)
+    , resyncRequested   (0)
+    , resyncFrom        (0)
+    , resyncing         (false)
+    , rebindSent        (false)
+    , outageMark        (0)
+    , decodeStartNs     (0)
+    , flushedTtl        (0)
+    , kernelDropsBase   (-1)
+    , kernelDropsBefore (0)
+    , clockOffsetUs     (0)
+    , clockOffsetValid  (0)
+{
+    updateGather();
+    resizeBlockBuffers();
+}
+
+
+NeuralynxThread::Stream::~Stream()
+{
+    decodeThread.stopThread(500);
+    receiver.stopThread(500);
+}
+
+
+void NeuralynxThread::Stream::setNumBoards(int n)
+{
+    if (CoreServices::getAcquisitionStatus() || n < minBoards || n > maxBoards)
+    {
+        jassertfalse;
+        return;
+    }
+
+    if (n == numBoards)
+    {
+        return;
+    }
+
+    numBoards = n;
+    updateGather();
+    owner.updateNumBoardsValue();
+    owner.sn->requestChainUpdate();
+}
+
+
+void NeuralynxThread::Stream::setSampleRate(float rate)
+{
+    if (rate == sampleRate)
+    {
+        return;
+    }
+
+    sampleRate = rate;
+    if (index == 0)
+    {
+        // (the editor updates the signal chain)
+        owner.sampleRate = rate;
+    }
+    else
+    {
+        owner.sn->requestChainUpdate();
+    }
+}
+
+
+void NeuralynxThread::Stream::updateGather()
+{
+    gather.clearQuick();
+    gatherTable = PacketKernel::GatherTable();
+    if (!channelMap.isEmpty())
+    {
+        updateChannelGather();
+    }
+    updateLfpGather();
+}
+
+
+void NeuralynxThread::Stream::updateChannelGather()
+{
+    int numChans = numBoards * boardChannels;
+    for (int channel : channelMap)
+    {
+        if (channel < numChans)
+        {
+            gather.add(channel);
+        }
+    }
+
+    if (gather.size() < channelMap.size())
+    {
+        std::cout << getLogPrefix() << "ignoring " << channelMap.size() - gather.size()
+            << " mapped channel(s) beyond the " << numChans << " received" << std::endl;
+    }
+
+    if (gather.isEmpty())
+    {
+        // nothing left to output; fall back to all channels rather than none
+        std::cout << getLogPrefix() << "no mapped channel is received, so outputting all channels" << std::endl;
+        return;
+    }
+
+    PacketKernel::makeGatherTable(gather.getRawDataPointer(), gather.size(), gatherTable);
+}
+
+
+void NeuralynxThread::Stream::updateLfpGather()
+{
+    lfpGather.clearQuick();
+    if (owner.lfpFactor <= 1)
+    {
+        return;
+    }
+
+    int numChans = getNumOutputChannels();
+    for (int channel : owner.lfpChannels)
+    {
+        int output = gather.isEmpty() ? (channel < numChans ? channel : -1) : gather.indexOf(channel);
+        if (output >= 0)
+        {
+            lfpGather.add(output);
+        }
+    }
+
+    if (lfpGather.isEmpty())
+    {
+        if (!owner.lfpChannels.isEmpty())
+        {
+            std::cout << getLogPrefix() << "no LFP channel is output, so decimating all channels" << std::endl;
+        }
+
+        for (int k = 0; k < numChans; ++k)
+        {
+            lfpGather.add(k);
+        }
+    }
+
+    decimator.reset(owner.lfpFactor, lfpGather.getRawDataPointer(), lfpGather.size());
+}
+
+
+int NeuralynxThread::Stream::getNumOutputChannels() const
+{
+    return gather.isEmpty() ? numBoards * boardChannels : gather.size();
+}
+
+
+int NeuralynxThread::Stream::getNumLfpChannels() const
+{
+    return lfpGather.size();
+}
+
+
+int NeuralynxThread::Stream::rcvPacket(int expectedBoards)
+{
+    if (expectedBoards > maxBoards) { return 0; }
+
+    int bytesToRead = expectedBoards > 0
+        ? PacketKernel::wordsInPacketWithBoards(expectedBoards) * 4
+        : owner.maxPacketSize;
+
+    int bytesRcvd = 0;
+
+    CaptureFile::Record record;
+    if (owner.source != SOURCE_NETWORK)
+    {
+        // next packet from the capture file (truncated to bytesToRead, as a socket read would be)
+        if (owner.replayReader.readNext(record))
+        {
+            bytesRcvd = jmin(int(record.bytes), bytesToRead);
+            std::memcpy(socketBuffer, record.data, bytesRcvd);
+        }
+    }
+
+    // try to receive a packet until timeout is reached
+    uint32 t1 = Time::getMillisecondCounter();
+    uint32 elapsed;
+    while (owner.source == SOURCE_NETWORK && (elapsed = Time::getMillisecondCounter() - t1) < timeoutMs)
+    {
+        if (owner.receiveMode == RECEIVE_PACKET_RING)
+        {
+            if (mmapSocket.wait(timeoutMs - elapsed) < 0)
+            {
+                return 0;
+            }
+
+            PacketMmapSocket::Frame frame;
+            if (mmapSocket.next(frame))
+            {
+                bytesRcvd = jmin(frame.bytes, bytesToRead);
+                std::memcpy(socketBuffer, frame.payload, bytesRcvd);
+                mmapSocket.release(mmapSocket.getNumReturned());
+                break;
+            }
+            continue;
+        }
+
+        int ready = waitForSocket(timeoutMs - elapsed);
+        if (ready < 0)
+        {
+            return 0;
+        }
+
+        if (ready > 0 && 0 != (bytesRcvd = socket->read(socketBuffer, bytesToRead, false)))
+        {
+            break;
+        }
+    }
+
+    if (expectedBoards > 0)
+    {
+        return bytesRcvd == bytesToRead ? expectedBoards : 0;
+    }
+
+    // figure out # of boards
+    if (bytesRcvd < owner.minPacketSize) { return 0; }
+
+    int boards = PacketKernel::readNumBoards(socketBuffer);
+    if (boards == 0 || bytesRcvd < PacketKernel::wordsInPacketWithBoards(boards) * 4)
+    {
+        return 0;
+    }
+
+    return boards;
+}
+
+
+int NeuralynxThread::Stream::rcvIntoRing()
+{
+    int numFree = packetRing.getNumFree();
+
+    if (numFree == 0)
+    {
+        // decode stage is not keeping up; drop the packet here rather than in the kernel
+        int bytesRcvd = socket->read(socketBuffer, socketBufferSize, false);
+        telemetry.syscalls.add();
+
+        if (bytesRcvd < 0)
+        {
+            return -1;
+        }
+        if (bytesRcvd > 0)
+        {
+            telemetry.packets.add();
+            telemetry.bytes.add(bytesRcvd);
+            telemetry.ringOverruns.add();
+            capturePacket(socketBuffer, bytesRcvd, getRealTimeNs());
+        }
+        return 0;
+    }
+
+    if (owner.receiveMode == RECEIVE_BATCHED)
+    {
+        return rcvIntoRingBatched(numFree);
+    }
+
+    // get every packet's arrival time, for the latency stats (and the kernel's drop count along with it)
+    bool sampleStats = telemetry.packets.get() % wakeSampleInterval == 0;
+    bool capturing = captureWriter.isOpen();
+    uint64 arrivalNs = 0;
+
+    uint32* slot = packetRing.getWriteSlot(0);
+    int bytesRcvd = rcvWithDropCount(slot, packetRing.getSlotBytes(), arrivalNs);
+    telemetry.syscalls.add();
+
+    if (bytesRcvd <= 0)
+    {
+        return bytesRcvd;
+    }
+
+    telemetry.packets.add();
+    telemetry.bytes.add(bytesRcvd);
+    if (sampleStats)
+    {
+        sampleWakeLatency();
+    }
+    if (capturing)
+    {
+        capturePacket(slot, bytesRcvd, arrivalNs);
+    }
+
+    packetRing.setWriteLength(0, bytesRcvd);
+    packetRing.setWriteArrival(0, arrivalNs);
+    packetRing.finishWrite(1);
+    return 1;
+}
+
+
+int NeuralynxThread::Stream::rcvIntoRingMapped()
+{
+    // blocks whose packets have all been decoded go back to the kernel (mmapSocket counts
+    // frames from when it was opened, packetRing from the start of acquisition)
+    mmapSocket.release(packetRing.getReadCount() - mmapReleaseBase);
+
+    int numFree = packetRing.getNumFree();
+    if (numFree == 0)
+    {
+        // decode stage is not keeping up; leave the packets in the kernel's ring
+        // (which drops them if it fills up, and they are counted as kernel drops)
+        Thread::sleep(1);
+        return 0;
+    }
+
+    // the kernel hands over whole blocks, so there is no per-packet wait
+    int ready;
+    if (owner.waitMode == WAIT_POLL)
+    {
+        ready = mmapSocket.wait(timeoutMs);
+    }
+    else
+    {
+        ready = mmapSocket.wait(0);
+        if (ready == 0 && owner.waitMode == WAIT_HYBRID)
+        {
+            int64 busyTicks = Time::getHighResolutionTicksPerSecond() * owner.busyPollUs / 1000000;
+            int64 start = Time::getHighResolutionTicks();
+            while (ready == 0 && Time::getHighResolutionTicks() - start < busyTicks)
+            {
+                ready = mmapSocket.wait(0);
+            }
+            if (ready == 0)
+            {
+                ready = mmapSocket.wait(timeoutMs);
+            }
+        }
+    }
+    telemetry.syscalls.add();
+
+    if (ready <= 0)
+    {
+        return ready;
+    }
+
+    bool capturing = captureWriter.isOpen();
+    uint64 numPackets = telemetry.packets.get();
+
+    PacketMmapSocket::Frame frame;
+    int n = 0;
+    while (n < numFree && mmapSocket.next(frame))
+    {
+        packetRing.setWriteExternal(n, frame.payload, frame.bytes);
+        packetRing.setWriteArrival(n, frame.arrivalNs);
+        telemetry.bytes.add(frame.bytes);
+
+        if ((numPackets + n) % wakeSampleInterval == 0)
+        {
+            addWakeLatency(double(int64(getRealTimeNs() - frame.arrivalNs)) * 1e-3);
+        }
+        if (capturing)
+        {
+            capturePacket(frame.payload, frame.bytes, frame.arrivalNs);
+        }
+        ++n;
+    }
+
+    if (n > 0)
+    {
+        telemetry.packets.add(n);
+        packetRing.finishWrite(n);
+
+        int64 drops = getKernelDropCount();
+        if (drops >= 0 && kernelDropsBase >= 0)
+        {
+            telemetry.kernelDrops.set(kernelDropsBefore + uint64(drops - kernelDropsBase));
+        }
+    }
+    return n;
+}
+
+
+int NeuralynxThread::Stream::rcvIntoRingBatched(int numFree)
+{
+#if JUCE_LINUX
+    int numToRead = jmin(numFree, int(maxBatch));
+    int slotBytes = packetRing.getSlotBytes();
+    bool capturing = captureWriter.isOpen();
+
+    mmsghdr msgs[maxBatch];
+    iovec iovs[maxBatch];
+    alignas(cmsghdr) char control[maxBatch][controlBytes];
+    for (int s = 0; s < numToRead; ++s)
+    {
+        iovs[s].iov_base = packetRing.getWriteSlot(s);
+        iovs[s].iov_len = slotBytes;
+
+        std::memset(&msgs[s], 0, sizeof(mmsghdr));
+        msgs[s].msg_hdr.msg_iov = &iovs[s];
+        msgs[s].msg_hdr.msg_iovlen = 1;
+
+        // every packet's arrival time comes along with it (and the kernel's drop count with the first)
+        msgs[s].msg_hdr.msg_control = control[s];
+        msgs[s].msg_hdr.msg_controllen = controlBytes;
+    }
+
+    int n = recvmmsg(socket->getRawSocketHandle(), msgs, numToRead, MSG_DONTWAIT, nullptr);
+    telemetry.syscalls.add();
+
+    if (n < 0)
+    {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+    }
+
+    uint64 bytesRcvd = 0;
+    for (int s = 0; s < n; ++s)
+    {
+        // mark truncated packets with an invalid length so the decode stage rejects them
+        bool truncated = (msgs[s].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+        packetRing.setWriteLength(s, truncated ? -1 : int(msgs[s].msg_len));
+        bytesRcvd += msgs[s].msg_len;
+
+        uint64 arrivalNs = getArrivalNs(&msgs[s].msg_hdr);
+        packetRing.setWriteArrival(s, arrivalNs);
+        if (capturing)
+        {
+            capturePacket(iovs[s].iov_base, int(msgs[s].msg_len), arrivalNs);
+        }
+    }
+
+    if (n > 0)
+    {
+        updateKernelDrops(&msgs[0].msg_hdr);
+    }
+
+    uint64 packetsBefore = telemetry.packets.get();
+    if ((packetsBefore + n) / wakeSampleInterval != packetsBefore / wakeSampleInterval)
+    {
+        sampleWakeLatency();
+    }
+
+    telemetry.packets.add(n);
+    telemetry.bytes.add(bytesRcvd);
+    packetRing.finishWrite(n);
+    return n;
+#else
+    jassertfalse; // receive mode should not have been selectable
+    return -1;
+#endif
+}
+
+
+int NeuralynxThread::Stream::rcvWithDropCount(void* dest, int maxBytes, uint64& arrivalNs)
+{
+#if JUCE_LINUX
+    iovec iov;
+    iov.iov_base = dest;
+    iov.iov_len = maxBytes;
+
+    alignas(cmsghdr) char control[controlBytes];
+
+    msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t bytesRcvd = recvmsg(socket->getRawSocketHandle(), &msg, MSG_DONTWAIT);
+    if (bytesRcvd < 0)
+    {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+    }
+
+    updateKernelDrops(&msg);
+    arrivalNs = getArrivalNs(&msg);
+    return int(bytesRcvd);
+#else
+    arrivalNs = getRealTimeNs();
+    return socket->read(dest, maxBytes, false);
+#endif
+}
+
+
+void NeuralynxThread::Stream::updateKernelDrops(const void* msgHdr)
+{
+#if JUCE_LINUX
+    auto msg = static_cast<const msghdr*>(msgHdr);
+    for (auto cmsg = CMSG_FIRSTHDR(msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(const_cast<msghdr*>(msg), cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL)
+        {
+            uint32 drops;
+            std::memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+
+            // the count is cumulative over the socket's lifetime; if it couldn't be read at
+            // the start of acquisition, fall back to counting from when the socket was created
+            if (kernelDropsBase < 0)
+            {
+                kernelDropsBase = 0;
+            }
+            telemetry.kernelDrops.set(kernelDropsBefore + uint32(drops - uint32(kernelDropsBase)));
+        }
+    }
+#endif
+}
+
+
+uint64 NeuralynxThread::getArrivalNs(const void* msgHdr)
+{
+#if JUCE_LINUX
+    auto msg = static_cast<const msghdr*>(msgHdr);
+    for (auto cmsg = CMSG_FIRSTHDR(msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(const_cast<msghdr*>(msg), cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_TIMESTAMPNS)
+        {
+            timespec arrival;
+            std::memcpy(&arrival, CMSG_DATA(cmsg), sizeof(arrival));
+            return uint64(arrival.tv_sec) * 1000000000 + uint64(arrival.tv_nsec);
+        }
+    }
+#endif
+    return getRealTimeNs();
+}
+
+
+void NeuralynxThread::Stream::capturePacket(const void* packet, int bytes, uint64 arrivalNs)
+{
+    if (bytes > 0 && captureWriter.isOpen() && !captureWriter.append(packet, uint32(bytes), arrivalNs))
+    {
+        // out of disk space, most likely; keep acquiring without capturing
+        std::cout << getLogPrefix() << "capture stopped: " << captureWriter.getError() << std::endl;
+    }
+}
+
+
+int NeuralynxThread::Stream::replayIntoRing()
+{
+    int numFree = packetRing.getNumFree();
+    if (numFree == 0)
+    {
+        // wait for the decode stage rather than dropping anything
+        receiver.wait(1);
+        return 0;
+    }
+
+    const int64 ticksPerSecond = Time::getHighResolutionTicksPerSecond();
+    int numToCopy = jmin(numFree, int(maxBatch));
+    int slotBytes = packetRing.getSlotBytes();
+    uint64 bytesCopied = 0;
+
+    int n = 0;
+    while (n < numToCopy)
+    {
+        if (!owner.replayNextValid && !(owner.replayNextValid = owner.replayReader.readNext(owner.replayNext)))
+        {
+            break; // end of file
+        }
+
+        if (owner.replayStartTicks < 0)
+        {
+            owner.replayStartTicks = Time::getHighResolutionTicks();
+            owner.replayFirstNs = owner.replayNext.arrivalNs;
+        }
+
+        if (owner.source == SOURCE_REPLAY_PACED)
+        {
+            int64 dueTicks = owner.replayStartTicks
+                + int64((owner.replayNext.arrivalNs - owner.replayFirstNs) * 1e-9 * ticksPerSecond);
+            int64 ticksLeft = dueTicks - Time::getHighResolutionTicks();
+            if (ticksLeft > 0)
+            {
+                if (n == 0)
+                {
+                    // (wake up at least every timeoutMs to check whether we should exit)
+                    int msLeft = int(ticksLeft * 1000 / ticksPerSecond);
+                    if (msLeft > 1)
+                    {
+                        receiver.wait(jmin(msLeft - 1, int(timeoutMs)));
+                    }
+                    else
+                    {
+                        Thread::yield();
+                    }
+                }
+                break;
+            }
+        }
+
+        // packets too long for a slot are marked invalid, as in rcvIntoRingBatched
+        int bytes = int(owner.replayNext.bytes);
+        std::memcpy(packetRing.getWriteSlot(n), owner.replayNext.data, jmin(bytes, slotBytes));
+        packetRing.setWriteLength(n, bytes > slotBytes ? -1 : bytes);
+        packetRing.setWriteArrival(n, 0); // (the recorded arrival times are long past)
+        bytesCopied += bytes;
 
+        owner.replayNextValid = false;
+        ++n;
+    }
 
-void NeuralynxThread::resizeBuffers()
-{
-    sourceBuffers[0]->resize(numBoards * boardChannels, srcBufferSize);
+    if (n == 0 && !owner.replayNextValid)
+    {
+        if (!owner.replayFinished)
+        {
+            owner.replayFinished = true;
+            std::cout << "Neuralynx Input: reached the end of " << owner.replayReader.getPath() << std::endl;
+        }
+        receiver.wait(timeoutMs);
+        return 0;
+    }
 
-    timestamps.resize(blockSize);
-    ttlEventWords.resize(blockSize);
+    telemetry.syscalls.add();
+    telemetry.packets.add(n);
+    telemetry.bytes.add(bytesCopied);
+    packetRing.finishWrite(n);
+    return n;
 }
 
 
-const float NeuralynxThread::atlasRawBitVolts = NeuralynxThread::atlasMaxInputUv / float(1 << 23);
-
-bool NeuralynxThread::updateBuffer()
+int NeuralynxThread::Stream::waitForSocket(int timeoutMs)
 {
-    if (firstSample)
+    if (owner.waitMode == WAIT_SPIN)
     {
-        // flush socket one last time before starting acquisition
-        flushSocket();
+        return 1;
     }
 
-    if (!rcvBlock())
+    if (owner.waitMode == WAIT_HYBRID)
     {
-        return false;
+        // check readiness without sleeping for a short time first, in case a packet is imminent
+        int64 busyTicks = Time::getHighResolutionTicksPerSecond() * owner.busyPollUs / 1000000;
+        int64 start = Time::getHighResolutionTicks();
+        do
+        {
+            int ready = socket->waitUntilReady(true, 0);
+            if (ready != 0)
+            {
+                return ready;
+            }
+        } while (Time::getHighResolutionTicks() - start < busyTicks);
     }
 
-    int numChans = numBoards * boardChannels;
-    int numSamples = blockSize;
-    int sOut = 0;
-    for (int sIn = 0; sIn < blockSize; ++sIn)
-    {
-        const uint32* packetStart = socketBuffer + wordsInPacketWithBoards(numBoards) * sIn;
+#if JUCE_LINUX
+    // ppoll takes a timespec, so the timeout is not rounded to the scheduler tick like select's
+    pollfd pfd;
+    pfd.fd = socket->getRawSocketHandle();
+    pfd.events = POLLIN;
+    pfd.revents = 0;
 
-        if (!packetValid(packetStart, numBoards))
-        {
-            // skip, don't stop acquiring though since it might just be a randomly flipped bit
-            ++invalidPackets;
-            --numSamples;
-            continue;
-        }
+    timespec timeout;
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_nsec = (timeoutMs % 1000) * 1000000L;
 
-        // get timestamp
-        uint64 tsRaw = (uint64(ByteOrder::littleEndianInt(packetStart + 3)) << 32)
-            + ByteOrder::littleEndianInt(packetStart + 4);
+    int ready = ppoll(&pfd, 1, &timeout, nullptr);
+    if (ready < 0)
+    {
+        return errno == EINTR ? 0 : -1;
+    }
+    if (ready > 0 && (pfd.revents & (POLLERR | POLLNVAL)))
+    {
+        return -1;
+    }
+    return ready > 0 ? 1 : 0;
+#else
+    return socket->waitUntilReady(true, timeoutMs);
+#endif
+}
 
-        if (firstSample)
-        {
-            firstSample = false;
-            tsOffset = tsRaw;
-            timestamps.setUnchecked(sOut, 0);
-        }
-        else
-        {
-            int64 tsDiff = tsRaw - tsOffset;
-            int64 ts = int64((tsDiff + usPerSamp / 2) / usPerSamp); // (round to nearest)
-            timestamps.setUnchecked(sOut, ts);
-        }
 
-        // get ttl
-        ttlEventWords.setUnchecked(sOut, ByteOrder::littleEndianInt(packetStart + 6));
+void NeuralynxThread::Stream::sampleWakeLatency()
+{
+#if JUCE_LINUX
+    timespec now;
+    timespec arrival;
+    if (clock_gettime(CLOCK_REALTIME, &now) != 0
+        || ioctl(socket->getRawSocketHandle(), SIOCGSTAMPNS, &arrival) != 0)
+    {
+        return;
+    }
 
-        // get data
-        for (int c = 0; c < numChans; ++c)
-        {
-            uint32 uSamp = ByteOrder::littleEndianInt(packetStart + headerWords + c);
-            thisBlock[numChans * sOut + c] = *reinterpret_cast<int32*>(&uSamp) * atlasRawBitVolts;
-        }
+    addWakeLatency((now.tv_sec - arrival.tv_sec) * 1e6 + (now.tv_nsec - arrival.tv_nsec) * 1e-3);
+#endif
+}
 
-        ++sOut;
+
+void NeuralynxThread::Stream::addWakeLatency(double latencyUs)
+{
+    if (latencyUs < 0)
+    {
+        return; // clock was adjusted
     }
 
-    sourceBuffers[0]->addToBuffer(thisBlock, &timestamps.getReference(0), &ttlEventWords.getReference(0), numSamples);
-    return true;
+    ++wakeLatencySamples;
+    wakeLatencySumUs += latencyUs;
+    wakeLatencyMaxUs = jmax(wakeLatencyMaxUs, latencyUs);
 }
 
 
-bool NeuralynxThread::foundInputSource()
+bool NeuralynxThread::Stream::waitForPackets(int n)
 {
-    auto ed = static_cast<NeuralynxEditor*>(sn->getEditor());
-    if (ed == nullptr)
+    while (packetRing.getNumReady() < n)
     {
-        receivingData = false;
-        return false;
+        if (receiverFailed.get() != 0 || !packetsAvailable.wait(timeoutMs))
+        {
+            return false;
+        }
     }
-    
-    IPAddress newIP = ed->updateAndGetIPAddress();
+    return true;
+}
+
 
-    if (newIP == IPAddress())
+int NeuralynxThread::Stream::waitForBlock()
+{
+    int capacity = owner.getBlockCapacity();
+
+    if (!waitForPackets(owner.blockPolicy == BLOCK_FIXED ? capacity : 1))
     {
-        receivingData = false;
-        return false;
+        if (receiverFailed.get() == 0)
+        {
+            telemetry.timeouts.add();
+        }
+
+        bool recovering = owner.recoveryEnabled && owner.source == SOURCE_NETWORK;
+        if ((owner.lossPolicy == LOSS_STOP && !recovering) || receiverFailed.get() != 0)
+        {
+            return -1;
+        }
+
+        // timed out; pass on whatever did arrive, and only give up after a sustained outage
+        int numReady = jmin(packetRing.getNumReady(), capacity);
+        if (numReady > 0)
+        {
+            telemetry.shortBlocks.add();
+            lastPacketMs = Time::getMillisecondCounter();
+            rebindSent = false;
+            return numReady;
+        }
+
+        uint32 outageMs = Time::getMillisecondCounter() - lastPacketMs;
+        if (outageMs < uint32(owner.outageLimitMs))
+        {
+            return 0;
+        }
+        if (!recovering)
+        {
+            return -1;
+        }
+
+        // the socket may have stopped working without an error (e.g. the interface went down and up again),
+        // so have the receiver recreate it and keep waiting
+        if (!rebindSent)
+        {
+            std::cout << getLogPrefix() << "no packets for " << outageMs << " ms" << std::endl;
+            telemetry.outages.add();
+            rebindRequested = 1;
+            rebindSent = true;
+        }
+        return outageMs < uint32(owner.outageLimitMs + recoveryLimitMs) ? 0 : -1;
     }
 
-    if (socket == nullptr || ipAddress != newIP || socket->getBoundPort() != port)
+    if (owner.blockPolicy == BLOCK_DEADLINE)
     {
-        // make and bind a new socket
-        ipAddress = newIP;
-        createAndBindSocket();
+        const PacketSignal::Clock::time_point deadline = PacketSignal::Clock::now()
+            + std::chrono::microseconds(owner.deadlineUs);
 
-        if (socket == nullptr)
+        while (packetRing.getNumReady() < capacity && PacketSignal::Clock::now() < deadline)
         {
-            receivingData = false;
-            return false;
+            packetsAvailable.waitUntil(deadline);
+
+            if (receiverFailed.get() != 0)
+            {
+                return -1;
+            }
         }
     }
 
-    jassert(socket->getBoundPort() == port);
+    lastPacketMs = Time::getMillisecondCounter();
+    rebindSent = false;
+    return jmin(packetRing.getNumReady(), capacity);
+}
 
-    flushSocket();
 
-    bool update = updateBoardsAndHz.getValue();
-    updateBoardsAndHz = false;
+NeuralynxThread::Receiver::Receiver(Stream& s)
+    : Thread("Neuralynx Receiver")
+    , stream(s)
+{}
 
-    // receive a test packet and check the number of boards
-    int boards = rcvPacket();
-    bool valid = boards > 0 && packetValid(socketBuffer, boards);
 
-    if (valid && (!receivingData.getValue() || update))
+void NeuralynxThread::Receiver::run()
+{
+    stream.applyThreadTuning();
+
+    double cpuStart = getThreadCpuSeconds();
+    uint32 wallStart = Time::getMillisecondCounter();
+
+    while (!threadShouldExit())
     {
-        if (boards != numBoards)
+        int numRcvd;
+        if (stream.owner.source != SOURCE_NETWORK)
+        {
+            numRcvd = stream.replayIntoRing();
+        }
+        else if (stream.owner.receiveMode == RECEIVE_PACKET_RING)
         {
-            setNumBoards(boards);
+            numRcvd = stream.rcvIntoRingMapped();
+        }
+        else
+        {
+            // (wake up at least every timeoutMs to check whether we should exit)
+            int ready = stream.waitForSocket(timeoutMs);
+
+            numRcvd = ready > 0 ? stream.rcvIntoRing() : ready;
         }
 
-        // try to infer the sample rate by receiving samples over 100 ms
-        int numRcvd = 0;
-        uint32 stopTs = 0;
-        while (true)
+        if (numRcvd < 0)
         {
-            if (!rcvPacket(boards))
-            {
-                valid = false;
-                break;
-            }
+            stream.telemetry.socketErrors.add();
+        }
 
-            uint32 ts = ByteOrder::littleEndianInt(socketBuffer + 4); // (just lower-order 32 bits)
-            
-            if (stopTs == 0)
+        if (numRcvd < 0 || stream.rebindRequested.get() != 0)
+        {
+            bool recovering = stream.owner.recoveryEnabled && stream.owner.source == SOURCE_NETWORK;
+            if (recovering && stream.recoverSocket())
             {
-                stopTs = ts + 100000;
+                continue;
             }
-            else if (ts >= stopTs)
+            if (threadShouldExit())
             {
                 break;
             }
 
-            numRcvd++;
+            stream.receiverFailed = 1;
+            stream.packetsAvailable.signal();
+            break;
         }
 
-        if (valid)
+        if (numRcvd > 0)
         {
-            // deal with 32,768 Hz as a special case (see documentation for "-CreateHardwareSubSystem")
-            if (numRcvd >= 3239 && numRcvd <= 3338)
-            {
-                sampleRate = 32768;
-            }
-            else // must be multiple of 2000 Hz
-            {
-                float srate = float(((numRcvd + 100) / 200) * 2000);
-                jassert(srate >= 16000 && srate <= 40000); // ATLAS limits
-                sampleRate = srate;
-            }
+            stream.packetsAvailable.signal();
         }
     }
 
-    receivingData = valid;
-    return valid;
+    stream.receiverCpuSeconds = getThreadCpuSeconds() - cpuStart;
+    stream.receiverWallSeconds = (Time::getMillisecondCounter() - wallStart) / 1000.0;
 }
 
 
-bool NeuralynxThread::startAcquisition()
-{
-    updateBoardsAndHz = false;
-    firstSample = true;
-    usPerSamp = 1000000 / double(sampleRate.getValue());
-    startThread();
-    return true;
-}
+NeuralynxThread::Decoder::Decoder(Stream& s)
+    : Thread("Neuralynx Decoder")
+    , stream(s)
+{}
 
 
-bool NeuralynxThread::stopAcquisition()
+void NeuralynxThread::Decoder::run()
 {
-    bool ok = true;
-
-    if (getCurrentThread() != this) // if an acquisition error occurs, will be called from the thread
-    {
-        ok = stopThread(500);
-    }
-    else
+    while (!threadShouldExit())
     {
-        // if an error ocurred, we should refresh the socket.
-        createAndBindSocket();
+        if (!stream.decodeBlock())
+        {
+            // updateBuffer stops acquisition for every stream
+            stream.owner.streamFailed = 1;
+            break;
+        }
     }
-
-    sourceBuffers[0]->clear();
-    return ok;
 }
 
 
-int NeuralynxThread::getNumDataOutputs(DataChannel::DataChannelTypes type, int subProcessorIdx) const
+NeuralynxThread::PacketSignal::PacketSignal()
+    : isSignalled(false)
+{}
+
+
+void NeuralynxThread::PacketSignal::signal()
 {
-    if (subProcessorIdx == 0 && type == DataChannel::HEADSTAGE_CHANNEL)
     {
-        return numBoards * boardChannels;
+        std::lock_guard<std::mutex> guard(lock);
+        isSignalled = true;
     }
-    return 0;
+    signalled.notify_one();
 }
 
 
-int NeuralynxThread::getNumTTLOutputs(int subprocessorIdx) const
+void NeuralynxThread::PacketSignal::reset()
 {
-    if (subprocessorIdx == 0)
-    {
-        return 32;
-    }
-    return 0;
+    std::lock_guard<std::mutex> guard(lock);
+    isSignalled = false;
 }
 
 
-float NeuralynxThread::getSampleRate(int subprocessorIdx) const
+bool NeuralynxThread::PacketSignal::waitUntil(Clock::time_point deadline)
 {
-    if (subprocessorIdx == 0)
+    std::unique_lock<std::mutex> guard(lock);
+    if (!signalled.wait_until(guard, deadline, [this] { return isSignalled; }))
     {
-        return sampleRate.getValue();
+        return false;
     }
-    return 0;
+    isSignalled = false;
+    return true;
 }
 
 
-float NeuralynxThread::getBitVolts(const DataChannel* chan) const
+bool NeuralynxThread::PacketSignal::wait(int timeoutMs)
 {
-    // Even though technically the input to ATLAS can be in the range +/-131,072 uV,
-    // and the data sent over UDP are scaled to reflect that, the processed data are stored
-    // in the CSC files as int16s in uV, i.e. with a bit(u)volts value of 1 and range of
-    // +/-32,767 uV. Thus it should be safe to use the same bitvolts of 1 when saving data from OEP.
-    return 1;
+    return waitUntil(Clock::now() + std::chrono::milliseconds(timeoutMs));
 }
 
 
-bool NeuralynxThread::usesCustomNames() const
+void NeuralynxThread::Stream::createAndBindSocket()
 {
-    return true;
-}
+    socket = new DatagramSocket();
+
+    if (!socket->bindToPort(port, ipAddress.toString()))
+    {
+        socket = nullptr;
+        return;
+    }
 
+#if JUCE_LINUX
+    // have the kernel's drop count and arrival time attached to received packets
+    int enable = 1;
+    setsockopt(socket->getRawSocketHandle(), SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable));
+    setsockopt(socket->getRawSocketHandle(), SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable));
+#endif
 
-GenericEditor* NeuralynxThread::createEditor(SourceNode* sn)
-{
-    return new NeuralynxEditor(sn, this);
+    applySocketTuning();
 }
 
 
-String NeuralynxThread::getChannelUnits(int chanIndex) const
+bool NeuralynxThread::Stream::recoverSocket()
 {
-    return "uV";
-}
+    rebindRequested = 0;
+    std::cout << getLogPrefix() << "recreating the socket" << std::endl;
 
+    bool mapped = owner.receiveMode == RECEIVE_PACKET_RING;
+    uint32 startMs = Time::getMillisecondCounter();
 
-
-void NeuralynxThread::labelTextChanged(Label* label)
-{
-    // the only label that should trigger this is the portLabel
-    std::istringstream portInput(label->getText().toStdString());
-    uint16 newPort;
-    portInput >> newPort;
-    if (portInput.good() && newPort != 0)
-    {
-        port = newPort;
-    }
-    else
+    while (!receiver.threadShouldExit() && Time::getMillisecondCounter() - startMs < uint32(recoveryLimitMs))
     {
-        CoreServices::sendStatusMessage("Neuralynx Input: invalid port");
-        label->setText(String(port), dontSendNotification);
-    }
-}
+        // packetRing's slots point into the packet ring, so it can only be closed once they have all been decoded
+        if (mapped && packetRing.getNumReady() > 0)
+        {
+            receiver.wait(1);
+            continue;
+        }
 
+        mmapSocket.close();
+        createAndBindSocket();
+        if (socket != nullptr && (!mapped || mmapSocket.open(ipAddress.toString().toStdString(), uint16(port))))
+        {
+            // the new packet ring counts frames from 0 (and the ring is empty, so all of
+            // packetRing's slots have been read); the kernel's drop count starts over too
+            mmapReleaseBase = packetRing.getReadCount();
+            kernelDropsBefore = telemetry.kernelDrops.get();
+            kernelDropsBase = getKernelDropCount();
+
+            resyncFrom = packetRing.getWriteCount();
+            resyncRequested = 1;
+            telemetry.socketRebinds.add();
+            std::cout << getLogPrefix() << "socket recreated after " << (Time::getMillisecondCounter() - startMs)
+                << " ms" << std::endl;
+            return true;
+        }
 
-void NeuralynxThread::buttonClicked(Button* button)
-{
-    // must be the refresh button
-    if (!CoreServices::getAcquisitionStatus())
+        receiver.wait(rebindRetryMs);
+    }
+
+    if (!receiver.threadShouldExit())
     {
-        updateBoardsAndHz = true;
+        std::cout << getLogPrefix() << "could not recreate the socket within " << recoveryLimitMs << " ms"
+            << (mapped && !mmapSocket.isOpen() ? ": " + mmapSocket.getError() : std::string()) << std::endl;
     }
+    return false;
 }
 
 
-void NeuralynxThread::setDefaultChannelNames()
+void NeuralynxThread::Stream::applySocketTuning()
 {
-    for (int c = 0; c < numBoards * boardChannels; ++c)
-    {
-        ChannelCustomInfo info;
-        info.name = "CH" + String(c + 1);
-        info.gain = getBitVolts(sn->getDataChannel(c));
-        channelInfo.set(c, info);
-    }
+    int handle = socket->getRawSocketHandle();
+    setTuningResult(ReceiveTuning::RCVBUF, ReceiveTuning::setReceiveBuffer(handle, owner.tuning.rcvBufKB));
+    setTuningResult(ReceiveTuning::BUSY_POLL, ReceiveTuning::setBusyPoll(handle, owner.tuning.busyPollUs));
 }
 
 
-void NeuralynxThread::setNumBoards(int n)
+void NeuralynxThread::Stream::applyThreadTuning()
 {
-    if (CoreServices::getAcquisitionStatus() || n < minBoards || n > maxBoards)
-    {
-        jassertfalse;
-        return;
-    }
+    setTuningResult(ReceiveTuning::RT_PRIORITY, ReceiveTuning::setRealtimePriority(owner.tuning.rtPriority));
 
-    if (n == numBoards)
+    // each stream's receiver gets its own CPU, counting up from the one chosen
+    int cpu = owner.tuning.cpu;
+    if (cpu >= 0)
     {
-        return;
+        cpu = (cpu + index) % ReceiveTuning::getNumCpus();
     }
-
-    numBoards = n;
-    numBoardsValue = n;
-    sn->requestChainUpdate();
+    setTuningResult(ReceiveTuning::CPU_AFFINITY, ReceiveTuning::setCpuAffinity(cpu));
 }
 
 
-int NeuralynxThread::rcvPacket(int expectedBoards, int offsetWords)
+void NeuralynxThread::Stream::applyHelperTuning(int helper)
 {
-    if (expectedBoards > maxBoards) { return 0; }
-
-    int bytesToRead = expectedBoards > 0
-        ? wordsInPacketWithBoards(expectedBoards) * 4
-        : maxPacketSize;
-
-    if (offsetWords * 4 + bytesToRead > socketBufferSize)
+    auto log = [this, helper](ReceiveTuning::Setting setting, const ReceiveTuning::Result& result)
     {
-        jassertfalse; // overrun!!
-        return 0;
-    }
-
-    int bytesRcvd;
+        if (result.state != ReceiveTuning::NOT_REQUESTED)
+        {
+            std::cout << getLogPrefix() << "decode helper " << helper << " " << ReceiveTuning::getSettingName(setting)
+                << " " << ReceiveTuning::getStateName(result.state) << ": " << result.detail << std::endl;
+        }
+    };
 
-    // try to receive a packet until timeout is reached
-    uint32 t1 = Time::getMillisecondCounter();
-    while (Time::getMillisecondCounter() - t1 < timeoutMs &&
-           0 == (bytesRcvd = socket->read(socketBuffer + offsetWords, bytesToRead, false)));
+    log(ReceiveTuning::RT_PRIORITY, ReceiveTuning::setRealtimePriority(owner.tuning.rtPriority));
 
-    if (expectedBoards > 0)
+    // helpers get CPUs of their own, counting up after the receivers'
+    int cpu = owner.tuning.cpu;
+    if (cpu >= 0)
     {
-        return bytesRcvd == bytesToRead ? expectedBoards : 0;
+        cpu = (cpu + owner.getNumActiveStreams() + index * (owner.decodeThreads - 1) + helper - 1)
+            % ReceiveTuning::getNumCpus();
     }
+    log(ReceiveTuning::CPU_AFFINITY, ReceiveTuning::setCpuAffinity(cpu));
+}
 
-    // figure out # of boards
-    if (bytesRcvd < minPacketSize) { return 0; }
-
-    int32 reportedChans = ByteOrder::littleEndianInt(socketBuffer + offsetWords + 2) - 10;
 
-    if (reportedChans % boardChannels != 0)
+void NeuralynxThread::Stream::setTuningResult(ReceiveTuning::Setting setting, const ReceiveTuning::Result& result)
+{
+    if (index == 0)
     {
-        return 0;
+        owner.setTuningResult(setting, result, true);
     }
-
-    int boards = reportedChans / boardChannels;
-    if (bytesRcvd < wordsInPacketWithBoards(boards) * 4
-        || boards < minBoards || boards > maxBoards)
+    else if (result.state != ReceiveTuning::NOT_REQUESTED)
     {
-        return 0;
+        std::cout << getLogPrefix() << ReceiveTuning::getSettingName(setting) << " "
+            << ReceiveTuning::getStateName(result.state) << ": " << result.detail << std::endl;
     }
-
-    return boards;
 }
 
 
-bool NeuralynxThread::rcvBlock()
+void NeuralynxThread::setTuningResult(ReceiveTuning::Setting setting, const ReceiveTuning::Result& result, bool log)
 {
-    int boards = numBoards;
-    int packetLength = wordsInPacketWithBoards(boards);
-
-    for (int s = 0; s < blockSize; ++s)
+    if (log && result.state != ReceiveTuning::NOT_REQUESTED)
     {
-        if (rcvPacket(boards, s * packetLength) != boards)
-        {
-            return false;
-        }
+        std::cout << "Neuralynx Input: " << ReceiveTuning::getSettingName(setting) << " "
+            << ReceiveTuning::getStateName(result.state) << ": " << result.detail << std::endl;
     }
-    return true;
+
+    const ScopedLock lock(tuningLock);
+    tuningResults[setting] = result;
 }
 
 
-void NeuralynxThread::createAndBindSocket()
+int64 NeuralynxThread::Stream::getKernelDropCount()
 {
-    socket = new DatagramSocket();
+    if (owner.receiveMode == RECEIVE_PACKET_RING)
+    {
+        return mmapSocket.getKernelDrops();
+    }
 
-    if (!socket->bindToPort(port, ipAddress.toString()))
+#if JUCE_LINUX && defined(SO_MEMINFO)
+    uint32 meminfo[SK_MEMINFO_VARS];
+    socklen_t len = sizeof(meminfo);
+    if (getsockopt(socket->getRawSocketHandle(), SOL_SOCKET, SO_MEMINFO, meminfo, &len) == 0
+        && len > SK_MEMINFO_DROPS * sizeof(uint32))
     {
-        socket = nullptr;
+        return meminfo[SK_MEMINFO_DROPS];
     }
+#endif
+    return -1;
 }
 
 
-void NeuralynxThread::flushSocket()
+bool NeuralynxThread::Stream::updatePacketRingSocket()
 {
-    int size = 65536; // UDP buffer size
-    MemoryBlock devnull(size);
-    while (socket->read(devnull.getData(), size, false) != 0);
-}
-
+    if (owner.receiveMode != RECEIVE_PACKET_RING)
+    {
+        mmapSocket.close();
+        return true;
+    }
 
-bool NeuralynxThread::packetValid(const uint32* packet, int boards)
-{
-    // expected header values (see here: https://neuralynx.com/software/NeuralynxDataFileFormats.pdf)
-    if (ByteOrder::littleEndianInt(packet) != 2048
-        || ByteOrder::littleEndianInt(packet + 1) != 1
-        || ByteOrder::littleEndianInt(packet + 2) != boards * boardChannels + 10)
+    std::string address = ipAddress.toString().toStdString();
+    if (mmapSocket.isOpenFor(address, uint16(port)))
     {
-        return false;
+        return true;
     }
-    
-    // checksum
-    int packetLength = wordsInPacketWithBoards(boards);
 
-    uint32 crcValue = 0;
-    for (int i = 0; i < packetLength; ++i)
+    if (!mmapSocket.open(address, uint16(port)))
     {
-        crcValue ^= packet[i];
+        CoreServices::sendStatusMessage("Neuralynx Input: could not open packet ring");
+        std::cout << getLogPrefix() << mmapSocket.getError() << std::endl;
+        return false;
     }
-    
-    return crcValue == 0;
+
+    std::cout << getLogPrefix() << "receiving from a packet ring on " << mmapSocket.getInterfaceName() << std::endl;
+    return true;
 }
 
 
-int NeuralynxThread::wordsInPacketWithBoards(int numBoards)
+void NeuralynxThread::Stream::flushSocket()
 {
-    return headerWords + numBoards * boardChannels + footerWords;
-};
\ No newline at end of file
+    int size = 65536; // UDP buffer size
+    MemoryBlock devnull(size);
+    while (socket->read(devnull.getData(), size, false) != 0);
+}
@@ -18,11 +18,27 @@ Do not share this plugin with other parties who have not signed the NDA.
 #define NEURALYNX_THREAD_H_INCLUDED
 
 #include <DataThreadHeaders.h>
+#include "CaptureFile.h"
+#include "PacketKernel.h"
+#include "PacketMmapSocket.h"
+#include "PacketRing.h"
+#include "PolyphaseDecimator.h"
+#include "RawRecording.h"
+#include "ReceiveTelemetry.h"
+#include "ReceiveTuning.h"
+#include "SharedMemoryRing.h"
+#include "ShardedDecoder.h"
+#include "TimestampConverter.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 
 class NeuralynxThread 
     : public DataThread
     , public Label::Listener
     , public Button::Listener
+    , public ComboBox::Listener
 {
     friend class NeuralynxEditor;
 
@@ -39,6 +55,8 @@ public:
     bool startAcquisition() override;
     bool stopAcquisition() override;
 
+    unsigned int getNumSubProcessors() const override;
+
     int getNumDataOutputs(DataChannel::DataChannelTypes type, int subProcessorIdx) const override;
     int getNumTTLOutputs(int subprocessorIdx) const override;
 
@@ -53,53 +71,248 @@ public:
 
     void labelTextChanged(Label* label) override;
     void buttonClicked(Button* button) override;
+    void comboBoxChanged(ComboBox* comboBox) override;
+
+    // Ways of pulling packets off the socket (see rcvIntoRing)
+    enum ReceiveMode
+    {
+        RECEIVE_SINGLE = 1, // one DatagramSocket::read per packet
+        RECEIVE_BATCHED,    // Linux only: recvmmsg, as many packets per call as are queued
+        RECEIVE_PACKET_RING // Linux only: read packets in place from a memory-mapped AF_PACKET ring
+                            // (see PacketMmapSocket); also works without cloning the MAC address
+    };
+
+    static bool receiveModeAvailable(ReceiveMode mode);
+
+    // Not while acquiring. Returns false if the mode isn't available on this platform.
+    bool setReceiveMode(ReceiveMode mode);
+    ReceiveMode getReceiveMode() const;
+
+    // How to wait for packets to arrive on the socket
+    enum WaitMode
+    {
+        WAIT_SPIN = 1, // repeat non-blocking reads until something arrives (uses a full core)
+        WAIT_POLL,     // block in poll until the socket is readable
+        WAIT_HYBRID    // spin for busyPollUs, then block in poll
+    };
+
+    // Not while acquiring. Return false if the value is out of range (busyPollUs: 1 to maxBusyPollUs).
+    bool setWaitMode(WaitMode mode);
+    WaitMode getWaitMode() const;
+    bool setBusyPollUs(int us);
+    int getBusyPollUs() const;
+
+    // Average number of packets received per receive syscall during the last acquisition
+    // (including calls that returned nothing while waiting).
+    double getPacketsPerSyscall(int stream = 0) const;
+
+    // How many packets updateBuffer passes on to the DataBuffer at a time
+    enum BlockPolicy
+    {
+        BLOCK_FIXED = 1, // always wait for blockParam packets
+        BLOCK_DEADLINE,  // pass on whatever has arrived blockParam us after the first packet of the block
+        BLOCK_ADAPTIVE   // pass on everything that is waiting (at least 1, at most blockParam packets),
+                         // so blocks are small when keeping up and grow when falling behind
+    };
+
+    BlockPolicy getBlockPolicy() const;
+    void setBlockPolicy(BlockPolicy policy);
+
+    // Packet count (BLOCK_FIXED, BLOCK_ADAPTIVE) or deadline in us (BLOCK_DEADLINE) for the current policy
+    int getBlockParam() const;
+
+    // Returns false if the value is out of range for the current policy
+    bool setBlockParam(int value);
+
+    // Maximum number of packets in one block with the current policy
+    int getBlockCapacity() const;
+
+    // What to do when packets are lost
+    enum LossPolicy
+    {
+        LOSS_STOP = 1, // stop acquisition if a block can't be completed within timeoutMs
+        LOSS_HOLD,     // keep going; fill missing samples by repeating the last sample
+        LOSS_ZERO,     // keep going; fill missing samples with zeros
+        LOSS_LINEAR    // keep going; fill missing samples by linear interpolation
+    };
+
+    // Not while acquiring. Return false if the value is out of range (outage limit: timeoutMs to
+    // maxOutageLimitMs). The outage limit applies to the policies that keep going, and with recovery on.
+    bool setLossPolicy(LossPolicy policy);
+    LossPolicy getLossPolicy() const;
+    bool setOutageLimitMs(int ms);
+    int getOutageLimitMs() const;
+
+    // Fraction of one core used by a stream's receiver thread during the last acquisition
+    double getReceiverCpuUsage(int stream = 0) const;
+
+    // Mean and maximum time from a packet's arrival in the kernel until the receive call
+    // that got it returned, in microseconds (Linux only; sampled every wakeSampleInterval packets)
+    double getMeanWakeLatencyUs(int stream = 0) const;
+    double getMaxWakeLatencyUs(int stream = 0) const;
+
+    // Number of packets waiting in a stream's receive ring, and the highest number seen this acquisition
+    int getRingOccupancy(int stream = 0) const;
+    int getMaxRingOccupancy(int stream = 0) const;
+    int getRingCapacity() const;
+
+    // Number of packets dropped this acquisition because a stream's receive ring was full
+    uint64 getRingOverruns(int stream = 0) const;
+
+    // Counters for the receive and decode stages of one stream during the current/last acquisition.
+    // May be read from any thread.
+    const ReceiveTelemetry& getTelemetry(int stream = 0) const;
+
+    // Counters summed over all active streams
+    ReceiveTelemetry::Snapshot getTelemetrySnapshot() const;
+
+    // Latency histogram of one stage (a ReceiveTelemetry::LatencyStage) summed over all active streams
+    LatencyHistogram::Counts getLatencyCounts(int stage) const;
+
+    // Besides the endpoint selected in the editor (stream 0), data can be received from further
+    // amplifier systems on other local addresses/ports. Each stream has its own socket, receiver
+    // thread and subprocessor; the number of boards and sample rate are probed per stream.
+    // Only stream 0 is active while replaying.
+    int getNumStreams() const;
+    int getNumActiveStreams() const;
+
+    // Adds an endpoint (not while acquiring). Returns false if it is already in use by a stream.
+    bool addStream(const IPAddress& address, int port);
+    void removeStream(int stream); // (stream > 0)
+
+    IPAddress getStreamAddress(int stream) const;
+    int getStreamPort(int stream) const;
+    bool isStreamReceiving(int stream) const;
+
+    // Estimated offset of a stream's hardware clock from stream 0's, in microseconds (positive if
+    // its timestamps are ahead), from packets decoded during the current/last acquisition. Returns
+    // false if there is no estimate yet. May be called from any thread.
+    bool getStreamOffsetUs(int stream, int64& offsetUs) const;
+
+    // A stream's output channels can be a subset of its boards' channels in any order, given as a map
+    // of 0-based channel indices (empty = all channels in order). Channels that aren't in the map are
+    // never converted, so a subset also cuts decode time and buffer size. Indices beyond the stream's
+    // # of boards are ignored. Not while acquiring; returns false if an index repeats or is negative.
+    bool setChannelMap(int stream, const Array<int>& map);
+    const Array<int>& getChannelMap(int stream) const;
+
+    // # of channels a stream outputs with its current map and # of boards
+    int getNumOutputChannels(int stream) const;
+
+    // Channel lists as typed in the editor: 1-based numbers and ranges, e.g. "1-32, 40, 48-41"
+    // (a descending range is output in that order). Whitespace is ignored; an empty list is valid.
+    static bool parseChannelList(const String& text, Array<int>& map);
+    static String formatChannelList(const Array<int>& map);
+
+    // Optionally, each active stream also outputs a low-pass filtered copy of some of its channels, decimated
+    // by factor (e.g. 16 for 2 kHz LFP from 32 kHz), as a second subprocessor (after all the wideband ones).
+    // channels are 0-based amplifier channel numbers; those a stream doesn't output are left out of its LFP,
+    // and empty means all of its output channels. A factor of 1 turns it off. Not while acquiring; returns
+    // false if the factor is out of range or a channel repeats or is negative.
+    bool setLfp(int factor, const Array<int>& channels);
+    int getLfpFactor() const;
+    const Array<int>& getLfpChannels() const;
+
+    // Where packets come from
+    enum Source
+    {
+        SOURCE_NETWORK = 1,  // the socket
+        SOURCE_REPLAY_PACED, // a capture file, at the pace the packets were recorded
+        SOURCE_REPLAY_FAST   // a capture file, as fast as the decode stage can take them
+    };
+
+    Source getSource() const;
+
+    // Switches to replaying the given capture file, or back to the network if source is SOURCE_NETWORK
+    // (file is then ignored). Returns false and stays on the network if the file can't be opened.
+    bool setSource(Source source, const File& file = File());
+
+    // The capture file being replayed, if any
+    File getReplayFile() const;
+
+    // When enabled, every datagram received from the network during acquisition is written,
+    // with its arrival time, to a new capture file in captureDirectory.
+    void setCaptureEnabled(bool enable);
+    bool getCaptureEnabled() const;
+
+    // When enabled, the raw samples of every valid packet decoded during acquisition are compressed
+    // losslessly (see RawRecording.h) on background threads and written to a new file in captureDirectory.
+    void setRawRecordingEnabled(bool enable);
+    bool getRawRecordingEnabled() const;
+
+    // When enabled, each stream's output (with sample numbers and TTL words) is also published, as soon as
+    // each block is decoded, to a shared memory ring that other processes can read (see SharedMemoryRing.h),
+    // named by SharedMemoryRing::getStreamName. The rings exist during acquisition.
+    void setSharedMemoryEnabled(bool enable);
+    bool getSharedMemoryEnabled() const;
+
+    // Number of threads that decode each block of a stream: with more than 1, the boards of each block are
+    // split among the stream's decode thread and helper threads (see ShardedDecoder.h), which spin for
+    // busyPollUs between blocks before sleeping. Only used for streams with more than one board and no
+    // channel map. Returns false if n is out of range.
+    bool setDecodeThreads(int n);
+    int getDecodeThreads() const;
+
+    // When enabled, a stream whose socket fails, or that receives nothing for outageLimitMs (with any loss
+    // policy), recovers instead of stopping acquisition: its receiver recreates the socket, and decoding resumes
+    // with the first valid packet received after that, once it is confirmed to have the same # of boards. Sample
+    // numbers follow the hardware timestamps across the outage unless the amplifier's clock has restarted (see
+    // TimestampConverter::resync). Each outage is counted in the telemetry and marked on an extra TTL line
+    // (outageTtlLine), which is high from the first sample filled in for it (or the first one after it, if none
+    // are) through the first sample after it. Acquisition still stops if a stream hasn't resumed within
+    // recoveryLimitMs, or comes back with a different # of boards. Not while acquiring.
+    void setRecoveryEnabled(bool enable);
+    bool getRecoveryEnabled() const;
+
+    // bit of the TTL word that marks outages when recovery is enabled
+    static const int outageTtlLine = 32;
+
+    // OS-level tuning of the receive path (see ReceiveTuning.h). Socket options are applied when the
+    // socket is created (it is recreated at the start of acquisition if they have changed), and thread
+    // settings by the receiver thread each time it starts. Returns false if a value is out of range.
+    const ReceiveTuning::Settings& getTuning() const;
+    bool setTuning(const ReceiveTuning::Settings& settings);
+
+    // Whether each tuning setting took effect, for the current socket and the current/last acquisition.
+    // May be called from any thread.
+    ReceiveTuning::Result getTuningResult(ReceiveTuning::Setting setting) const;
 
 private:
     void setDefaultChannelNames() override;
 
     /*** local functions ***/
 
-    void setNumBoards(int n);
-
-    // Receive a packet, with unspecified # of boards. Blocks for a maximum of 5 ms (before it gives up).
-    // On failure, returns 0; otherwise writes the packet to socketData and returns the # of boards.
-    // Does not check the checksum.
-    // If expectedBoards is > 0, returns 0 (fails) if the # of boards does not match this input.
-    // Note that otherwise, it is possible that multiple packets will be received at once.
-    // offsetWords is the offset in 32-bit words from the start of socketBuffer to write the packet to.
-    int rcvPacket(int expectedBoards = 0, int offsetWords = 0);
-
-    // Attempts to receive blockSize packets (using the current value of numBoards).
-    // Returns true on success, false on failure.
-    bool rcvBlock();
+    // Sum of numBoards over the active streams, for numBoardsValue
+    void updateNumBoardsValue();
 
-    // Attempts to (re)create the socket, destroying one if it already exists.
-    void createAndBindSocket();
+    // Waits for a probe started by foundInputSource to finish, and discards its results
+    void stopProbe();
 
-    void flushSocket();
+    // Kernel arrival time from a SO_TIMESTAMPNS control message if present, otherwise the current time
+    // (ns since the Unix epoch)
+    static uint64 getArrivalNs(const void* msgHdr);
 
-    // Check the header fields and checksum of the given packet (with specified # of boards)
-    static bool packetValid(const uint32* packet, int boards);
-
-    static int wordsInPacketWithBoards(int numBoards);
+    void setTuningResult(ReceiveTuning::Setting setting, const ReceiveTuning::Result& result, bool log);
 
     /*** constants ***/
 
     static const int atlasMaxInputUv = 131072;
     static const float atlasRawBitVolts; // for conversion from raw data (24-bit precision) to uV
 
-    static const int minBoards = 1;
-    static const int maxBoards = 16;
+    static const int minBoards = PacketKernel::minBoards;
+    static const int maxBoards = PacketKernel::maxBoards;
 
-    static const int headerWords = 17;
-    static const int boardChannels = 32;
-    static const int footerWords = 1;
+    static const int boardChannels = PacketKernel::boardChannels;
 
     static const int maxChannels = boardChannels * maxBoards;
-    const int minPacketSize = wordsInPacketWithBoards(minBoards) * 4;
-    const int maxPacketSize = wordsInPacketWithBoards(maxBoards) * 4;
+    const int minPacketSize = PacketKernel::wordsInPacketWithBoards(minBoards) * 4;
+    const int maxPacketSize = PacketKernel::wordsInPacketWithBoards(maxBoards) * 4;
+
+    static const int defaultBlockPackets = 20;
+    static const int maxBlockPackets = 256;
 
-    static const int blockSize = 20;
+    static const int defaultDeadlineUs = 500;
+    static const int maxDeadlineUs = 100000;
 
     static const uint16 defaultPort = 26090;
 
@@ -107,34 +320,452 @@ private:
 
     static const int timeoutMs = 50;
 
+    // packets that can be queued between the receive and decode stages (~100 ms at 40 kHz)
+    static const int ringPackets = 4096;
+
+    // maximum number of packets taken from the socket in one recvmmsg call
+    static const int maxBatch = 64;
+
+    static const int defaultBusyPollUs = 50;
+    static const int maxBusyPollUs = 1000;
+
+    static const int wakeSampleInterval = 64;
+
+    static const int defaultOutageLimitMs = 1000;
+    static const int maxOutageLimitMs = 60000;
+
+    // how long a stream may take to resume after a socket error or outage, with recovery enabled
+    static const int recoveryLimitMs = 10000;
+
+    // time between attempts to recreate a socket
+    static const int rebindRetryMs = 100;
+
+    // how far the first packet after an outage may be from where the local clock says it should be
+    // before the amplifier's clock is taken to have restarted
+    static const int resyncToleranceMs = 500;
+
+    // longest gap that will be filled in (longer ones are partially filled)
+    static const int maxGapFill = srcBufferSize / 2;
+
+    // packets whose timestamps the sample rate is inferred from (2-4 ms' worth)
+    static const int ratePackets = 64;
+
+    // samples each shared memory ring holds (0.4 s at 40 kHz; 34 MB with 16 boards)
+    static const int sharedRingSamples = 16384;
+
+    // how long foundInputSource waits for a probe before returning the previous result
+    static const int probeWaitMs = 20;
+
+    static const int defaultLfpFactor = 16;
+
     /*** state ***/
 
-    // Each board has 32 channels. Determined in foundInputSource.
-    int numBoards;
+    // total # of boards over the active streams (for the editor)
     Value numBoardsValue;
 
-    // Determined in foundInputSource.
+    // of stream 0. Determined in foundInputSource.
     Value sampleRate;
 
     Value updateBoardsAndHz;
 
-    // for use while thread is running
-    bool firstSample;
-    uint64 tsOffset;
-    double usPerSamp;
+    ReceiveMode receiveMode;
+    WaitMode waitMode;
+    int busyPollUs;
 
-    ScopedPointer<DatagramSocket> socket;
-    IPAddress ipAddress;
-    int port;
+    BlockPolicy blockPolicy;
+    int fixedBlockPackets;
+    int deadlineUs;
+    int adaptiveMaxPackets;
 
-    Value receivingData;
+    LossPolicy lossPolicy;
+    int outageLimitMs;
 
-    const int socketBufferSize = blockSize * maxPacketSize;
-    const HeapBlock<uint32> socketBuffer{ socketBufferSize / sizeof(uint32) };
-
-    const HeapBlock<float> thisBlock{ blockSize * maxChannels };
+    // whether every active stream is receiving
+    Value receivingData;
 
-    uint64 invalidPackets; // keep track, maybe for debugging
+    Source source;
+
+    // capture file being replayed (open while source is not SOURCE_NETWORK)
+    CaptureFile::Reader replayReader;
+    CaptureFile::Record replayNext;
+    bool replayNextValid;
+    bool replayFinished;
+    int64 replayStartTicks;
+    uint64 replayFirstNs;
+
+    bool captureEnabled;
+    bool rawRecording;
+    bool sharedMemory;
+    int decodeThreads;
+    bool recoveryEnabled;
+    File captureDirectory;
+
+    ReceiveTuning::Settings tuning;
+
+    // see setLfp (1 = no LFP subprocessors)
+    int lfpFactor;
+    Array<int> lfpChannels;
+
+    CriticalSection tuningLock;
+    ReceiveTuning::Result tuningResults[ReceiveTuning::numSettings];
+
+    class Stream;
+
+    // Probes the active streams for foundInputSource, so that the message thread isn't blocked
+    // while waiting for packets
+    class Prober : public Thread
+    {
+    public:
+        Prober(NeuralynxThread& owner);
+        void run() override;
+
+    private:
+        NeuralynxThread& owner;
+    };
+
+    Prober prober;
+
+    // whether the probe should re-infer sample rates that are already known (refresh button)
+    bool probeUpdate;
+
+    // set by the prober when it has probed every stream
+    Atomic<int> probeFinished;
+
+    // Drains a stream's socket into its packetRing while acquisition is running, so that
+    // the kernel queue keeps emptying even if decoding or the DataBuffer stalls.
+    class Receiver : public Thread
+    {
+    public:
+        Receiver(Stream& stream);
+        void run() override;
+
+    private:
+        Stream& stream;
+    };
+
+    // Decode stage for streams other than stream 0 (whose blocks are decoded by updateBuffer)
+    class Decoder : public Thread
+    {
+    public:
+        Decoder(Stream& stream);
+        void run() override;
+
+    private:
+        Stream& stream;
+    };
+
+    // Tells the decode stage that packets have arrived. Like an auto-reset WaitableEvent, but waits
+    // to the steady clock's resolution instead of whole milliseconds (for sub-ms block deadlines).
+    class PacketSignal
+    {
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        PacketSignal();
+
+        void signal();
+        void reset();
+
+        // Waits until signalled or until the deadline, and returns whether it was signalled (clearing the signal)
+        bool waitUntil(Clock::time_point deadline);
+        bool wait(int timeoutMs);
+
+    private:
+        std::mutex lock;
+        std::condition_variable signalled;
+        bool isSignalled;
+    };
+
+    // Everything belonging to one endpoint, from its socket to its DataBuffer
+    class Stream
+    {
+    public:
+        Stream(NeuralynxThread& owner, int index, const IPAddress& address, int port);
+        ~Stream();
+
+        // Runs on the prober thread: creates the socket if necessary and receives from it (or from the
+        // capture file, for stream 0 when replaying) to find the # of boards and, if not known yet or
+        // update is true, the sample rate (from the timestamps of ratePackets packets). The results are
+        // stored in probedBoards etc. until applyProbe is called on the message thread.
+        void probe(bool update);
+        void applyProbe();
+
+        // Prepares for acquisition and starts the receiver (and for streams other than 0, decoder) thread.
+        // Returns false if the socket can't be set up.
+        bool start();
+
+        // Stops the threads, unless called from one of them. Returns false if one didn't stop in time.
+        bool stop();
+
+        // Prints the statistics of the last acquisition
+        void report() const;
+
+        // Decode stage: decodes the next block from packetRing into the stream's DataBuffer.
+        // Returns false on failure (see waitForBlock).
+        bool decodeBlock();
+
+        void setNumBoards(int n);
+        void setSampleRate(float rate);
+
+        // Builds gather and gatherTable from channelMap and numBoards, and lfpGather from those and the
+        // owner's LFP channels
+        void updateGather();
+        void updateChannelGather();
+        void updateLfpGather(); // (also sets up decimator)
+        int getNumOutputChannels() const;
+        int getNumLfpChannels() const; // (0 if LFP is off)
+
+        // Receive a packet, with unspecified # of boards. Blocks for a maximum of timeoutMs (before it gives up).
+        // On failure, returns 0; otherwise writes the packet to socketBuffer and returns the # of boards.
+        // Does not check the checksum.
+        // If expectedBoards is > 0, returns 0 (fails) if the # of boards does not match this input.
+        // Note that otherwise, it is possible that multiple packets will be received at once.
+        int rcvPacket(int expectedBoards = 0);
+
+        // Receive stage (runs on the receiver thread): copies whatever packets are available into
+        // free slots of packetRing without inspecting them, or discards them if the ring is full.
+        // Returns the number of packets received (possibly 0), or -1 on a socket error.
+        int rcvIntoRing();
+
+        // rcvIntoRing implementation for RECEIVE_BATCHED: receives directly into up to maxBatch
+        // ring slots with one recvmmsg call.
+        int rcvIntoRingBatched(int numFree);
+
+        // rcvIntoRing implementation for RECEIVE_PACKET_RING (waits by itself): publishes packets in
+        // mmapSocket's ring to packetRing without copying them, and hands blocks of the ring back
+        // to the kernel once the decode stage has released all of their packets.
+        int rcvIntoRingMapped();
+
+        // Waits until the socket is readable according to waitMode, for up to timeoutMs.
+        // Returns 1 if it is (or in WAIT_SPIN mode, where the caller's reads do the waiting),
+        // 0 on timeout and -1 on error.
+        int waitForSocket(int timeoutMs);
+
+        // Runs on the receiver thread after a socket error or when the decode stage asks for it (rebindRequested):
+        // recreates the socket (and packet ring), retrying every rebindRetryMs for up to recoveryLimitMs, and has
+        // the decode stage resync on the packets received after that. Returns false if it couldn't.
+        bool recoverSocket();
+
+        // Samples the kernel arrival time of the last packet received (if supported)
+        // and adds it to the wake-up latency statistics.
+        void sampleWakeLatency();
+        void addWakeLatency(double latencyUs);
+
+        // Linux only: receives one datagram with recvmsg to read the kernel's drop count (SO_RXQ_OVFL)
+        // and arrival time (SO_TIMESTAMPNS) along with it. Otherwise the same as a non-blocking
+        // DatagramSocket::read, and arrivalNs is the time it returns.
+        int rcvWithDropCount(void* dest, int maxBytes, uint64& arrivalNs);
+
+        // Updates telemetry.kernelDrops from a SO_RXQ_OVFL control message, if present
+        void updateKernelDrops(const void* msgHdr);
+
+        // Writes a received packet to the capture file, if capturing
+        void capturePacket(const void* packet, int bytes, uint64 arrivalNs);
+
+        // Receive stage when replaying (stream 0 only): copies the next records of the capture file into
+        // packetRing, waiting for them to be due in SOURCE_REPLAY_PACED. Never drops packets, so the decoded
+        // output only depends on the file. Returns the number of packets copied (possibly 0).
+        int replayIntoRing();
+
+        // Linux only: total number of packets the kernel has dropped for the socket (or the packet
+        // ring in RECEIVE_PACKET_RING mode), or -1 if unavailable
+        int64 getKernelDropCount();
+
+        // Decode stage: waits until at least n packets are in packetRing. Returns false if no new
+        // packet arrived for timeoutMs or if the receiver thread has failed.
+        bool waitForPackets(int n);
+
+        // Decode stage: waits for the next block according to blockPolicy. Returns the number of packets
+        // to decode, or -1 on failure (see waitForPackets). If lossPolicy is not LOSS_STOP, a timeout
+        // only counts as a failure once no packets have arrived for outageLimitMs; until then,
+        // whatever has arrived is returned (possibly 0 packets).
+        int waitForBlock();
+
+        // Sizes thisBlock, timestamps, ttlEventWords, ttlChanges, ttlEdges and arrivals (and the LFP block) for the
+        // current policy and # of boards
+        void resizeBlockBuffers();
+
+        // Passes the first numSamples samples of thisBlock to the DataBuffer, and their decimated
+        // LFP channels (if any) to the LFP one, counts their TTL edges and saves the last one in lastSample.
+        // Returns the new # of samples in thisBlock (0).
+        int flushBlock(int numSamples);
+
+        // Records the latency of each of the first numSamples samples of thisBlock that has an arrival
+        // time, given when its block started decoding and when it was handed to the DataBuffer
+        void recordLatency(int numSamples, uint64 handoffStartNs, uint64 deliveredNs);
+
+        // Fills the gap between the last sample passed on (lastTs) and the sample that was just decoded
+        // into row sOut of thisBlock, which has timestamp ts, according to lossPolicy. Flushes thisBlock
+        // as necessary and returns the row that now holds the decoded sample.
+        int fillGap(int sOut, int64 ts);
+
+        // Adds the hardware timestamp (us) of a packet that was just decoded to the clock offset
+        // and drift estimates
+        void updateClockOffset(int64 hardwareUs);
+
+        // Decode stage: whether the packet at offset sIn of packetRing is the first one to check after a recovery
+        bool isResyncPoint(int sIn) const;
+
+        // Decode stage: returns the sample number of the first valid packet after a recovery, given its hardware
+        // timestamp (us), continuing from the last sample passed on, and starts marking the outage
+        int64 resync(uint64 hardwareUs);
+
+        // Attempts to (re)create the socket, destroying one if it already exists.
+        void createAndBindSocket();
+
+        // Apply the socket and thread parts of tuning and record the results (applyThreadTuning
+        // runs on the receiver thread). Only stream 0's results are recorded; the others are logged.
+        void applySocketTuning();
+        void applyThreadTuning();
+
+        // Applies the thread parts of tuning on one of shardedDecoder's helper threads (1..) and logs the results
+        void applyHelperTuning(int helper);
+
+        void setTuningResult(ReceiveTuning::Setting setting, const ReceiveTuning::Result& result);
+
+        // Opens mmapSocket for ipAddress and port in RECEIVE_PACKET_RING mode (if it isn't already)
+        // or closes it otherwise. Returns false if it can't be opened.
+        bool updatePacketRingSocket();
+
+        void flushSocket();
+
+        // prefix for console messages
+        String getLogPrefix() const;
+
+        NeuralynxThread& owner;
+        int index; // position in streams, and subprocessor index
+
+        // Each board has 32 channels. Determined in probe.
+        int numBoards;
+        float sampleRate;
+        bool receiving;
+
+        // results of the last probe
+        int probedBoards;
+        float probedRate; // 0 if not measured
+        bool probedValid;
+
+        // for use while thread is running (also estimates the hardware clock's offset and drift)
+        TimestampConverter tsConverter;
+
+        // decoder specialized for numBoards
+        PacketKernel::Decoder decoder;
+
+        // requested output channels (see setChannelMap), and the ones of them that exist with numBoards,
+        // which are gathered from each packet by gatherDecoder (empty = decode all channels)
+        Array<int> channelMap;
+        Array<int> gather;
+        PacketKernel::GatherTable gatherTable;
+        PacketKernel::GatherDecoder gatherDecoder;
+
+        // positions in a decoded sample of the channels that are decimated for the LFP subprocessor
+        Array<int> lfpGather;
+        PolyphaseDecimator decimator;
+
+        // last sample passed on, for filling gaps (output channels)
+        int64 lastTs;
+        uint32 lastTtl;
+        const HeapBlock<float> lastSample{ maxChannels };
+        const HeapBlock<float> gapEndSample{ maxChannels };
+        uint32 lastPacketMs;
+        uint32 lastSampleMs; // when the last block with valid packets was decoded
+
+        ScopedPointer<DatagramSocket> socket;
+        IPAddress ipAddress;
+        int port;
+
+        // open in RECEIVE_PACKET_RING mode (the socket above stays bound, so the port remains in use)
+        PacketMmapSocket mmapSocket;
+        uint64 mmapReleaseBase; // packetRing's read count when mmapSocket was last opened or flushed
+
+        // receive statistics, reset at the start of each acquisition
+        double receiverCpuSeconds;
+        double receiverWallSeconds;
+
+        uint64 wakeLatencySamples;
+        double wakeLatencySumUs;
+        double wakeLatencyMaxUs;
+
+        File captureFile;
+        CaptureFile::Writer captureWriter;
+
+        File rawFile;
+        RawRecording::Writer rawWriter;
+
+        SharedMemoryRing::Writer sharedRing;
+
+        // used while probing the input and for discarding packets
+        const int socketBufferSize = owner.maxPacketSize;
+        const HeapBlock<uint32> socketBuffer{ socketBufferSize / sizeof(uint32) };
+
+        Receiver receiver;
+        Decoder decodeThread;
+
+        // receive stage -> decode stage
+        PacketRing packetRing{ ringPackets, socketBufferSize };
+        PacketSignal packetsAvailable;
+        Atomic<int> receiverFailed;
+
+        // recovery (see setRecoveryEnabled): the decode stage sets rebindRequested once an outage reaches
+        // outageLimitMs; after recreating the socket, the receiver sets resyncFrom to the number of packets
+        // written to packetRing before the new socket's, and then resyncRequested
+        Atomic<int> rebindRequested;
+        Atomic<int> resyncRequested;
+        uint64 resyncFrom;
+
+        // (decode stage) the next valid packet from resyncFrom on is to be resynced; rebindRequested has been
+        // set for the current outage; TTL bits added to the samples filled in for an outage and the one after it
+        bool resyncing;
+        bool rebindSent;
+        uint64 outageMark;
+
+        // sized by resizeBlockBuffers
+        HeapBlock<float> thisBlock;
+        Array<int64> timestamps;
+        Array<uint64> ttlEventWords;
+        HeapBlock<int> ttlChanges; // (positions in ttlEventWords)
+        HeapBlock<SharedMemoryRing::TtlEdge> ttlEdges; // (the changes, for sharedRing)
+        HeapBlock<uint64> arrivals; // (receive time of each sample's packet in ns, 0 if unknown or filled)
+
+        // board-sharded decoding (running during acquisition if decodeThreads > 1 applies to this stream):
+        // each block is decoded into rows 0.. of thisBlock, which are then moved into place; the rest of a
+        // block is moved to shardSpill if a gap has to be filled first
+        ShardedDecoder shardedDecoder;
+        HeapBlock<const uint32_t*> shardPackets;
+        HeapBlock<bool> shardValid;
+        HeapBlock<float> shardSpill;
+
+        // wall-clock time (ns, as for arrivals) that decoding of the current block started
+        uint64 decodeStartNs;
+
+        // TTL word of the last sample passed on
+        uint64 flushedTtl;
+
+        // decimator output, for the LFP DataBuffer (which gets no TTL events)
+        HeapBlock<float> lfpBlock;
+        Array<int64> lfpTimestamps;
+        Array<uint64> lfpTtlWords;
+
+        // counters for both stages, reset at the start of each acquisition
+        ReceiveTelemetry telemetry;
+
+        // kernel drop count at the start of acquisition or when the socket was recreated (-1 if it couldn't be
+        // read), and the drops counted on sockets replaced during this acquisition
+        int64 kernelDropsBase;
+        uint64 kernelDropsBefore;
+
+        // last clock offset estimate from tsConverter, for other threads. Local time is the
+        // steady clock, so estimates are comparable between streams.
+        Atomic<int64> clockOffsetUs;
+        Atomic<int> clockOffsetValid;
+
+        JUCE_DECLARE_NON_COPYABLE(Stream);
+    };
+
+    OwnedArray<Stream> streams;
+
+    // set by a decoder thread that has failed, so that updateBuffer stops acquisition
+    Atomic<int> streamFailed;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(NeuralynxThread);
 };
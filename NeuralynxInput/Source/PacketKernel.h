@@ -0,0 +1,865 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+We hope that this plugin will be useful to others, but its source code
+and functionality are subject to a non-disclosure agreement (NDA) with
+Neuralynx, Inc. If you or your institution have not signed the appropriate
+NDA, STOP and do not read or execute this plugin until you have done so.
+Do not share this plugin with other parties who have not signed the NDA.
+
+*/
+
+#ifndef PACKET_KERNEL_H_INCLUDED
+#define PACKET_KERNEL_H_INCLUDED
+
+// Header-only and does not depend on JUCE, so it can also be used by tools outside the plugin.
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PACKET_KERNEL_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define PACKET_KERNEL_TARGET_AVX2
+#define PACKET_KERNEL_TARGET_SSE2
+#else
+#define PACKET_KERNEL_TARGET_AVX2 __attribute__((target("avx2")))
+#define PACKET_KERNEL_TARGET_SSE2 __attribute__((target("sse2")))
+#endif
+#else
+#define PACKET_KERNEL_X86 0
+#endif
+
+/*
+ * Framing and fused validate + decode for Digital Lynx SX / ATLAS UDP packets.
+ * In one pass over the packet, the decoders check the XOR checksum and convert the 32-bit
+ * little-endian samples to float. Each one is a template on the number of boards, so its loops
+ * have a fixed length; a table per instruction set maps board counts to instantiations.
+ * The vectorized implementations (SSE2, AVX2) are chosen at runtime according to the CPU,
+ * and give bit-identical results to the scalar one. Gather decoders do the same for a subset
+ * of the channels, in any order.
+ */
+class PacketKernel
+{
+public:
+    /*** packet layout (see https://neuralynx.com/software/NeuralynxDataFileFormats.pdf) ***/
+
+    static const int headerWords = 17;
+    static const int boardChannels = 32;
+    static const int footerWords = 1;
+
+    static const int minBoards = 1;
+    static const int maxBoards = 16;
+
+    static int wordsInPacketWithBoards(int numBoards)
+    {
+        return headerWords + numBoards * boardChannels + footerWords;
+    }
+
+    static uint32_t readWord(const uint32_t* packet, int index)
+    {
+        return littleEndian(packet[index]);
+    }
+
+    // Hardware timestamp in microseconds
+    static uint64_t readTimestamp(const uint32_t* packet)
+    {
+        return (uint64_t(readWord(packet, 3)) << 32) | readWord(packet, 4);
+    }
+
+    // Parallel input port (TTL) word
+    static uint32_t readTtl(const uint32_t* packet)
+    {
+        return readWord(packet, 6);
+    }
+
+    // Number of boards the header says the packet has, or 0 if that is not a valid number
+    static int readNumBoards(const uint32_t* packet)
+    {
+        int32_t reportedChans = int32_t(readWord(packet, 2)) - 10;
+        int boards = reportedChans / boardChannels;
+        if (reportedChans % boardChannels != 0 || boards < minBoards || boards > maxBoards)
+        {
+            return 0;
+        }
+        return boards;
+    }
+
+    // Checks the fixed header fields for a packet with the given # of boards
+    static bool headerValid(const uint32_t* packet, int boards)
+    {
+        return readWord(packet, 0) == 2048 // STX
+            && readWord(packet, 1) == 1    // packet ID
+            && readWord(packet, 2) == uint32_t(boards * boardChannels + 10);
+    }
+
+    // Checks the header and checksum without decoding
+    static bool packetValid(const uint32_t* packet, int boards)
+    {
+        if (!headerValid(packet, boards))
+        {
+            return false;
+        }
+
+        uint32_t crcValue = 0;
+        for (int i = 0, n = wordsInPacketWithBoards(boards); i < n; ++i)
+        {
+            crcValue ^= packet[i];
+        }
+        return crcValue == 0;
+    }
+
+    // Checks the checksum of a packet with a fixed # of boards and converts its samples to float,
+    // multiplied by scale, into out[0 .. boards * boardChannels), even if the checksum fails.
+    // Returns whether the checksum is valid. The header is not checked.
+    typedef bool (*Decoder)(const uint32_t* packet, float scale, float* out);
+
+    // Fastest decoder on this CPU for the given # of boards, or null if it is out of range
+    static Decoder getDecoder(int boards)
+    {
+        return lookUp(getBestTable(), boards);
+    }
+
+    // Name of the instruction set getDecoder uses on this CPU
+    static const char* getImplementationName()
+    {
+        return getBestTable() == getAVX2Table() ? "AVX2"
+            : getBestTable() == getSSE2Table() ? "SSE2"
+            : "scalar";
+    }
+
+    // Whether the instruction sets used by the vectorized implementations are supported on this CPU/build
+    // (also for other kernels, which can use PACKET_KERNEL_TARGET_SSE2/AVX2 in the same way)
+    static bool supportsSSE2() { return getSSE2Table() != nullptr; }
+    static bool supportsAVX2() { return getAVX2Table() != nullptr; }
+
+    // Individual implementations; null if boards is out of range or the instruction set
+    // is not supported on this CPU/build
+    static Decoder getScalar(int boards) { return lookUp(getScalarTable(), boards); }
+    static Decoder getSSE2(int boards)   { return lookUp(getSSE2Table(), boards); }
+    static Decoder getAVX2(int boards)   { return lookUp(getAVX2Table(), boards); }
+
+    /*** board slices ***/
+
+    // Converts the samples of numBoards consecutive boards of a packet (samples points at the first channel
+    // of the first one) to float, multiplied by scale, into out[0 .. numBoards * boardChannels), and returns
+    // the XOR of their words. For decoding the boards of a packet separately, e.g. on several threads: the
+    // packet's checksum is valid if headerFooterXor and the results for all of its boards XOR to 0.
+    typedef uint32_t (*BoardDecoder)(const uint32_t* samples, int numBoards, float scale, float* out);
+
+    // Fastest board decoder on this CPU
+    static BoardDecoder getBoardDecoder()
+    {
+        static const BoardDecoder best = getAVX2BoardDecoder() != nullptr ? getAVX2BoardDecoder()
+            : getSSE2BoardDecoder() != nullptr ? getSSE2BoardDecoder()
+            : getScalarBoardDecoder();
+        return best;
+    }
+
+    // Specific implementations, for testing (null if not supported on this CPU)
+    static BoardDecoder getScalarBoardDecoder() { return &Scalar::decodeBoards; }
+    static BoardDecoder getSSE2BoardDecoder()   { return getSSE2Table() != nullptr ? getSSE2BoardDecoderUnchecked() : nullptr; }
+    static BoardDecoder getAVX2BoardDecoder()   { return getAVX2Table() != nullptr ? getAVX2BoardDecoderUnchecked() : nullptr; }
+
+    // XOR of the header and footer words of a packet with the given # of boards (the part of the
+    // checksum that isn't samples)
+    static uint32_t headerFooterXor(const uint32_t* packet, int boards)
+    {
+        const int numChans = boards * boardChannels;
+        uint32_t crcValue = 0;
+        for (int i = 0; i < headerWords; ++i)
+        {
+            crcValue ^= packet[i];
+        }
+        for (int i = 0; i < footerWords; ++i)
+        {
+            crcValue ^= packet[headerWords + numChans + i];
+        }
+        return crcValue;
+    }
+
+    /*** channel subsets ***/
+
+    // Moves a channel of the packet (or gatherBlock consecutive channels) to an output position
+    struct GatherMove
+    {
+        int channel;
+        int output;
+    };
+
+    static const int gatherBlock = 8;
+
+    // A channel map (indices into a packet's channels, in output order) compiled for decodeGather:
+    // runs of gatherBlock ascending channels are converted with vector instructions, and the rest
+    // one at a time. Each kind is a flat list, so the loops over them don't branch per channel.
+    struct GatherTable
+    {
+        std::vector<GatherMove> blocks;
+        std::vector<GatherMove> singles;
+        int numOutputs = 0;
+    };
+
+    static void makeGatherTable(const int* channels, int numChannels, GatherTable& table)
+    {
+        table.blocks.clear();
+        table.singles.clear();
+        table.numOutputs = numChannels;
+
+        int i = 0;
+        while (i < numChannels)
+        {
+            int run = 1;
+            while (run < gatherBlock && i + run < numChannels && channels[i + run] == channels[i] + run)
+            {
+                ++run;
+            }
+
+            if (run == gatherBlock)
+            {
+                table.blocks.push_back({ channels[i], i });
+                i += gatherBlock;
+            }
+            else
+            {
+                table.singles.push_back({ channels[i], i });
+                ++i;
+            }
+        }
+    }
+
+    // Like a Decoder, but converts only the channels in table into out[0 .. table.numOutputs).
+    // The checksum still covers the whole packet, but the channels that aren't needed are not
+    // converted or stored. The header is not checked.
+    typedef bool (*GatherDecoder)(const uint32_t* packet, int boards, const GatherTable& table,
+        float scale, float* out);
+
+    // Fastest gather decoder on this CPU
+    static GatherDecoder getGatherDecoder()
+    {
+        static const GatherDecoder best = getBestGatherDecoder();
+        return best;
+    }
+
+    static bool decodeGather(const uint32_t* packet, int boards, const GatherTable& table, float scale, float* out)
+    {
+        return getGatherDecoder()(packet, boards, table, scale, out);
+    }
+
+    // Specific implementations, for testing (null if not supported on this CPU)
+    static GatherDecoder getScalarGather() { return &Scalar::decodeGather; }
+    static GatherDecoder getSSE2Gather()   { return getSSE2Table() != nullptr ? getSSE2GatherUnchecked() : nullptr; }
+    static GatherDecoder getAVX2Gather()   { return getAVX2Table() != nullptr ? getAVX2GatherUnchecked() : nullptr; }
+
+    /*** TTL edges ***/
+
+    // Finds the positions i in [0, n) where words[i] differs from the word before it (previous, for i = 0),
+    // e.g. the samples of a block of per-sample TTL words at which an input changed. Writes them to changes
+    // (room for n) and returns how many there are. Runs of unchanged words are skipped a vector at a time.
+    typedef int (*ChangeFinder)(const uint64_t* words, int n, uint64_t previous, int* changes);
+
+    static int findChanges(const uint64_t* words, int n, uint64_t previous, int* changes)
+    {
+        static const ChangeFinder best = getBestChangeFinder();
+        return best(words, n, previous, changes);
+    }
+
+    // Specific implementations, for testing (null if not supported on this CPU)
+    static ChangeFinder getScalarChangeFinder() { return &Scalar::findChanges; }
+    static ChangeFinder getSSE2ChangeFinder()   { return getSSE2Table() != nullptr ? getSSE2ChangeFinderUnchecked() : nullptr; }
+    static ChangeFinder getAVX2ChangeFinder()   { return getAVX2Table() != nullptr ? getAVX2ChangeFinderUnchecked() : nullptr; }
+
+    // Checks the header and checksum of packet and decodes it (see Decoder), looking up the decoder
+    // for the # of boards each time. If the # of boards is known in advance, calling the result of
+    // getDecoder after checking headerValid avoids the lookup.
+    static bool validateAndDecode(const uint32_t* packet, int boards, float scale, float* out)
+    {
+        Decoder decoder = getDecoder(boards);
+        return decoder != nullptr && headerValid(packet, boards) && decoder(packet, scale, out);
+    }
+
+private:
+    typedef Decoder Table[maxBoards + 1]; // indexed by # of boards
+
+    static uint32_t littleEndian(uint32_t word)
+    {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return ((word & 0xff) << 24) | ((word & 0xff00) << 8) | ((word >> 8) & 0xff00) | (word >> 24);
+#else
+        return word;
+#endif
+    }
+
+    static Decoder lookUp(const Decoder* table, int boards)
+    {
+        return table != nullptr && boards >= minBoards && boards <= maxBoards ? table[boards] : nullptr;
+    }
+
+    /*** implementations ***/
+
+    // (each implementation XORs in the header and footer words with headerFooterXor; only the samples differ)
+
+    struct Scalar
+    {
+        template <int Boards>
+        static bool decode(const uint32_t* packet, float scale, float* out)
+        {
+            const int numChans = Boards * boardChannels;
+            const uint32_t* samples = packet + headerWords;
+
+            uint32_t crcValue = headerFooterXor(packet, Boards);
+            for (int c = 0; c < numChans; ++c)
+            {
+                crcValue ^= samples[c];
+                out[c] = toFloat(samples[c], scale);
+            }
+
+            return crcValue == 0;
+        }
+
+        static uint32_t decodeBoards(const uint32_t* samples, int numBoards, float scale, float* out)
+        {
+            uint32_t crcValue = 0;
+            for (int c = 0, numChans = numBoards * boardChannels; c < numChans; ++c)
+            {
+                crcValue ^= samples[c];
+                out[c] = toFloat(samples[c], scale);
+            }
+            return crcValue;
+        }
+
+        static float toFloat(uint32_t word, float scale)
+        {
+            int32_t sample;
+            word = littleEndian(word);
+            std::memcpy(&sample, &word, sizeof(sample));
+            return sample * scale;
+        }
+
+        // 64 bits at a time (the order of the words doesn't matter)
+        static uint32_t xorSamples(const uint32_t* samples, int numChans)
+        {
+            uint64_t crc0 = 0;
+            uint64_t crc1 = 0;
+            for (int c = 0; c < numChans; c += 4)
+            {
+                uint64_t v0, v1;
+                std::memcpy(&v0, samples + c, sizeof(v0));
+                std::memcpy(&v1, samples + c + 2, sizeof(v1));
+                crc0 ^= v0;
+                crc1 ^= v1;
+            }
+            crc0 ^= crc1;
+            return uint32_t(crc0) ^ uint32_t(crc0 >> 32);
+        }
+
+        static bool decodeGather(const uint32_t* packet, int boards, const GatherTable& table,
+            float scale, float* out)
+        {
+            const int numChans = boards * boardChannels;
+            const uint32_t* samples = packet + headerWords;
+            for (const GatherMove& move : table.blocks)
+            {
+                for (int c = 0; c < gatherBlock; ++c)
+                {
+                    out[move.output + c] = toFloat(samples[move.channel + c], scale);
+                }
+            }
+            for (const GatherMove& move : table.singles)
+            {
+                out[move.output] = toFloat(samples[move.channel], scale);
+            }
+
+            return (xorSamples(samples, numChans) ^ headerFooterXor(packet, boards)) == 0;
+        }
+
+        static int findChanges(const uint64_t* words, int n, uint64_t previous, int* changes)
+        {
+            return findChangesFrom(0, words, n, previous, changes, 0);
+        }
+
+        // (also finishes the vectorized versions, from word i)
+        static int findChangesFrom(int i, const uint64_t* words, int n, uint64_t previous, int* changes, int numChanges)
+        {
+            for (; i < n; ++i)
+            {
+                if (words[i] != (i > 0 ? words[i - 1] : previous))
+                {
+                    changes[numChanges++] = i;
+                }
+            }
+            return numChanges;
+        }
+    };
+
+#if PACKET_KERNEL_X86
+
+    // (x86 is little-endian, so no byte swapping is needed in the vectorized versions)
+
+    struct SSE2
+    {
+        template <int Boards>
+        PACKET_KERNEL_TARGET_SSE2
+        static bool decode(const uint32_t* packet, float scale, float* out)
+        {
+            const int numChans = Boards * boardChannels;
+            const uint32_t* samples = packet + headerWords;
+            const __m128 scaleV = _mm_set1_ps(scale);
+
+            __m128i crc0 = _mm_setzero_si128();
+            __m128i crc1 = _mm_setzero_si128();
+
+            // numChans is a multiple of 32, so no remainder loop is needed
+            for (int c = 0; c < numChans; c += 8)
+            {
+                __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + c));
+                __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + c + 4));
+                crc0 = _mm_xor_si128(crc0, v0);
+                crc1 = _mm_xor_si128(crc1, v1);
+                _mm_storeu_ps(out + c, _mm_mul_ps(_mm_cvtepi32_ps(v0), scaleV));
+                _mm_storeu_ps(out + c + 4, _mm_mul_ps(_mm_cvtepi32_ps(v1), scaleV));
+            }
+
+            crc0 = _mm_xor_si128(crc0, crc1);
+            crc0 = _mm_xor_si128(crc0, _mm_shuffle_epi32(crc0, _MM_SHUFFLE(1, 0, 3, 2)));
+            crc0 = _mm_xor_si128(crc0, _mm_shuffle_epi32(crc0, _MM_SHUFFLE(2, 3, 0, 1)));
+            uint32_t crcValue = uint32_t(_mm_cvtsi128_si32(crc0));
+
+            return (crcValue ^ headerFooterXor(packet, Boards)) == 0;
+        }
+
+        // (as decode, for a number of boards only known at run time)
+        PACKET_KERNEL_TARGET_SSE2
+        static uint32_t decodeBoards(const uint32_t* samples, int numBoards, float scale, float* out)
+        {
+            const int numChans = numBoards * boardChannels;
+            const __m128 scaleV = _mm_set1_ps(scale);
+
+            __m128i crc0 = _mm_setzero_si128();
+            __m128i crc1 = _mm_setzero_si128();
+            for (int c = 0; c < numChans; c += 8)
+            {
+                __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + c));
+                __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + c + 4));
+                crc0 = _mm_xor_si128(crc0, v0);
+                crc1 = _mm_xor_si128(crc1, v1);
+                _mm_storeu_ps(out + c, _mm_mul_ps(_mm_cvtepi32_ps(v0), scaleV));
+                _mm_storeu_ps(out + c + 4, _mm_mul_ps(_mm_cvtepi32_ps(v1), scaleV));
+            }
+
+            crc0 = _mm_xor_si128(crc0, crc1);
+            crc0 = _mm_xor_si128(crc0, _mm_shuffle_epi32(crc0, _MM_SHUFFLE(1, 0, 3, 2)));
+            crc0 = _mm_xor_si128(crc0, _mm_shuffle_epi32(crc0, _MM_SHUFFLE(2, 3, 0, 1)));
+            return uint32_t(_mm_cvtsi128_si32(crc0));
+        }
+
+        PACKET_KERNEL_TARGET_SSE2
+        static uint32_t xorSamples(const uint32_t* samples, int numChans)
+        {
+            __m128i crc0 = _mm_setzero_si128();
+            __m128i crc1 = _mm_setzero_si128();
+            for (int c = 0; c < numChans; c += 8)
+            {
+                crc0 = _mm_xor_si128(crc0, _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + c)));
+                crc1 = _mm_xor_si128(crc1, _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + c + 4)));
+            }
+
+            crc0 = _mm_xor_si128(crc0, crc1);
+            crc0 = _mm_xor_si128(crc0, _mm_shuffle_epi32(crc0, _MM_SHUFFLE(1, 0, 3, 2)));
+            crc0 = _mm_xor_si128(crc0, _mm_shuffle_epi32(crc0, _MM_SHUFFLE(2, 3, 0, 1)));
+            return uint32_t(_mm_cvtsi128_si32(crc0));
+        }
+
+        PACKET_KERNEL_TARGET_SSE2
+        static bool decodeGather(const uint32_t* packet, int boards, const GatherTable& table,
+            float scale, float* out)
+        {
+            const int numChans = boards * boardChannels;
+            const uint32_t* samples = packet + headerWords;
+            const __m128 scaleV = _mm_set1_ps(scale);
+
+            for (const GatherMove& move : table.blocks)
+            {
+                const uint32_t* in = samples + move.channel;
+                __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+                __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 4));
+                _mm_storeu_ps(out + move.output, _mm_mul_ps(_mm_cvtepi32_ps(v0), scaleV));
+                _mm_storeu_ps(out + move.output + 4, _mm_mul_ps(_mm_cvtepi32_ps(v1), scaleV));
+            }
+            for (const GatherMove& move : table.singles)
+            {
+                out[move.output] = int32_t(samples[move.channel]) * scale;
+            }
+
+            return (xorSamples(samples, numChans) ^ headerFooterXor(packet, boards)) == 0;
+        }
+
+        // Compares each pair of words with the pair one before it. SSE2 has no 64-bit compare, so a
+        // pair is unchanged if all of its bytes are; only pairs that aren't are looked at one by one.
+        PACKET_KERNEL_TARGET_SSE2
+        static int findChanges(const uint64_t* words, int n, uint64_t previous, int* changes)
+        {
+            if (n == 0)
+            {
+                return 0;
+            }
+
+            int numChanges = 0;
+            if (words[0] != previous)
+            {
+                changes[numChanges++] = 0;
+            }
+
+            int i = 1;
+            for (; i + 2 <= n; i += 2)
+            {
+                __m128i current = _mm_loadu_si128(reinterpret_cast<const __m128i*>(words + i));
+                __m128i before = _mm_loadu_si128(reinterpret_cast<const __m128i*>(words + i - 1));
+                if (_mm_movemask_epi8(_mm_cmpeq_epi8(current, before)) != 0xffff)
+                {
+                    for (int k = i; k < i + 2; ++k)
+                    {
+                        if (words[k] != words[k - 1])
+                        {
+                            changes[numChanges++] = k;
+                        }
+                    }
+                }
+            }
+            return Scalar::findChangesFrom(i, words, n, previous, changes, numChanges);
+        }
+    };
+
+    struct AVX2
+    {
+        template <int Boards>
+        PACKET_KERNEL_TARGET_AVX2
+        static bool decode(const uint32_t* packet, float scale, float* out)
+        {
+            const int numChans = Boards * boardChannels;
+            const uint32_t* samples = packet + headerWords;
+            const __m256 scaleV = _mm256_set1_ps(scale);
+
+            __m256i crc0 = _mm256_setzero_si256();
+            __m256i crc1 = _mm256_setzero_si256();
+
+            // one board (32 channels) per iteration
+            for (int c = 0; c < numChans; c += 32)
+            {
+                __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + c));
+                __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + c + 8));
+                __m256i v2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + c + 16));
+                __m256i v3 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + c + 24));
+                crc0 = _mm256_xor_si256(crc0, _mm256_xor_si256(v0, v2));
+                crc1 = _mm256_xor_si256(crc1, _mm256_xor_si256(v1, v3));
+                _mm256_storeu_ps(out + c, _mm256_mul_ps(_mm256_cvtepi32_ps(v0), scaleV));
+                _mm256_storeu_ps(out + c + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(v1), scaleV));
+                _mm256_storeu_ps(out + c + 16, _mm256_mul_ps(_mm256_cvtepi32_ps(v2), scaleV));
+                _mm256_storeu_ps(out + c + 24, _mm256_mul_ps(_mm256_cvtepi32_ps(v3), scaleV));
+            }
+
+            crc0 = _mm256_xor_si256(crc0, crc1);
+            __m128i crc = _mm_xor_si128(_mm256_castsi256_si128(crc0), _mm256_extracti128_si256(crc0, 1));
+            crc = _mm_xor_si128(crc, _mm_shuffle_epi32(crc, _MM_SHUFFLE(1, 0, 3, 2)));
+            crc = _mm_xor_si128(crc, _mm_shuffle_epi32(crc, _MM_SHUFFLE(2, 3, 0, 1)));
+            uint32_t crcValue = uint32_t(_mm_cvtsi128_si32(crc));
+
+            return (crcValue ^ headerFooterXor(packet, Boards)) == 0;
+        }
+
+        // (as decode, for a number of boards only known at run time)
+        PACKET_KERNEL_TARGET_AVX2
+        static uint32_t decodeBoards(const uint32_t* samples, int numBoards, float scale, float* out)
+        {
+            const int numChans = numBoards * boardChannels;
+            const __m256 scaleV = _mm256_set1_ps(scale);
+
+            __m256i crc0 = _mm256_setzero_si256();
+            __m256i crc1 = _mm256_setzero_si256();
+            for (int c = 0; c < numChans; c += 32)
+            {
+                __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + c));
+                __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + c + 8));
+                __m256i v2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + c + 16));
+                __m256i v3 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + c + 24));
+                crc0 = _mm256_xor_si256(crc0, _mm256_xor_si256(v0, v2));
+                crc1 = _mm256_xor_si256(crc1, _mm256_xor_si256(v1, v3));
+                _mm256_storeu_ps(out + c, _mm256_mul_ps(_mm256_cvtepi32_ps(v0), scaleV));
+                _mm256_storeu_ps(out + c + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(v1), scaleV));
+                _mm256_storeu_ps(out + c + 16, _mm256_mul_ps(_mm256_cvtepi32_ps(v2), scaleV));
+                _mm256_storeu_ps(out + c + 24, _mm256_mul_ps(_mm256_cvtepi32_ps(v3), scaleV));
+            }
+
+            crc0 = _mm256_xor_si256(crc0, crc1);
+            __m128i crc = _mm_xor_si128(_mm256_castsi256_si128(crc0), _mm256_extracti128_si256(crc0, 1));
+            crc = _mm_xor_si128(crc, _mm_shuffle_epi32(crc, _MM_SHUFFLE(1, 0, 3, 2)));
+            crc = _mm_xor_si128(crc, _mm_shuffle_epi32(crc, _MM_SHUFFLE(2, 3, 0, 1)));
+            return uint32_t(_mm_cvtsi128_si32(crc));
+        }
+
+        PACKET_KERNEL_TARGET_AVX2
+        static uint32_t xorSamples(const uint32_t* samples, int numChans)
+        {
+            __m256i crc0 = _mm256_setzero_si256();
+            __m256i crc1 = _mm256_setzero_si256();
+            for (int c = 0; c < numChans; c += 32)
+            {
+                __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + c));
+                __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + c + 8));
+                __m256i v2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + c + 16));
+                __m256i v3 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + c + 24));
+                crc0 = _mm256_xor_si256(crc0, _mm256_xor_si256(v0, v2));
+                crc1 = _mm256_xor_si256(crc1, _mm256_xor_si256(v1, v3));
+            }
+
+            crc0 = _mm256_xor_si256(crc0, crc1);
+            __m128i crc = _mm_xor_si128(_mm256_castsi256_si128(crc0), _mm256_extracti128_si256(crc0, 1));
+            crc = _mm_xor_si128(crc, _mm_shuffle_epi32(crc, _MM_SHUFFLE(1, 0, 3, 2)));
+            crc = _mm_xor_si128(crc, _mm_shuffle_epi32(crc, _MM_SHUFFLE(2, 3, 0, 1)));
+            return uint32_t(_mm_cvtsi128_si32(crc));
+        }
+
+        // (vpgather is no faster than scalar loads on many CPUs, so it isn't used for the singles)
+        PACKET_KERNEL_TARGET_AVX2
+        static bool decodeGather(const uint32_t* packet, int boards, const GatherTable& table,
+            float scale, float* out)
+        {
+            const int numChans = boards * boardChannels;
+            const uint32_t* samples = packet + headerWords;
+            const __m256 scaleV = _mm256_set1_ps(scale);
+
+            for (const GatherMove& move : table.blocks)
+            {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + move.channel));
+                _mm256_storeu_ps(out + move.output, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scaleV));
+            }
+            for (const GatherMove& move : table.singles)
+            {
+                out[move.output] = int32_t(samples[move.channel]) * scale;
+            }
+
+            return (xorSamples(samples, numChans) ^ headerFooterXor(packet, boards)) == 0;
+        }
+
+        // (as SSE2, 4 words at a time)
+        PACKET_KERNEL_TARGET_AVX2
+        static int findChanges(const uint64_t* words, int n, uint64_t previous, int* changes)
+        {
+            if (n == 0)
+            {
+                return 0;
+            }
+
+            int numChanges = 0;
+            if (words[0] != previous)
+            {
+                changes[numChanges++] = 0;
+            }
+
+            int i = 1;
+            for (; i + 4 <= n; i += 4)
+            {
+                __m256i current = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + i));
+                __m256i before = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + i - 1));
+                int unchanged = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(current, before)));
+                if (unchanged != 0xf)
+                {
+                    for (int k = 0; k < 4; ++k)
+                    {
+                        if (!(unchanged & (1 << k)))
+                        {
+                            changes[numChanges++] = i + k;
+                        }
+                    }
+                }
+            }
+            return Scalar::findChangesFrom(i, words, n, previous, changes, numChanges);
+        }
+    };
+
+    static bool cpuHasSSE2()
+    {
+#if defined(__x86_64__) || defined(_M_X64)
+        return true; // part of x86-64
+#elif defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        return (info[3] & (1 << 26)) != 0;
+#else
+        return __builtin_cpu_supports("sse2");
+#endif
+    }
+
+    static bool cpuHasAVX2()
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+        {
+            return false;
+        }
+
+        // the OS must also save the AVX registers (OSXSAVE + XCR0)
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        if (!osxsave || (_xgetbv(0) & 6) != 6)
+        {
+            return false;
+        }
+
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+
+#endif // PACKET_KERNEL_X86
+
+    /*** dispatch tables ***/
+
+    // Fills table[1 .. Boards] with Impl::decode<1 .. Boards>
+    template <typename Impl, int Boards>
+    struct TableFiller
+    {
+        static void fill(Decoder* table)
+        {
+            table[Boards] = &Impl::template decode<Boards>;
+            TableFiller<Impl, Boards - 1>::fill(table);
+        }
+    };
+
+    template <typename Impl>
+    struct TableFiller<Impl, 0>
+    {
+        static void fill(Decoder* table)
+        {
+            table[0] = nullptr;
+        }
+    };
+
+    template <typename Impl>
+    struct TableHolder
+    {
+        TableHolder()
+        {
+            TableFiller<Impl, maxBoards>::fill(table);
+        }
+
+        Table table;
+    };
+
+    static const Decoder* getScalarTable()
+    {
+        static const TableHolder<Scalar> holder;
+        return holder.table;
+    }
+
+    static const Decoder* getSSE2Table()
+    {
+#if PACKET_KERNEL_X86
+        static const TableHolder<SSE2> holder;
+        static const bool supported = cpuHasSSE2();
+        return supported ? holder.table : nullptr;
+#else
+        return nullptr;
+#endif
+    }
+
+    static const Decoder* getAVX2Table()
+    {
+#if PACKET_KERNEL_X86
+        static const TableHolder<AVX2> holder;
+        static const bool supported = cpuHasAVX2();
+        return supported ? holder.table : nullptr;
+#else
+        return nullptr;
+#endif
+    }
+
+    static GatherDecoder getSSE2GatherUnchecked()
+    {
+#if PACKET_KERNEL_X86
+        return &SSE2::decodeGather;
+#else
+        return nullptr;
+#endif
+    }
+
+    static GatherDecoder getAVX2GatherUnchecked()
+    {
+#if PACKET_KERNEL_X86
+        return &AVX2::decodeGather;
+#else
+        return nullptr;
+#endif
+    }
+
+    static BoardDecoder getSSE2BoardDecoderUnchecked()
+    {
+#if PACKET_KERNEL_X86
+        return &SSE2::decodeBoards;
+#else
+        return nullptr;
+#endif
+    }
+
+    static BoardDecoder getAVX2BoardDecoderUnchecked()
+    {
+#if PACKET_KERNEL_X86
+        return &AVX2::decodeBoards;
+#else
+        return nullptr;
+#endif
+    }
+
+    static ChangeFinder getSSE2ChangeFinderUnchecked()
+    {
+#if PACKET_KERNEL_X86
+        return &SSE2::findChanges;
+#else
+        return nullptr;
+#endif
+    }
+
+    static ChangeFinder getAVX2ChangeFinderUnchecked()
+    {
+#if PACKET_KERNEL_X86
+        return &AVX2::findChanges;
+#else
+        return nullptr;
+#endif
+    }
+
+    static ChangeFinder getBestChangeFinder()
+    {
+        return getAVX2ChangeFinder() != nullptr ? getAVX2ChangeFinder()
+            : getSSE2ChangeFinder() != nullptr ? getSSE2ChangeFinder()
+            : getScalarChangeFinder();
+    }
+
+    static GatherDecoder getBestGatherDecoder()
+    {
+        return getAVX2Gather() != nullptr ? getAVX2Gather()
+            : getSSE2Gather() != nullptr ? getSSE2Gather()
+            : getScalarGather();
+    }
+
+    static const Decoder* getBestTable()
+    {
+        static const Decoder* const best = getAVX2Table() != nullptr ? getAVX2Table()
+            : getSSE2Table() != nullptr ? getSSE2Table()
+            : getScalarTable();
+        return best;
+    }
+};
+
+#endif // PACKET_KERNEL_H_INCLUDED
@@ -0,0 +1,467 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+We hope that this plugin will be useful to others, but its source code
+and functionality are subject to a non-disclosure agreement (NDA) with
+Neuralynx, Inc. If you or your institution have not signed the appropriate
+NDA, STOP and do not read or execute this plugin until you have done so.
+Do not share this plugin with other parties who have not signed the NDA.
+
+*/
+
+#include "PacketMmapSocket.h"
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <ifaddrs.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+PacketMmapSocket::PacketMmapSocket()
+    : fd          (-1)
+    , map         (nullptr)
+    , mapBytes    (0)
+    , boundPort   (0)
+    , currentBlock(0)
+    , inBlock     (false)
+    , framesLeft  (0)
+    , nextFrame   (nullptr)
+    , held        (numBlocks)
+    , heldStart   (0)
+    , heldCount   (0)
+    , numReturned (0)
+    , numReleased (0)
+    , kernelDrops (0)
+{}
+
+
+PacketMmapSocket::~PacketMmapSocket()
+{
+    close();
+}
+
+
+bool PacketMmapSocket::isAvailable()
+{
+#ifdef __linux__
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+bool PacketMmapSocket::isOpen() const
+{
+    return map != nullptr;
+}
+
+
+bool PacketMmapSocket::isOpenFor(const std::string& localAddress, uint16_t port) const
+{
+    return isOpen() && address == localAddress && boundPort == port;
+}
+
+
+const std::string& PacketMmapSocket::getInterfaceName() const
+{
+    return interfaceName;
+}
+
+
+const std::string& PacketMmapSocket::getError() const
+{
+    return error;
+}
+
+
+uint64_t PacketMmapSocket::getNumReturned() const
+{
+    return numReturned;
+}
+
+
+bool PacketMmapSocket::fail(const std::string& message)
+{
+    error = message;
+    close();
+    return false;
+}
+
+
+#ifdef __linux__
+
+bool PacketMmapSocket::open(const std::string& localAddress, uint16_t port)
+{
+    close();
+    error.clear();
+    interfaceName.clear();
+
+    // find the interface with this address
+    in_addr target;
+    if (inet_pton(AF_INET, localAddress.c_str(), &target) != 1)
+    {
+        return fail("invalid address " + localAddress);
+    }
+
+    ifaddrs* addrs = nullptr;
+    if (getifaddrs(&addrs) != 0)
+    {
+        return fail(std::string("could not list interfaces: ") + std::strerror(errno));
+    }
+    for (ifaddrs* a = addrs; a != nullptr; a = a->ifa_next)
+    {
+        if (a->ifa_addr != nullptr && a->ifa_addr->sa_family == AF_INET
+            && reinterpret_cast<sockaddr_in*>(a->ifa_addr)->sin_addr.s_addr == target.s_addr)
+        {
+            interfaceName = a->ifa_name;
+            break;
+        }
+    }
+    freeifaddrs(addrs);
+
+    unsigned ifIndex = interfaceName.empty() ? 0 : if_nametoindex(interfaceName.c_str());
+    if (ifIndex == 0)
+    {
+        return fail("no interface has address " + localAddress);
+    }
+
+    // SOCK_DGRAM: frames start at the IP header whatever the link type (ethernet, loopback...).
+    // No protocol until bound, so nothing is queued before the filter is attached.
+    fd = socket(AF_PACKET, SOCK_DGRAM, 0);
+    if (fd < 0)
+    {
+        int e = errno;
+        return fail(std::string("could not create packet socket: ") + std::strerror(e)
+            + (e == EPERM ? " (needs CAP_NET_RAW)" : ""));
+    }
+
+    int version = TPACKET_V3;
+    if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) != 0)
+    {
+        return fail(std::string("TPACKET_V3 not supported: ") + std::strerror(errno));
+    }
+
+    // unfragmented UDP to the port: ip[9] == 17 && !(ip[6:2] & 0x1fff) && udp[2:2] == port
+    sock_filter code[] = {
+        BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, 9),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,   IPPROTO_UDP, 0, 6),
+        BPF_STMT(BPF_LD  | BPF_H   | BPF_ABS, 6),
+        BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K,  0x1fff, 4, 0),
+        BPF_STMT(BPF_LDX | BPF_B   | BPF_MSH, 0),
+        BPF_STMT(BPF_LD  | BPF_H   | BPF_IND, 2),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,   port, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K,             0x40000),
+        BPF_STMT(BPF_RET | BPF_K,             0)
+    };
+    sock_fprog filter;
+    filter.len = sizeof(code) / sizeof(code[0]);
+    filter.filter = code;
+    if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &filter, sizeof(filter)) != 0)
+    {
+        return fail(std::string("could not attach port filter: ") + std::strerror(errno));
+    }
+
+#ifdef PACKET_IGNORE_OUTGOING
+    // (only matters on loopback, where packets are seen going out as well as coming in; next() skips them too)
+    int ignoreOutgoing = 1;
+    setsockopt(fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &ignoreOutgoing, sizeof(ignoreOutgoing));
+#endif
+
+    tpacket_req3 req;
+    std::memset(&req, 0, sizeof(req));
+    req.tp_block_size = blockBytes;
+    req.tp_block_nr = numBlocks;
+    req.tp_frame_size = 2048; // (frames are variable-size in V3; this only has to divide the block size)
+    req.tp_frame_nr = (blockBytes / req.tp_frame_size) * numBlocks;
+    req.tp_retire_blk_tov = blockTimeoutMs;
+    if (setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) != 0)
+    {
+        return fail(std::string("could not create receive ring: ") + std::strerror(errno));
+    }
+
+    mapBytes = size_t(blockBytes) * numBlocks;
+    void* m = mmap(nullptr, mapBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (m == MAP_FAILED)
+    {
+        return fail(std::string("could not map receive ring: ") + std::strerror(errno));
+    }
+    map = static_cast<uint8_t*>(m);
+
+    sockaddr_ll sll;
+    std::memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_IP);
+    sll.sll_ifindex = int(ifIndex);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&sll), sizeof(sll)) != 0)
+    {
+        return fail("could not bind to " + interfaceName + ": " + std::strerror(errno));
+    }
+
+    // receive frames sent to other MAC addresses too (undone by the kernel when the socket closes)
+    packet_mreq mreq;
+    std::memset(&mreq, 0, sizeof(mreq));
+    mreq.mr_ifindex = int(ifIndex);
+    mreq.mr_type = PACKET_MR_PROMISC;
+    if (setsockopt(fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) != 0)
+    {
+        return fail("could not enable promiscuous mode on " + interfaceName + ": " + std::strerror(errno));
+    }
+
+    address = localAddress;
+    boundPort = port;
+    kernelDrops = 0;
+    flush();
+    return true;
+}
+
+
+void PacketMmapSocket::close()
+{
+    if (map != nullptr)
+    {
+        munmap(map, mapBytes);
+        map = nullptr;
+    }
+    if (fd >= 0)
+    {
+        ::close(fd);
+        fd = -1;
+    }
+    address.clear();
+    boundPort = 0;
+    currentBlock = 0;
+    inBlock = false;
+    heldCount = 0;
+}
+
+
+int PacketMmapSocket::wait(int timeoutMs)
+{
+    if (!isOpen())
+    {
+        return -1;
+    }
+
+    if (inBlock && framesLeft > 0)
+    {
+        return 1;
+    }
+    if (inBlock)
+    {
+        finishBlock();
+    }
+    if (blockReady(currentBlock))
+    {
+        return 1;
+    }
+
+    if (timeoutMs <= 0)
+    {
+        return 0;
+    }
+
+    pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN | POLLERR;
+    pfd.revents = 0;
+
+    int ready = poll(&pfd, 1, timeoutMs);
+    if (ready < 0)
+    {
+        return errno == EINTR ? 0 : -1;
+    }
+    if (ready > 0 && (pfd.revents & (POLLERR | POLLNVAL)))
+    {
+        return -1;
+    }
+    return blockReady(currentBlock) ? 1 : 0;
+}
+
+
+bool PacketMmapSocket::next(Frame& frame)
+{
+    if (!isOpen())
+    {
+        return false;
+    }
+
+    while (true)
+    {
+        if (!inBlock)
+        {
+            if (!blockReady(currentBlock))
+            {
+                return false;
+            }
+
+            auto desc = reinterpret_cast<const tpacket_block_desc*>(map + size_t(currentBlock) * blockBytes);
+            framesLeft = desc->hdr.bh1.num_pkts;
+            nextFrame = reinterpret_cast<const uint8_t*>(desc) + desc->hdr.bh1.offset_to_first_pkt;
+            inBlock = true;
+        }
+
+        if (framesLeft == 0)
+        {
+            finishBlock();
+            continue;
+        }
+
+        auto hdr = reinterpret_cast<const tpacket3_hdr*>(nextFrame);
+        nextFrame += hdr->tp_next_offset;
+        --framesLeft;
+
+        auto sll = reinterpret_cast<const sockaddr_ll*>(reinterpret_cast<const uint8_t*>(hdr)
+            + TPACKET_ALIGN(sizeof(tpacket3_hdr)));
+        if (sll->sll_pkttype == PACKET_OUTGOING)
+        {
+            continue;
+        }
+
+        // (the filter has checked the protocol, fragmentation and port)
+        const uint8_t* ip = reinterpret_cast<const uint8_t*>(hdr) + hdr->tp_net;
+        int snapBytes = int(hdr->tp_snaplen);
+        int ipHeaderBytes = (ip[0] & 0xf) * 4;
+        if (ipHeaderBytes < 20 || snapBytes < ipHeaderBytes + 8)
+        {
+            continue;
+        }
+
+        const uint8_t* udp = ip + ipHeaderBytes;
+        int payloadBytes = ((int(udp[4]) << 8) | udp[5]) - 8;
+        if (payloadBytes < 0)
+        {
+            continue;
+        }
+
+        frame.payload = reinterpret_cast<const uint32_t*>(udp + 8);
+        frame.bytes = payloadBytes < snapBytes - ipHeaderBytes - 8 ? payloadBytes : snapBytes - ipHeaderBytes - 8;
+        frame.arrivalNs = uint64_t(hdr->tp_sec) * 1000000000 + hdr->tp_nsec;
+        ++numReturned;
+        return true;
+    }
+}
+
+
+void PacketMmapSocket::finishBlock()
+{
+    // keep the block until its frames are released
+    held[(heldStart + heldCount) % numBlocks] = { currentBlock, numReturned };
+    ++heldCount;
+    currentBlock = (currentBlock + 1) % numBlocks;
+    inBlock = false;
+}
+
+
+void PacketMmapSocket::release(uint64_t numConsumed)
+{
+    numReleased = numConsumed;
+    while (heldCount > 0 && held[heldStart].endCount <= numReleased)
+    {
+        returnBlock(held[heldStart].index);
+        heldStart = (heldStart + 1) % numBlocks;
+        --heldCount;
+    }
+}
+
+
+void PacketMmapSocket::flush()
+{
+    if (!isOpen())
+    {
+        return;
+    }
+
+    for (; heldCount > 0; --heldCount)
+    {
+        returnBlock(held[heldStart].index);
+        heldStart = (heldStart + 1) % numBlocks;
+    }
+
+    if (inBlock)
+    {
+        returnBlock(currentBlock);
+        currentBlock = (currentBlock + 1) % numBlocks;
+        inBlock = false;
+    }
+
+    // blocks are handed over in order, so the ones that are ready follow the current one
+    for (int i = 0; i < numBlocks && blockReady(currentBlock); ++i)
+    {
+        returnBlock(currentBlock);
+        currentBlock = (currentBlock + 1) % numBlocks;
+    }
+
+    heldStart = 0;
+    numReturned = 0;
+    numReleased = 0;
+}
+
+
+int64_t PacketMmapSocket::getKernelDrops()
+{
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    // (the kernel resets these counters each time they are read)
+    tpacket_stats_v3 stats;
+    socklen_t len = sizeof(stats);
+    if (getsockopt(fd, SOL_PACKET, PACKET_STATISTICS, &stats, &len) != 0)
+    {
+        return -1;
+    }
+    kernelDrops += stats.tp_drops;
+    return int64_t(kernelDrops);
+}
+
+
+bool PacketMmapSocket::blockReady(int blockIndex) const
+{
+    auto desc = reinterpret_cast<tpacket_block_desc*>(map + size_t(blockIndex) * blockBytes);
+    return (__atomic_load_n(&desc->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) != 0;
+}
+
+
+void PacketMmapSocket::returnBlock(int blockIndex)
+{
+    auto desc = reinterpret_cast<tpacket_block_desc*>(map + size_t(blockIndex) * blockBytes);
+    __atomic_store_n(&desc->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+}
+
+#else // not Linux
+
+bool PacketMmapSocket::open(const std::string&, uint16_t)
+{
+    error = "packet ring capture is only available on Linux";
+    return false;
+}
+
+void PacketMmapSocket::close() {}
+int PacketMmapSocket::wait(int) { return -1; }
+bool PacketMmapSocket::next(Frame&) { return false; }
+void PacketMmapSocket::release(uint64_t) {}
+void PacketMmapSocket::flush() {}
+int64_t PacketMmapSocket::getKernelDrops() { return -1; }
+void PacketMmapSocket::finishBlock() {}
+bool PacketMmapSocket::blockReady(int) const { return false; }
+void PacketMmapSocket::returnBlock(int) {}
+
+#endif
@@ -0,0 +1,137 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+We hope that this plugin will be useful to others, but its source code
+and functionality are subject to a non-disclosure agreement (NDA) with
+Neuralynx, Inc. If you or your institution have not signed the appropriate
+NDA, STOP and do not read or execute this plugin until you have done so.
+Do not share this plugin with other parties who have not signed the NDA.
+
+*/
+
+#ifndef PACKET_MMAP_SOCKET_H_INCLUDED
+#define PACKET_MMAP_SOCKET_H_INCLUDED
+
+// Does not depend on JUCE, so it can also be used by tools outside the plugin.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Linux only: receives UDP datagrams for one destination port from a network interface through an
+ * AF_PACKET socket with a memory-mapped TPACKET_V3 ring, so that the payloads can be read in place
+ * from memory shared with the kernel, without a copy through the UDP stack.
+ *
+ * A BPF filter attached to the socket passes only unfragmented IPv4/UDP frames for the port, and
+ * the interface is put in promiscuous mode, so frames addressed to another MAC address (e.g. when
+ * the workstation's MAC is not cloned) are received too. Needs CAP_NET_RAW (or root).
+ *
+ * The kernel fills fixed-size blocks of frames and hands a block over when it is full or
+ * blockTimeoutMs after its first frame. Frames returned by next() stay valid until released;
+ * they must be released in the order they were returned. Not thread-safe except as noted.
+ */
+class PacketMmapSocket
+{
+public:
+    static const int blockBytes = 1 << 16;
+    static const int numBlocks = 256;    // 16 MB in total
+    static const int blockTimeoutMs = 1; // longest a block is held open (rounded up to the kernel timer tick)
+
+    struct Frame
+    {
+        const uint32_t* payload; // UDP payload (4-byte aligned)
+        int bytes;
+        uint64_t arrivalNs;      // kernel timestamp, ns since the Unix epoch
+    };
+
+    PacketMmapSocket();
+    ~PacketMmapSocket();
+
+    // Whether this mode is compiled in (Linux)
+    static bool isAvailable();
+
+    // Opens the ring on the interface that has the given local IPv4 address (dotted quad),
+    // for datagrams to the given port. Returns false on failure (see getError).
+    bool open(const std::string& localAddress, uint16_t port);
+    void close();
+
+    bool isOpen() const;
+    bool isOpenFor(const std::string& localAddress, uint16_t port) const;
+
+    const std::string& getInterfaceName() const;
+    const std::string& getError() const;
+
+    // Waits up to timeoutMs (0 = just check) for a frame to be available.
+    // Returns 1 if one is, 0 on timeout and -1 on error.
+    int wait(int timeoutMs);
+
+    // Returns the next datagram without copying it, or false if none is available right now.
+    // Frames that aren't valid UDP datagrams for the port are skipped.
+    bool next(Frame& frame);
+
+    // Number of frames returned by next() since open/flush
+    uint64_t getNumReturned() const;
+
+    // Declares that the first numConsumed frames returned since open/flush are no longer
+    // needed; blocks whose frames have all been consumed are handed back to the kernel.
+    void release(uint64_t numConsumed);
+
+    // Hands every block back to the kernel and resets the frame count, discarding any
+    // frames that have not been returned yet. Invalidates all frames.
+    void flush();
+
+    // Frames dropped by the kernel because the ring was full, since open (-1 if unknown)
+    int64_t getKernelDrops();
+
+private:
+    bool fail(const std::string& message);
+
+    // Whether the block at blockIndex has been handed to user space
+    bool blockReady(int blockIndex) const;
+    void returnBlock(int blockIndex);
+
+    // Moves on from the current block once all of its frames have been returned
+    void finishBlock();
+
+    int fd;
+    uint8_t* map;
+    size_t mapBytes;
+
+    std::string address;
+    uint16_t boundPort;
+    std::string interfaceName;
+    std::string error;
+
+    // walking the current block
+    int currentBlock;        // next block to read or the one being read
+    bool inBlock;
+    uint32_t framesLeft;     // in the current block
+    const uint8_t* nextFrame;
+
+    // blocks that have been walked but not yet released, oldest first, with the
+    // number of frames returned up to the end of each one
+    struct HeldBlock
+    {
+        int index;
+        uint64_t endCount;
+    };
+    std::vector<HeldBlock> held; // circular, numBlocks entries
+    int heldStart;
+    int heldCount;
+
+    uint64_t numReturned;
+    uint64_t numReleased;
+
+    uint64_t kernelDrops;
+
+    PacketMmapSocket(const PacketMmapSocket&) = delete;
+    PacketMmapSocket& operator=(const PacketMmapSocket&) = delete;
+};
+
+#endif // PACKET_MMAP_SOCKET_H_INCLUDED
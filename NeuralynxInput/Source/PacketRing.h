@@ -0,0 +1,211 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+We hope that this plugin will be useful to others, but its source code
+and functionality are subject to a non-disclosure agreement (NDA) with
+Neuralynx, Inc. If you or your institution have not signed the appropriate
+NDA, STOP and do not read or execute this plugin until you have done so.
+Do not share this plugin with other parties who have not signed the NDA.
+
+*/
+
+#ifndef PACKET_RING_H_INCLUDED
+#define PACKET_RING_H_INCLUDED
+
+// Does not depend on JUCE, so it can also be used by tools outside the plugin.
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Lock-free single-producer/single-consumer ring of fixed-size packet slots.
+ * All storage is allocated in the constructor. The producer writes raw packets directly
+ * into free slots (possibly several at a time, e.g. with recvmmsg) and then publishes them
+ * with finishWrite; the consumer reads published slots in place and releases them with finishRead.
+ * Alternatively, a slot can refer to a packet stored elsewhere (see setWriteExternal).
+ *
+ * Slot offsets passed to the get* functions are relative to the next slot to write or read,
+ * and must be less than getNumFree() or getNumReady(), respectively.
+ */
+class PacketRing
+{
+public:
+    PacketRing(int numSlots, int slotBytes)
+        : numSlots  (numSlots)
+        , slotWords ((slotBytes + 3) / 4)
+        , data      (size_t(numSlots) * slotWords)
+        , lengths   (numSlots)
+        , external  (numSlots, nullptr)
+        , arrivals  (numSlots, 0)
+        , writeCount(0)
+        , readCount (0)
+        , maxReady  (0)
+    {
+        assert(numSlots > 0 && slotBytes > 0);
+    }
+
+    // Discard all packets. Only call while neither the producer nor the consumer is active.
+    void reset()
+    {
+        writeCount.store(0);
+        readCount.store(0);
+        maxReady.store(0);
+    }
+
+    int getCapacity() const  { return numSlots; }
+    int getSlotBytes() const { return slotWords * 4; }
+
+    /*** producer ***/
+
+    int getNumFree() const
+    {
+        return numSlots - int(writeCount.load(std::memory_order_relaxed)
+            - readCount.load(std::memory_order_acquire));
+    }
+
+    uint32_t* getWriteSlot(int offset)
+    {
+        return slotAt(writeCount.load(std::memory_order_relaxed) + offset);
+    }
+
+    // Record the number of bytes actually received into a slot
+    void setWriteLength(int offset, int bytes)
+    {
+        int index = indexOf(writeCount.load(std::memory_order_relaxed) + offset);
+        lengths[index] = bytes;
+        external[index] = nullptr;
+    }
+
+    // Make a slot refer to a packet that stays where it is (e.g. in a buffer shared with the kernel)
+    // instead of copying it in. The packet must stay valid until the consumer has released the slot
+    // (see getReadCount).
+    void setWriteExternal(int offset, const uint32_t* packet, int bytes)
+    {
+        int index = indexOf(writeCount.load(std::memory_order_relaxed) + offset);
+        lengths[index] = bytes;
+        external[index] = packet;
+    }
+
+    // Record when a packet arrived (in whatever clock the consumer expects; 0 if unknown).
+    // Slots whose arrival isn't set keep the time of the last packet in them.
+    void setWriteArrival(int offset, uint64_t ns)
+    {
+        arrivals[indexOf(writeCount.load(std::memory_order_relaxed) + offset)] = ns;
+    }
+
+    // Publish the next n slots to the consumer
+    void finishWrite(int n)
+    {
+        uint64_t written = writeCount.load(std::memory_order_relaxed) + n;
+        writeCount.store(written, std::memory_order_release);
+
+        int ready = int(written - readCount.load(std::memory_order_acquire));
+        if (ready > maxReady.load(std::memory_order_relaxed))
+        {
+            maxReady.store(ready, std::memory_order_relaxed);
+        }
+    }
+
+    /*** consumer ***/
+
+    int getNumReady() const
+    {
+        return int(writeCount.load(std::memory_order_acquire)
+            - readCount.load(std::memory_order_relaxed));
+    }
+
+    const uint32_t* getReadSlot(int offset) const
+    {
+        uint64_t count = readCount.load(std::memory_order_relaxed) + offset;
+        const uint32_t* packet = external[indexOf(count)];
+        return packet != nullptr ? packet : slotAt(count);
+    }
+
+    int getReadLength(int offset) const
+    {
+        return lengths[indexOf(readCount.load(std::memory_order_relaxed) + offset)];
+    }
+
+    uint64_t getReadArrival(int offset) const
+    {
+        return arrivals[indexOf(readCount.load(std::memory_order_relaxed) + offset)];
+    }
+
+    // Release the next n slots back to the producer
+    void finishRead(int n)
+    {
+        readCount.store(readCount.load(std::memory_order_relaxed) + n, std::memory_order_release);
+    }
+
+    /*** statistics (may be called from any thread) ***/
+
+    int getOccupancy() const
+    {
+        return int(writeCount.load(std::memory_order_acquire) - readCount.load(std::memory_order_acquire));
+    }
+
+    // Total number of slots released by the consumer since the last reset
+    uint64_t getReadCount() const
+    {
+        return readCount.load(std::memory_order_acquire);
+    }
+
+    // Total number of slots published by the producer since the last reset
+    uint64_t getWriteCount() const
+    {
+        return writeCount.load(std::memory_order_acquire);
+    }
+
+    // Highest occupancy seen by the producer since the last reset
+    int getMaxOccupancy() const
+    {
+        return maxReady.load(std::memory_order_relaxed);
+    }
+
+private:
+    int indexOf(uint64_t count) const
+    {
+        return int(count % uint64_t(numSlots));
+    }
+
+    uint32_t* slotAt(uint64_t count)
+    {
+        return data.data() + size_t(indexOf(count)) * slotWords;
+    }
+
+    const uint32_t* slotAt(uint64_t count) const
+    {
+        return data.data() + size_t(indexOf(count)) * slotWords;
+    }
+
+    const int numSlots;
+    const int slotWords;
+
+    std::vector<uint32_t> data;
+    std::vector<int> lengths;
+    std::vector<const uint32_t*> external;
+    std::vector<uint64_t> arrivals;
+
+    // written by producer, read by consumer
+    std::atomic<uint64_t> writeCount;
+    char pad1[64];
+
+    // written by consumer, read by producer
+    std::atomic<uint64_t> readCount;
+    char pad2[64];
+
+    std::atomic<int> maxReady;
+
+    PacketRing(const PacketRing&) = delete;
+    PacketRing& operator=(const PacketRing&) = delete;
+};
+
+#endif // PACKET_RING_H_INCLUDED
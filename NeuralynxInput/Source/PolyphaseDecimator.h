@@ -0,0 +1,265 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+We hope that this plugin will be useful to others, but its source code
+and functionality are subject to a non-disclosure agreement (NDA) with
+Neuralynx, Inc. If you or your institution have not signed the appropriate
+NDA, STOP and do not read or execute this plugin until you have done so.
+Do not share this plugin with other parties who have not signed the NDA.
+
+*/
+
+#ifndef POLYPHASE_DECIMATOR_H_INCLUDED
+#define POLYPHASE_DECIMATOR_H_INCLUDED
+
+// Header-only and does not depend on JUCE, so it can also be used by tools outside the plugin.
+
+#include "PacketKernel.h" // for the instruction set macros and CPU detection
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/*
+ * Low-pass filters a set of channels and decimates them by an integer factor, e.g. to derive LFP
+ * from wideband data. The filter is a Blackman-windowed sinc of factor * tapsPerPhase taps, in
+ * polyphase form: each input sample is multiplied by the tapsPerPhase taps that involve it and added
+ * to the accumulators of the outputs they belong to, so the work per input sample is tapsPerPhase
+ * multiply-adds per channel whatever the factor, and no input history is kept. All channels of an
+ * accumulator are updated together with vector instructions, so rows of interleaved samples (as
+ * decoded from packets) can be fed in directly.
+ *
+ * Output m is completed by input sample m * factor and numbered m, so outputs line up with the
+ * input's sample numbers; the filter delays the signal by (factor * tapsPerPhase - 1) / 2 input samples.
+ */
+class PolyphaseDecimator
+{
+public:
+    static const int tapsPerPhase = 16;
+    static const int minFactor = 2;
+    static const int maxFactor = 64;
+
+    // -6 dB point of the filter, as a fraction of the output Nyquist frequency
+    static double getCutoff() { return 0.8; }
+
+    PolyphaseDecimator()
+        : factor        (0)
+        , numChannels   (0)
+        , stride        (0)
+        , nextSample    (-1)
+        , accumulate    (getBestAccumulate())
+    {}
+
+    // Sets the factor (minFactor .. maxFactor) and which channels of the input rows to filter, in output
+    // order, designs the filter and clears its state. Returns false if the factor is out of range.
+    bool reset(int newFactor, const int* newChannels, int newNumChannels)
+    {
+        if (newFactor < minFactor || newFactor > maxFactor || newNumChannels < 0)
+        {
+            return false;
+        }
+
+        factor = newFactor;
+        numChannels = newNumChannels;
+        channels.assign(newChannels, newChannels + newNumChannels);
+
+        // rows are padded to whole vectors, so the vector loops need no remainder
+        stride = (numChannels + 7) & ~7;
+        input.assign(stride, 0.0f);
+
+        designTaps();
+        clear();
+        return true;
+    }
+
+    // Forgets all input so far
+    void clear()
+    {
+        accumulators.assign(size_t(tapsPerPhase) * stride, 0.0f);
+        nextSample = -1;
+    }
+
+    int getFactor() const      { return factor; }
+    int getNumChannels() const { return numChannels; }
+    const std::vector<float>& getTaps() const { return taps; }
+
+    // Most output rows process can produce from numRows input rows
+    int getMaxOutputRows(int numRows) const
+    {
+        return numRows / factor + 1;
+    }
+
+    // Filters numRows input rows, rowStride floats apart, whose sample numbers are in sampleNumbers.
+    // Writes each completed output row (numChannels floats) to out, and its number to outSampleNumbers.
+    // A jump in the sample numbers restarts the filter (rows with negative numbers are skipped).
+    // Returns the number of output rows written.
+    int process(const float* rows, int numRows, int rowStride, const int64_t* sampleNumbers,
+        float* out, int64_t* outSampleNumbers)
+    {
+        int numOut = 0;
+        for (int r = 0; r < numRows; ++r)
+        {
+            const int64_t n = sampleNumbers[r];
+            if (n < 0)
+            {
+                nextSample = -1;
+                continue;
+            }
+
+            if (n != nextSample)
+            {
+                std::memset(accumulators.data(), 0, accumulators.size() * sizeof(float));
+            }
+            nextSample = n + 1;
+
+            const float* row = rows + size_t(r) * rowStride;
+            for (int c = 0; c < numChannels; ++c)
+            {
+                input[c] = row[channels[c]];
+            }
+
+            // x[n] contributes to outputs ceil(n / factor) ... + tapsPerPhase - 1, with
+            // tap m * factor - n of each
+            const int64_t firstOutput = (n + factor - 1) / factor;
+            float* acc[tapsPerPhase];
+            for (int i = 0; i < tapsPerPhase; ++i)
+            {
+                acc[i] = accumulator(firstOutput + i);
+            }
+            accumulate(&taps[int(firstOutput * factor - n)], factor, input.data(), acc, stride);
+
+            // tap 0 is the last contribution to output n / factor
+            if (n % factor == 0)
+            {
+                float* done = accumulator(n / factor);
+                std::memcpy(out + size_t(numOut) * numChannels, done, numChannels * sizeof(float));
+                std::memset(done, 0, stride * sizeof(float));
+                outSampleNumbers[numOut++] = n / factor;
+            }
+        }
+        return numOut;
+    }
+
+private:
+    // acc[i][0 .. n) += taps[i * tapStride] * x[0 .. n) for each i < tapsPerPhase, n a multiple of 8.
+    // Goes through x once, a vector at a time, so each vector is loaded once for all the taps.
+    typedef void (*Accumulate)(const float* taps, int tapStride, const float* x, float* const* acc, int n);
+
+    float* accumulator(int64_t output)
+    {
+        return accumulators.data() + size_t(output % tapsPerPhase) * stride;
+    }
+
+    void designTaps()
+    {
+        const int numTaps = factor * tapsPerPhase;
+        const double pi = 3.14159265358979323846;
+        const double fc = getCutoff() * 0.5 / factor; // cycles per input sample
+        const double centre = (numTaps - 1) / 2.0;
+
+        std::vector<double> h(numTaps);
+        double sum = 0;
+        for (int k = 0; k < numTaps; ++k)
+        {
+            double x = k - centre;
+            double sinc = x == 0 ? 2 * fc : std::sin(2 * pi * fc * x) / (pi * x);
+            double phase = 2 * pi * k / (numTaps - 1);
+            double window = 0.42 - 0.5 * std::cos(phase) + 0.08 * std::cos(2 * phase);
+            h[k] = sinc * window;
+            sum += h[k];
+        }
+
+        // unity gain at DC
+        taps.resize(numTaps);
+        for (int k = 0; k < numTaps; ++k)
+        {
+            taps[k] = float(h[k] / sum);
+        }
+    }
+
+    static void accumulateScalar(const float* taps, int tapStride, const float* x, float* const* acc, int n)
+    {
+        for (int i = 0; i < tapsPerPhase; ++i)
+        {
+            const float a = taps[i * tapStride];
+            float* y = acc[i];
+            for (int c = 0; c < n; ++c)
+            {
+                y[c] += a * x[c];
+            }
+        }
+    }
+
+#if PACKET_KERNEL_X86
+    PACKET_KERNEL_TARGET_SSE2
+    static void accumulateSSE2(const float* taps, int tapStride, const float* x, float* const* acc, int n)
+    {
+        for (int c = 0; c < n; c += 8)
+        {
+            const __m128 x0 = _mm_loadu_ps(x + c);
+            const __m128 x1 = _mm_loadu_ps(x + c + 4);
+            for (int i = 0; i < tapsPerPhase; ++i)
+            {
+                const __m128 a = _mm_set1_ps(taps[i * tapStride]);
+                float* y = acc[i] + c;
+                _mm_storeu_ps(y, _mm_add_ps(_mm_loadu_ps(y), _mm_mul_ps(a, x0)));
+                _mm_storeu_ps(y + 4, _mm_add_ps(_mm_loadu_ps(y + 4), _mm_mul_ps(a, x1)));
+            }
+        }
+    }
+
+    // (multiply then add rather than FMA, so that the result is the same as the other versions)
+    PACKET_KERNEL_TARGET_AVX2
+    static void accumulateAVX2(const float* taps, int tapStride, const float* x, float* const* acc, int n)
+    {
+        __m256 a[tapsPerPhase];
+        for (int i = 0; i < tapsPerPhase; ++i)
+        {
+            a[i] = _mm256_set1_ps(taps[i * tapStride]);
+        }
+
+        for (int c = 0; c < n; c += 8)
+        {
+            const __m256 xv = _mm256_loadu_ps(x + c);
+            for (int i = 0; i < tapsPerPhase; ++i)
+            {
+                float* y = acc[i] + c;
+                _mm256_storeu_ps(y, _mm256_add_ps(_mm256_loadu_ps(y), _mm256_mul_ps(a[i], xv)));
+            }
+        }
+    }
+#endif
+
+    static Accumulate getBestAccumulate()
+    {
+#if PACKET_KERNEL_X86
+        return PacketKernel::supportsAVX2() ? &accumulateAVX2
+            : PacketKernel::supportsSSE2() ? &accumulateSSE2
+            : &accumulateScalar;
+#else
+        return &accumulateScalar;
+#endif
+    }
+
+    int factor;
+    int numChannels;
+    int stride; // floats per accumulator row
+    std::vector<int> channels;
+    std::vector<float> taps;
+
+    // one row per output in progress, indexed by output number % tapsPerPhase
+    std::vector<float> accumulators;
+    std::vector<float> input; // current input row, gathered and padded
+
+    int64_t nextSample; // expected sample number of the next input (-1 if none yet)
+
+    Accumulate accumulate;
+};
+
+#endif // POLYPHASE_DECIMATOR_H_INCLUDED
@@ -0,0 +1,886 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+We hope that this plugin will be useful to others, but its source code
+and functionality are subject to a non-disclosure agreement (NDA) with
+Neuralynx, Inc. If you or your institution have not signed the appropriate
+NDA, STOP and do not read or execute this plugin until you have done so.
+Do not share this plugin with other parties who have not signed the NDA.
+
+*/
+
+#include "RawRecording.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <sys/types.h>
+#include <time.h>
+#endif
+
+using namespace RawRecording;
+
+namespace
+{
+    // values whose Rice quotient reaches this are stored as escapeQuotient ones and 32 raw bits
+    const int escapeQuotient = 24;
+    const int parameterBits = 5;
+
+    // most bytes encodeStream can produce for n values
+    size_t maxCodedBytes(int n)
+    {
+        return size_t(n) * 8 + 16;
+    }
+
+    uint32_t zigzag(uint32_t difference)
+    {
+        return (difference << 1) ^ uint32_t(int32_t(difference) >> 31);
+    }
+
+    uint32_t unzigzag(uint32_t z)
+    {
+        return (z >> 1) ^ (0u - (z & 1));
+    }
+
+    // Bits are packed from the least significant end of each byte
+    class BitWriter
+    {
+    public:
+        BitWriter(uint8_t* dest) : out(dest), start(dest), acc(0), numBits(0) {}
+
+        // (n <= 32)
+        void put(uint32_t value, int n)
+        {
+            acc |= uint64_t(value) << numBits;
+            numBits += n;
+            if (numBits >= 32)
+            {
+                uint32_t word = uint32_t(acc);
+                std::memcpy(out, &word, 4);
+                out += 4;
+                acc >>= 32;
+                numBits -= 32;
+            }
+        }
+
+        // Returns the total number of bytes written
+        size_t finish()
+        {
+            while (numBits > 0)
+            {
+                *out++ = uint8_t(acc);
+                acc >>= 8;
+                numBits -= numBits >= 8 ? 8 : numBits;
+            }
+            return size_t(out - start);
+        }
+
+    private:
+        uint8_t* out;
+        uint8_t* start;
+        uint64_t acc;
+        int numBits;
+    };
+
+    class BitReader
+    {
+    public:
+        BitReader(const uint8_t* data, size_t bytes) : in(data), end(data + bytes), acc(0), numBits(0) {}
+
+        // (n <= 32) Returns false if the data runs out.
+        bool get(int n, uint32_t& value)
+        {
+            if (!fill(n))
+            {
+                return false;
+            }
+            value = n == 32 ? uint32_t(acc) : uint32_t(acc) & ((1u << n) - 1);
+            acc >>= n;
+            numBits -= n;
+            return true;
+        }
+
+        // Counts ones up to a zero (which is consumed) or up to limit ones (which are all consumed)
+        bool getUnary(int limit, int& ones)
+        {
+            ones = 0;
+            while (ones < limit)
+            {
+                if (!fill(1))
+                {
+                    return false;
+                }
+                bool one = (acc & 1) != 0;
+                acc >>= 1;
+                --numBits;
+                if (!one)
+                {
+                    return true;
+                }
+                ++ones;
+            }
+            return true;
+        }
+
+    private:
+        bool fill(int n)
+        {
+            while (numBits < n)
+            {
+                if (in == end)
+                {
+                    return false;
+                }
+                acc |= uint64_t(*in++) << numBits;
+                numBits += 8;
+            }
+            return true;
+        }
+
+        const uint8_t* in;
+        const uint8_t* end;
+        uint64_t acc;
+        int numBits;
+    };
+
+    // CPU time used so far by the calling thread
+    uint64_t getThreadCpuNs()
+    {
+#ifdef _WIN32
+        FILETIME creation, exit, kernel, user;
+        if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+        {
+            return 0;
+        }
+        auto toTicks = [](const FILETIME& ft) { return (uint64_t(ft.dwHighDateTime) << 32) | ft.dwLowDateTime; };
+        return (toTicks(kernel) + toTicks(user)) * 100; // 100 ns units
+#else
+        timespec ts;
+        if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+        {
+            return 0;
+        }
+        return uint64_t(ts.tv_sec) * 1000000000 + uint64_t(ts.tv_nsec);
+#endif
+    }
+
+    int seek(std::FILE* f, uint64_t offset)
+    {
+#ifdef _WIN32
+        return _fseeki64(f, int64_t(offset), SEEK_SET);
+#else
+        return fseeko(f, off_t(offset), SEEK_SET);
+#endif
+    }
+
+    template <typename T>
+    void appendBytes(std::vector<uint8_t>& out, const T& value)
+    {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(&value);
+        out.insert(out.end(), p, p + sizeof(T));
+    }
+
+    template <typename T>
+    T readAs(const uint8_t* p)
+    {
+        T value;
+        std::memcpy(&value, p, sizeof(T));
+        return value;
+    }
+}
+
+
+/*** stream coding ***/
+
+void RawRecording::encodeStream(const uint32_t* values, int n, int stride, std::vector<uint8_t>& out)
+{
+    size_t start = out.size();
+    out.resize(start + maxCodedBytes(n));
+    BitWriter writer(out.data() + start);
+
+    uint32_t previous = 0;
+    uint32_t residuals[partitionSamples];
+    for (int p = 0; p < n; p += partitionSamples)
+    {
+        int count = std::min(partitionSamples, n - p);
+
+        uint64_t sum = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            uint32_t value = values[size_t(p + i) * stride];
+            residuals[i] = zigzag(value - previous);
+            previous = value;
+            sum += residuals[i];
+        }
+
+        // Rice parameter close to log2 of the mean residual
+        int k = 0;
+        while (k < 31 && (uint64_t(count) << (k + 1)) <= sum)
+        {
+            ++k;
+        }
+        writer.put(uint32_t(k), parameterBits);
+
+        const uint32_t mask = k == 0 ? 0 : (~0u >> (32 - k));
+        for (int i = 0; i < count; ++i)
+        {
+            uint32_t q = residuals[i] >> k;
+            if (q < uint32_t(escapeQuotient))
+            {
+                writer.put((1u << q) - 1, int(q) + 1); // q ones, then a zero
+                if (k > 0)
+                {
+                    writer.put(residuals[i] & mask, k);
+                }
+            }
+            else
+            {
+                writer.put((1u << escapeQuotient) - 1, escapeQuotient);
+                writer.put(residuals[i], 32);
+            }
+        }
+    }
+
+    out.resize(start + writer.finish());
+}
+
+
+bool RawRecording::decodeStream(const uint8_t* data, size_t bytes, int n, uint32_t* values, int stride)
+{
+    BitReader reader(data, bytes);
+    uint32_t previous = 0;
+
+    for (int p = 0; p < n; p += partitionSamples)
+    {
+        int count = std::min(partitionSamples, n - p);
+
+        uint32_t k;
+        if (!reader.get(parameterBits, k) || k > 31)
+        {
+            return false;
+        }
+
+        for (int i = 0; i < count; ++i)
+        {
+            int q;
+            uint32_t residual;
+            if (!reader.getUnary(escapeQuotient, q))
+            {
+                return false;
+            }
+
+            if (q == escapeQuotient)
+            {
+                if (!reader.get(32, residual))
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                uint32_t low = 0;
+                if (k > 0 && !reader.get(int(k), low))
+                {
+                    return false;
+                }
+                residual = (uint32_t(q) << k) | low;
+            }
+
+            previous += unzigzag(residual);
+            values[size_t(p + i) * stride] = previous;
+        }
+    }
+    return true;
+}
+
+
+/*** Writer ***/
+
+Writer::Writer()
+    : numChannels     (0)
+    , file            (nullptr)
+    , closedSeconds   (-1)
+    , current         (-1)
+    , dropCountdown   (0)
+    , nextSequence    (0)
+    , stopping        (false)
+    , nextToWrite     (0)
+    , fileOffset      (0)
+    , writeFailed     (false)
+    , numSamples      (0)
+    , numDropped      (0)
+    , numChunksWritten(0)
+    , numFileBytes    (0)
+    , encodeCpuNs     (0)
+{}
+
+
+Writer::~Writer()
+{
+    close();
+}
+
+
+bool Writer::open(const std::string& path, int channels, double sampleRate, double microvoltsPerCount,
+    int numWorkers)
+{
+    close();
+    setError("");
+
+    file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr)
+    {
+        setError("can't create " + path + ": " + std::strerror(errno));
+        return false;
+    }
+
+    numChannels = channels;
+
+    std::vector<uint8_t> header;
+    header.insert(header.end(), magic, magic + sizeof(magic));
+    appendBytes(header, version);
+    appendBytes(header, uint32_t(fileHeaderBytes));
+    appendBytes(header, uint32_t(numChannels));
+    appendBytes(header, uint32_t(chunkSamples));
+    appendBytes(header, sampleRate);
+    appendBytes(header, microvoltsPerCount);
+    appendBytes(header, uint64_t(0)); // index offset, written by close
+
+    if (std::fwrite(header.data(), 1, header.size(), file) != header.size())
+    {
+        setError("can't write " + path + ": " + std::strerror(errno));
+        std::fclose(file);
+        file = nullptr;
+        return false;
+    }
+
+    numWorkers = std::max(1, numWorkers);
+
+    // enough for every worker to be busy while as many chunks again are filled or wait to be written
+    chunks.resize(size_t(numWorkers) * 2 + 2);
+    freeChunks.clear();
+    for (int i = 0; i < int(chunks.size()); ++i)
+    {
+        Chunk& chunk = chunks[i];
+        chunk.samples.resize(size_t(chunkSamples) * numChannels);
+        chunk.sampleNumbers.resize(chunkSamples);
+        chunk.ttlWords.resize(chunkSamples);
+        chunk.numSamples = 0;
+        chunk.ready = false;
+        freeChunks.push_back(i);
+    }
+
+    pending.clear();
+    stopping = false;
+    current = -1;
+    dropCountdown = 0;
+    nextSequence = 0;
+    nextToWrite = 0;
+    fileOffset = uint64_t(fileHeaderBytes);
+    index.clear();
+    writeFailed = false;
+
+    numSamples = 0;
+    numDropped = 0;
+    numChunksWritten = 0;
+    numFileBytes = fileOffset;
+    encodeCpuNs = 0;
+    openTime = std::chrono::steady_clock::now();
+    closedSeconds = -1;
+
+    for (int i = 0; i < numWorkers; ++i)
+    {
+        workers.emplace_back(&Writer::runWorker, this);
+    }
+    return true;
+}
+
+
+bool Writer::isOpen() const
+{
+    return file != nullptr;
+}
+
+
+void Writer::append(const uint32_t* samples, int64_t sampleNumber, uint32_t ttl)
+{
+    if (file == nullptr)
+    {
+        return;
+    }
+
+    if (current >= 0)
+    {
+        // sample numbers are stored relative to the chunk's first, as 32-bit differences
+        const Chunk& chunk = chunks[current];
+        int64_t offset = sampleNumber - chunk.sampleNumbers[0] - chunk.numSamples;
+        if (offset != int64_t(int32_t(offset)))
+        {
+            submitCurrent();
+        }
+    }
+
+    if (current < 0)
+    {
+        if (dropCountdown > 0)
+        {
+            --dropCountdown;
+            ++numDropped;
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(queueLock);
+        if (freeChunks.empty())
+        {
+            dropCountdown = chunkSamples - 1;
+            ++numDropped;
+            return;
+        }
+        current = freeChunks.back();
+        freeChunks.pop_back();
+        chunks[current].numSamples = 0;
+    }
+
+    Chunk& chunk = chunks[current];
+    int s = chunk.numSamples++;
+    std::memcpy(&chunk.samples[size_t(s) * numChannels], samples, numChannels * sizeof(uint32_t));
+    chunk.sampleNumbers[s] = sampleNumber;
+    chunk.ttlWords[s] = ttl;
+    ++numSamples;
+
+    if (chunk.numSamples == chunkSamples)
+    {
+        submitCurrent();
+    }
+}
+
+
+void Writer::submitCurrent()
+{
+    if (current < 0)
+    {
+        return;
+    }
+
+    Chunk& chunk = chunks[current];
+    chunk.sequence = nextSequence++;
+    {
+        std::lock_guard<std::mutex> lock(queueLock);
+        pending.push_back(current);
+    }
+    workAvailable.notify_one();
+    current = -1;
+}
+
+
+void Writer::runWorker()
+{
+    while (true)
+    {
+        int c;
+        {
+            std::unique_lock<std::mutex> lock(queueLock);
+            workAvailable.wait(lock, [this] { return stopping || !pending.empty(); });
+            if (pending.empty())
+            {
+                return; // stopping, and nothing is left
+            }
+            c = pending.front();
+            pending.pop_front();
+        }
+
+        uint64_t cpuStart = getThreadCpuNs();
+        encodeChunk(chunks[c]);
+        encodeCpuNs += getThreadCpuNs() - cpuStart;
+
+        std::lock_guard<std::mutex> lock(writeLock);
+        chunks[c].ready = true;
+        writeReadyChunks();
+    }
+}
+
+
+void Writer::encodeChunk(Chunk& chunk)
+{
+    const int n = chunk.numSamples;
+    const int numStreams = numChannels + 2;
+
+    std::vector<uint8_t>& out = chunk.coded;
+    out.clear();
+
+    appendBytes(out, chunkMagic);
+    appendBytes(out, uint32_t(0)); // chunk bytes, filled in below
+    appendBytes(out, chunk.sampleNumbers[0]);
+    appendBytes(out, uint32_t(n));
+    appendBytes(out, uint32_t(numChannels));
+    appendBytes(out, uint64_t(0));
+
+    size_t lengths = out.size();
+    out.resize(lengths + size_t(numStreams) * 4);
+
+    auto addStream = [&](int stream, const uint32_t* values, int stride)
+    {
+        size_t start = out.size();
+        encodeStream(values, n, stride, out);
+        uint32_t bytes = uint32_t(out.size() - start);
+        std::memcpy(&out[lengths + size_t(stream) * 4], &bytes, 4);
+        out.resize((out.size() + 3) & ~size_t(3), 0);
+    };
+
+    // sample numbers as offsets from first + i (all 0 without gaps)
+    std::vector<uint32_t> offsets(n);
+    for (int i = 0; i < n; ++i)
+    {
+        offsets[i] = uint32_t(chunk.sampleNumbers[i] - chunk.sampleNumbers[0] - i);
+    }
+    addStream(0, offsets.data(), 1);
+    addStream(1, chunk.ttlWords.data(), 1);
+
+    for (int c = 0; c < numChannels; ++c)
+    {
+        addStream(c + 2, chunk.samples.data() + c, numChannels);
+    }
+
+    uint32_t totalBytes = uint32_t(out.size());
+    std::memcpy(&out[4], &totalBytes, 4);
+}
+
+
+void Writer::writeReadyChunks()
+{
+    while (true)
+    {
+        int c = -1;
+        for (int i = 0; i < int(chunks.size()); ++i)
+        {
+            if (chunks[i].ready && chunks[i].sequence == nextToWrite)
+            {
+                c = i;
+                break;
+            }
+        }
+        if (c < 0)
+        {
+            return;
+        }
+
+        Chunk& chunk = chunks[c];
+        if (!writeFailed)
+        {
+            if (std::fwrite(chunk.coded.data(), 1, chunk.coded.size(), file) == chunk.coded.size())
+            {
+                index.push_back({ fileOffset, chunk.sampleNumbers[0] });
+                fileOffset += chunk.coded.size();
+                numFileBytes = fileOffset;
+                ++numChunksWritten;
+            }
+            else
+            {
+                // e.g. the disk is full; drop the rest
+                writeFailed = true;
+                setError(std::string("can't write recording: ") + std::strerror(errno));
+            }
+        }
+        if (writeFailed)
+        {
+            numDropped += uint64_t(chunk.numSamples);
+        }
+
+        chunk.ready = false;
+        ++nextToWrite;
+
+        std::lock_guard<std::mutex> lock(queueLock);
+        freeChunks.push_back(c);
+    }
+}
+
+
+void Writer::close()
+{
+    if (file == nullptr)
+    {
+        return;
+    }
+
+    submitCurrent();
+    {
+        std::lock_guard<std::mutex> lock(queueLock);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+    workers.clear();
+
+    if (!writeFailed)
+    {
+        std::vector<uint8_t> footer;
+        appendBytes(footer, indexMagic);
+        appendBytes(footer, uint32_t(index.size()));
+        for (const auto& entry : index)
+        {
+            appendBytes(footer, entry.first);
+            appendBytes(footer, entry.second);
+        }
+
+        uint64_t indexOffset = fileOffset;
+        if (std::fwrite(footer.data(), 1, footer.size(), file) != footer.size()
+            || seek(file, fileHeaderBytes - 8) != 0
+            || std::fwrite(&indexOffset, 1, 8, file) != 8)
+        {
+            setError(std::string("can't write recording index: ") + std::strerror(errno));
+        }
+        else
+        {
+            numFileBytes = fileOffset + footer.size();
+        }
+    }
+
+    std::fclose(file);
+    file = nullptr;
+    closedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - openTime).count();
+
+    chunks.clear();
+    freeChunks.clear();
+    pending.clear();
+}
+
+
+Writer::Stats Writer::getStats() const
+{
+    Stats stats;
+    stats.samples = numSamples;
+    stats.droppedSamples = numDropped;
+    stats.chunks = numChunksWritten;
+    stats.packedBytes = stats.samples * uint64_t(numChannels) * 3;
+    stats.fileBytes = numFileBytes;
+    stats.encodeCpuSeconds = encodeCpuNs * 1e-9;
+
+    double closed = closedSeconds;
+    stats.wallSeconds = closed >= 0 ? closed
+        : std::chrono::duration<double>(std::chrono::steady_clock::now() - openTime).count();
+    return stats;
+}
+
+
+std::string Writer::getError() const
+{
+    std::lock_guard<std::mutex> lock(errorLock);
+    return error;
+}
+
+
+void Writer::setError(const std::string& message)
+{
+    std::lock_guard<std::mutex> lock(errorLock);
+    error = message;
+}
+
+
+/*** Reader ***/
+
+Reader::Reader()
+    : file              (nullptr)
+    , fileBytes         (0)
+    , numChannels       (0)
+    , sampleRate        (0)
+    , microvoltsPerCount(0)
+    , indexed           (false)
+{}
+
+
+Reader::~Reader()
+{
+    close();
+}
+
+
+bool Reader::open(const std::string& path)
+{
+    close();
+    error.clear();
+
+    file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        error = "can't open " + path + ": " + std::strerror(errno);
+        return false;
+    }
+
+#ifdef _WIN32
+    _fseeki64(file, 0, SEEK_END);
+    fileBytes = uint64_t(_ftelli64(file));
+#else
+    fseeko(file, 0, SEEK_END);
+    fileBytes = uint64_t(ftello(file));
+#endif
+
+    uint8_t header[fileHeaderBytes];
+    if (!readAt(0, header, sizeof(header)) || std::memcmp(header, magic, sizeof(magic)) != 0
+        || readAs<uint32_t>(header + 8) > version)
+    {
+        error = path + " is not a raw recording, or was written by a newer version";
+        close();
+        return false;
+    }
+
+    uint64_t position = readAs<uint32_t>(header + 12);
+    numChannels = int(readAs<uint32_t>(header + 16));
+    sampleRate = readAs<double>(header + 24);
+    microvoltsPerCount = readAs<double>(header + 32);
+    uint64_t indexOffset = readAs<uint64_t>(header + 40);
+
+    uint8_t entry[16];
+    if (indexOffset != 0 && readAt(indexOffset, entry, 8) && readAs<uint32_t>(entry) == indexMagic)
+    {
+        uint32_t numChunks = readAs<uint32_t>(entry + 4);
+        for (uint32_t i = 0; i < numChunks && readAt(indexOffset + 8 + uint64_t(i) * 16, entry, 16); ++i)
+        {
+            chunkOffsets.push_back(readAs<uint64_t>(entry));
+            chunkFirstSamples.push_back(readAs<int64_t>(entry + 8));
+        }
+        indexed = chunkOffsets.size() == numChunks;
+    }
+
+    if (!indexed)
+    {
+        // walk from chunk to chunk, stopping at the first that is incomplete
+        chunkOffsets.clear();
+        chunkFirstSamples.clear();
+
+        uint8_t chunkHeader[chunkHeaderBytes];
+        while (readAt(position, chunkHeader, sizeof(chunkHeader)) && readAs<uint32_t>(chunkHeader) == chunkMagic)
+        {
+            uint32_t bytes = readAs<uint32_t>(chunkHeader + 4);
+            if (bytes < uint32_t(chunkHeaderBytes) || position + bytes > fileBytes)
+            {
+                break;
+            }
+            chunkOffsets.push_back(position);
+            chunkFirstSamples.push_back(readAs<int64_t>(chunkHeader + 8));
+            position += bytes;
+        }
+    }
+    return true;
+}
+
+
+bool Reader::isOpen() const
+{
+    return file != nullptr;
+}
+
+
+void Reader::close()
+{
+    if (file != nullptr)
+    {
+        std::fclose(file);
+        file = nullptr;
+    }
+    fileBytes = 0;
+    numChannels = 0;
+    indexed = false;
+    chunkOffsets.clear();
+    chunkFirstSamples.clear();
+}
+
+
+int Reader::findChunk(int64_t sampleNumber) const
+{
+    auto it = std::upper_bound(chunkFirstSamples.begin(), chunkFirstSamples.end(), sampleNumber);
+    return it == chunkFirstSamples.begin() ? 0 : int(it - chunkFirstSamples.begin()) - 1;
+}
+
+
+bool Reader::readChunk(int chunk, std::vector<int32_t>& samples, std::vector<int64_t>& sampleNumbers,
+    std::vector<uint32_t>& ttlWords)
+{
+    if (chunk < 0 || chunk >= getNumChunks())
+    {
+        error = "no chunk " + std::to_string(chunk);
+        return false;
+    }
+
+    uint8_t header[chunkHeaderBytes];
+    if (!readAt(chunkOffsets[chunk], header, sizeof(header)))
+    {
+        return false;
+    }
+
+    uint32_t bytes = readAs<uint32_t>(header + 4);
+    int64_t first = readAs<int64_t>(header + 8);
+    int n = int(readAs<uint32_t>(header + 16));
+    int numStreams = numChannels + 2;
+    size_t tableBytes = size_t(numStreams) * 4;
+
+    if (readAs<uint32_t>(header) != chunkMagic || int(readAs<uint32_t>(header + 20)) != numChannels
+        || n > chunkSamples || bytes < chunkHeaderBytes + tableBytes)
+    {
+        error = "chunk " + std::to_string(chunk) + " is damaged";
+        return false;
+    }
+
+    buffer.resize(bytes);
+    if (!readAt(chunkOffsets[chunk], buffer.data(), bytes))
+    {
+        return false;
+    }
+
+    samples.resize(size_t(n) * numChannels);
+    sampleNumbers.resize(n);
+    ttlWords.resize(n);
+    std::vector<uint32_t> offsets(n);
+
+    size_t position = chunkHeaderBytes + tableBytes;
+    for (int stream = 0; stream < numStreams; ++stream)
+    {
+        uint32_t streamBytes = readAs<uint32_t>(&buffer[chunkHeaderBytes + size_t(stream) * 4]);
+        if (position + streamBytes > bytes)
+        {
+            error = "chunk " + std::to_string(chunk) + " is damaged";
+            return false;
+        }
+
+        uint32_t* dest = stream == 0 ? offsets.data()
+            : stream == 1 ? ttlWords.data()
+            : reinterpret_cast<uint32_t*>(samples.data()) + (stream - 2);
+        int stride = stream < 2 ? 1 : numChannels;
+
+        if (!decodeStream(&buffer[position], streamBytes, n, dest, stride))
+        {
+            error = "chunk " + std::to_string(chunk) + " is damaged";
+            return false;
+        }
+        position += (streamBytes + 3) & ~uint32_t(3);
+    }
+
+    for (int i = 0; i < n; ++i)
+    {
+        sampleNumbers[i] = first + i + int32_t(offsets[i]);
+    }
+    return true;
+}
+
+
+bool Reader::readAt(uint64_t offset, void* dest, size_t bytes)
+{
+    if (offset + bytes > fileBytes || seek(file, offset) != 0 || std::fread(dest, 1, bytes, file) != bytes)
+    {
+        error = "can't read the recording at offset " + std::to_string(offset);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,229 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+We hope that this plugin will be useful to others, but its source code
+and functionality are subject to a non-disclosure agreement (NDA) with
+Neuralynx, Inc. If you or your institution have not signed the appropriate
+NDA, STOP and do not read or execute this plugin until you have done so.
+Do not share this plugin with other parties who have not signed the NDA.
+
+*/
+
+#ifndef RAW_RECORDING_H_INCLUDED
+#define RAW_RECORDING_H_INCLUDED
+
+// Does not depend on JUCE, so it can also be used by tools outside the plugin.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Losslessly compressed recordings of the raw samples in packets (.nlxraw), with their sample
+ * numbers and TTL words.
+ *
+ * Samples are grouped into chunks of chunkSamples samples of every channel. In a chunk, each
+ * channel (and the sample numbers and TTL words) is coded separately: the difference from the
+ * previous sample, zigzag-mapped to an unsigned number, is Rice coded, with the Rice parameter
+ * chosen for each partition of partitionSamples samples. Chunks are compressed in parallel by
+ * worker threads and written in order.
+ *
+ * Layout (all fields little-endian):
+ *   file header (fileHeaderBytes):
+ *     char magic[8], uint32 version, uint32 header bytes, uint32 # of channels, uint32 chunkSamples,
+ *     double sample rate, double microvolts per count, uint64 index offset (0 if the file wasn't closed)
+ *   chunks:
+ *     uint32 chunkMagic, uint32 chunk bytes (including this header), int64 first sample number,
+ *     uint32 # of samples, uint32 # of channels, uint64 reserved (0),
+ *     uint32 coded bytes of each stream (sample numbers, TTL words, then each channel),
+ *     the coded streams, each padded to a multiple of 4 bytes
+ *   index:
+ *     uint32 indexMagic, uint32 # of chunks, then per chunk: uint64 file offset, int64 first sample number
+ * A file that wasn't closed properly has no index; the reader then finds the chunks by walking
+ * from one to the next, up to the last complete one.
+ */
+namespace RawRecording
+{
+    static const char magic[8] = { 'N', 'L', 'X', 'R', 'A', 'W', '\0', '\0' };
+    static const uint32_t version = 1;
+    static const uint32_t chunkMagic = 0x434b4e43; // "CNKC"
+    static const uint32_t indexMagic = 0x58444e49; // "INDX"
+    static const int fileHeaderBytes = 48;
+    static const int chunkHeaderBytes = 32;
+
+    static const int chunkSamples = 1024;
+    static const int partitionSamples = 256;
+
+    static const char* const extension = ".nlxraw";
+
+    /*** coding of one stream of values ***/
+
+    // Appends the coded form of n values, stride words apart, to out
+    void encodeStream(const uint32_t* values, int n, int stride, std::vector<uint8_t>& out);
+
+    // Decodes n values from bytes of coded data into values, stride words apart.
+    // Returns false if the data is truncated or malformed.
+    bool decodeStream(const uint8_t* data, size_t bytes, int n, uint32_t* values, int stride);
+
+    // Compresses samples on worker threads and writes them to a recording file
+    class Writer
+    {
+    public:
+        Writer();
+        ~Writer();
+
+        // Creates (or replaces) the file at path and starts numWorkers compression threads.
+        // Returns false on failure (see getError).
+        bool open(const std::string& path, int numChannels, double sampleRate, double microvoltsPerCount,
+            int numWorkers);
+        bool isOpen() const;
+
+        // Adds one sample of every channel (the raw words from a packet), with its sample number and TTL
+        // word. Only call from one thread. Never waits for compression or the disk: if every chunk buffer
+        // is still waiting to be compressed, the next chunk's worth of samples is dropped (and counted).
+        void append(const uint32_t* samples, int64_t sampleNumber, uint32_t ttl);
+
+        // Compresses and writes the rest, writes the index and closes the file
+        void close();
+
+        struct Stats
+        {
+            uint64_t samples;          // samples recorded (of every channel)
+            uint64_t droppedSamples;   // samples not recorded because the workers weren't keeping up
+            uint64_t chunks;           // chunks written
+            uint64_t packedBytes;      // size of the samples recorded, packed as 24 bits each
+            uint64_t fileBytes;        // size of the file so far
+            double encodeCpuSeconds;   // CPU time the workers spent compressing
+            double wallSeconds;        // time since the file was opened (until it was closed)
+        };
+
+        // May be called from any thread
+        Stats getStats() const;
+
+        std::string getError() const;
+
+    private:
+        struct Chunk
+        {
+            std::vector<uint32_t> samples; // sample-major
+            std::vector<int64_t> sampleNumbers;
+            std::vector<uint32_t> ttlWords;
+            int numSamples;
+            uint64_t sequence;
+            std::vector<uint8_t> coded;
+            bool ready;
+        };
+
+        void runWorker();
+        void encodeChunk(Chunk& chunk);
+
+        // Submits the current chunk (if any) to the workers
+        void submitCurrent();
+
+        // Writes chunks that are ready, in order (call with writeLock held)
+        void writeReadyChunks();
+
+        void setError(const std::string& message);
+
+        int numChannels;
+        std::FILE* file;
+        std::chrono::steady_clock::time_point openTime;
+        std::atomic<double> closedSeconds;
+
+        std::vector<Chunk> chunks;
+        int current;             // chunk being filled by append (-1 if none)
+        int dropCountdown;       // samples still to drop before trying to get a free chunk again
+        uint64_t nextSequence;
+
+        // queueLock guards freeChunks, pending and stopping; writeLock guards the file, index and ready flags
+        std::mutex queueLock;
+        std::condition_variable workAvailable;
+        std::vector<int> freeChunks;
+        std::deque<int> pending;
+        bool stopping;
+
+        std::mutex writeLock;
+        uint64_t nextToWrite;
+        uint64_t fileOffset;
+        std::vector<std::pair<uint64_t, int64_t>> index; // (offset, first sample number) per chunk
+        bool writeFailed;
+
+        std::vector<std::thread> workers;
+
+        std::atomic<uint64_t> numSamples;
+        std::atomic<uint64_t> numDropped;
+        std::atomic<uint64_t> numChunksWritten;
+        std::atomic<uint64_t> numFileBytes;
+        std::atomic<uint64_t> encodeCpuNs;
+
+        mutable std::mutex errorLock;
+        std::string error;
+
+        Writer(const Writer&) = delete;
+        Writer& operator=(const Writer&) = delete;
+    };
+
+    // Reads chunks from a recording file, in any order
+    class Reader
+    {
+    public:
+        Reader();
+        ~Reader();
+
+        // Returns false if the file can't be opened or is not a recording (see getError)
+        bool open(const std::string& path);
+        bool isOpen() const;
+        void close();
+
+        int getNumChannels() const     { return numChannels; }
+        double getSampleRate() const   { return sampleRate; }
+        double getMicrovoltsPerCount() const { return microvoltsPerCount; }
+
+        // Whether the file was closed properly (otherwise its chunks were found by walking through it)
+        bool hasIndex() const          { return indexed; }
+
+        int getNumChunks() const       { return int(chunkOffsets.size()); }
+        int64_t getChunkFirstSample(int chunk) const { return chunkFirstSamples[chunk]; }
+
+        // The last chunk starting at or before sampleNumber (0 if there is none)
+        int findChunk(int64_t sampleNumber) const;
+
+        // Decodes a chunk. samples is sample-major (getNumChannels() values per sample).
+        // Returns false if the chunk is damaged.
+        bool readChunk(int chunk, std::vector<int32_t>& samples, std::vector<int64_t>& sampleNumbers,
+            std::vector<uint32_t>& ttlWords);
+
+        const std::string& getError() const { return error; }
+
+    private:
+        bool readAt(uint64_t offset, void* dest, size_t bytes);
+
+        std::FILE* file;
+        uint64_t fileBytes;
+        int numChannels;
+        double sampleRate;
+        double microvoltsPerCount;
+        bool indexed;
+        std::vector<uint64_t> chunkOffsets;
+        std::vector<int64_t> chunkFirstSamples;
+        std::vector<uint8_t> buffer;
+        std::string error;
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+    };
+}
+
+#endif // RAW_RECORDING_H_INCLUDED
@@ -0,0 +1,279 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+We hope that this plugin will be useful to others, but its source code
+and functionality are subject to a non-disclosure agreement (NDA) with
+Neuralynx, Inc. If you or your institution have not signed the appropriate
+NDA, STOP and do not read or execute this plugin until you have done so.
+Do not share this plugin with other parties who have not signed the NDA.
+
+*/
+
+#ifndef RECEIVE_TELEMETRY_H_INCLUDED
+#define RECEIVE_TELEMETRY_H_INCLUDED
+
+// Does not depend on JUCE, so it can also be used by tools outside the plugin.
+
+#include "LatencyHistogram.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+/*
+ * Counters describing the receive path. Each counter has a single writer (the receiver
+ * or the decode thread), so updating one is just a relaxed load and store, with no locked
+ * instruction; any thread can read them at any time. Cheap enough to leave on in production.
+ */
+class ReceiveTelemetry
+{
+public:
+    class Counter
+    {
+    public:
+        Counter() : value(0) {}
+
+        // (only call from the counter's writer thread)
+        void add(uint64_t n = 1)   { value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+        void set(uint64_t v)       { value.store(v, std::memory_order_relaxed); }
+        void setMax(uint64_t v)    { if (v > get()) { set(v); } }
+
+        uint64_t get() const       { return value.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<uint64_t> value;
+    };
+
+    // A value that is set rather than counted (same threading rules as Counter)
+    class Gauge
+    {
+    public:
+        Gauge() : value(0) {}
+
+        void set(double v)         { value.store(v, std::memory_order_relaxed); }
+        double get() const         { return value.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<double> value;
+    };
+
+    /*** written by the receive stage ***/
+
+    Counter packets;          // datagrams received
+    Counter bytes;            // bytes received
+    Counter syscalls;         // receive calls, including ones that returned nothing
+    Counter ringOverruns;     // packets dropped because the receive ring was full
+    Counter kernelDrops;      // packets dropped by the kernel (SO_RXQ_OVFL; Linux only)
+    Counter socketErrors;     // receive calls that failed
+    Counter socketRebinds;    // sockets recreated to recover from an error or outage
+
+    /*** written by the decode stage ***/
+
+    Counter invalidPackets;   // wrong size, header or checksum
+    Counter timeouts;         // waits for a block that ran out of time
+    Counter shortBlocks;      // blocks passed on incomplete after a timeout
+    Counter gaps;             // timestamp gaps detected
+    Counter samplesFilled;    // samples inserted to fill gaps
+    Counter samplesUnfilled;  // samples missing from gaps that were too long to fill
+    Counter reorderedPackets; // duplicate or out-of-order timestamps (dropped)
+    Counter blocks;           // blocks decoded
+    Counter decodeNs;         // total time spent decoding blocks (including passing them on)
+    Counter maxDecodeNs;      // longest time spent decoding one block
+    Counter samples;          // samples passed on (including filled ones)
+    Counter ttlEdges;         // samples at which the TTL word changed (edge events)
+    Counter outages;          // times no packets arrived for the outage limit (with recovery on)
+    Counter resyncs;          // times decoding resumed after a recovery
+    Counter clockRebases;     // resyncs after which the amplifier's timestamps no longer followed on
+    Counter outageMs;         // total time from the last sample before each recovery to the first after it
+    Gauge clockDriftPpm;      // how much faster the amplifier clock runs than this computer's (0 until known)
+
+    // Time each packet spent from its arrival (the kernel's receive timestamp where available) until it
+    // was passed to the DataBuffer, in ns, and the parts that adds up to
+    enum LatencyStage
+    {
+        LATENCY_TOTAL = 0,
+        LATENCY_QUEUEING,   // arrival until the decode stage started on its block
+        LATENCY_DECODE,     // decoding (and the shared memory output) until the hand-off began
+        LATENCY_HANDOFF,    // addToBuffer
+        numLatencyStages
+    };
+
+    LatencyHistogram latency[numLatencyStages];
+
+    static const char* getLatencyStageName(int stage)
+    {
+        static const char* const names[numLatencyStages] = { "total", "queueing", "decode", "hand-off" };
+        return names[stage];
+    }
+
+    struct Snapshot
+    {
+        double seconds; // steady clock time the snapshot was taken
+
+        uint64_t packets, bytes, syscalls, ringOverruns, kernelDrops;
+        uint64_t invalidPackets, timeouts, shortBlocks, gaps, samplesFilled, samplesUnfilled;
+        uint64_t reorderedPackets, blocks, decodeNs, maxDecodeNs;
+        uint64_t samples, ttlEdges;
+        uint64_t socketErrors, socketRebinds, outages, resyncs, clockRebases, outageMs;
+        double clockDriftPpm;
+    };
+
+    // Rates and averages over the interval between two snapshots
+    struct Rates
+    {
+        double packetsPerSecond;
+        double megabytesPerSecond;
+        double packetsPerSyscall;
+        double decodeUsPerBlock;
+        double samplesPerSecond;
+        double ttlEdgesPerSecond;
+    };
+
+    Snapshot getSnapshot() const
+    {
+        Snapshot s;
+        s.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        s.packets = packets.get();
+        s.bytes = bytes.get();
+        s.syscalls = syscalls.get();
+        s.ringOverruns = ringOverruns.get();
+        s.kernelDrops = kernelDrops.get();
+        s.invalidPackets = invalidPackets.get();
+        s.timeouts = timeouts.get();
+        s.shortBlocks = shortBlocks.get();
+        s.gaps = gaps.get();
+        s.samplesFilled = samplesFilled.get();
+        s.samplesUnfilled = samplesUnfilled.get();
+        s.reorderedPackets = reorderedPackets.get();
+        s.blocks = blocks.get();
+        s.decodeNs = decodeNs.get();
+        s.maxDecodeNs = maxDecodeNs.get();
+        s.samples = samples.get();
+        s.ttlEdges = ttlEdges.get();
+        s.socketErrors = socketErrors.get();
+        s.socketRebinds = socketRebinds.get();
+        s.outages = outages.get();
+        s.resyncs = resyncs.get();
+        s.clockRebases = clockRebases.get();
+        s.outageMs = outageMs.get();
+        s.clockDriftPpm = clockDriftPpm.get();
+        return s;
+    }
+
+    // Totals of two sets of counters (e.g. from different streams) taken at about the same time
+    static Snapshot combine(const Snapshot& a, const Snapshot& b)
+    {
+        Snapshot s = a;
+        s.seconds = b.seconds > a.seconds ? b.seconds : a.seconds;
+        s.packets += b.packets;
+        s.bytes += b.bytes;
+        s.syscalls += b.syscalls;
+        s.ringOverruns += b.ringOverruns;
+        s.kernelDrops += b.kernelDrops;
+        s.invalidPackets += b.invalidPackets;
+        s.timeouts += b.timeouts;
+        s.shortBlocks += b.shortBlocks;
+        s.gaps += b.gaps;
+        s.samplesFilled += b.samplesFilled;
+        s.samplesUnfilled += b.samplesUnfilled;
+        s.reorderedPackets += b.reorderedPackets;
+        s.blocks += b.blocks;
+        s.decodeNs += b.decodeNs;
+        s.maxDecodeNs = b.maxDecodeNs > a.maxDecodeNs ? b.maxDecodeNs : a.maxDecodeNs;
+        s.samples += b.samples;
+        s.ttlEdges += b.ttlEdges;
+        s.socketErrors += b.socketErrors;
+        s.socketRebinds += b.socketRebinds;
+        s.outages += b.outages;
+        s.resyncs += b.resyncs;
+        s.clockRebases += b.clockRebases;
+        s.outageMs += b.outageMs;
+        // (the drift of each stream is its own; keep a's)
+        return s;
+    }
+
+    static Rates getRates(const Snapshot& previous, const Snapshot& current)
+    {
+        Rates r = {};
+        double seconds = current.seconds - previous.seconds;
+        if (seconds > 0)
+        {
+            r.packetsPerSecond = (current.packets - previous.packets) / seconds;
+            r.megabytesPerSecond = (current.bytes - previous.bytes) / seconds / 1e6;
+            r.samplesPerSecond = (current.samples - previous.samples) / seconds;
+            r.ttlEdgesPerSecond = (current.ttlEdges - previous.ttlEdges) / seconds;
+        }
+
+        uint64_t syscalls = current.syscalls - previous.syscalls;
+        if (syscalls > 0)
+        {
+            r.packetsPerSyscall = double(current.packets - previous.packets) / syscalls;
+        }
+
+        uint64_t blocks = current.blocks - previous.blocks;
+        if (blocks > 0)
+        {
+            r.decodeUsPerBlock = (current.decodeNs - previous.decodeNs) / 1000.0 / blocks;
+        }
+        return r;
+    }
+
+    // Reset all counters. Only call while neither stage is running.
+    void reset()
+    {
+        Counter* all[] = { &packets, &bytes, &syscalls, &ringOverruns, &kernelDrops,
+            &invalidPackets, &timeouts, &shortBlocks, &gaps, &samplesFilled, &samplesUnfilled,
+            &reorderedPackets, &blocks, &decodeNs, &maxDecodeNs, &samples, &ttlEdges,
+            &socketErrors, &socketRebinds, &outages, &resyncs, &clockRebases, &outageMs };
+
+        for (Counter* c : all)
+        {
+            c->set(0);
+        }
+        clockDriftPpm.set(0);
+
+        for (LatencyHistogram& histogram : latency)
+        {
+            histogram.reset();
+        }
+    }
+
+    /*** CSV log (one row per interval between snapshots; counters are cumulative) ***/
+
+    static std::string getCsvHeader()
+    {
+        return "seconds,packets_per_s,mb_per_s,packets_per_syscall,decode_us_per_block,"
+            "packets,bytes,syscalls,ring_overruns,kernel_drops,invalid_packets,timeouts,short_blocks,"
+            "gaps,samples_filled,samples_unfilled,reordered_packets,blocks,max_decode_us,clock_drift_ppm,"
+            "samples_per_s,ttl_edges_per_s,samples,ttl_edges,"
+            "socket_errors,socket_rebinds,outages,resyncs,clock_rebases,outage_ms";
+    }
+
+    static std::string getCsvRow(const Snapshot& start, const Snapshot& previous, const Snapshot& current)
+    {
+        Rates r = getRates(previous, current);
+
+        std::ostringstream row;
+        row << (current.seconds - start.seconds) << ',' << r.packetsPerSecond << ',' << r.megabytesPerSecond
+            << ',' << r.packetsPerSyscall << ',' << r.decodeUsPerBlock
+            << ',' << current.packets << ',' << current.bytes << ',' << current.syscalls
+            << ',' << current.ringOverruns << ',' << current.kernelDrops << ',' << current.invalidPackets
+            << ',' << current.timeouts << ',' << current.shortBlocks << ',' << current.gaps
+            << ',' << current.samplesFilled << ',' << current.samplesUnfilled << ',' << current.reorderedPackets
+            << ',' << current.blocks << ',' << current.maxDecodeNs / 1000.0 << ',' << current.clockDriftPpm
+            << ',' << r.samplesPerSecond << ',' << r.ttlEdgesPerSecond
+            << ',' << current.samples << ',' << current.ttlEdges
+            << ',' << current.socketErrors << ',' << current.socketRebinds << ',' << current.outages
+            << ',' << current.resyncs << ',' << current.clockRebases << ',' << current.outageMs;
+        return row.str();
+    }
+};
+
+#endif // RECEIVE_TELEMETRY_H_INCLUDED
@@ -0,0 +1,291 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+We hope that this plugin will be useful to others, but its source code
+and functionality are subject to a non-disclosure agreement (NDA) with
+Neuralynx, Inc. If you or your institution have not signed the appropriate
+NDA, STOP and do not read or execute this plugin until you have done so.
+Do not share this plugin with other parties who have not signed the NDA.
+
+*/
+
+#include "ReceiveTuning.h"
+
+#include <cerrno>
+#include <cstring>
+#include <thread>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <WinSock2.h>
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#endif
+
+#if defined(__linux__) && !defined(SO_BUSY_POLL)
+#define SO_BUSY_POLL 46 // (missing from older libc headers)
+#endif
+
+namespace ReceiveTuning
+{
+    namespace
+    {
+        Result makeResult(State state, const std::string& detail)
+        {
+            Result result;
+            result.state = state;
+            result.detail = detail;
+            return result;
+        }
+
+        std::string errorString(int error)
+        {
+            return std::strerror(error);
+        }
+
+#ifdef _WIN32
+        typedef int OptLen;
+        typedef char OptVal;
+
+        int lastSocketError() { return WSAGetLastError(); }
+#else
+        typedef socklen_t OptLen;
+        typedef void OptVal;
+
+        int lastSocketError() { return errno; }
+#endif
+
+        // Current receive buffer in bytes of payload, or -1 if it can't be read
+        int getReceiveBuffer(int socketHandle)
+        {
+            int bytes = 0;
+            OptLen len = sizeof(bytes);
+            if (getsockopt(socketHandle, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<OptVal*>(&bytes), &len) != 0)
+            {
+                return -1;
+            }
+#ifdef __linux__
+            // Linux reports double the requested size, to account for its bookkeeping overhead
+            bytes /= 2;
+#endif
+            return bytes;
+        }
+    }
+
+
+    bool isValid(const Settings& settings)
+    {
+        return settings.rcvBufKB >= 0 && settings.rcvBufKB <= maxRcvBufKB
+            && settings.busyPollUs >= 0 && settings.busyPollUs <= maxBusyPollUs
+            && settings.rtPriority >= 0 && settings.rtPriority <= maxRtPriority
+            && settings.cpu >= -1 && settings.cpu < getNumCpus();
+    }
+
+
+    const char* getSettingName(Setting setting)
+    {
+        switch (setting)
+        {
+        case RCVBUF:       return "receive buffer";
+        case BUSY_POLL:    return "socket busy-poll";
+        case RT_PRIORITY:  return "real-time priority";
+        case CPU_AFFINITY: return "CPU pinning";
+        default:           return "";
+        }
+    }
+
+
+    const char* getStateName(State state)
+    {
+        switch (state)
+        {
+        case PENDING:     return "pending";
+        case APPLIED:     return "applied";
+        case LIMITED:     return "limited";
+        case REFUSED:     return "refused";
+        case UNSUPPORTED: return "unsupported";
+        default:          return "default";
+        }
+    }
+
+
+    Result setReceiveBuffer(int socketHandle, int kb)
+    {
+        if (kb <= 0)
+        {
+            int current = getReceiveBuffer(socketHandle);
+            return makeResult(NOT_REQUESTED, current < 0 ? std::string("OS default")
+                : "OS default (" + std::to_string(current / 1024) + " KB)");
+        }
+
+        int bytes = kb * 1024;
+        if (setsockopt(socketHandle, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const OptVal*>(&bytes), sizeof(bytes)) != 0)
+        {
+            return makeResult(REFUSED, "setsockopt(SO_RCVBUF) failed: " + errorString(lastSocketError()));
+        }
+
+        int got = getReceiveBuffer(socketHandle);
+
+#ifdef __linux__
+        if (got >= 0 && got < bytes)
+        {
+            // SO_RCVBUF is silently capped at net.core.rmem_max; privileged processes can exceed it
+            setsockopt(socketHandle, SOL_SOCKET, SO_RCVBUFFORCE, &bytes, sizeof(bytes));
+            got = getReceiveBuffer(socketHandle);
+        }
+#endif
+
+        if (got < 0)
+        {
+            return makeResult(APPLIED, "requested " + std::to_string(kb) + " KB (could not read back)");
+        }
+        if (got < bytes)
+        {
+            return makeResult(LIMITED, "got " + std::to_string(got / 1024) + " of " + std::to_string(kb)
+#ifdef __linux__
+                + " KB; raise net.core.rmem_max"
+#else
+                + " KB"
+#endif
+            );
+        }
+        return makeResult(APPLIED, std::to_string(got / 1024) + " KB");
+    }
+
+
+    Result setBusyPoll(int socketHandle, int us)
+    {
+        if (us <= 0)
+        {
+            return makeResult(NOT_REQUESTED, "off");
+        }
+
+#ifdef __linux__
+        if (setsockopt(socketHandle, SOL_SOCKET, SO_BUSY_POLL, &us, sizeof(us)) != 0)
+        {
+            int error = errno;
+            return makeResult(REFUSED, "setsockopt(SO_BUSY_POLL) failed: " + errorString(error)
+                + (error == EPERM ? " (above net.core.busy_poll; needs CAP_NET_ADMIN)" : ""));
+        }
+
+        int got = 0;
+        socklen_t len = sizeof(got);
+        if (getsockopt(socketHandle, SOL_SOCKET, SO_BUSY_POLL, &got, &len) == 0 && got != us)
+        {
+            return makeResult(LIMITED, "got " + std::to_string(got) + " us");
+        }
+        return makeResult(APPLIED, std::to_string(us) + " us");
+#else
+        (void)socketHandle;
+        return makeResult(UNSUPPORTED, "SO_BUSY_POLL is Linux only");
+#endif
+    }
+
+
+    Result setRealtimePriority(int priority)
+    {
+        if (priority <= 0)
+        {
+            return makeResult(NOT_REQUESTED, "normal scheduling");
+        }
+
+#ifdef _WIN32
+        // no SCHED_FIFO; the closest is the highest priority within the process's class
+        if (!SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL))
+        {
+            return makeResult(REFUSED, "SetThreadPriority failed (error " + std::to_string(GetLastError()) + ")");
+        }
+        return makeResult(LIMITED, "time-critical thread priority (Windows has no SCHED_FIFO)");
+#else
+        int maxPriority = sched_get_priority_max(SCHED_FIFO);
+        int requested = priority;
+        if (maxPriority > 0 && priority > maxPriority)
+        {
+            priority = maxPriority;
+        }
+
+        sched_param param;
+        std::memset(&param, 0, sizeof(param));
+        param.sched_priority = priority;
+
+        int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (error != 0)
+        {
+            return makeResult(REFUSED, "SCHED_FIFO " + std::to_string(priority) + " refused: " + errorString(error)
+                + (error == EPERM ? " (needs CAP_SYS_NICE or an rtprio limit)" : ""));
+        }
+
+        int policy = 0;
+        if (pthread_getschedparam(pthread_self(), &policy, &param) == 0
+            && (policy != SCHED_FIFO || param.sched_priority != priority))
+        {
+            return makeResult(REFUSED, "SCHED_FIFO " + std::to_string(priority) + " did not take effect");
+        }
+
+        if (priority != requested)
+        {
+            return makeResult(LIMITED, "SCHED_FIFO " + std::to_string(priority) + " (maximum)");
+        }
+        return makeResult(APPLIED, "SCHED_FIFO " + std::to_string(priority));
+#endif
+    }
+
+
+    Result setCpuAffinity(int cpu)
+    {
+        if (cpu < 0)
+        {
+            return makeResult(NOT_REQUESTED, "any CPU");
+        }
+
+        if (cpu >= getNumCpus())
+        {
+            return makeResult(REFUSED, "CPU " + std::to_string(cpu) + " does not exist");
+        }
+
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+
+        int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (error != 0)
+        {
+            return makeResult(REFUSED, "pinning to CPU " + std::to_string(cpu) + " refused: " + errorString(error)
+                + (error == EINVAL ? " (not in this process's cpuset?)" : ""));
+        }
+
+        cpu_set_t got;
+        CPU_ZERO(&got);
+        if (pthread_getaffinity_np(pthread_self(), sizeof(got), &got) == 0
+            && (CPU_COUNT(&got) != 1 || !CPU_ISSET(cpu, &got)))
+        {
+            return makeResult(REFUSED, "pinning to CPU " + std::to_string(cpu) + " did not take effect");
+        }
+        return makeResult(APPLIED, "CPU " + std::to_string(cpu));
+#elif defined(_WIN32)
+        if (cpu >= 64 || SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) == 0)
+        {
+            return makeResult(REFUSED, "SetThreadAffinityMask failed for CPU " + std::to_string(cpu));
+        }
+        return makeResult(APPLIED, "CPU " + std::to_string(cpu));
+#else
+        return makeResult(UNSUPPORTED, "thread pinning is not supported on this platform");
+#endif
+    }
+
+
+    int getNumCpus()
+    {
+        unsigned n = std::thread::hardware_concurrency();
+        return n > 0 ? int(n) : 1;
+    }
+}
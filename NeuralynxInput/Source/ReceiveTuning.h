@@ -0,0 +1,86 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+We hope that this plugin will be useful to others, but its source code
+and functionality are subject to a non-disclosure agreement (NDA) with
+Neuralynx, Inc. If you or your institution have not signed the appropriate
+NDA, STOP and do not read or execute this plugin until you have done so.
+Do not share this plugin with other parties who have not signed the NDA.
+
+*/
+
+#ifndef RECEIVE_TUNING_H_INCLUDED
+#define RECEIVE_TUNING_H_INCLUDED
+
+// Does not depend on JUCE, so it can also be used by tools outside the plugin.
+
+#include <string>
+
+/*
+ * OS-level tuning of the receive path: socket options for the data socket and scheduling
+ * of the receiver thread. Each function tries to apply one setting, reads it back where
+ * the OS allows, and says whether it took effect, so that a refused setting is never silent.
+ */
+namespace ReceiveTuning
+{
+    struct Settings
+    {
+        int rcvBufKB = 0;   // socket receive buffer (SO_RCVBUF) in KB; 0 = OS default
+        int busyPollUs = 0; // kernel busy polling on the socket (SO_BUSY_POLL; Linux only); 0 = off
+        int rtPriority = 0; // SCHED_FIFO priority of the receiver thread, 1-99; 0 = normal scheduling
+        int cpu = -1;       // CPU to pin the receiver thread to; -1 = any
+    };
+
+    static const int maxRcvBufKB = 512 * 1024;
+    static const int maxBusyPollUs = 1000;
+    static const int maxRtPriority = 99;
+
+    // Whether the values are in range (cpu is checked against the CPUs present)
+    bool isValid(const Settings& settings);
+
+    enum Setting
+    {
+        RCVBUF = 0,
+        BUSY_POLL,
+        RT_PRIORITY,
+        CPU_AFFINITY,
+        numSettings
+    };
+
+    enum State
+    {
+        NOT_REQUESTED = 0, // left at the OS default
+        PENDING,           // will be applied at the start of acquisition
+        APPLIED,           // took effect as requested
+        LIMITED,           // took effect, but the OS capped the value (see detail)
+        REFUSED,           // the OS refused (see detail)
+        UNSUPPORTED        // not available on this platform
+    };
+
+    struct Result
+    {
+        State state = NOT_REQUESTED;
+        std::string detail; // human-readable outcome, e.g. "got 416 KB (net.core.rmem_max)"
+    };
+
+    const char* getSettingName(Setting setting);
+    const char* getStateName(State state);
+
+    // Socket options. socketHandle is the native socket (e.g. DatagramSocket::getRawSocketHandle()).
+    Result setReceiveBuffer(int socketHandle, int kb);
+    Result setBusyPoll(int socketHandle, int us);
+
+    // Scheduling of the calling thread
+    Result setRealtimePriority(int priority);
+    Result setCpuAffinity(int cpu);
+
+    // Number of CPUs the affinity setting can refer to
+    int getNumCpus();
+}
+
+#endif // RECEIVE_TUNING_H_INCLUDED
@@ -0,0 +1,285 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+We hope that this plugin will be useful to others, but its source code
+and functionality are subject to a non-disclosure agreement (NDA) with
+Neuralynx, Inc. If you or your institution have not signed the appropriate
+NDA, STOP and do not read or execute this plugin until you have done so.
+Do not share this plugin with other parties who have not signed the NDA.
+
+*/
+
+#include "ShardedDecoder.h"
+
+#include <algorithm>
+#include <chrono>
+
+ShardedDecoder::ShardedDecoder()
+    : boardDecoder  (PacketKernel::getBoardDecoder())
+    , numThreads    (1)
+    , spinUs        (0)
+    , shares        (new Share[maxThreads])
+    , packets       (nullptr)
+    , numPackets    (0)
+    , numBoards     (0)
+    , scale         (1)
+    , out           (nullptr)
+    , stride        (0)
+    , blockNumber   (0)
+    , tasksLeft     (0)
+    , stopping      (false)
+    , numSleeping   (0)
+    , numTasks      (0)
+    , numSteals     (0)
+{
+    for (int w = 0; w < maxThreads; ++w)
+    {
+        shares[w].range.store(0, std::memory_order_relaxed);
+    }
+}
+
+
+ShardedDecoder::~ShardedDecoder()
+{
+    stop();
+}
+
+
+void ShardedDecoder::start(int threads, int spin, std::function<void(int)> onStart)
+{
+    stop();
+
+    numThreads = std::min(std::max(threads, 1), int(maxThreads));
+    spinUs = spin;
+    onHelperStart = onStart;
+    numTasks.store(0, std::memory_order_relaxed);
+    numSteals.store(0, std::memory_order_relaxed);
+
+    for (int w = 1; w < numThreads; ++w)
+    {
+        helpers.emplace_back(&ShardedDecoder::runHelper, this, w);
+    }
+}
+
+
+void ShardedDecoder::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepLock);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (std::thread& helper : helpers)
+    {
+        helper.join();
+    }
+    helpers.clear();
+
+    stopping = false;
+    numThreads = 1;
+}
+
+
+void ShardedDecoder::decode(const uint32_t* const* blockPackets, int blockNumPackets, int blockNumBoards,
+    float blockScale, float* blockOut, int blockStride, bool* valid)
+{
+    if (blockNumPackets <= 0)
+    {
+        return;
+    }
+
+    packets = blockPackets;
+    numPackets = blockNumPackets;
+    numBoards = blockNumBoards;
+    scale = blockScale;
+    out = blockOut;
+    stride = blockStride;
+    boardXor.resize(size_t(numBoards) * numPackets);
+
+    // even shares (some are empty if there are more threads than boards)
+    uint32_t block = blockNumber.load(std::memory_order_relaxed) + 1;
+    for (int w = 0; w < numThreads; ++w)
+    {
+        shares[w].range.store(packRange(block, numBoards * w / numThreads, numBoards * (w + 1) / numThreads),
+            std::memory_order_relaxed);
+    }
+    tasksLeft.store(numBoards, std::memory_order_relaxed);
+
+    // announce the block; sleeping helpers are woken, but as their shares can be stolen, the block
+    // doesn't wait for them
+    blockNumber.store(block);
+    if (numSleeping.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(sleepLock);
+        wake.notify_all();
+    }
+
+    work(0, block);
+
+    // boards other workers took and are still decoding
+    while (tasksLeft.load(std::memory_order_acquire) > 0)
+    {
+        std::this_thread::yield();
+    }
+
+    for (int k = 0; k < numPackets; ++k)
+    {
+        if (packets[k] == nullptr)
+        {
+            valid[k] = false;
+            continue;
+        }
+
+        uint32_t crcValue = PacketKernel::headerFooterXor(packets[k], numBoards);
+        for (int b = 0; b < numBoards; ++b)
+        {
+            crcValue ^= boardXor[size_t(b) * numPackets + k];
+        }
+        valid[k] = crcValue == 0;
+    }
+}
+
+
+int ShardedDecoder::takeFront(Share& share, uint32_t block)
+{
+    uint64_t range = share.range.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        int first = int((range >> 16) & 0xffff);
+        int end = int(range & 0xffff);
+        if (uint32_t(range >> 32) != block || first >= end)
+        {
+            return -1;
+        }
+        if (share.range.compare_exchange_weak(range, packRange(block, first + 1, end), std::memory_order_acquire,
+            std::memory_order_relaxed))
+        {
+            return first;
+        }
+    }
+}
+
+
+int ShardedDecoder::takeBack(Share& share, uint32_t block)
+{
+    uint64_t range = share.range.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        int first = int((range >> 16) & 0xffff);
+        int end = int(range & 0xffff);
+        if (uint32_t(range >> 32) != block || first >= end)
+        {
+            return -1;
+        }
+        if (share.range.compare_exchange_weak(range, packRange(block, first, end - 1), std::memory_order_acquire,
+            std::memory_order_relaxed))
+        {
+            return end - 1;
+        }
+    }
+}
+
+
+void ShardedDecoder::work(int w, uint32_t block)
+{
+    int board;
+    while ((board = takeFront(shares[w], block)) >= 0)
+    {
+        decodeBoard(board);
+        numTasks.fetch_add(1, std::memory_order_relaxed);
+        tasksLeft.fetch_sub(1, std::memory_order_release);
+    }
+
+    // own share done; steal from the largest one left until there are none
+    for (;;)
+    {
+        int victim = -1;
+        int mostLeft = 0;
+        for (int v = 0; v < numThreads; ++v)
+        {
+            uint64_t range = shares[v].range.load(std::memory_order_relaxed);
+            int left = int(range & 0xffff) - int((range >> 16) & 0xffff);
+            if (uint32_t(range >> 32) == block && left > mostLeft)
+            {
+                victim = v;
+                mostLeft = left;
+            }
+        }
+
+        if (victim < 0)
+        {
+            return;
+        }
+
+        board = takeBack(shares[victim], block);
+        if (board >= 0)
+        {
+            decodeBoard(board);
+            numTasks.fetch_add(1, std::memory_order_relaxed);
+            numSteals.fetch_add(1, std::memory_order_relaxed);
+            tasksLeft.fetch_sub(1, std::memory_order_release);
+        }
+    }
+}
+
+
+void ShardedDecoder::decodeBoard(int board)
+{
+    const int offset = board * PacketKernel::boardChannels;
+    uint32_t* crcValues = &boardXor[size_t(board) * numPackets];
+
+    for (int k = 0; k < numPackets; ++k)
+    {
+        if (packets[k] == nullptr)
+        {
+            crcValues[k] = 0;
+            continue;
+        }
+        crcValues[k] = boardDecoder(packets[k] + PacketKernel::headerWords + offset, 1, scale,
+            out + size_t(k) * stride + offset);
+    }
+}
+
+
+void ShardedDecoder::runHelper(int w)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    if (onHelperStart)
+    {
+        onHelperStart(w);
+    }
+
+    uint32_t seen = blockNumber.load(std::memory_order_acquire);
+    Clock::time_point lastWork = Clock::now();
+
+    while (!stopping)
+    {
+        uint32_t block = blockNumber.load(std::memory_order_acquire);
+        if (block != seen)
+        {
+            seen = block;
+            work(w, block);
+            lastWork = Clock::now();
+            continue;
+        }
+
+        if (spinUs < 0 || Clock::now() - lastWork < std::chrono::microseconds(spinUs))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // (decode checks numSleeping after announcing a block, so either it wakes us or we see the block)
+        std::unique_lock<std::mutex> lock(sleepLock);
+        numSleeping.fetch_add(1);
+        wake.wait(lock, [this, seen] { return stopping || blockNumber.load() != seen; });
+        numSleeping.fetch_sub(1);
+    }
+}
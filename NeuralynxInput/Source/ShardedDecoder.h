@@ -0,0 +1,130 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+We hope that this plugin will be useful to others, but its source code
+and functionality are subject to a non-disclosure agreement (NDA) with
+Neuralynx, Inc. If you or your institution have not signed the appropriate
+NDA, STOP and do not read or execute this plugin until you have done so.
+Do not share this plugin with other parties who have not signed the NDA.
+
+*/
+
+#ifndef SHARDED_DECODER_H_INCLUDED
+#define SHARDED_DECODER_H_INCLUDED
+
+// Does not depend on JUCE, so it can also be used by tools outside the plugin.
+
+#include "PacketKernel.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Decodes a block of packets on several threads, for configurations with so many boards that one
+ * thread can't keep up. The boards are the units of work: a task is one board (32 channels) of every
+ * packet in the block, so each thread writes its own columns of the output rows, and a board's
+ * columns are two whole cache lines if the rows are aligned.
+ *
+ * The thread calling decode is one of the workers and the others are helper threads. Each worker
+ * starts a block with an even share of the boards, which it takes from the front; once its share is
+ * used up, it steals from the back of the largest share left. A share is a range packed into one
+ * atomic word along with the block's number, so taking a task is one compare-and-swap and a worker
+ * that is late for a block can't take a task from the next one.
+ */
+class ShardedDecoder
+{
+public:
+    static const int maxThreads = PacketKernel::maxBoards;
+
+    ShardedDecoder();
+    ~ShardedDecoder();
+
+    // Starts numThreads - 1 helper threads (1 = decode on the calling thread only). Between blocks, the
+    // helpers spin for spinUs before sleeping until the next one; -1 = always spin, which keeps the
+    // helpers' cores busy but wakes them soonest. If given, onHelperStart is called on each helper
+    // thread (with its worker number, 1..numThreads - 1) before it starts waiting for blocks, e.g. to
+    // set its priority and affinity.
+    void start(int numThreads, int spinUs, std::function<void(int)> onHelperStart = nullptr);
+    void stop();
+
+    bool isRunning() const         { return numThreads > 1; }
+    int getNumThreads() const      { return numThreads; }
+
+    // Decodes numPackets packets of numBoards boards (see PacketKernel::Decoder): packets[k] is converted
+    // into out + k * stride and valid[k] set to whether its checksum is valid. A null packet is skipped
+    // (and not valid). Headers are not checked. Only call from one thread at a time.
+    void decode(const uint32_t* const* packets, int numPackets, int numBoards, float scale,
+        float* out, int stride, bool* valid);
+
+    // Board tasks done this run, and how many of them were stolen from another worker's share
+    uint64_t getNumTasks() const   { return numTasks.load(std::memory_order_relaxed); }
+    uint64_t getNumSteals() const  { return numSteals.load(std::memory_order_relaxed); }
+
+private:
+    // One worker's boards in the current block: block number << 32 | first << 16 | end
+    // (padded so that each share is on its own cache line)
+    struct Share
+    {
+        std::atomic<uint64_t> range;
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    static uint64_t packRange(uint32_t block, int first, int end)
+    {
+        return (uint64_t(block) << 32) | (uint64_t(first) << 16) | uint64_t(end);
+    }
+
+    // Takes a board from the front of a share (own) or the back (stolen). Returns -1 if the
+    // share is empty or belongs to another block.
+    int takeFront(Share& share, uint32_t block);
+    int takeBack(Share& share, uint32_t block);
+
+    // Does tasks of the given block, as worker w, until none are left to take
+    void work(int w, uint32_t block);
+    void decodeBoard(int board);
+    void runHelper(int w);
+
+    PacketKernel::BoardDecoder boardDecoder;
+
+    int numThreads;
+    int spinUs;
+    std::function<void(int)> onHelperStart;
+    std::vector<std::thread> helpers;
+    std::unique_ptr<Share[]> shares;
+
+    // the current block (written by decode before it is announced)
+    const uint32_t* const* packets;
+    int numPackets;
+    int numBoards;
+    float scale;
+    float* out;
+    int stride;
+    std::vector<uint32_t> boardXor; // [board * numPackets + k]
+
+    std::atomic<uint32_t> blockNumber; // announces a block to the helpers
+    std::atomic<int> tasksLeft;        // boards of the current block not finished yet
+    std::atomic<bool> stopping;
+
+    std::mutex sleepLock;
+    std::condition_variable wake;
+    std::atomic<int> numSleeping;
+
+    std::atomic<uint64_t> numTasks;
+    std::atomic<uint64_t> numSteals;
+
+    ShardedDecoder(const ShardedDecoder&) = delete;
+    ShardedDecoder& operator=(const ShardedDecoder&) = delete;
+};
+
+#endif // SHARDED_DECODER_H_INCLUDED
@@ -0,0 +1,584 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+We hope that this plugin will be useful to others, but its source code
+and functionality are subject to a non-disclosure agreement (NDA) with
+Neuralynx, Inc. If you or your institution have not signed the appropriate
+NDA, STOP and do not read or execute this plugin until you have done so.
+Do not share this plugin with other parties who have not signed the NDA.
+
+*/
+
+#include "SharedMemoryRing.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+using namespace SharedMemoryRing;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "the ring's counters must be lock-free to be shared between processes");
+
+namespace
+{
+    const intptr_t noHandle = -1;
+
+    // slots start on a cache line
+    const size_t headerBytes = (sizeof(Header) + 63) & ~size_t(63);
+
+    size_t getSlotBytes(int numChannels)
+    {
+        return (slotHeaderBytes + size_t(numChannels) * sizeof(float) + 7) & ~size_t(7);
+    }
+
+    std::string lastErrorString()
+    {
+#ifdef _WIN32
+        return "error " + std::to_string(GetLastError());
+#else
+        return std::strerror(errno);
+#endif
+    }
+
+    // POSIX shm names start with a slash; Windows names are per session
+    std::string getSystemName(const std::string& name)
+    {
+#ifdef _WIN32
+        return "Local\\" + name;
+#else
+        return "/" + name;
+#endif
+    }
+
+    void closeHandle(intptr_t& h)
+    {
+#ifdef _WIN32
+        if (h != noHandle)
+        {
+            CloseHandle(reinterpret_cast<HANDLE>(h));
+        }
+#endif
+        h = noHandle;
+    }
+
+    void unmap(const void* base, size_t bytes)
+    {
+#ifdef _WIN32
+        (void)bytes;
+        UnmapViewOfFile(base);
+#else
+        munmap(const_cast<void*>(base), bytes);
+#endif
+    }
+}
+
+
+uint64_t SharedMemoryRing::getMonotonicNs()
+{
+#ifdef _WIN32
+    static const double nsPerTick = []
+    {
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+        return 1e9 / double(frequency.QuadPart);
+    }();
+
+    LARGE_INTEGER ticks;
+    QueryPerformanceCounter(&ticks);
+    return uint64_t(double(ticks.QuadPart) * nsPerTick);
+#else
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000 + uint64_t(ts.tv_nsec);
+#endif
+}
+
+
+std::string SharedMemoryRing::getStreamName(int stream)
+{
+    return stream > 0 ? "nlx_input_stream" + std::to_string(stream + 1) : "nlx_input";
+}
+
+
+/*** Writer ***/
+
+Writer::Writer()
+    : handle      (noHandle)
+    , header      (nullptr)
+    , slots       (nullptr)
+    , edgeRecords (nullptr)
+    , mappedBytes (0)
+    , written     (0)
+    , edgesWritten(0)
+{}
+
+
+Writer::~Writer()
+{
+    close();
+}
+
+
+bool Writer::create(const std::string& newName, int numChannels, int capacity, double sampleRate)
+{
+    close();
+    error.clear();
+
+    uint32_t slotCount = 1;
+    while (slotCount < uint32_t(std::max(capacity, 2)))
+    {
+        slotCount *= 2;
+    }
+    const size_t slotBytes = getSlotBytes(numChannels);
+    const size_t bytes = headerBytes + slotCount * slotBytes + size_t(numEdgeRecords) * edgeRecordBytes;
+    const std::string systemName = getSystemName(newName);
+
+    void* base;
+#ifdef _WIN32
+    HANDLE h = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+        DWORD(uint64_t(bytes) >> 32), DWORD(bytes), systemName.c_str());
+    if (h == nullptr)
+    {
+        error = "can't create shared memory " + newName + ": " + lastErrorString();
+        return false;
+    }
+    handle = reinterpret_cast<intptr_t>(h);
+
+    // (if a reader still has the last one open, it is reused)
+    base = MapViewOfFile(h, FILE_MAP_ALL_ACCESS, 0, 0, bytes);
+    if (base == nullptr)
+    {
+        error = "can't map shared memory " + newName + ": " + lastErrorString();
+        closeHandle(handle);
+        return false;
+    }
+#else
+    // readers of an old segment keep it until they close it
+    shm_unlink(systemName.c_str());
+    int fd = shm_open(systemName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0)
+    {
+        error = "can't create shared memory " + newName + ": " + lastErrorString();
+        return false;
+    }
+
+    if (ftruncate(fd, off_t(bytes)) != 0)
+    {
+        error = "can't size shared memory " + newName + ": " + lastErrorString();
+        ::close(fd);
+        shm_unlink(systemName.c_str());
+        return false;
+    }
+
+    base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd); // (the mapping stays)
+    if (base == MAP_FAILED)
+    {
+        error = "can't map shared memory " + newName + ": " + lastErrorString();
+        shm_unlink(systemName.c_str());
+        return false;
+    }
+#endif
+
+    name = newName;
+    mappedBytes = bytes;
+    written = 0;
+    edgesWritten = 0;
+
+    header = new (base) Header;
+    header->state.store(stateStarting, std::memory_order_relaxed);
+    std::memcpy(header->magic, magic, sizeof(magic));
+    header->version = version;
+    header->headerBytes = uint32_t(headerBytes);
+    header->numChannels = uint32_t(numChannels);
+    header->capacity = slotCount;
+    header->slotBytes = uint32_t(slotBytes);
+    header->edgeCapacity = uint32_t(numEdgeRecords);
+    header->sampleRate = sampleRate;
+    header->createdNs = getMonotonicNs();
+    header->claimed.store(0, std::memory_order_relaxed);
+    header->published.store(0, std::memory_order_relaxed);
+    header->edgesClaimed.store(0, std::memory_order_relaxed);
+    header->edgesPublished.store(0, std::memory_order_relaxed);
+    header->state.store(stateLive, std::memory_order_release);
+
+    slots = static_cast<char*>(base) + headerBytes;
+    edgeRecords = slots + slotCount * slotBytes;
+    return true;
+}
+
+
+bool Writer::isOpen() const
+{
+    return header != nullptr;
+}
+
+
+void Writer::publish(const float* samples, const int64_t* sampleNumbers, const uint64_t* ttlWords, int numSamples)
+{
+    if (header == nullptr)
+    {
+        return;
+    }
+
+    const uint32_t numChannels = header->numChannels;
+    const uint32_t capacity = header->capacity;
+    const size_t slotBytes = header->slotBytes;
+    const uint64_t publishNs = getMonotonicNs();
+
+    // at most half the ring at a time, so readers that are keeping up never see their slots claimed
+    for (int done = 0; done < numSamples; )
+    {
+        const int n = std::min(numSamples - done, int(capacity / 2));
+
+        header->claimed.store(written + n, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release); // (claim before overwriting)
+
+        for (int i = 0; i < n; ++i)
+        {
+            const int s = done + i;
+            char* slot = slots + size_t((written + i) & (capacity - 1)) * slotBytes;
+
+            std::memcpy(slot, &sampleNumbers[s], 8);
+            std::memcpy(slot + 8, &ttlWords[s], 8);
+            std::memcpy(slot + 16, &publishNs, 8);
+            std::memcpy(slot + slotHeaderBytes, samples + size_t(s) * numChannels, numChannels * sizeof(float));
+        }
+
+        written += n;
+        header->published.store(written, std::memory_order_release);
+        done += n;
+    }
+}
+
+
+void Writer::publishEdges(const TtlEdge* edges, int numEdges)
+{
+    if (header == nullptr)
+    {
+        return;
+    }
+
+    const uint32_t capacity = header->edgeCapacity;
+
+    // (as publish)
+    for (int done = 0; done < numEdges; )
+    {
+        const int n = std::min(numEdges - done, int(capacity / 2));
+
+        header->edgesClaimed.store(edgesWritten + n, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (int i = 0; i < n; ++i)
+        {
+            const TtlEdge& edge = edges[done + i];
+            char* record = edgeRecords + size_t((edgesWritten + i) & (capacity - 1)) * edgeRecordBytes;
+
+            std::memcpy(record, &edge.sampleNumber, 8);
+            std::memcpy(record + 8, &edge.word, 8);
+            std::memcpy(record + 16, &edge.changed, 8);
+        }
+
+        edgesWritten += n;
+        header->edgesPublished.store(edgesWritten, std::memory_order_release);
+        done += n;
+    }
+}
+
+
+void Writer::close()
+{
+    if (header == nullptr)
+    {
+        return;
+    }
+
+    header->state.store(stateClosed, std::memory_order_release);
+    unmap(header, mappedBytes);
+    header = nullptr;
+    slots = nullptr;
+    edgeRecords = nullptr;
+
+#ifdef _WIN32
+    closeHandle(handle);
+#else
+    shm_unlink(getSystemName(name).c_str());
+#endif
+}
+
+
+/*** Reader ***/
+
+Reader::Reader()
+    : handle      (noHandle)
+    , header      (nullptr)
+    , slots       (nullptr)
+    , edgeRecords (nullptr)
+    , mappedBytes (0)
+    , position    (0)
+    , numLost     (0)
+    , edgePosition(0)
+    , numEdgesLost(0)
+{}
+
+
+Reader::~Reader()
+{
+    close();
+}
+
+
+bool Reader::open(const std::string& name)
+{
+    close();
+    error.clear();
+
+    const std::string systemName = getSystemName(name);
+    const void* base;
+    size_t bytes;
+
+#ifdef _WIN32
+    HANDLE h = OpenFileMappingA(FILE_MAP_READ, FALSE, systemName.c_str());
+    if (h == nullptr)
+    {
+        error = "no shared memory " + name + ": " + lastErrorString();
+        return false;
+    }
+    handle = reinterpret_cast<intptr_t>(h);
+
+    base = MapViewOfFile(h, FILE_MAP_READ, 0, 0, 0);
+    MEMORY_BASIC_INFORMATION info;
+    if (base == nullptr || VirtualQuery(base, &info, sizeof(info)) == 0)
+    {
+        error = "can't map shared memory " + name + ": " + lastErrorString();
+        if (base != nullptr)
+        {
+            UnmapViewOfFile(base);
+        }
+        closeHandle(handle);
+        return false;
+    }
+    bytes = info.RegionSize;
+#else
+    int fd = shm_open(systemName.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+    {
+        error = "no shared memory " + name + ": " + lastErrorString();
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        error = "can't get the size of shared memory " + name + ": " + lastErrorString();
+        ::close(fd);
+        return false;
+    }
+    bytes = size_t(st.st_size);
+
+    base = bytes >= headerBytes ? mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (base == MAP_FAILED)
+    {
+        error = "can't map shared memory " + name + (bytes >= headerBytes ? ": " + lastErrorString() : "");
+        return false;
+    }
+#endif
+
+    header = static_cast<const Header*>(base);
+    slots = static_cast<const char*>(base) + headerBytes;
+    mappedBytes = bytes;
+
+    if (std::memcmp(header->magic, magic, sizeof(magic)) != 0 || header->version != version
+        || header->headerBytes != headerBytes || header->slotBytes != getSlotBytes(int(header->numChannels))
+        || headerBytes + size_t(header->capacity) * header->slotBytes
+            + size_t(header->edgeCapacity) * edgeRecordBytes > bytes
+        || header->state.load(std::memory_order_acquire) == stateStarting)
+    {
+        error = name + " is not a Neuralynx Input ring of this version, or isn't ready";
+        close();
+        return false;
+    }
+
+    edgeRecords = slots + size_t(header->capacity) * header->slotBytes;
+    position = header->published.load(std::memory_order_acquire);
+    numLost = 0;
+    edgePosition = header->edgesPublished.load(std::memory_order_acquire);
+    numEdgesLost = 0;
+    return true;
+}
+
+
+bool Reader::isOpen() const
+{
+    return header != nullptr;
+}
+
+
+void Reader::close()
+{
+    if (header != nullptr)
+    {
+        unmap(header, mappedBytes);
+        header = nullptr;
+        slots = nullptr;
+        edgeRecords = nullptr;
+    }
+    closeHandle(handle);
+}
+
+
+int Reader::getNumChannels() const
+{
+    return header != nullptr ? int(header->numChannels) : 0;
+}
+
+
+double Reader::getSampleRate() const
+{
+    return header != nullptr ? header->sampleRate : 0;
+}
+
+
+int Reader::getCapacity() const
+{
+    return header != nullptr ? int(header->capacity) : 0;
+}
+
+
+bool Reader::isWriterClosed() const
+{
+    return header != nullptr && header->state.load(std::memory_order_acquire) == stateClosed;
+}
+
+
+uint64_t Reader::getNumAvailable() const
+{
+    return header != nullptr ? header->published.load(std::memory_order_acquire) - position : 0;
+}
+
+
+int Reader::read(float* samples, int64_t* sampleNumbers, uint64_t* ttlWords, uint64_t* publishNs, int maxSamples)
+{
+    if (header == nullptr || maxSamples <= 0)
+    {
+        return 0;
+    }
+
+    const uint32_t numChannels = header->numChannels;
+    const uint64_t capacity = header->capacity;
+    const size_t slotBytes = header->slotBytes;
+
+    const uint64_t end = header->published.load(std::memory_order_acquire);
+    if (end - position > capacity)
+    {
+        numLost += end - capacity - position;
+        position = end - capacity;
+    }
+
+    const int n = int(std::min(end - position, uint64_t(maxSamples)));
+    for (int i = 0; i < n; ++i)
+    {
+        const char* slot = slots + size_t((position + i) & (capacity - 1)) * slotBytes;
+        if (sampleNumbers != nullptr)
+        {
+            std::memcpy(&sampleNumbers[i], slot, 8);
+        }
+        if (ttlWords != nullptr)
+        {
+            std::memcpy(&ttlWords[i], slot + 8, 8);
+        }
+        if (publishNs != nullptr)
+        {
+            std::memcpy(&publishNs[i], slot + 16, 8);
+        }
+        std::memcpy(samples + size_t(i) * numChannels, slot + slotHeaderBytes, numChannels * sizeof(float));
+    }
+
+    // any slot the writer claimed while we were copying may be torn; drop those
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t claimed = header->claimed.load(std::memory_order_relaxed);
+    const uint64_t firstIntact = claimed > capacity ? claimed - capacity : 0;
+    const int torn = position < firstIntact ? int(std::min(firstIntact - position, uint64_t(n))) : 0;
+
+    if (torn > 0 && torn < n)
+    {
+        const int kept = n - torn;
+        std::memmove(samples, samples + size_t(torn) * numChannels, size_t(kept) * numChannels * sizeof(float));
+        if (sampleNumbers != nullptr)
+        {
+            std::memmove(sampleNumbers, sampleNumbers + torn, kept * sizeof(int64_t));
+        }
+        if (ttlWords != nullptr)
+        {
+            std::memmove(ttlWords, ttlWords + torn, kept * sizeof(uint64_t));
+        }
+        if (publishNs != nullptr)
+        {
+            std::memmove(publishNs, publishNs + torn, kept * sizeof(uint64_t));
+        }
+    }
+
+    numLost += uint64_t(torn);
+    position += uint64_t(n);
+    return n - torn;
+}
+
+
+int Reader::readEdges(TtlEdge* edges, int maxEdges)
+{
+    if (header == nullptr || maxEdges <= 0)
+    {
+        return 0;
+    }
+
+    const uint64_t capacity = header->edgeCapacity;
+
+    // (as read)
+    const uint64_t end = header->edgesPublished.load(std::memory_order_acquire);
+    if (end - edgePosition > capacity)
+    {
+        numEdgesLost += end - capacity - edgePosition;
+        edgePosition = end - capacity;
+    }
+
+    const int n = int(std::min(end - edgePosition, uint64_t(maxEdges)));
+    for (int i = 0; i < n; ++i)
+    {
+        const char* record = edgeRecords + size_t((edgePosition + i) & (capacity - 1)) * edgeRecordBytes;
+        std::memcpy(&edges[i].sampleNumber, record, 8);
+        std::memcpy(&edges[i].word, record + 8, 8);
+        std::memcpy(&edges[i].changed, record + 16, 8);
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t claimed = header->edgesClaimed.load(std::memory_order_relaxed);
+    const uint64_t firstIntact = claimed > capacity ? claimed - capacity : 0;
+    const int torn = edgePosition < firstIntact ? int(std::min(firstIntact - edgePosition, uint64_t(n))) : 0;
+
+    if (torn > 0 && torn < n)
+    {
+        std::memmove(edges, edges + torn, size_t(n - torn) * sizeof(TtlEdge));
+    }
+
+    numEdgesLost += uint64_t(torn);
+    edgePosition += uint64_t(n);
+    return n - torn;
+}
@@ -0,0 +1,199 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+We hope that this plugin will be useful to others, but its source code
+and functionality are subject to a non-disclosure agreement (NDA) with
+Neuralynx, Inc. If you or your institution have not signed the appropriate
+NDA, STOP and do not read or execute this plugin until you have done so.
+Do not share this plugin with other parties who have not signed the NDA.
+
+*/
+
+#ifndef SHARED_MEMORY_RING_H_INCLUDED
+#define SHARED_MEMORY_RING_H_INCLUDED
+
+// Does not depend on JUCE, so it can also be used by tools outside the plugin. External programs
+// (e.g. a closed-loop controller) can read the plugin's output by building SharedMemoryRing.cpp
+// with this header, or by linking the nlx_shared_ring library.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * Broadcast of decoded samples to other processes through a named shared memory segment (POSIX shm,
+ * or a named file mapping on Windows).
+ *
+ * One writer publishes samples into a ring of capacity slots; any number of readers copy them out,
+ * each at its own position. Nothing is locked and readers never hold up the writer: a reader that
+ * falls more than capacity samples behind loses the oldest ones, and is told how many. The writer
+ * announces how far it is about to write (claimed) before writing slots and how far it has written
+ * (published) after, so a reader can tell which of the slots it copied might have been overwritten
+ * while it was copying them, as in a seqlock.
+ *
+ * Changes of the TTL word (edges) go through a second ring in the same way, with the exact sample
+ * number of each, so a reader can follow events without scanning every sample's word. Each edge is
+ * published before the samples it is in.
+ *
+ * Layout: the header below, then capacity slots of slotBytes each:
+ *   int64 sample number, uint64 TTL word (all 64 lines, including the outage marker),
+ *   uint64 publishNs (see getMonotonicNs), float samples[# of channels], padded to a multiple of 8 bytes
+ * then edgeCapacity edge records of edgeRecordBytes each:
+ *   int64 sample number, uint64 new TTL word, uint64 lines changed
+ * Sample i is in slot i % capacity and edge i in record i % edgeCapacity. The segment is made anew each
+ * time the writer is created; readers of an old one see its state become stateClosed.
+ */
+namespace SharedMemoryRing
+{
+    static const char magic[8] = { 'N', 'L', 'X', 'S', 'H', 'M', '\0', '\0' };
+    static const uint32_t version = 3;
+    static const int slotHeaderBytes = 24;
+    static const int edgeRecordBytes = 24;
+    static const int numEdgeRecords = 4096; // edgeCapacity of the rings the Writer makes
+
+    enum State : uint32_t
+    {
+        stateStarting = 0,
+        stateLive,
+        stateClosed
+    };
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t headerBytes;
+        uint32_t numChannels;
+        uint32_t capacity;   // slots (a power of 2)
+        uint32_t slotBytes;
+        uint32_t edgeCapacity; // edge records (a power of 2)
+        std::atomic<uint32_t> state;
+        double sampleRate;
+        uint64_t createdNs;  // getMonotonicNs when the writer was created
+
+        // (on their own cache lines, as they are written for every block)
+        alignas(64) std::atomic<uint64_t> claimed;   // samples the writer has started writing
+        alignas(64) std::atomic<uint64_t> published; // samples the writer has finished writing
+
+        // the same for edges (together, as they are written much less often)
+        alignas(64) std::atomic<uint64_t> edgesClaimed;
+        std::atomic<uint64_t> edgesPublished;
+    };
+
+    // A change of the TTL word, at the first sample with the new word
+    struct TtlEdge
+    {
+        int64_t sampleNumber;
+        uint64_t word;    // the new word
+        uint64_t changed; // lines that changed (the new word ^ the one before)
+    };
+
+    // Clock for publishNs: monotonic and, on the supported platforms, the same for every process
+    uint64_t getMonotonicNs();
+
+    // Name of the segment for the given stream (0-based) of the plugin
+    std::string getStreamName(int stream);
+
+    // Publishes samples to a new shared memory segment. Use from one thread at a time.
+    class Writer
+    {
+    public:
+        Writer();
+        ~Writer();
+
+        // Creates the segment (replacing one of the same name), for capacity (rounded up to a power of 2)
+        // samples of numChannels channels. Returns false on failure (see getError).
+        bool create(const std::string& name, int numChannels, int capacity, double sampleRate);
+        bool isOpen() const;
+
+        // Publishes numSamples samples: samples holds numChannels floats per sample
+        void publish(const float* samples, const int64_t* sampleNumbers, const uint64_t* ttlWords, int numSamples);
+
+        // Publishes numEdges TTL edges; call before publishing the samples they are in
+        void publishEdges(const TtlEdge* edges, int numEdges);
+
+        // Marks the segment closed (so readers know no more samples will come) and removes it
+        void close();
+
+        const std::string& getName() const  { return name; }
+        const std::string& getError() const { return error; }
+
+    private:
+        std::string name;
+        intptr_t handle;
+        Header* header;
+        char* slots;
+        char* edgeRecords;
+        size_t mappedBytes;
+        uint64_t written;
+        uint64_t edgesWritten;
+        std::string error;
+
+        Writer(const Writer&) = delete;
+        Writer& operator=(const Writer&) = delete;
+    };
+
+    // Reads samples from a segment made by a Writer, in another process or the same one
+    class Reader
+    {
+    public:
+        Reader();
+        ~Reader();
+
+        // Attaches to the named segment, starting after the latest sample published. Returns false if it
+        // doesn't exist (yet) or isn't a ring of this version (see getError).
+        bool open(const std::string& name);
+        bool isOpen() const;
+        void close();
+
+        int getNumChannels() const;
+        double getSampleRate() const;
+        int getCapacity() const;
+
+        // True once the writer has closed the segment (it should then be reopened to follow a new one)
+        bool isWriterClosed() const;
+
+        // Number of samples published that haven't been read yet
+        uint64_t getNumAvailable() const;
+
+        // Copies up to maxSamples of the next samples (numChannels floats each) and their details; any of
+        // the pointers except samples may be null. Returns the number copied, which is 0 if nothing new has
+        // been published. If the reader fell behind, the samples it missed are skipped and counted.
+        int read(float* samples, int64_t* sampleNumbers, uint64_t* ttlWords, uint64_t* publishNs, int maxSamples);
+
+        // Samples skipped because the writer overwrote them before they were read
+        uint64_t getNumLost() const { return numLost; }
+
+        // Copies up to maxEdges of the next TTL edges, as read does samples. Edges are read separately from
+        // samples: every edge at or before a sample that read returned has already been published.
+        int readEdges(TtlEdge* edges, int maxEdges);
+
+        // Edges skipped because the writer overwrote them before they were read
+        uint64_t getNumEdgesLost() const { return numEdgesLost; }
+
+        const std::string& getError() const { return error; }
+
+    private:
+        intptr_t handle;
+        const Header* header;
+        const char* slots;
+        const char* edgeRecords;
+        size_t mappedBytes;
+        uint64_t position;
+        uint64_t numLost;
+        uint64_t edgePosition;
+        uint64_t numEdgesLost;
+        std::string error;
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+    };
+}
+
+#endif // SHARED_MEMORY_RING_H_INCLUDED
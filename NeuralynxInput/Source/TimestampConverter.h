@@ -0,0 +1,329 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+We hope that this plugin will be useful to others, but its source code
+and functionality are subject to a non-disclosure agreement (NDA) with
+Neuralynx, Inc. If you or your institution have not signed the appropriate
+NDA, STOP and do not read or execute this plugin until you have done so.
+Do not share this plugin with other parties who have not signed the NDA.
+
+*/
+
+#ifndef TIMESTAMP_CONVERTER_H_INCLUDED
+#define TIMESTAMP_CONVERTER_H_INCLUDED
+
+// Does not depend on JUCE, so it can also be used by tools outside the plugin.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+/*
+ * Converts the hardware timestamps in packets (microseconds) to sample numbers,
+ * counting from the first packet after reset.
+ *
+ * Sample numbers are exact: the elapsed time is scaled by the sample rate as a reduced fraction
+ * of integers (e.g. 32,768 Hz = 512/15625 samples per us), and the quotient and remainder are
+ * carried from one packet to the next, so a packet that follows the previous one closely costs
+ * a multiply and an add or two. Only after a gap or reordering is there an integer division.
+ *
+ * Sample numbers can be continued across an outage in which the hardware clock may have restarted
+ * (see resync).
+ *
+ * It also compares the amplifier's clock with this computer's (see addClockSample).
+ */
+class TimestampConverter
+{
+public:
+    TimestampConverter()
+        : num        (0)
+        , den        (1)
+        , offset     (0)
+        , base       (0)
+        , started    (false)
+        , lastDiff   (0)
+        , quotient   (0)
+        , remainder  (0)
+    {
+        resetClock();
+    }
+
+    // (sampleRate is rounded to a whole number of Hz)
+    void reset(double sampleRate)
+    {
+        num = std::max<int64_t>(1, std::llround(sampleRate));
+        den = 1000000;
+        int64_t divisor = gcd(num, den);
+        num /= divisor;
+        den /= divisor;
+        base = 0;
+        started = false;
+        resetClock();
+    }
+
+    // Sample number of the packet with the given hardware timestamp (rounded to the nearest sample,
+    // rounding halves up)
+    int64_t toSampleNumber(uint64_t hardwareTs)
+    {
+        if (!started)
+        {
+            started = true;
+            offset = hardwareTs;
+            lastDiff = 0;
+            quotient = 0;
+            remainder = den / 2; // (for rounding)
+            return base;
+        }
+
+        int64_t tsDiff = int64_t(hardwareTs - offset);
+        int64_t step = tsDiff - lastDiff;
+        lastDiff = tsDiff;
+
+        if (step >= 0 && step * num < maxIncrementalSamples * den)
+        {
+            remainder += step * num;
+            while (remainder >= den)
+            {
+                remainder -= den;
+                ++quotient;
+            }
+        }
+        else
+        {
+            // floor((tsDiff * num + den / 2) / den), also for negative values
+            int64_t scaled = tsDiff * num + den / 2;
+            quotient = scaled / den;
+            remainder = scaled % den;
+            if (remainder < 0)
+            {
+                remainder += den;
+                --quotient;
+            }
+        }
+        return base + quotient;
+    }
+
+    // Sample number of the first packet after an outage, which has the given hardware timestamp, given the
+    // sample number of the last packet before it and how long it lasted by the local clock. If the hardware
+    // clock ran on through the outage, this is just toSampleNumber. If the packet is at or before the last one,
+    // or more than toleranceUs from where the local clock says it should be (the amplifier was restarted, or
+    // its clock was set), the conversion is rebased: the packet is given the sample number the outage implies
+    // (at least lastSample + 1), later packets count on from it, the clock comparison starts over and
+    // rebased is set.
+    int64_t resync(uint64_t hardwareTs, int64_t lastSample, int64_t outageUs, int64_t toleranceUs, bool& rebased)
+    {
+        int64_t sample = toSampleNumber(hardwareTs);
+        int64_t expected = lastSample + usToSamples(outageUs);
+        int64_t tolerance = usToSamples(toleranceUs);
+
+        rebased = sample <= lastSample || sample > expected + tolerance || sample < expected - tolerance;
+        if (!rebased)
+        {
+            return sample;
+        }
+
+        base = std::max(expected, lastSample + 1);
+        started = false;
+        resetClock();
+        return toSampleNumber(hardwareTs);
+    }
+
+    /*** clock comparison ***/
+
+    // Adds the hardware timestamp of a packet and the local time (steady clock, us) at which it was
+    // received or decoded. Over each window of clockWindowUs, the largest (hardware - local) time is
+    // kept, i.e. the one from the packet with the least delay, which tracks the offset between the
+    // clocks; the drift is the slope of a straight-line fit to those offsets. Returns true when a
+    // window has been completed, so the offset (and possibly the drift) has been updated.
+    bool addClockSample(uint64_t hardwareUs, int64_t localUs)
+    {
+        int64_t offsetUs = int64_t(hardwareUs) - localUs;
+
+        if (windowStartUs < 0)
+        {
+            windowStartUs = localUs;
+            windowMaxUs = offsetUs;
+            return false;
+        }
+
+        windowMaxUs = std::max(windowMaxUs, offsetUs);
+        if (localUs - windowStartUs < clockWindowUs)
+        {
+            return false;
+        }
+
+        clockOffsetUs = windowMaxUs;
+        windowStartUs = -1;
+
+        // (relative to the first window, to keep the sums small)
+        if (numWindows == 0)
+        {
+            firstLocalUs = localUs;
+            firstOffsetUs = clockOffsetUs;
+        }
+        double x = double(localUs - firstLocalUs);
+        double y = double(clockOffsetUs - firstOffsetUs);
+        ++numWindows;
+        sumX += x;
+        sumY += y;
+        sumXX += x * x;
+        sumXY += x * y;
+        return true;
+    }
+
+    // Number of completed windows since reset
+    int getNumClockWindows() const
+    {
+        return numWindows;
+    }
+
+    // Offset of the hardware clock from the local one over the last completed window, in us
+    int64_t getClockOffsetUs() const
+    {
+        return clockOffsetUs;
+    }
+
+    // How much faster the hardware clock runs than the local one, in parts per million
+    // (0 until there are at least 2 windows)
+    double getClockDriftPpm() const
+    {
+        double denominator = numWindows * sumXX - sumX * sumX;
+        if (numWindows < 2 || denominator <= 0)
+        {
+            return 0;
+        }
+        return (numWindows * sumXY - sumX * sumY) / denominator * 1e6;
+    }
+
+    static const int64_t clockWindowUs = 1000000;
+
+    // Infers the sample rate from the hardware timestamps of n packets received in a row, some of
+    // which may have been lost, duplicated or reordered. The shortest step between timestamps is taken
+    // as one period (to within their 1 us resolution), so that every step of up to maxGapPeriods periods
+    // can be counted, and the rate is the number of periods counted over the total time they span.
+    // Rates within 1% of one that ATLAS supports (a multiple of 2000 Hz, or 32,768 Hz) are snapped to it.
+    // Returns 0 if there are fewer than minRateSteps usable steps or the rate is implausible.
+    static double inferSampleRate(const uint64_t* timestamps, int n)
+    {
+        int64_t minStep = 0;
+        for (int i = 1; i < n; ++i)
+        {
+            int64_t step = int64_t(timestamps[i] - timestamps[i - 1]);
+            if (step > 0 && (minStep == 0 || step < minStep))
+            {
+                minStep = step;
+            }
+        }
+
+        if (minStep == 0)
+        {
+            return 0;
+        }
+
+        int64_t periods = 0;
+        int64_t spanUs = 0;
+        int numSteps = 0;
+        for (int i = 1; i < n; ++i)
+        {
+            int64_t step = int64_t(timestamps[i] - timestamps[i - 1]);
+            int64_t stepPeriods = step > 0 ? std::llround(double(step) / minStep) : 0;
+            if (stepPeriods >= 1 && stepPeriods <= maxGapPeriods)
+            {
+                periods += stepPeriods;
+                spanUs += step;
+                ++numSteps;
+            }
+        }
+
+        if (numSteps < minRateSteps)
+        {
+            return 0;
+        }
+
+        double rate = 1e6 * periods / spanUs;
+        if (rate < minRate || rate > maxRate)
+        {
+            return 0;
+        }
+
+        // (32,768 Hz is a special case; see the documentation for "-CreateHardwareSubSystem")
+        double nearest = std::round(rate / 2000) * 2000;
+        if (std::fabs(rate - 32768) < std::fabs(rate - nearest))
+        {
+            nearest = 32768;
+        }
+        return std::fabs(rate - nearest) <= nearest * 0.01 ? nearest : std::round(rate);
+    }
+
+    // usable steps needed by inferSampleRate; with 1 us timestamps, this many periods
+    // pin the rate down to well within the 2.4% between 32,000 and 32,768 Hz
+    static const int minRateSteps = 16;
+
+    // longest step counted by inferSampleRate (longer ones could be miscounted by a period,
+    // as the shortest step can be up to 1 us shorter than a period)
+    static const int maxGapPeriods = 8;
+
+    static constexpr double minRate = 1000;
+    static constexpr double maxRate = 100000;
+
+private:
+    // (rounded to the nearest sample; us >= 0)
+    int64_t usToSamples(int64_t us) const
+    {
+        return (us * num + den / 2) / den;
+    }
+
+    static int64_t gcd(int64_t a, int64_t b)
+    {
+        while (b != 0)
+        {
+            int64_t t = a % b;
+            a = b;
+            b = t;
+        }
+        return a;
+    }
+
+    void resetClock()
+    {
+        windowStartUs = -1;
+        windowMaxUs = 0;
+        clockOffsetUs = 0;
+        numWindows = 0;
+        firstLocalUs = 0;
+        firstOffsetUs = 0;
+        sumX = sumY = sumXX = sumXY = 0;
+    }
+
+    // longest step between packets handled by carrying the remainder (longer ones are divided)
+    static const int64_t maxIncrementalSamples = 4;
+
+    // samples per us = num / den, in lowest terms
+    int64_t num;
+    int64_t den;
+
+    uint64_t offset;
+    int64_t base; // sample number of the packet at offset
+    bool started;
+
+    // lastDiff * num + den / 2 = quotient * den + remainder, 0 <= remainder < den
+    int64_t lastDiff;
+    int64_t quotient;
+    int64_t remainder;
+
+    // clock comparison
+    int64_t windowStartUs; // -1 if no window is open
+    int64_t windowMaxUs;
+    int64_t clockOffsetUs;
+    int numWindows;
+    int64_t firstLocalUs;
+    int64_t firstOffsetUs;
+    double sumX, sumY, sumXX, sumXY;
+};
+
+#endif // TIMESTAMP_CONVERTER_H_INCLUDED
@@ -0,0 +1,2161 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+We hope that this plugin will be useful to others, but its source code
+and functionality are subject to a non-disclosure agreement (NDA) with
+Neuralynx, Inc. If you or your institution have not signed the appropriate
+NDA, STOP and do not read or execute this plugin until you have done so.
+Do not share this plugin with other parties who have not signed the NDA.
+
+*/
+
+// Benchmarks for the plugin's decode and receive paths. Run with --help for options.
+// Prints a table and optionally writes the results as JSON, to compare across builds and machines.
+// Exits with status 2 if a vectorized, gather, transpose or TTL edge kernel doesn't match the scalar one
+// (or the decimator a direct FIR filter).
+
+#include "ChannelTranspose.h"
+#include "LatencyHistogram.h"
+#include "PacketBuilder.h"
+#include "PacketKernel.h"
+#include "PacketMmapSocket.h"
+#include "PacketRing.h"
+#include "PolyphaseDecimator.h"
+#include "RawRecording.h"
+#include "ShardedDecoder.h"
+#include "SharedMemoryRing.h"
+#include "TimestampConverter.h"
+#include "UdpSocket.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _MSC_VER
+#define NOINLINE __declspec(noinline)
+#else
+#define NOINLINE __attribute__((noinline))
+#endif
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    const int boardCounts[] = { 1, 2, 4, 8, 16 };
+    const float rawBitVolts = 131072 / float(1 << 23); // as in NeuralynxThread
+
+    struct Options
+    {
+        bool quick = false;
+        bool loopback = true;
+        std::string jsonPath;
+        int port = 26099;
+        double loopbackSeconds = 2;
+    };
+
+    uint64_t nowNs()
+    {
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count());
+    }
+
+    /*** results ***/
+
+    class Result
+    {
+    public:
+        Result(const std::string& name)
+        {
+            add("name", name);
+        }
+
+        Result& add(const std::string& key, const std::string& value)
+        {
+            fields.push_back({ key, "\"" + value + "\"" });
+            return *this;
+        }
+
+        Result& add(const std::string& key, double value)
+        {
+            std::ostringstream s;
+            s.precision(6);
+            s << value;
+            fields.push_back({ key, s.str() });
+            return *this;
+        }
+
+        std::string toJson() const
+        {
+            std::string json = "{";
+            for (size_t i = 0; i < fields.size(); ++i)
+            {
+                json += (i > 0 ? ", \"" : "\"") + fields[i].first + "\": " + fields[i].second;
+            }
+            return json + "}";
+        }
+
+        std::string toText() const
+        {
+            std::string text;
+            for (const auto& field : fields)
+            {
+                std::string value = field.second;
+                value.erase(std::remove(value.begin(), value.end(), '"'), value.end());
+                text += (text.empty() ? "" : "  ") + (field.first == "name" ? value : field.first + "=" + value);
+            }
+            return text;
+        }
+
+    private:
+        std::vector<std::pair<std::string, std::string>> fields;
+    };
+
+    std::vector<Result> results;
+
+    void report(const Result& result)
+    {
+        results.push_back(result);
+        std::printf("%s\n", result.toText().c_str());
+        std::fflush(stdout);
+    }
+
+    /*** test data ***/
+
+    // Random packets with valid headers and checksums (samples cover the full 32-bit range)
+    std::vector<std::vector<uint32_t>> makePackets(int boards, int count, std::mt19937& rng)
+    {
+        std::vector<std::vector<uint32_t>> packets(count);
+        const int words = PacketKernel::wordsInPacketWithBoards(boards);
+
+        for (auto& packet : packets)
+        {
+            packet.resize(words);
+            packet[0] = 2048;
+            packet[1] = 1;
+            packet[2] = uint32_t(boards * PacketKernel::boardChannels + 10);
+
+            uint32_t crc = packet[0] ^ packet[1] ^ packet[2];
+            for (int i = 3; i < words - 1; ++i)
+            {
+                packet[i] = rng();
+                crc ^= packet[i];
+            }
+            packet[words - 1] = crc;
+        }
+        return packets;
+    }
+
+    struct NamedImplementation
+    {
+        const char* name;
+        PacketKernel::Decoder (*get)(int boards);
+        PacketKernel::GatherDecoder gather;
+    };
+
+    // implementations supported on this CPU
+    std::vector<NamedImplementation> getImplementations()
+    {
+        std::vector<NamedImplementation> impls = { { "scalar", &PacketKernel::getScalar, PacketKernel::getScalarGather() } };
+        if (PacketKernel::getSSE2(1) != nullptr)
+        {
+            impls.push_back({ "SSE2", &PacketKernel::getSSE2, PacketKernel::getSSE2Gather() });
+        }
+        if (PacketKernel::getAVX2(1) != nullptr)
+        {
+            impls.push_back({ "AVX2", &PacketKernel::getAVX2, PacketKernel::getAVX2Gather() });
+        }
+        return impls;
+    }
+
+    /*** benchmarks ***/
+
+    // Every implementation must give bit-identical output and the same validity as the scalar one,
+    // for valid packets and packets with a flipped bit. Returns the number of mismatches.
+    int checkKernels()
+    {
+        std::mt19937 rng(1);
+        int totalMismatches = 0;
+
+        for (const auto& impl : getImplementations())
+        {
+            int mismatches = 0;
+            int checked = 0;
+            for (int boards = 1; boards <= 16; ++boards)
+            {
+                const int numChans = boards * PacketKernel::boardChannels;
+                std::vector<float> expected(numChans), actual(numChans);
+                PacketKernel::Decoder reference = PacketKernel::getScalar(boards);
+                PacketKernel::Decoder decoder = impl.get(boards);
+
+                for (auto& packet : makePackets(boards, 64, rng))
+                {
+                    for (int corrupt = 0; corrupt < 2; ++corrupt)
+                    {
+                        if (corrupt)
+                        {
+                            packet[rng() % packet.size()] ^= 1u << (rng() % 32);
+                        }
+
+                        bool expectedValid = reference(packet.data(), rawBitVolts, expected.data());
+                        bool actualValid = decoder(packet.data(), rawBitVolts, actual.data());
+
+                        ++checked;
+                        if (expectedValid != actualValid
+                            || std::memcmp(expected.data(), actual.data(), numChans * sizeof(float)) != 0)
+                        {
+                            ++mismatches;
+                        }
+                    }
+                }
+            }
+
+            report(Result("kernel_check").add("impl", impl.name).add("packets", checked).add("mismatches", mismatches));
+            totalMismatches += mismatches;
+        }
+
+        // the gather decoders must pick the same values out as the full decode, for random channel
+        // maps made of runs of ascending channels of random lengths
+        for (const auto& impl : getImplementations())
+        {
+            int mismatches = 0;
+            int checked = 0;
+            for (int boards = 1; boards <= 16; ++boards)
+            {
+                const int numChans = boards * PacketKernel::boardChannels;
+                std::vector<float> expected(numChans), actual(numChans);
+                PacketKernel::GatherTable table;
+                PacketKernel::Decoder reference = PacketKernel::getScalar(boards);
+
+                for (auto& packet : makePackets(boards, 64, rng))
+                {
+                    std::vector<int> channels;
+                    while (int(channels.size()) < numChans && rng() % 8 != 0)
+                    {
+                        int first = rng() % numChans;
+                        int count = 1 + rng() % std::min(numChans - first, 40);
+                        for (int c = first; c < first + count && int(channels.size()) < numChans; ++c)
+                        {
+                            channels.push_back(c);
+                        }
+                    }
+                    PacketKernel::makeGatherTable(channels.data(), int(channels.size()), table);
+
+                    for (int corrupt = 0; corrupt < 2; ++corrupt)
+                    {
+                        if (corrupt)
+                        {
+                            packet[rng() % packet.size()] ^= 1u << (rng() % 32);
+                        }
+
+                        bool expectedValid = reference(packet.data(), rawBitVolts, expected.data());
+                        bool actualValid = impl.gather(packet.data(), boards, table, rawBitVolts, actual.data());
+
+                        ++checked;
+                        bool same = expectedValid == actualValid;
+                        for (size_t k = 0; k < channels.size(); ++k)
+                        {
+                            same = same && std::memcmp(&expected[channels[k]], &actual[k], sizeof(float)) == 0;
+                        }
+                        if (!same)
+                        {
+                            ++mismatches;
+                        }
+                    }
+                }
+            }
+
+            report(Result("gather_check").add("impl", impl.name).add("packets", checked).add("mismatches", mismatches));
+            totalMismatches += mismatches;
+        }
+        return totalMismatches;
+    }
+
+    // Runs fn(i) for increasing i until minSeconds have passed; returns ns per call
+    template <typename Fn>
+    double timeLoop(double minSeconds, Fn fn)
+    {
+        uint64_t calls = 0;
+        uint64_t batch = 256;
+        const Clock::time_point start = Clock::now();
+        double elapsed;
+        do
+        {
+            for (uint64_t i = 0; i < batch; ++i)
+            {
+                fn(calls + i);
+            }
+            calls += batch;
+            batch *= 2;
+            elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        } while (elapsed < minSeconds);
+
+        return elapsed * 1e9 / calls;
+    }
+
+    void benchDecode(double minSeconds)
+    {
+        std::mt19937 rng(2);
+        volatile float sink = 0;
+
+        for (int boards : boardCounts)
+        {
+            const int numChans = boards * PacketKernel::boardChannels;
+            const int packetBytes = PacketKernel::wordsInPacketWithBoards(boards) * 4;
+            auto packets = makePackets(boards, 256, rng);
+            std::vector<float> out(numChans);
+
+            auto reportDecode = [&](const char* name, double ns)
+            {
+                report(Result("decode").add("impl", name).add("boards", boards).add("ns_per_packet", ns)
+                    .add("mb_per_s", packetBytes / ns * 1e3));
+            };
+
+            // the checksum on its own, as it was computed before decoding was fused with it
+            double ns = timeLoop(minSeconds, [&](uint64_t i)
+            {
+                const auto& packet = packets[i & 255];
+                uint32_t crc = 0;
+                for (uint32_t word : packet)
+                {
+                    crc ^= word;
+                }
+                sink = float(crc);
+            });
+            reportDecode("checksum_only", ns);
+
+            for (const auto& impl : getImplementations())
+            {
+                PacketKernel::Decoder decoder = impl.get(boards);
+                ns = timeLoop(minSeconds, [&](uint64_t i)
+                {
+                    decoder(packets[i & 255].data(), rawBitVolts, out.data());
+                    sink = out[0];
+                });
+                reportDecode(impl.name, ns);
+            }
+
+            // what the plugin does: header check + the decoder chosen for this CPU and # of boards
+            PacketKernel::Decoder best = PacketKernel::getDecoder(boards);
+            ns = timeLoop(minSeconds, [&](uint64_t i)
+            {
+                const uint32_t* packet = packets[i & 255].data();
+                PacketKernel::headerValid(packet, boards) && best(packet, rawBitVolts, out.data());
+                sink = out[0];
+            });
+            reportDecode("dispatched", ns);
+
+            // looking up the decoder for every packet
+            ns = timeLoop(minSeconds, [&](uint64_t i)
+            {
+                PacketKernel::validateAndDecode(packets[i & 255].data(), boards, rawBitVolts, out.data());
+                sink = out[0];
+            });
+            reportDecode("dispatched_lookup", ns);
+
+            // channel maps keeping a quarter of the channels (as the plugin decodes with one): the
+            // first 8 of each board, and every 4th channel (the worst case, with no runs to vectorize)
+            for (int stride : { 0, 4 })
+            {
+                std::vector<int> channels;
+                for (int c = 0; c < numChans; c += stride > 0 ? stride : 1)
+                {
+                    if (stride > 0 || c % PacketKernel::boardChannels < PacketKernel::boardChannels / 4)
+                    {
+                        channels.push_back(c);
+                    }
+                }
+                PacketKernel::GatherTable table;
+                PacketKernel::makeGatherTable(channels.data(), int(channels.size()), table);
+
+                ns = timeLoop(minSeconds, [&](uint64_t i)
+                {
+                    const uint32_t* packet = packets[i & 255].data();
+                    PacketKernel::headerValid(packet, boards)
+                        && PacketKernel::decodeGather(packet, boards, table, rawBitVolts, out.data());
+                    sink = out[0];
+                });
+                reportDecode(stride > 0 ? "gather_strided" : "gather_runs", ns);
+            }
+        }
+    }
+
+    /*** board-sharded decode ***/
+
+    // The board decoders and ShardedDecoder (with any number of threads) must give bit-identical output
+    // and the same validity as the scalar decoder, including for corrupted and skipped packets. Returns
+    // the number of mismatches.
+    int checkShardedDecoder()
+    {
+        std::mt19937 rng(9);
+        int totalMismatches = 0;
+
+        std::vector<std::pair<const char*, PacketKernel::BoardDecoder>> impls = { { "scalar", PacketKernel::getScalarBoardDecoder() } };
+        if (PacketKernel::getSSE2BoardDecoder() != nullptr)
+        {
+            impls.push_back({ "SSE2", PacketKernel::getSSE2BoardDecoder() });
+        }
+        if (PacketKernel::getAVX2BoardDecoder() != nullptr)
+        {
+            impls.push_back({ "AVX2", PacketKernel::getAVX2BoardDecoder() });
+        }
+
+        for (const auto& impl : impls)
+        {
+            int mismatches = 0;
+            int checked = 0;
+            for (int boards = 1; boards <= 16; ++boards)
+            {
+                const int numChans = boards * PacketKernel::boardChannels;
+                std::vector<float> expected(numChans), actual(numChans);
+                PacketKernel::Decoder reference = PacketKernel::getScalar(boards);
+
+                for (auto& packet : makePackets(boards, 16, rng))
+                {
+                    for (int corrupt = 0; corrupt < 2; ++corrupt)
+                    {
+                        if (corrupt)
+                        {
+                            packet[rng() % packet.size()] ^= 1u << (rng() % 32);
+                        }
+
+                        // in two pieces, as two threads would
+                        int split = int(rng() % (boards + 1));
+                        const uint32_t* samples = packet.data() + PacketKernel::headerWords;
+                        uint32_t crc = PacketKernel::headerFooterXor(packet.data(), boards)
+                            ^ impl.second(samples, split, rawBitVolts, actual.data())
+                            ^ impl.second(samples + split * PacketKernel::boardChannels, boards - split, rawBitVolts,
+                                actual.data() + split * PacketKernel::boardChannels);
+                        bool expectedValid = reference(packet.data(), rawBitVolts, expected.data());
+
+                        ++checked;
+                        if (expectedValid != (crc == 0)
+                            || std::memcmp(expected.data(), actual.data(), numChans * sizeof(float)) != 0)
+                        {
+                            ++mismatches;
+                        }
+                    }
+                }
+            }
+
+            report(Result("board_decoder_check").add("impl", impl.first).add("packets", checked).add("mismatches", mismatches));
+            totalMismatches += mismatches;
+        }
+
+        ShardedDecoder sharded;
+        for (int threads : { 1, 2, 3, 4, 7 })
+        {
+            // (helpers that spin, and ones that sleep; the start hook must run once on each helper, 1..threads - 1)
+            std::atomic<uint32_t> helpersStarted(0);
+            sharded.start(threads, threads % 2 == 0 ? -1 : 0, [&](int w) { helpersStarted.fetch_or(1u << w); });
+
+            int mismatches = 0;
+            int checked = 0;
+            for (int boards : { 1, 3, 5, 16 })
+            {
+                const int numChans = boards * PacketKernel::boardChannels;
+                PacketKernel::Decoder reference = PacketKernel::getScalar(boards);
+
+                for (int block = 0; block < 50; ++block)
+                {
+                    const int numPackets = 1 + int(rng() % 64);
+                    auto packets = makePackets(boards, numPackets, rng);
+                    std::vector<const uint32_t*> pointers(numPackets);
+                    for (int k = 0; k < numPackets; ++k)
+                    {
+                        if (rng() % 8 == 0)
+                        {
+                            packets[k][rng() % packets[k].size()] ^= 1u << (rng() % 32);
+                        }
+                        pointers[k] = rng() % 16 == 0 ? nullptr : packets[k].data(); // (as for a packet of the wrong size)
+                    }
+
+                    // (rows padded, as the output may be wider than the packet)
+                    const int stride = numChans + 8;
+                    std::vector<float> expected(numChans), actual(size_t(numPackets) * stride);
+                    std::unique_ptr<bool[]> valid(new bool[numPackets]);
+                    sharded.decode(pointers.data(), numPackets, boards, rawBitVolts, actual.data(), stride, valid.get());
+
+                    for (int k = 0; k < numPackets; ++k)
+                    {
+                        ++checked;
+                        if (pointers[k] == nullptr)
+                        {
+                            mismatches += valid[k] ? 1 : 0;
+                            continue;
+                        }
+
+                        bool expectedValid = reference(packets[k].data(), rawBitVolts, expected.data());
+                        if (expectedValid != valid[k]
+                            || std::memcmp(expected.data(), &actual[size_t(k) * stride], numChans * sizeof(float)) != 0)
+                        {
+                            ++mismatches;
+                        }
+                    }
+                }
+            }
+
+            sharded.stop();
+            if (helpersStarted.load() != ((1u << threads) - 2))
+            {
+                ++mismatches;
+            }
+
+            report(Result("sharded_check").add("threads", threads).add("packets", checked).add("mismatches", mismatches));
+            totalMismatches += mismatches;
+        }
+        return totalMismatches;
+    }
+
+    // Decoding a block of 16-board packets with 1 to N threads (as many as there are cores), at 1 ms and
+    // 10 ms of 40 kHz data per block. The helpers spin between blocks, so this is the best case for waking them.
+    void benchShardedDecode(double minSeconds)
+    {
+        std::mt19937 rng(10);
+        volatile float sink = 0;
+
+        const int boards = 16;
+        const int numChans = boards * PacketKernel::boardChannels;
+        const int packetBytes = PacketKernel::wordsInPacketWithBoards(boards) * 4;
+        const int maxThreads = std::max(1, std::min(int(std::thread::hardware_concurrency()), int(ShardedDecoder::maxThreads)));
+
+        std::vector<int> threadCounts;
+        for (int threads = 1; threads < maxThreads; threads *= 2)
+        {
+            threadCounts.push_back(threads);
+        }
+        threadCounts.push_back(maxThreads);
+
+        for (int numPackets : { 40, 400 })
+        {
+            auto packets = makePackets(boards, numPackets, rng);
+            std::vector<const uint32_t*> pointers(numPackets);
+            for (int k = 0; k < numPackets; ++k)
+            {
+                pointers[k] = packets[k].data();
+            }
+            std::vector<float> out(size_t(numPackets) * numChans);
+            std::unique_ptr<bool[]> valid(new bool[numPackets]);
+
+            double singleNs = 0;
+            for (int threads : threadCounts)
+            {
+                ShardedDecoder sharded;
+                sharded.start(threads, -1);
+                double ns = timeLoop(minSeconds, [&](uint64_t)
+                {
+                    sharded.decode(pointers.data(), numPackets, boards, rawBitVolts, out.data(), numChans, valid.get());
+                    sink = out[0];
+                }) / numPackets;
+
+                singleNs = threads == 1 ? ns : singleNs;
+                double stolen = sharded.getNumTasks() > 0 ? double(sharded.getNumSteals()) / sharded.getNumTasks() : 0;
+                report(Result("sharded_decode").add("boards", boards).add("block_packets", numPackets)
+                    .add("threads", threads).add("ns_per_packet", ns).add("mb_per_s", packetBytes / ns * 1e3)
+                    .add("speedup", singleNs / ns).add("stolen_fraction", stolen));
+            }
+        }
+    }
+
+    /*** channel-major output ***/
+
+    const int blockPackets = 20;   // NeuralynxThread::defaultBlockPackets
+    const int ringSamples = 10000; // NeuralynxThread::srcBufferSize
+
+    // Per-channel arrays like the DataBuffer's AudioSampleBuffer
+    struct ChannelRing
+    {
+        ChannelRing(int numChans) : data(size_t(numChans) * ringSamples), pointers(numChans)
+        {
+            for (int c = 0; c < numChans; ++c)
+            {
+                pointers[c] = data.data() + size_t(c) * ringSamples;
+            }
+        }
+
+        std::vector<float> data;
+        std::vector<float*> pointers;
+    };
+
+    // stands in for AudioSampleBuffer::copyFrom, which the DataBuffer calls for every sample of every channel
+    NOINLINE void copySamples(float* dest, const float* source, int num)
+    {
+        std::memcpy(dest, source, num * sizeof(float));
+    }
+
+    // What DataBuffer::addToBuffer (with the default chunk size of 1) does with interleaved rows
+    void addToBufferPattern(const float* rows, int numRows, int numChans, float* const* channels, int start)
+    {
+        for (int r = 0; r < numRows; ++r)
+        {
+            for (int c = 0; c < numChans; ++c)
+            {
+                copySamples(channels[c] + start + r, rows + r * numChans + c, 1);
+            }
+        }
+    }
+
+    // The transposers must put every sample where addToBuffer would. Returns the number of mismatches.
+    int checkTransposers()
+    {
+        std::mt19937 rng(3);
+        std::vector<std::pair<const char*, ChannelTranspose::Transposer>> impls = { { "scalar", ChannelTranspose::getScalar() } };
+        if (ChannelTranspose::getSSE2() != nullptr)
+        {
+            impls.push_back({ "SSE2", ChannelTranspose::getSSE2() });
+        }
+
+        int totalMismatches = 0;
+        for (const auto& impl : impls)
+        {
+            int mismatches = 0;
+            int checked = 0;
+            for (int numChans : { 1, 3, 32, 37, 512 })
+            {
+                for (int numRows : { 1, 4, 7, 20, 256 })
+                {
+                    std::vector<float> rows(size_t(numRows) * numChans);
+                    for (float& x : rows)
+                    {
+                        x = float(rng());
+                    }
+
+                    ChannelRing expected(numChans), actual(numChans);
+                    int start = rng() % (ringSamples - numRows);
+                    addToBufferPattern(rows.data(), numRows, numChans, expected.pointers.data(), start);
+                    impl.second(rows.data(), numRows, numChans, actual.pointers.data(), start);
+
+                    ++checked;
+                    if (expected.data != actual.data)
+                    {
+                        ++mismatches;
+                    }
+                }
+            }
+
+            report(Result("transpose_check").add("impl", impl.first).add("blocks", checked).add("mismatches", mismatches));
+            totalMismatches += mismatches;
+        }
+        return totalMismatches;
+    }
+
+    std::vector<std::pair<const char*, PacketKernel::ChangeFinder>> getChangeFinders()
+    {
+        std::vector<std::pair<const char*, PacketKernel::ChangeFinder>> impls = { { "scalar", PacketKernel::getScalarChangeFinder() } };
+        if (PacketKernel::getSSE2ChangeFinder() != nullptr)
+        {
+            impls.push_back({ "SSE2", PacketKernel::getSSE2ChangeFinder() });
+        }
+        if (PacketKernel::getAVX2ChangeFinder() != nullptr)
+        {
+            impls.push_back({ "AVX2", PacketKernel::getAVX2ChangeFinder() });
+        }
+        return impls;
+    }
+
+    // TTL words with an edge every edgeInterval samples on average (none if 0), one bit at a time
+    std::vector<uint64_t> makeTtlWords(int count, int edgeInterval, std::mt19937& rng)
+    {
+        std::vector<uint64_t> words(count);
+        uint64_t word = 0;
+        for (uint64_t& w : words)
+        {
+            if (edgeInterval > 0 && rng() % edgeInterval == 0)
+            {
+                word ^= uint64_t(1) << (rng() % 32);
+            }
+            w = word;
+        }
+        return words;
+    }
+
+    // The vectorized change finders must find the same edges as the scalar one, for any block length
+    // and edge density. Returns the number of mismatches.
+    int checkChangeFinders()
+    {
+        std::mt19937 rng(7);
+        int totalMismatches = 0;
+
+        for (const auto& impl : getChangeFinders())
+        {
+            int mismatches = 0;
+            int checked = 0;
+            for (int n : { 0, 1, 2, 3, 5, 20, 37, 256 })
+            {
+                for (int edgeInterval : { 0, 1, 3, 50 })
+                {
+                    auto words = makeTtlWords(n, edgeInterval, rng);
+                    uint64_t previous = rng() % 2 == 0 ? 0 : rng();
+
+                    std::vector<int> expected(n), actual(n);
+                    int numExpected = PacketKernel::getScalarChangeFinder()(words.data(), n, previous, expected.data());
+                    int numActual = impl.second(words.data(), n, previous, actual.data());
+
+                    ++checked;
+                    if (numExpected != numActual || !std::equal(expected.begin(), expected.begin() + numExpected, actual.begin()))
+                    {
+                        ++mismatches;
+                    }
+                }
+            }
+
+            report(Result("ttl_edge_check").add("impl", impl.first).add("blocks", checked).add("mismatches", mismatches));
+            totalMismatches += mismatches;
+        }
+        return totalMismatches;
+    }
+
+    // Cost of finding the TTL edges in a block of per-sample words, when they are rare (as usual) and when
+    // they are frequent
+    void benchTtlEdges(double minSeconds)
+    {
+        std::mt19937 rng(8);
+        volatile int sink = 0;
+
+        for (int edgeInterval : { 0, 1000, 10 })
+        {
+            for (int blockSamples : { int(blockPackets), 256 })
+            {
+                const int numBlocks = 64;
+                auto words = makeTtlWords(numBlocks * blockSamples, edgeInterval, rng);
+                std::vector<int> changes(blockSamples);
+
+                for (const auto& impl : getChangeFinders())
+                {
+                    double ns = timeLoop(minSeconds, [&](uint64_t i)
+                    {
+                        const uint64_t* block = words.data() + (i % numBlocks) * blockSamples;
+                        sink = impl.second(block, blockSamples, block[0], changes.data());
+                    });
+                    report(Result("ttl_edges").add("impl", impl.first).add("edge_interval", edgeInterval)
+                        .add("block_samples", blockSamples).add("ns_per_sample", ns / blockSamples));
+                }
+            }
+        }
+    }
+
+    // Cost of getting a block of blockPackets decoded packets into per-channel storage: as the plugin
+    // has to (decode the block into interleaved rows, then the DataBuffer copies them sample by sample),
+    // and by decoding 4 packets at a time into a tile that stays in L1 and transposing each tile
+    // straight into the channels, as a DataBuffer that exposed its storage would allow.
+    void benchChannelMajor(double minSeconds)
+    {
+        std::mt19937 rng(4);
+        volatile float sink = 0;
+
+        for (int boards : boardCounts)
+        {
+            const int numChans = boards * PacketKernel::boardChannels;
+            auto packets = makePackets(boards, 256, rng);
+            PacketKernel::Decoder decoder = PacketKernel::getDecoder(boards);
+            std::vector<float> block(size_t(blockPackets) * numChans);
+            ChannelRing ring(numChans);
+
+            auto reportBlock = [&](const char* method, double ns)
+            {
+                report(Result("channel_major").add("method", method).add("boards", boards).add("ns_per_block", ns)
+                    .add("mb_per_s", blockPackets * numChans * sizeof(float) / ns * 1e3));
+            };
+
+            auto nextStart = [&](uint64_t i) { return int(i * blockPackets % (ringSamples - blockPackets)); };
+            auto decodeBlock = [&](uint64_t i)
+            {
+                for (int p = 0; p < blockPackets; ++p)
+                {
+                    decoder(packets[(i * blockPackets + p) & 255].data(), rawBitVolts, block.data() + p * numChans);
+                }
+            };
+
+            // copying alone, from an already decoded block
+            decodeBlock(0);
+            double ns = timeLoop(minSeconds, [&](uint64_t i)
+            {
+                addToBufferPattern(block.data(), blockPackets, numChans, ring.pointers.data(), nextStart(i));
+                sink = ring.data[0];
+            });
+            reportBlock("addToBuffer_copy", ns);
+
+            ns = timeLoop(minSeconds, [&](uint64_t i)
+            {
+                ChannelTranspose::transposeToChannels(block.data(), blockPackets, numChans, ring.pointers.data(), nextStart(i));
+                sink = ring.data[0];
+            });
+            reportBlock("tiled_transpose", ns);
+
+            // decoding included
+            ns = timeLoop(minSeconds, [&](uint64_t i)
+            {
+                decodeBlock(i);
+                addToBufferPattern(block.data(), blockPackets, numChans, ring.pointers.data(), nextStart(i));
+                sink = ring.data[0];
+            });
+            reportBlock("decode_then_addToBuffer", ns);
+
+            const int tileRows = 4;
+            ns = timeLoop(minSeconds, [&](uint64_t i)
+            {
+                int start = nextStart(i);
+                for (int p = 0; p < blockPackets; p += tileRows)
+                {
+                    int rows = std::min(tileRows, blockPackets - p);
+                    for (int t = 0; t < rows; ++t)
+                    {
+                        decoder(packets[(i * blockPackets + p + t) & 255].data(), rawBitVolts, block.data() + t * numChans);
+                    }
+                    ChannelTranspose::transposeToChannels(block.data(), rows, numChans, ring.pointers.data(), start + p);
+                }
+                sink = ring.data[0];
+            });
+            reportBlock("decode_tiles_direct", ns);
+        }
+    }
+
+    // The decimator must give what filtering each channel with its taps directly and keeping every
+    // factor-th sample would (to within float rounding), including after a jump in the sample numbers,
+    // which restarts the filter as if the input had begun there. Returns the number of mismatches.
+    int checkDecimator()
+    {
+        std::mt19937 rng(5);
+        std::uniform_real_distribution<float> noise(-1000, 1000);
+        int totalMismatches = 0;
+
+        for (int factor : { 2, 3, 16, 64 })
+        {
+            const int numRows = 4000;
+            const int rowStride = 37;
+            const int jumpAt = numRows / 2 + 5; // (not a multiple of factor)
+            const int jumpBy = 1001;
+
+            std::vector<int> channels = { 36, 0, 5, 6, 7, 1, 2, 3, 4, 20, 33 };
+            const int numChans = int(channels.size());
+
+            std::vector<float> rows(size_t(numRows) * rowStride);
+            for (float& x : rows)
+            {
+                x = noise(rng);
+            }
+            std::vector<int64_t> sampleNumbers(numRows);
+            for (int r = 0; r < numRows; ++r)
+            {
+                sampleNumbers[r] = 12345 + r + (r >= jumpAt ? jumpBy : 0);
+            }
+
+            PolyphaseDecimator decimator;
+            decimator.reset(factor, channels.data(), numChans);
+            const std::vector<float>& taps = decimator.getTaps();
+
+            // in uneven pieces, as blocks arrive
+            std::vector<float> out(size_t(decimator.getMaxOutputRows(numRows) + numRows / 7) * numChans);
+            std::vector<int64_t> outNumbers(out.size() / numChans);
+            int numOut = 0;
+            for (int r = 0; r < numRows; )
+            {
+                int n = std::min(int(rng() % 50) + 1, numRows - r);
+                numOut += decimator.process(rows.data() + size_t(r) * rowStride, n, rowStride, sampleNumbers.data() + r,
+                    out.data() + size_t(numOut) * numChans, outNumbers.data() + numOut);
+                r += n;
+            }
+
+            int mismatches = 0;
+            int expectedOut = 0;
+            for (int r = 0; r < numRows; ++r)
+            {
+                if (sampleNumbers[r] % factor != 0)
+                {
+                    continue;
+                }
+
+                int segmentStart = r < jumpAt ? 0 : jumpAt;
+                bool numberOk = expectedOut < numOut && outNumbers[expectedOut] == sampleNumbers[r] / factor;
+                for (int c = 0; c < numChans && numberOk; ++c)
+                {
+                    double expected = 0;
+                    double magnitude = 0;
+                    for (int k = 0; k < int(taps.size()) && r - k >= segmentStart; ++k)
+                    {
+                        expected += double(taps[k]) * rows[size_t(r - k) * rowStride + channels[c]];
+                        magnitude += std::abs(taps[k]) * 1000.0;
+                    }
+                    if (std::abs(out[size_t(expectedOut) * numChans + c] - expected) > 1e-5 * magnitude + 1e-3)
+                    {
+                        numberOk = false;
+                    }
+                }
+                if (!numberOk)
+                {
+                    ++mismatches;
+                }
+                ++expectedOut;
+            }
+            if (numOut != expectedOut)
+            {
+                ++mismatches;
+            }
+
+            report(Result("decimator_check").add("factor", factor).add("outputs", numOut).add("mismatches", mismatches));
+            totalMismatches += mismatches;
+        }
+        return totalMismatches;
+    }
+
+    // Cost of making the LFP subprocessor's data: decimating every channel of a block of blockPackets decoded
+    // packets, compared to decoding them
+    void benchDecimate(double minSeconds)
+    {
+        std::mt19937 rng(6);
+        volatile float sink = 0;
+
+        for (int boards : { 4, 16 })
+        {
+            const int numChans = boards * PacketKernel::boardChannels;
+            auto packets = makePackets(boards, 256, rng);
+            PacketKernel::Decoder decoder = PacketKernel::getDecoder(boards);
+
+            std::vector<float> block(size_t(blockPackets) * numChans);
+            std::vector<int64_t> sampleNumbers(blockPackets);
+            for (int p = 0; p < blockPackets; ++p)
+            {
+                decoder(packets[p].data(), rawBitVolts, block.data() + p * numChans);
+            }
+
+            std::vector<int> channels(numChans);
+            for (int c = 0; c < numChans; ++c)
+            {
+                channels[c] = c;
+            }
+
+            for (int factor : { 4, 16, 64 })
+            {
+                PolyphaseDecimator decimator;
+                decimator.reset(factor, channels.data(), numChans);
+                std::vector<float> out(size_t(decimator.getMaxOutputRows(blockPackets)) * numChans);
+                std::vector<int64_t> outNumbers(decimator.getMaxOutputRows(blockPackets));
+
+                double ns = timeLoop(minSeconds, [&](uint64_t i)
+                {
+                    for (int p = 0; p < blockPackets; ++p)
+                    {
+                        sampleNumbers[p] = int64_t(i * blockPackets + p);
+                    }
+                    if (decimator.process(block.data(), blockPackets, numChans, sampleNumbers.data(),
+                        out.data(), outNumbers.data()) > 0)
+                    {
+                        sink = out[0];
+                    }
+                });
+                report(Result("decimate").add("boards", boards).add("factor", factor).add("taps", factor * PolyphaseDecimator::tapsPerPhase)
+                    .add("ns_per_packet", ns / blockPackets).add("ns_per_sample", ns / blockPackets / numChans));
+            }
+        }
+    }
+
+    // Raw words as an amplifier might give them: a slow oscillation plus noise on each channel, in counts
+    // of atlasRawBitVolts (about 200 uV of LFP and 10 uV of noise)
+    std::vector<uint32_t> makeRawSamples(int numChans, int numSamples, std::mt19937& rng)
+    {
+        std::normal_distribution<double> noise(0, 640);
+        std::uniform_real_distribution<double> phase(0, 6.283185307179586);
+
+        std::vector<uint32_t> samples(size_t(numSamples) * numChans);
+        for (int c = 0; c < numChans; ++c)
+        {
+            const double start = phase(rng);
+            for (int s = 0; s < numSamples; ++s)
+            {
+                double value = 12800 * std::sin(start + s * 6.283185307179586 * 8 / 32000) + noise(rng);
+                samples[size_t(s) * numChans + c] = uint32_t(int32_t(std::lround(value)));
+            }
+        }
+        return samples;
+    }
+
+    // Raw recordings must give back exactly what was recorded: each stream of values through the coder
+    // (realistic, random and extreme values, whole and partial partitions), then samples through a file,
+    // both with its index and found by walking the chunks. Returns the number of mismatches.
+    int checkRawRecording()
+    {
+        std::mt19937 rng(7);
+        int totalMismatches = 0;
+
+        const int stride = 3;
+        std::vector<uint32_t> realistic = makeRawSamples(stride, RawRecording::chunkSamples, rng);
+        std::vector<uint32_t> random(realistic.size());
+        std::vector<uint32_t> extreme(realistic.size());
+        for (size_t i = 0; i < random.size(); ++i)
+        {
+            random[i] = rng();
+            extreme[i] = i % 5 == 0 ? 0 : i % 2 == 0 ? 0x80000000u : 0x7fffffffu;
+        }
+
+        int mismatches = 0;
+        int checked = 0;
+        for (const std::vector<uint32_t>* values : { &realistic, &random, &extreme })
+        {
+            for (int n : { 1, 255, 256, 257, 1000, RawRecording::chunkSamples })
+            {
+                std::vector<uint8_t> coded;
+                RawRecording::encodeStream(values->data() + 1, n, stride, coded);
+
+                std::vector<uint32_t> decoded(size_t(n) * stride, 0);
+                if (!RawRecording::decodeStream(coded.data(), coded.size(), n, decoded.data() + 1, stride))
+                {
+                    ++mismatches;
+                    continue;
+                }
+                for (int i = 0; i < n; ++i)
+                {
+                    if (decoded[size_t(i) * stride + 1] != (*values)[size_t(i) * stride + 1])
+                    {
+                        ++mismatches;
+                        break;
+                    }
+                }
+                ++checked;
+            }
+        }
+        report(Result("raw_codec_check").add("streams", checked).add("mismatches", mismatches));
+        totalMismatches += mismatches;
+
+        // through a file, in 3 whole chunks and a partial one, with a gap in the sample numbers too big
+        // for a chunk to span
+        const int numChans = 40;
+        const int numSamples = 3 * RawRecording::chunkSamples + 100;
+        const int gapAt = RawRecording::chunkSamples + 300;
+        const std::string path = "nlx_benchmark_check" + std::string(RawRecording::extension);
+
+        std::vector<uint32_t> samples = makeRawSamples(numChans, numSamples, rng);
+        std::vector<int64_t> sampleNumbers(numSamples);
+        std::vector<uint32_t> ttlWords(numSamples);
+        for (int s = 0; s < numSamples; ++s)
+        {
+            sampleNumbers[s] = 1000 + s + (s >= gapAt ? 5000000000ll : 0) + (s % 500 == 0 ? 1 : 0);
+            ttlWords[s] = s / 37 % 3 == 0 ? 0 : 1u << (s / 111 % 32);
+        }
+
+        mismatches = 0;
+        {
+            RawRecording::Writer writer;
+            if (!writer.open(path, numChans, 32000, rawBitVolts, 3))
+            {
+                std::fprintf(stderr, "%s\n", writer.getError().c_str());
+                return totalMismatches + 1;
+            }
+            for (int s = 0; s < numSamples; ++s)
+            {
+                writer.append(&samples[size_t(s) * numChans], sampleNumbers[s], ttlWords[s]);
+            }
+            writer.close();
+            if (writer.getStats().samples != uint64_t(numSamples) || writer.getStats().droppedSamples > 0)
+            {
+                ++mismatches;
+            }
+        }
+
+        for (bool indexed : { true, false })
+        {
+            if (!indexed)
+            {
+                // as if the writer hadn't been closed: clear the index offset
+                std::FILE* f = std::fopen(path.c_str(), "r+b");
+                const uint64_t zero = 0;
+                if (f == nullptr || std::fseek(f, RawRecording::fileHeaderBytes - 8, SEEK_SET) != 0
+                    || std::fwrite(&zero, 8, 1, f) != 1)
+                {
+                    ++mismatches;
+                }
+                if (f != nullptr)
+                {
+                    std::fclose(f);
+                }
+            }
+
+            RawRecording::Reader reader;
+            if (!reader.open(path) || reader.hasIndex() != indexed || reader.getNumChannels() != numChans)
+            {
+                ++mismatches;
+                continue;
+            }
+
+            std::vector<int32_t> chunkSamples;
+            std::vector<int64_t> chunkNumbers;
+            std::vector<uint32_t> chunkTtl;
+            int s = 0;
+            for (int chunk = 0; chunk < reader.getNumChunks(); ++chunk)
+            {
+                if (reader.findChunk(reader.getChunkFirstSample(chunk) + 1) != chunk
+                    || !reader.readChunk(chunk, chunkSamples, chunkNumbers, chunkTtl))
+                {
+                    ++mismatches;
+                    break;
+                }
+                for (size_t i = 0; i < chunkNumbers.size(); ++i, ++s)
+                {
+                    if (s >= numSamples || chunkNumbers[i] != sampleNumbers[s] || chunkTtl[i] != ttlWords[s]
+                        || std::memcmp(&chunkSamples[i * numChans], &samples[size_t(s) * numChans], numChans * 4) != 0)
+                    {
+                        ++mismatches;
+                        break;
+                    }
+                }
+            }
+            if (s != numSamples)
+            {
+                ++mismatches;
+            }
+        }
+        std::remove(path.c_str());
+
+        report(Result("raw_file_check").add("samples", numSamples).add("mismatches", mismatches));
+        return totalMismatches + mismatches;
+    }
+
+    // Cost and compression ratio of coding a chunk of every channel (as one raw recording worker does),
+    // and of decoding it again
+    void benchRawRecording(double minSeconds)
+    {
+        std::mt19937 rng(8);
+        volatile uint32_t sink = 0;
+
+        for (int boards : { 4, 16 })
+        {
+            const int numChans = boards * PacketKernel::boardChannels;
+            const int n = RawRecording::chunkSamples;
+            std::vector<uint32_t> samples = makeRawSamples(numChans, n, rng);
+            std::vector<uint8_t> coded;
+            std::vector<size_t> ends(numChans);
+
+            double encodeNs = timeLoop(minSeconds, [&](uint64_t)
+            {
+                coded.clear();
+                for (int c = 0; c < numChans; ++c)
+                {
+                    RawRecording::encodeStream(samples.data() + c, n, numChans, coded);
+                    ends[c] = coded.size();
+                }
+            });
+
+            std::vector<uint32_t> decoded(samples.size());
+            double decodeNs = timeLoop(minSeconds, [&](uint64_t)
+            {
+                size_t start = 0;
+                for (int c = 0; c < numChans; ++c)
+                {
+                    RawRecording::decodeStream(coded.data() + start, ends[c] - start, n, decoded.data() + c, numChans);
+                    start = ends[c];
+                }
+                sink = decoded[0];
+            });
+
+            const double channelSamples = double(n) * numChans;
+            report(Result("raw_record").add("boards", boards).add("ratio_vs_24bit", channelSamples * 3 / coded.size())
+                .add("bits_per_sample", coded.size() * 8 / channelSamples)
+                .add("encode_ns_per_sample", encodeNs / channelSamples).add("decode_ns_per_sample", decodeNs / channelSamples)
+                .add("encode_cores_at_32khz", encodeNs / n * 32000 * 1e-9));
+        }
+    }
+
+    /*** shared memory ***/
+
+    const char* const ringName = "nlx_benchmark_ring";
+
+    // Sample n of the shared memory tests: channel c is n + c, its TTL word is n * 0x100000003 (so the
+    // lines above 32, like the outage marker, must come through too)
+    void makeRingSamples(int numChans, int64_t first, int n, std::vector<float>& samples,
+        std::vector<int64_t>& sampleNumbers, std::vector<uint64_t>& ttlWords)
+    {
+        samples.resize(size_t(n) * numChans);
+        sampleNumbers.resize(n);
+        ttlWords.resize(n);
+        for (int i = 0; i < n; ++i)
+        {
+            sampleNumbers[i] = first + i;
+            ttlWords[i] = uint64_t(first + i) * 0x100000003;
+            for (int c = 0; c < numChans; ++c)
+            {
+                samples[size_t(i) * numChans + c] = float((first + i + c) % 100000);
+            }
+        }
+    }
+
+    bool ringSampleValid(const float* sample, int numChans, int64_t sampleNumber, uint64_t ttl)
+    {
+        if (ttl != uint64_t(sampleNumber) * 0x100000003)
+        {
+            return false;
+        }
+        for (int c = 0; c < numChans; ++c)
+        {
+            if (sample[c] != float((sampleNumber + c) % 100000))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // A TTL edge of the shared memory tests, at the given sample (whose word is as in makeRingSamples)
+    SharedMemoryRing::TtlEdge makeRingEdge(int64_t sampleNumber)
+    {
+        SharedMemoryRing::TtlEdge edge;
+        edge.sampleNumber = sampleNumber;
+        edge.word = uint64_t(sampleNumber) * 0x100000003;
+        edge.changed = edge.word ^ (uint64_t(sampleNumber - 1) * 0x100000003);
+        return edge;
+    }
+
+    bool ringEdgeValid(const SharedMemoryRing::TtlEdge& edge)
+    {
+        const SharedMemoryRing::TtlEdge expected = makeRingEdge(edge.sampleNumber);
+        return edge.word == expected.word && edge.changed == expected.changed;
+    }
+
+    // Readers of the shared memory ring must get every sample (and TTL edge) intact and in order while they keep up,
+    // count what they miss when they don't, and never return a sample that was being overwritten, also
+    // while the writer races ahead on another thread. Returns the number of mismatches.
+    int checkSharedMemoryRing()
+    {
+        const int numChans = 70;
+        const int capacity = 1024;
+        int mismatches = 0;
+
+        SharedMemoryRing::Writer writer;
+        if (!writer.create(ringName, numChans, capacity, 32000))
+        {
+            std::fprintf(stderr, "shared memory: %s\n", writer.getError().c_str());
+            report(Result("shm_check").add("skipped", 1));
+            return 0;
+        }
+
+        std::vector<float> samples, readSamples(size_t(capacity) * numChans);
+        std::vector<int64_t> sampleNumbers, readNumbers(capacity);
+        std::vector<uint64_t> ttlWords;
+        std::vector<uint64_t> readTtl(capacity);
+
+        // keeping up, then lapped
+        SharedMemoryRing::Reader reader;
+        int64_t next = 0;
+        if (!reader.open(ringName) || reader.getNumChannels() != numChans || reader.getCapacity() != capacity)
+        {
+            ++mismatches;
+        }
+        for (int n : { 1, 100, 1000, 5000 })
+        {
+            makeRingSamples(numChans, next, n, samples, sampleNumbers, ttlWords);
+            writer.publish(samples.data(), sampleNumbers.data(), ttlWords.data(), n);
+            next += n;
+
+            const uint64_t lostBefore = reader.getNumLost();
+            int got = 0, numRead;
+            while ((numRead = reader.read(readSamples.data(), readNumbers.data(), readTtl.data(), nullptr, capacity)) > 0)
+            {
+                for (int i = 0; i < numRead; ++i)
+                {
+                    if (!ringSampleValid(&readSamples[size_t(i) * numChans], numChans, readNumbers[i], readTtl[i])
+                        || readNumbers[i] != next - n + int64_t(reader.getNumLost() - lostBefore) + got + i)
+                    {
+                        ++mismatches;
+                    }
+                }
+                got += numRead;
+            }
+            if (got + int64_t(reader.getNumLost() - lostBefore) != n || (n <= capacity && got != n))
+            {
+                ++mismatches;
+            }
+        }
+
+        // the same for edges (edge e at sample 7e)
+        const int edgeCapacity = SharedMemoryRing::numEdgeRecords;
+        std::vector<SharedMemoryRing::TtlEdge> edges, readEdges(edgeCapacity);
+        int64_t nextEdge = 0;
+        for (int n : { 1, 100, edgeCapacity, edgeCapacity * 2 + 3 })
+        {
+            edges.resize(n);
+            for (int i = 0; i < n; ++i)
+            {
+                edges[i] = makeRingEdge((nextEdge + i) * 7);
+            }
+            writer.publishEdges(edges.data(), n);
+            nextEdge += n;
+
+            const uint64_t lostBefore = reader.getNumEdgesLost();
+            int got = 0, numRead;
+            while ((numRead = reader.readEdges(readEdges.data(), edgeCapacity)) > 0)
+            {
+                for (int i = 0; i < numRead; ++i)
+                {
+                    if (!ringEdgeValid(readEdges[i]) || readEdges[i].sampleNumber
+                        != (nextEdge - n + int64_t(reader.getNumEdgesLost() - lostBefore) + got + i) * 7)
+                    {
+                        ++mismatches;
+                    }
+                }
+                got += numRead;
+            }
+            if (got + int64_t(reader.getNumEdgesLost() - lostBefore) != n || (n <= edgeCapacity && got != n))
+            {
+                ++mismatches;
+            }
+        }
+
+        // a writer running flat out against readers on other threads (with an edge at the start of each
+        // write, which readers must get intact and in order)
+        std::atomic<bool> writing(true);
+        std::atomic<int> raceMismatches(0);
+        std::atomic<uint64_t> raceRead(0), raceLost(0), raceEdgesRead(0);
+        std::vector<std::thread> readers;
+        for (int r = 0; r < 3; ++r)
+        {
+            readers.emplace_back([&]()
+            {
+                SharedMemoryRing::Reader threadReader;
+                if (!threadReader.open(ringName))
+                {
+                    ++raceMismatches;
+                    return;
+                }
+                std::vector<float> buffer(size_t(capacity) * numChans);
+                std::vector<int64_t> numbers(capacity);
+                std::vector<uint64_t> ttl(capacity);
+                std::vector<SharedMemoryRing::TtlEdge> threadEdges(64);
+                int64_t expected = -1, lastEdge = -1;
+                uint64_t total = 0, totalEdges = 0;
+                while (writing || threadReader.getNumAvailable() > 0)
+                {
+                    int numEdges = threadReader.readEdges(threadEdges.data(), 64);
+                    for (int i = 0; i < numEdges; ++i)
+                    {
+                        if (!ringEdgeValid(threadEdges[i]) || threadEdges[i].sampleNumber <= lastEdge)
+                        {
+                            ++raceMismatches;
+                        }
+                        lastEdge = threadEdges[i].sampleNumber;
+                    }
+                    totalEdges += uint64_t(numEdges);
+
+                    int numRead = threadReader.read(buffer.data(), numbers.data(), ttl.data(), nullptr, 64);
+                    for (int i = 0; i < numRead; ++i)
+                    {
+                        if (!ringSampleValid(&buffer[size_t(i) * numChans], numChans, numbers[i], ttl[i])
+                            || (expected >= 0 && numbers[i] < expected))
+                        {
+                            ++raceMismatches;
+                        }
+                        expected = numbers[i] + 1;
+                    }
+                    total += uint64_t(numRead);
+                }
+                raceRead += total;
+                raceLost += threadReader.getNumLost();
+                raceEdgesRead += totalEdges;
+            });
+        }
+
+        const Clock::time_point start = Clock::now();
+        while (std::chrono::duration<double>(Clock::now() - start).count() < 0.2)
+        {
+            int n = 1 + int(next % 97);
+            makeRingSamples(numChans, next, n, samples, sampleNumbers, ttlWords);
+            const SharedMemoryRing::TtlEdge edge = makeRingEdge(next);
+            writer.publishEdges(&edge, 1);
+            writer.publish(samples.data(), sampleNumbers.data(), ttlWords.data(), n);
+            next += n;
+        }
+        writing = false;
+        for (std::thread& thread : readers)
+        {
+            thread.join();
+        }
+
+        writer.close();
+        if (!reader.isWriterClosed())
+        {
+            ++mismatches;
+        }
+        mismatches += raceMismatches;
+
+        report(Result("shm_check").add("race_samples_written", double(next)).add("race_samples_read", double(raceRead))
+            .add("race_samples_lost", double(raceLost)).add("race_edges_read", double(raceEdgesRead))
+            .add("mismatches", mismatches));
+        return mismatches;
+    }
+
+    void addLatencyPercentiles(Result& result, std::vector<uint32_t>& latenciesNs)
+    {
+        if (latenciesNs.empty())
+        {
+            return;
+        }
+
+        std::sort(latenciesNs.begin(), latenciesNs.end());
+        auto percentileUs = [&](double p)
+        {
+            size_t index = std::min(latenciesNs.size() - 1, size_t(p / 100 * latenciesNs.size()));
+            return latenciesNs[index] / 1000.0;
+        };
+        result.add("latency_p50_us", percentileUs(50)).add("latency_p90_us", percentileUs(90))
+            .add("latency_p99_us", percentileUs(99)).add("latency_p999_us", percentileUs(99.9))
+            .add("latency_max_us", latenciesNs.back() / 1000.0);
+    }
+
+    // Latency from publishing a block to the shared memory ring to a reader (polling on another thread, as a
+    // closed-loop process would) having it, with blocks published in real time as the plugin does
+    void benchSharedMemory(const Options& opt, int boards, double rate, int blockSamples, int numReaders)
+    {
+        const int numChans = boards * PacketKernel::boardChannels;
+
+        SharedMemoryRing::Writer writer;
+        if (!writer.create(ringName, numChans, 16384, rate))
+        {
+            std::fprintf(stderr, "shm_latency: skipped (%s)\n", writer.getError().c_str());
+            return;
+        }
+
+        std::atomic<bool> writing(true);
+        std::atomic<int> numReady(0);
+        std::vector<std::vector<uint32_t>> latenciesNs(numReaders);
+        std::vector<uint64_t> lost(numReaders), read(numReaders);
+        std::vector<std::thread> readers;
+        for (int r = 0; r < numReaders; ++r)
+        {
+            readers.emplace_back([&, r]()
+            {
+                SharedMemoryRing::Reader reader;
+                bool ok = reader.open(ringName);
+                ++numReady;
+                if (!ok)
+                {
+                    return;
+                }
+
+                std::vector<float> buffer(size_t(blockSamples) * numChans);
+                std::vector<uint64_t> publishNs(blockSamples);
+                latenciesNs[r].reserve(size_t(rate * opt.loopbackSeconds / blockSamples * 1.1));
+                while (writing || reader.getNumAvailable() > 0)
+                {
+                    int n = reader.read(buffer.data(), nullptr, nullptr, publishNs.data(), blockSamples);
+                    if (n == 0)
+                    {
+                        std::this_thread::yield();
+                        continue;
+                    }
+                    uint64_t nowNs = SharedMemoryRing::getMonotonicNs();
+                    latenciesNs[r].push_back(uint32_t(std::min<uint64_t>(nowNs - publishNs[0], UINT32_MAX)));
+                    read[r] += uint64_t(n);
+                }
+                lost[r] = reader.getNumLost();
+            });
+        }
+        while (numReady < numReaders)
+        {
+            std::this_thread::yield();
+        }
+
+        std::vector<float> samples;
+        std::vector<int64_t> sampleNumbers;
+        std::vector<uint64_t> ttlWords;
+        const uint64_t numBlocks = uint64_t(rate * opt.loopbackSeconds / blockSamples);
+        const double periodNs = 1e9 * blockSamples / rate;
+        const Clock::time_point start = Clock::now();
+        for (uint64_t b = 0; b < numBlocks; ++b)
+        {
+            Clock::time_point due = start + std::chrono::nanoseconds(int64_t(b * periodNs));
+            if (due > Clock::now())
+            {
+                std::this_thread::sleep_until(due);
+            }
+            makeRingSamples(numChans, int64_t(b * blockSamples), blockSamples, samples, sampleNumbers, ttlWords);
+            writer.publish(samples.data(), sampleNumbers.data(), ttlWords.data(), blockSamples);
+        }
+        writing = false;
+        for (std::thread& thread : readers)
+        {
+            thread.join();
+        }
+        writer.close();
+
+        std::vector<uint32_t> all;
+        uint64_t totalLost = 0, totalRead = 0;
+        for (int r = 0; r < numReaders; ++r)
+        {
+            all.insert(all.end(), latenciesNs[r].begin(), latenciesNs[r].end());
+            totalLost += lost[r];
+            totalRead += read[r];
+        }
+
+        Result result("shm_latency");
+        result.add("boards", boards).add("rate_hz", rate).add("block_samples", blockSamples).add("readers", numReaders)
+            .add("samples_published", double(numBlocks * blockSamples)).add("samples_read", double(totalRead))
+            .add("samples_lost", double(totalLost));
+        addLatencyPercentiles(result, all);
+        report(result);
+    }
+
+    // Timestamps as the hardware makes them (rounded to the us), with gaps and reordering, must convert
+    // back to exactly the sample numbers they were made from. Returns the number of mismatches.
+    int checkTimestamps()
+    {
+        std::mt19937 rng(1);
+        int totalMismatches = 0;
+
+        for (double rate : { 16000.0, 30000.0, 32000.0, 32768.0, 40000.0 })
+        {
+            TimestampConverter converter;
+            converter.reset(rate);
+            const double usPerSample = 1e6 / rate;
+            const uint64_t start = 1000000000000ull + rng() % 1000000;
+
+            int mismatches = 0;
+            int64_t n = 0;
+            for (int i = 0; i < 2000000; ++i, ++n)
+            {
+                if (rng() % 1000 == 0)
+                {
+                    n += rng() % 1000; // lost packets
+                }
+                int64_t sample = rng() % 1000 == 0 ? n - 3 : n; // (out of order)
+                uint64_t ts = start + uint64_t(sample * usPerSample + 0.5);
+
+                if (converter.toSampleNumber(ts) != sample)
+                {
+                    ++mismatches;
+                }
+            }
+
+            report(Result("timestamp_check").add("rate_hz", rate).add("mismatches", mismatches));
+            totalMismatches += mismatches;
+        }
+        return totalMismatches;
+    }
+
+    // After an outage, sample numbers must follow the hardware timestamps if the amplifier's clock ran on
+    // through it (even if the outage's length by the local clock is off by less than the tolerance), and
+    // continue from the local clock if it restarted or jumped; either way, the following packets must count
+    // on from there. Returns the number of mismatches.
+    int checkResync()
+    {
+        const double rate = 32000;
+        const double usPerSample = 1e6 / rate;
+        const uint64_t start = 1000000000000ull;
+        const int64_t outageUs = 2000000;
+        const int64_t toleranceUs = 500000;
+        const int64_t last = 99999; // (before the outage)
+        const int64_t ranOn = last + int64_t(outageUs / usPerSample);
+        auto hardwareTs = [&](uint64_t from, int64_t n) { return from + uint64_t(n * usPerSample + 0.5); };
+
+        struct Case
+        {
+            int64_t measuredUs;   // outage by the local clock
+            uint64_t resumeStart; // hardware clock after the outage (timestamp of sample 0)
+            int64_t resumeN;      // first sample after it by that clock
+            bool restarted;
+        };
+        const Case cases[] = {
+            { outageUs + 30000, start, ranOn, false },
+            { outageUs - 400000, start, ranOn, false },
+            { outageUs, 5000, 0, true },                         // amplifier restarted
+            { outageUs, start + 3600000000ull, ranOn, true }     // clock set an hour ahead
+        };
+
+        int mismatches = 0;
+        for (const Case& c : cases)
+        {
+            TimestampConverter converter;
+            converter.reset(rate);
+            for (int64_t n = 0; n <= last; ++n)
+            {
+                converter.toSampleNumber(hardwareTs(start, n));
+            }
+
+            bool rebased;
+            int64_t first = converter.resync(hardwareTs(c.resumeStart, c.resumeN), last, c.measuredUs, toleranceUs,
+                rebased);
+            int64_t expected = c.restarted ? last + std::llround(c.measuredUs / usPerSample) : c.resumeN;
+            if (rebased != c.restarted || first != expected)
+            {
+                ++mismatches;
+            }
+
+            for (int64_t k = 1; k <= 10000; ++k)
+            {
+                if (converter.toSampleNumber(hardwareTs(c.resumeStart, c.resumeN + k)) != first + k)
+                {
+                    ++mismatches;
+                }
+            }
+        }
+
+        report(Result("resync_check").add("cases", double(sizeof(cases) / sizeof(cases[0])))
+            .add("mismatches", mismatches));
+        return mismatches;
+    }
+
+    // Percentiles from a LatencyHistogram must be within 1% of the exact ones, over the whole range of
+    // latencies and for an interval taken with since(). Returns the number of mismatches.
+    int checkLatencyHistogram()
+    {
+        std::mt19937 rng(1);
+        std::lognormal_distribution<double> distribution(std::log(20000.0), 2.0); // (median 20 us)
+
+        LatencyHistogram histogram;
+        LatencyHistogram::Counts before;
+        std::vector<uint64_t> values;
+        int mismatches = 0;
+        int checked = 0;
+
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            // (the second pass is checked as an interval after the first)
+            values.clear();
+            for (int i = 0; i < 1000000; ++i)
+            {
+                uint64_t ns = uint64_t(std::min(distribution(rng), 1e10));
+                histogram.record(ns);
+                values.push_back(ns);
+            }
+            std::sort(values.begin(), values.end());
+
+            LatencyHistogram::Counts now;
+            now.add(histogram);
+            LatencyHistogram::Counts interval = now.since(before);
+            before = now;
+
+            if (interval.getTotal() != values.size())
+            {
+                ++mismatches;
+            }
+            for (double p : { 0.1, 1.0, 10.0, 50.0, 90.0, 99.0, 99.9, 99.99, 100.0 })
+            {
+                size_t rank = size_t(p / 100 * values.size() + 0.5);
+                double exact = double(values[std::max<size_t>(rank, 1) - 1]);
+                if (std::abs(interval.getPercentile(p) - exact) > exact * 0.01 + 1)
+                {
+                    ++mismatches;
+                }
+                ++checked;
+            }
+        }
+
+        report(Result("latency_histogram_check").add("percentiles", checked).add("mismatches", mismatches));
+        return mismatches;
+    }
+
+    void benchTimestamps(double minSeconds)
+    {
+        volatile int64_t sink = 0;
+
+        for (double rate : { 30000.0, 32768.0 })
+        {
+            TimestampConverter converter;
+            converter.reset(rate);
+            const double usPerSample = 1e6 / rate;
+
+            double ns = timeLoop(minSeconds, [&](uint64_t i)
+            {
+                sink = converter.toSampleNumber(uint64_t(i * usPerSample));
+            });
+            report(Result("timestamp_convert").add("rate_hz", rate).add("ns_per_packet", ns));
+        }
+    }
+
+    // Sender thread -> UDP loopback -> receiver thread -> PacketRing -> decoder thread, as in the plugin.
+    // The sender stamps its send time into the spare header words, so the decoder can measure the
+    // latency from send to decoded. rate = 0 sends as fast as possible. If mapped is true, the receiver
+    // reads from an AF_PACKET ring and only passes pointers to the decoder, as in the plugin's
+    // "Packet ring" mode.
+    void benchLoopback(const Options& opt, int boards, double rate, bool mapped)
+    {
+        const int words = PacketKernel::wordsInPacketWithBoards(boards);
+        const int packetBytes = words * 4;
+        const int numChans = boards * PacketKernel::boardChannels;
+
+        UdpSocket rxSocket, txSocket;
+        rxSocket.setBufferSizes(8 << 20);
+        if (!rxSocket.bind("127.0.0.1", uint16_t(opt.port)) || !txSocket.setDestination("127.0.0.1", uint16_t(opt.port)))
+        {
+            std::fprintf(stderr, "loopback: can't bind to port %d\n", opt.port);
+            return;
+        }
+
+        // (declared before the threads, which read packets in place from its ring)
+        PacketMmapSocket mmapSocket;
+        if (mapped && !mmapSocket.open("127.0.0.1", uint16_t(opt.port)))
+        {
+            std::fprintf(stderr, "loopback_packet_ring: skipped (%s)\n", mmapSocket.getError().c_str());
+            return;
+        }
+
+        PacketRing ring(4096, packetBytes);
+        std::atomic<bool> sending(true), receiving(true);
+        uint64_t sent = 0, received = 0, ringFull = 0, invalid = 0;
+        std::vector<uint32_t> latenciesNs;
+        latenciesNs.reserve(size_t((rate > 0 ? rate : 1e6) * opt.loopbackSeconds * 1.1));
+
+        std::thread decoder([&]()
+        {
+            std::vector<float> out(numChans);
+            PacketKernel::Decoder decoder = PacketKernel::getDecoder(boards);
+            TimestampConverter converter;
+            converter.reset(rate > 0 ? rate : 32000);
+
+            while (receiving || ring.getNumReady() > 0)
+            {
+                int n = ring.getNumReady();
+                if (n == 0)
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                for (int s = 0; s < n; ++s)
+                {
+                    const uint32_t* packet = ring.getReadSlot(s);
+                    if (ring.getReadLength(s) != packetBytes || !PacketKernel::headerValid(packet, boards)
+                        || !decoder(packet, rawBitVolts, out.data()))
+                    {
+                        ++invalid;
+                        continue;
+                    }
+                    converter.toSampleNumber(PacketKernel::readTimestamp(packet));
+
+                    uint64_t sentNs = (uint64_t(PacketKernel::readWord(packet, 8)) << 32) | PacketKernel::readWord(packet, 7);
+                    latenciesNs.push_back(uint32_t(std::min<uint64_t>(nowNs() - sentNs, UINT32_MAX)));
+                }
+                ring.finishRead(n);
+            }
+        });
+
+        std::thread receiver([&]()
+        {
+            while (mapped)
+            {
+                // blocks whose packets have all been decoded go back to the kernel
+                mmapSocket.release(ring.getReadCount());
+
+                int numFree = ring.getNumFree();
+                if (numFree == 0)
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                int ready = mmapSocket.wait(20);
+                if (ready < 0 || (ready == 0 && !sending))
+                {
+                    break;
+                }
+
+                PacketMmapSocket::Frame frame;
+                int n = 0;
+                while (n < numFree && mmapSocket.next(frame))
+                {
+                    ring.setWriteExternal(n++, frame.payload, frame.bytes);
+                }
+                received += n;
+                ring.finishWrite(n);
+            }
+
+            std::vector<uint32_t> discard(words);
+            while (!mapped && (sending || ring.getNumFree() < ring.getCapacity()))
+            {
+                bool full = ring.getNumFree() == 0;
+                void* dest = full ? discard.data() : ring.getWriteSlot(0);
+
+                int bytes = rxSocket.receive(dest, packetBytes, 20);
+                if (bytes <= 0)
+                {
+                    if (!sending)
+                    {
+                        break; // nothing more in flight
+                    }
+                    continue;
+                }
+
+                ++received;
+                if (full)
+                {
+                    ++ringFull;
+                    continue;
+                }
+                ring.setWriteLength(0, bytes);
+                ring.finishWrite(1);
+            }
+            receiving = false;
+        });
+
+        PacketBuilder builder(boards, rate > 0 ? rate : 32000);
+        const uint64_t total = uint64_t((rate > 0 ? rate : 1e7) * opt.loopbackSeconds);
+        const Clock::time_point start = Clock::now();
+        const double periodNs = rate > 0 ? 1e9 / rate : 0;
+
+        for (uint64_t n = 0; n < total; ++n)
+        {
+            if (rate > 0)
+            {
+                // send whatever is due, sleeping in between
+                Clock::time_point due = start + std::chrono::nanoseconds(int64_t(n * periodNs));
+                if (due > Clock::now())
+                {
+                    std::this_thread::sleep_until(due);
+                }
+            }
+            else if (std::chrono::duration<double>(Clock::now() - start).count() >= opt.loopbackSeconds)
+            {
+                break;
+            }
+
+            uint32_t* packet = builder.build(n, builder.getTimestamp(n, 0), 1000);
+
+            // stamp the send time into spare header words, keeping the checksum valid
+            uint64_t sendNs = nowNs();
+            packet[7] = uint32_t(sendNs & 0xffffffff);
+            packet[8] = uint32_t(sendNs >> 32);
+            packet[words - 1] ^= packet[7] ^ packet[8];
+
+            if (txSocket.send(packet, packetBytes) == packetBytes)
+            {
+                ++sent;
+            }
+        }
+        double sendSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        sending = false;
+        receiver.join();
+        decoder.join();
+
+        Result result(mapped ? "loopback_packet_ring" : "loopback");
+        result.add("boards", boards).add("target_rate_hz", rate).add("seconds", sendSeconds)
+            .add("sent", double(sent)).add("received", double(received))
+            .add("lost", double(sent - std::min(sent, received))).add("ring_full", double(ringFull))
+            .add("kernel_drops", double(mapped ? mmapSocket.getKernelDrops() : -1))
+            .add("invalid", double(invalid)).add("packets_per_s", received / sendSeconds)
+            .add("mb_per_s", received * double(packetBytes) / sendSeconds / 1e6);
+
+        addLatencyPercentiles(result, latenciesNs);
+        report(result);
+    }
+
+    // Decodes packets received through an AF_PACKET ring that is closed and reopened halfway through,
+    // as the plugin's "Packet ring" mode does when it recovers from a socket error. Every packet must
+    // arrive intact and in order, and blocks of the ring must only be released once all of their packets
+    // have been decoded. Returns the number of mismatches, or 0 if the packet ring isn't available.
+    int checkPacketRingRebind(const Options& opt)
+    {
+        const int boards = 4;
+        const int packetBytes = PacketKernel::wordsInPacketWithBoards(boards) * 4;
+        const int numChans = boards * PacketKernel::boardChannels;
+        const int perHalf = 2000;
+
+        UdpSocket rxSocket, txSocket;
+        if (!rxSocket.bind("127.0.0.1", uint16_t(opt.port)) || !txSocket.setDestination("127.0.0.1", uint16_t(opt.port)))
+        {
+            std::fprintf(stderr, "packet_ring_rebind: can't bind to port %d\n", opt.port);
+            return 0;
+        }
+
+        PacketMmapSocket mmapSocket;
+        if (!mmapSocket.open("127.0.0.1", uint16_t(opt.port)))
+        {
+            std::fprintf(stderr, "packet_ring_rebind: skipped (%s)\n", mmapSocket.getError().c_str());
+            return 0;
+        }
+
+        PacketRing ring(256, packetBytes);
+        std::atomic<bool> sending(true), rebindRequested(false), rebound(false), receiving(true);
+        std::atomic<uint64_t> decoded(0);
+        uint64_t sent = 0, invalid = 0, outOfOrder = 0, earlyReleases = 0;
+
+        std::thread decoder([&]()
+        {
+            std::vector<float> out(numChans);
+            PacketKernel::Decoder decode = PacketKernel::getDecoder(boards);
+            uint64_t expected = 0;
+
+            while (receiving || ring.getNumReady() > 0)
+            {
+                int n = ring.getNumReady();
+                if (n == 0)
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                for (int s = 0; s < n; ++s)
+                {
+                    const uint32_t* packet = ring.getReadSlot(s);
+                    if (ring.getReadLength(s) != packetBytes || !PacketKernel::packetValid(packet, boards)
+                        || !decode(packet, rawBitVolts, out.data()))
+                    {
+                        ++invalid;
+                    }
+                    else if (PacketKernel::readTtl(packet) != expected++)
+                    {
+                        ++outOfOrder;
+                        expected = PacketKernel::readTtl(packet) + 1;
+                    }
+                }
+                ring.finishRead(n);
+                decoded += uint64_t(n);
+            }
+        });
+
+        std::thread receiver([&]()
+        {
+            uint64_t releaseBase = 0;
+            while (true)
+            {
+                // as in NeuralynxThread::Stream::rcvIntoRingMapped
+                uint64_t consumed = ring.getReadCount() - releaseBase;
+                if (consumed > mmapSocket.getNumReturned())
+                {
+                    ++earlyReleases;
+                }
+                mmapSocket.release(consumed);
+
+                // as in NeuralynxThread::Stream::recoverSocket: wait for the ring to drain, then reopen
+                if (rebindRequested && !rebound && ring.getNumReady() == 0)
+                {
+                    mmapSocket.close();
+                    if (!mmapSocket.open("127.0.0.1", uint16_t(opt.port)))
+                    {
+                        break;
+                    }
+                    releaseBase = ring.getReadCount();
+                    rebound = true;
+                }
+
+                int numFree = ring.getNumFree();
+                if (numFree == 0)
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                int ready = mmapSocket.wait(20);
+                if (ready < 0 || (ready == 0 && !sending))
+                {
+                    break;
+                }
+
+                PacketMmapSocket::Frame frame;
+                int n = 0;
+                while (n < numFree && mmapSocket.next(frame))
+                {
+                    ring.setWriteExternal(n++, frame.payload, frame.bytes);
+                }
+                ring.finishWrite(n);
+            }
+            receiving = false;
+        });
+
+        PacketBuilder builder(boards, 32000);
+        for (uint64_t n = 0; n < 2 * perHalf && receiving; ++n)
+        {
+            if (n == perHalf)
+            {
+                // everything before the rebind must have been decoded from the first ring
+                const Clock::time_point start = Clock::now();
+                while (decoded < sent && receiving && Clock::now() - start < std::chrono::seconds(2))
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+                rebindRequested = true;
+                while (!rebound && receiving)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            }
+
+            // (a little slower than the plugin's streams, so loopback doesn't drop any)
+            if (txSocket.send(builder.build(n, builder.getTimestamp(n, 0), 1), packetBytes) == packetBytes)
+            {
+                ++sent;
+            }
+            if (n % 32 == 31)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+
+        sending = false;
+        receiver.join();
+        decoder.join();
+
+        int mismatches = int(invalid + outOfOrder + earlyReleases) + (rebound ? 0 : 1)
+            + int(sent - std::min<uint64_t>(sent, decoded));
+        report(Result("packet_ring_rebind_check").add("sent", double(sent)).add("decoded", double(decoded))
+            .add("invalid", double(invalid)).add("out_of_order", double(outOfOrder))
+            .add("early_releases", double(earlyReleases)).add("mismatches", mismatches));
+        return mismatches;
+    }
+
+    bool writeJson(const std::string& path)
+    {
+        FILE* f = std::fopen(path.c_str(), "w");
+        if (f == nullptr)
+        {
+            return false;
+        }
+
+        std::time_t now = std::time(nullptr);
+        char timeString[32];
+        std::strftime(timeString, sizeof(timeString), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+#if defined(__clang__)
+        const char* compiler = "clang " __clang_version__;
+#elif defined(__GNUC__)
+        const char* compiler = "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+        std::string msvc = "msvc " + std::to_string(_MSC_VER);
+        const char* compiler = msvc.c_str();
+#else
+        const char* compiler = "unknown";
+#endif
+
+        std::fprintf(f, "{\n  \"tool\": \"nlx_benchmark\",\n  \"format\": 1,\n  \"time\": \"%s\",\n"
+            "  \"compiler\": \"%s\",\n  \"dispatch\": \"%s\",\n  \"results\": [\n",
+            timeString, compiler, PacketKernel::getImplementationName());
+
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            std::fprintf(f, "    %s%s\n", results[i].toJson().c_str(), i + 1 < results.size() ? "," : "");
+        }
+        std::fprintf(f, "  ]\n}\n");
+        return std::fclose(f) == 0;
+    }
+
+    void printUsage()
+    {
+        std::printf(
+            "usage: nlx_benchmark [options]\n"
+            "  --json FILE           also write the results to FILE as JSON\n"
+            "  --quick               shorter runs (less precise)\n"
+            "  --no-loopback         skip the UDP loopback benchmarks\n"
+            "                        (the packet ring variants run on Linux with CAP_NET_RAW)\n"
+            "  --loopback-seconds S  length of each loopback and shared memory run (default 2)\n"
+            "  --port N              loopback port (default 26099)\n");
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    Options opt;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--quick")                               { opt.quick = true; }
+        else if (arg == "--no-loopback")                    { opt.loopback = false; }
+        else if (arg == "--json" && hasValue)               { opt.jsonPath = argv[++i]; }
+        else if (arg == "--port" && hasValue)               { opt.port = std::atoi(argv[++i]); }
+        else if (arg == "--loopback-seconds" && hasValue)   { opt.loopbackSeconds = std::atof(argv[++i]); }
+        else
+        {
+            printUsage();
+            return 1;
+        }
+    }
+
+    const double minSeconds = opt.quick ? 0.05 : 0.3;
+    if (opt.quick)
+    {
+        opt.loopbackSeconds = std::min(opt.loopbackSeconds, 0.5);
+    }
+
+    std::printf("decoder for this CPU: %s\n", PacketKernel::getImplementationName());
+
+    int mismatches = checkKernels() + checkShardedDecoder() + checkTransposers() + checkChangeFinders();
+    int filterMismatches = checkDecimator();
+    int tsMismatches = checkTimestamps() + checkResync() + checkLatencyHistogram();
+    int rawMismatches = checkRawRecording();
+    int shmMismatches = checkSharedMemoryRing();
+    benchDecode(minSeconds);
+    benchShardedDecode(minSeconds);
+    benchChannelMajor(minSeconds);
+    benchDecimate(minSeconds);
+    benchTtlEdges(minSeconds);
+    benchRawRecording(minSeconds);
+    benchTimestamps(minSeconds);
+
+    // publish to read through shared memory, as with a closed-loop process on the same machine
+    for (int numReaders : { 1, 4 })
+    {
+        benchSharedMemory(opt, 16, 40000, 8, numReaders);
+    }
+
+    int recoveryMismatches = 0;
+    if (opt.loopback)
+    {
+        if (PacketMmapSocket::isAvailable())
+        {
+            recoveryMismatches = checkPacketRingRebind(opt);
+        }
+
+        // real-time stream (latency), then as fast as possible (throughput)
+        for (bool mapped : { false, true })
+        {
+            if (mapped && !PacketMmapSocket::isAvailable())
+            {
+                break;
+            }
+            benchLoopback(opt, 4, 32000, mapped);
+            benchLoopback(opt, 16, 40000, mapped);
+            benchLoopback(opt, 16, 0, mapped);
+        }
+    }
+
+    if (!opt.jsonPath.empty() && !writeJson(opt.jsonPath))
+    {
+        std::fprintf(stderr, "can't write %s\n", opt.jsonPath.c_str());
+        return 1;
+    }
+
+    if (mismatches > 0)
+    {
+        std::fprintf(stderr, "decoder output does not match the scalar decoder\n");
+        return 2;
+    }
+    if (filterMismatches > 0)
+    {
+        std::fprintf(stderr, "decimator output does not match direct filtering\n");
+        return 2;
+    }
+    if (tsMismatches > 0)
+    {
+        std::fprintf(stderr, "timestamps were not converted to the right sample numbers (or resynced after an "
+            "outage), or latency percentiles were off\n");
+        return 2;
+    }
+    if (recoveryMismatches > 0)
+    {
+        std::fprintf(stderr, "packets were lost, corrupted or released too early across a packet ring rebind\n");
+        return 2;
+    }
+    if (rawMismatches > 0)
+    {
+        std::fprintf(stderr, "raw recording does not give back the samples recorded\n");
+        return 2;
+    }
+    if (shmMismatches > 0)
+    {
+        std::fprintf(stderr, "shared memory readers did not get the samples published\n");
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,120 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+We hope that this plugin will be useful to others, but its source code
+and functionality are subject to a non-disclosure agreement (NDA) with
+Neuralynx, Inc. If you or your institution have not signed the appropriate
+NDA, STOP and do not read or execute this plugin until you have done so.
+Do not share this plugin with other parties who have not signed the NDA.
+
+*/
+
+#ifndef CHANNEL_TRANSPOSE_H_INCLUDED
+#define CHANNEL_TRANSPOSE_H_INCLUDED
+
+// Tiled transpose to channel-major storage, for the benchmark. The plugin can't use it, as the
+// DataBuffer's per-channel storage isn't accessible (it copies the interleaved blocks itself).
+
+#include "PacketKernel.h"
+
+/*
+ * Copies numRows rows of numChans interleaved samples (e.g. decoded packets) to separate arrays
+ * per channel, as an AudioSampleBuffer stores them: row r of channel c goes to channels[c][start + r].
+ * Works through tiles of 4 channels x 4 rows, so that each source cache line is used for several
+ * channels before it is evicted and each destination is written 4 samples at a time.
+ */
+class ChannelTranspose
+{
+public:
+    typedef void (*Transposer)(const float* rows, int numRows, int numChans, float* const* channels, int start);
+
+    static void transposeToChannels(const float* rows, int numRows, int numChans, float* const* channels, int start)
+    {
+        static const Transposer best = getBest();
+        best(rows, numRows, numChans, channels, start);
+    }
+
+    // Specific implementations, for testing (null if not supported on this CPU)
+    static Transposer getScalar() { return &transposeScalar; }
+    static Transposer getSSE2()
+    {
+#if PACKET_KERNEL_X86
+        return PacketKernel::supportsSSE2() ? &transposeSSE2 : nullptr;
+#else
+        return nullptr;
+#endif
+    }
+
+    static Transposer getBest()
+    {
+        return getSSE2() != nullptr ? getSSE2() : getScalar();
+    }
+
+private:
+    static void transposeScalar(const float* rows, int numRows, int numChans, float* const* channels, int start)
+    {
+        transposeScalarFrom(0, rows, numRows, numChans, channels, start);
+    }
+
+    // One channel at a time, so each destination is written sequentially (also finishes the
+    // vectorized version, from channel c)
+    static void transposeScalarFrom(int c, const float* rows, int numRows, int numChans, float* const* channels,
+        int start)
+    {
+        for (; c < numChans; ++c)
+        {
+            float* out = channels[c] + start;
+            for (int r = 0; r < numRows; ++r)
+            {
+                out[r] = rows[r * numChans + c];
+            }
+        }
+    }
+
+#if PACKET_KERNEL_X86
+    PACKET_KERNEL_TARGET_SSE2
+    static void transposeSSE2(const float* rows, int numRows, int numChans, float* const* channels, int start)
+    {
+        int c = 0;
+        for (; c + 4 <= numChans; c += 4)
+        {
+            float* out0 = channels[c] + start;
+            float* out1 = channels[c + 1] + start;
+            float* out2 = channels[c + 2] + start;
+            float* out3 = channels[c + 3] + start;
+
+            int r = 0;
+            for (; r + 4 <= numRows; r += 4)
+            {
+                const float* in = rows + r * numChans + c;
+                __m128 v0 = _mm_loadu_ps(in);
+                __m128 v1 = _mm_loadu_ps(in + numChans);
+                __m128 v2 = _mm_loadu_ps(in + 2 * numChans);
+                __m128 v3 = _mm_loadu_ps(in + 3 * numChans);
+                _MM_TRANSPOSE4_PS(v0, v1, v2, v3);
+                _mm_storeu_ps(out0 + r, v0);
+                _mm_storeu_ps(out1 + r, v1);
+                _mm_storeu_ps(out2 + r, v2);
+                _mm_storeu_ps(out3 + r, v3);
+            }
+            for (; r < numRows; ++r)
+            {
+                const float* in = rows + r * numChans + c;
+                out0[r] = in[0];
+                out1[r] = in[1];
+                out2[r] = in[2];
+                out3[r] = in[3];
+            }
+        }
+
+        transposeScalarFrom(c, rows, numRows, numChans, channels, start);
+    }
+#endif
+};
+
+#endif // CHANNEL_TRANSPOSE_H_INCLUDED
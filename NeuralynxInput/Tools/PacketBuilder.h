@@ -0,0 +1,100 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+We hope that this plugin will be useful to others, but its source code
+and functionality are subject to a non-disclosure agreement (NDA) with
+Neuralynx, Inc. If you or your institution have not signed the appropriate
+NDA, STOP and do not read or execute this plugin until you have done so.
+Do not share this plugin with other parties who have not signed the NDA.
+
+*/
+
+#ifndef PACKET_BUILDER_H_INCLUDED
+#define PACKET_BUILDER_H_INCLUDED
+
+// Builds Digital Lynx SX / ATLAS UDP packets for the command-line tools.
+
+#include "PacketKernel.h"
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+class PacketBuilder
+{
+public:
+    // amplitude of the test signal, in raw units (~100 uV)
+    static const int32_t amplitude = 6400;
+
+    PacketBuilder(int boards, double sampleRate)
+        : numChans(boards * PacketKernel::boardChannels)
+        , usPerSample(1e6 / sampleRate)
+        , words(PacketKernel::wordsInPacketWithBoards(boards))
+        , packet(words)
+        , sine(tableSize)
+    {
+        for (int i = 0; i < tableSize; ++i)
+        {
+            sine[i] = int32_t(std::lround(amplitude * std::sin(2 * 3.14159265358979 * i / tableSize)));
+        }
+    }
+
+    int getNumWords() const { return words; }
+    int getNumBytes() const { return words * 4; }
+
+    // Hardware timestamp (us) of sample n, counting from startTs
+    uint64_t getTimestamp(uint64_t n, uint64_t startTs) const
+    {
+        return startTs + uint64_t(n * usPerSample + 0.5);
+    }
+
+    // Fills the packet for sample n: a sine wave per channel (of a different frequency on each),
+    // the given timestamp, a TTL word that counts up every ttlPeriod samples and a valid checksum.
+    uint32_t* build(uint64_t n, uint64_t ts, uint64_t ttlPeriod)
+    {
+        packet[0] = 2048;                    // STX
+        packet[1] = 1;                       // packet ID
+        packet[2] = uint32_t(numChans + 10); // size
+        packet[3] = uint32_t(ts >> 32);
+        packet[4] = uint32_t(ts & 0xffffffff);
+        packet[5] = 0;                       // status
+        packet[6] = uint32_t(n / ttlPeriod); // parallel input port
+        for (int i = 7; i < PacketKernel::headerWords; ++i)
+        {
+            packet[i] = 0;
+        }
+
+        uint32_t* samples = packet.data() + PacketKernel::headerWords;
+        for (int c = 0; c < numChans; ++c)
+        {
+            samples[c] = uint32_t(sine[(n * uint64_t(c + 1)) & (tableSize - 1)]);
+        }
+
+        // footer makes the XOR of all words 0
+        uint32_t crc = 0;
+        for (int i = 0; i < words - 1; ++i)
+        {
+            crc ^= packet[i];
+        }
+        packet[words - 1] = crc;
+
+        return packet.data();
+    }
+
+private:
+    static const int tableSize = 1024;
+
+    const int numChans;
+    const double usPerSample;
+    const int words;
+
+    std::vector<uint32_t> packet;
+    std::vector<int32_t> sine;
+};
+
+#endif // PACKET_BUILDER_H_INCLUDED
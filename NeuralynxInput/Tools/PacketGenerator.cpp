@@ -0,0 +1,304 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+We hope that this plugin will be useful to others, but its source code
+and functionality are subject to a non-disclosure agreement (NDA) with
+Neuralynx, Inc. If you or your institution have not signed the appropriate
+NDA, STOP and do not read or execute this plugin until you have done so.
+Do not share this plugin with other parties who have not signed the NDA.
+
+*/
+
+// Sends a stream of Digital Lynx SX / ATLAS packets over UDP, for testing the plugin without hardware.
+// Run with --help for options.
+
+#include "CaptureFile.h"
+#include "PacketBuilder.h"
+#include "UdpSocket.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    volatile std::sig_atomic_t interrupted = 0;
+
+    void onInterrupt(int)
+    {
+        interrupted = 1;
+    }
+
+    struct Options
+    {
+        std::string host = "127.0.0.1";
+        int port = 26090;
+        int boards = 1;
+        double rate = 32000;
+        double seconds = 0; // 0 = until interrupted
+        double loss = 0;
+        double reorder = 0;
+        double corrupt = 0;
+        unsigned seed = 1;
+        uint64_t tsStart = 0;
+        bool fast = false;
+        std::string output;
+    };
+
+    void printUsage()
+    {
+        std::printf(
+            "usage: nlx_packet_generator [options]\n"
+            "Sends Digital Lynx SX / ATLAS packets (sine waves on every channel, rising timestamps,\n"
+            "a counting TTL word and valid checksums) to the Neuralynx Input plugin.\n"
+            "\n"
+            "  --host ADDR      destination address (default 127.0.0.1)\n"
+            "  --port N         destination port (default 26090)\n"
+            "  --boards N       number of 32-channel boards, 1-16 (default 1)\n"
+            "  --rate HZ        sample rate: 16000-40000 in steps of 2000, or 32768 (default 32000)\n"
+            "  --seconds S      stop after S seconds (default: run until interrupted)\n"
+            "  --loss P         drop each packet with probability P\n"
+            "  --reorder P      swap each packet with the next one with probability P\n"
+            "  --corrupt P      flip one random bit of each packet with probability P\n"
+            "  --seed N         random seed for loss, reordering and corruption (default 1)\n"
+            "  --ts-start US    hardware timestamp of the first packet, in us (default 0)\n"
+            "  --fast           send as fast as possible instead of in real time\n"
+            "  --output FILE    write the packets to a capture file (.nlxcap) instead of sending\n"
+            "                   them; requires --seconds\n");
+    }
+
+    bool parseOptions(int argc, char* argv[], Options& opt)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if (arg == "--help" || arg == "-h")
+            {
+                return false;
+            }
+
+            if (arg == "--fast")
+            {
+                opt.fast = true;
+                continue;
+            }
+
+            if (i + 1 >= argc)
+            {
+                std::fprintf(stderr, "missing value for %s\n", arg.c_str());
+                return false;
+            }
+
+            const char* value = argv[++i];
+            if      (arg == "--host")     { opt.host = value; }
+            else if (arg == "--port")     { opt.port = std::atoi(value); }
+            else if (arg == "--boards")   { opt.boards = std::atoi(value); }
+            else if (arg == "--rate")     { opt.rate = std::atof(value); }
+            else if (arg == "--seconds")  { opt.seconds = std::atof(value); }
+            else if (arg == "--loss")     { opt.loss = std::atof(value); }
+            else if (arg == "--reorder")  { opt.reorder = std::atof(value); }
+            else if (arg == "--corrupt")  { opt.corrupt = std::atof(value); }
+            else if (arg == "--seed")     { opt.seed = unsigned(std::strtoul(value, nullptr, 10)); }
+            else if (arg == "--ts-start") { opt.tsStart = std::strtoull(value, nullptr, 10); }
+            else if (arg == "--output")   { opt.output = value; }
+            else
+            {
+                std::fprintf(stderr, "unknown option %s\n", arg.c_str());
+                return false;
+            }
+        }
+
+        bool rateValid = opt.rate == 32768
+            || (opt.rate >= 16000 && opt.rate <= 40000 && std::fmod(opt.rate, 2000) == 0);
+
+        if (opt.boards < 1 || opt.boards > 16 || !rateValid || opt.port < 1 || opt.port > 65535
+            || opt.loss < 0 || opt.loss > 1 || opt.reorder < 0 || opt.reorder > 1 || opt.corrupt < 0 || opt.corrupt > 1
+            || (!opt.output.empty() && opt.seconds <= 0))
+        {
+            std::fprintf(stderr, "invalid options\n");
+            return false;
+        }
+        return true;
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    Options opt;
+    if (!parseOptions(argc, argv, opt))
+    {
+        printUsage();
+        return 1;
+    }
+
+    PacketBuilder builder(opt.boards, opt.rate);
+    const int packetBytes = builder.getNumBytes();
+
+    UdpSocket socket;
+    CaptureFile::Writer capture;
+    bool toFile = !opt.output.empty();
+
+    if (toFile)
+    {
+        if (!capture.open(opt.output))
+        {
+            std::fprintf(stderr, "%s\n", capture.getError().c_str());
+            return 1;
+        }
+    }
+    else if (!socket.isValid() || !socket.setDestination(opt.host, uint16_t(opt.port)))
+    {
+        std::fprintf(stderr, "can't send to %s:%d\n", opt.host.c_str(), opt.port);
+        return 1;
+    }
+
+    std::signal(SIGINT, onInterrupt);
+
+    std::mt19937_64 rng(opt.seed);
+    std::uniform_real_distribution<double> chance(0, 1);
+    std::uniform_int_distribution<int> bitPicker(0, packetBytes * 8 - 1);
+
+    const uint64_t total = opt.seconds > 0 ? uint64_t(opt.seconds * opt.rate) : UINT64_MAX;
+    const double periodNs = 1e9 / opt.rate;
+    const uint64_t ttlPeriod = uint64_t(opt.rate / 10); // TTL word changes every 100 ms
+    const uint64_t captureStartNs = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+
+    std::vector<uint32_t> held(builder.getNumWords());
+    bool holding = false;
+
+    uint64_t sent = 0, dropped = 0, reordered = 0, corrupted = 0, sendErrors = 0;
+    double maxLagMs = 0;
+
+    std::printf("sending %d boards (%d channels) at %g Hz, %d bytes per packet, to %s\n", opt.boards,
+        opt.boards * PacketKernel::boardChannels, opt.rate, packetBytes,
+        toFile ? opt.output.c_str() : (opt.host + ":" + std::to_string(opt.port)).c_str());
+
+    const Clock::time_point start = Clock::now();
+    Clock::time_point nextReport = start + std::chrono::seconds(1);
+    uint64_t sentAtLastReport = 0;
+
+    for (uint64_t n = 0; n < total && !interrupted; ++n)
+    {
+        if (!opt.fast && !toFile)
+        {
+            // sleep while the next packet is well in the future, then spin until it's due
+            Clock::time_point due = start + std::chrono::nanoseconds(int64_t(n * periodNs));
+            Clock::time_point now = Clock::now();
+            if (due - now > std::chrono::microseconds(300))
+            {
+                std::this_thread::sleep_for(due - now - std::chrono::microseconds(200));
+            }
+            while ((now = Clock::now()) < due) {}
+
+            maxLagMs = std::max(maxLagMs, std::chrono::duration<double, std::milli>(now - due).count());
+        }
+
+        uint32_t* packet = builder.build(n, builder.getTimestamp(n, opt.tsStart), ttlPeriod);
+
+        if (opt.corrupt > 0 && chance(rng) < opt.corrupt)
+        {
+            int bit = bitPicker(rng);
+            packet[bit / 32] ^= uint32_t(1) << (bit % 32);
+            ++corrupted;
+        }
+
+        bool drop = opt.loss > 0 && chance(rng) < opt.loss;
+        bool hold = !drop && !holding && opt.reorder > 0 && chance(rng) < opt.reorder;
+
+        if (drop)
+        {
+            ++dropped;
+        }
+        else if (hold)
+        {
+            // send after the next packet
+            std::copy(packet, packet + builder.getNumWords(), held.begin());
+            holding = true;
+            ++reordered;
+        }
+
+        for (int k = 0; k < 2; ++k)
+        {
+            const uint32_t* toSend;
+            if (k == 0 && !drop && !hold)
+            {
+                toSend = packet;
+            }
+            else if (k == 1 && holding && !hold)
+            {
+                toSend = held.data();
+                holding = false;
+            }
+            else
+            {
+                continue;
+            }
+
+            if (toFile)
+            {
+                capture.append(toSend, uint32_t(packetBytes), captureStartNs + uint64_t(n * periodNs));
+                ++sent;
+            }
+            else if (socket.send(toSend, packetBytes) == packetBytes)
+            {
+                ++sent;
+            }
+            else
+            {
+                ++sendErrors;
+            }
+        }
+
+        if (!toFile && (n & 1023) == 0 && Clock::now() >= nextReport)
+        {
+            double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+            std::printf("%6.1f s: %llu packets sent (%.0f/s), max lag %.2f ms\n", elapsed,
+                (unsigned long long)sent, double(sent - sentAtLastReport), maxLagMs);
+            std::fflush(stdout);
+            sentAtLastReport = sent;
+            nextReport += std::chrono::seconds(1);
+        }
+    }
+
+    if (holding)
+    {
+        // (the packet it was swapped with never came)
+        if (toFile)
+        {
+            capture.append(held.data(), uint32_t(packetBytes), captureStartNs + uint64_t(total * periodNs));
+            ++sent;
+        }
+        else if (socket.send(held.data(), packetBytes) == packetBytes)
+        {
+            ++sent;
+        }
+    }
+
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    std::printf("done: %llu packets in %.2f s (%.0f/s, %.1f MB/s); dropped %llu, reordered %llu, corrupted %llu, "
+        "send errors %llu; max lag %.2f ms\n", (unsigned long long)sent, elapsed, sent / elapsed,
+        sent * double(packetBytes) / elapsed / 1e6, (unsigned long long)dropped, (unsigned long long)reordered,
+        (unsigned long long)corrupted, (unsigned long long)sendErrors, maxLagMs);
+
+    if (toFile)
+    {
+        capture.close();
+    }
+    return 0;
+}
@@ -0,0 +1,237 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+We hope that this plugin will be useful to others, but its source code
+and functionality are subject to a non-disclosure agreement (NDA) with
+Neuralynx, Inc. If you or your institution have not signed the appropriate
+NDA, STOP and do not read or execute this plugin until you have done so.
+Do not share this plugin with other parties who have not signed the NDA.
+
+*/
+
+// Reads the plugin's output from its shared memory ring, as a closed-loop process would, and prints
+// the rate, losses, publish-to-read latency and TTL edges once per second. Also an example of using the reader.
+// Run with --help for options.
+
+#include "SharedMemoryRing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    // TTL line 33, which the plugin's RECOVER loss policy sets on samples filled in during an outage
+    const uint64_t outageBit = uint64_t(1) << 32;
+
+    volatile std::sig_atomic_t interrupted = 0;
+
+    void onInterrupt(int)
+    {
+        interrupted = 1;
+    }
+
+    struct Options
+    {
+        std::string name = SharedMemoryRing::getStreamName(0);
+        double seconds = 0; // 0 = until interrupted
+        bool spin = false;
+    };
+
+    void printUsage()
+    {
+        std::printf(
+            "usage: nlx_shm_reader [options]\n"
+            "Reads samples published by the Neuralynx Input plugin (with SHM on) from shared memory and\n"
+            "prints the sample rate, samples lost, the latency from publishing to reading and the TTL edges\n"
+            "published each second.\n"
+            "Waits for the ring to appear, and follows it across acquisitions.\n"
+            "\n"
+            "  --stream N       read stream N of the plugin (default 1)\n"
+            "  --name NAME      read the ring with this name instead\n"
+            "  --seconds S      stop after S seconds (default: run until interrupted)\n"
+            "  --spin           poll without yielding the CPU between reads (lowest latency)\n");
+    }
+
+    bool parseOptions(int argc, char* argv[], Options& opt)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if (arg == "--help" || arg == "-h")
+            {
+                return false;
+            }
+
+            if (arg == "--spin")
+            {
+                opt.spin = true;
+                continue;
+            }
+
+            if (i + 1 >= argc)
+            {
+                std::fprintf(stderr, "missing value for %s\n", arg.c_str());
+                return false;
+            }
+
+            const char* value = argv[++i];
+            if      (arg == "--stream")  { opt.name = SharedMemoryRing::getStreamName(std::atoi(value) - 1); }
+            else if (arg == "--name")    { opt.name = value; }
+            else if (arg == "--seconds") { opt.seconds = std::atof(value); }
+            else
+            {
+                std::fprintf(stderr, "unknown option %s\n", arg.c_str());
+                return false;
+            }
+        }
+        return !opt.name.empty() && opt.seconds >= 0;
+    }
+
+    double percentileUs(const std::vector<uint32_t>& sortedNs, double p)
+    {
+        size_t index = std::min(sortedNs.size() - 1, size_t(p / 100 * sortedNs.size()));
+        return sortedNs[index] / 1000.0;
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    Options opt;
+    if (!parseOptions(argc, argv, opt))
+    {
+        printUsage();
+        return 1;
+    }
+
+    std::signal(SIGINT, onInterrupt);
+
+    SharedMemoryRing::Reader reader;
+    std::vector<float> samples;
+    std::vector<int64_t> sampleNumbers;
+    std::vector<uint64_t> ttlWords;
+    std::vector<uint64_t> publishNs;
+    std::vector<uint32_t> latenciesNs;
+    std::vector<SharedMemoryRing::TtlEdge> edges(256);
+
+    const Clock::time_point start = Clock::now();
+    Clock::time_point nextReport = start + std::chrono::seconds(1);
+    uint64_t samplesSinceReport = 0, lostAtLastReport = 0, outageSamples = 0;
+    uint64_t edgesSinceReport = 0, edgesLostAtLastReport = 0;
+    SharedMemoryRing::TtlEdge lastEdge = {};
+    int64_t lastSample = -1;
+    uint64_t lastTtl = 0;
+    bool waiting = false;
+
+    while (!interrupted && (opt.seconds <= 0 || Clock::now() - start < std::chrono::duration<double>(opt.seconds)))
+    {
+        if (!reader.isOpen() || reader.isWriterClosed())
+        {
+            if (reader.isOpen())
+            {
+                std::printf("%s closed\n", opt.name.c_str());
+                reader.close();
+            }
+
+            if (!reader.open(opt.name))
+            {
+                if (!waiting)
+                {
+                    std::printf("waiting for %s (%s)\n", opt.name.c_str(), reader.getError().c_str());
+                    waiting = true;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                continue;
+            }
+
+            waiting = false;
+            lostAtLastReport = 0;
+            edgesLostAtLastReport = 0;
+            std::printf("reading %s: %d channels at %g Hz, %d samples of buffering\n", opt.name.c_str(),
+                reader.getNumChannels(), reader.getSampleRate(), reader.getCapacity());
+
+            const int maxSamples = 256;
+            samples.resize(size_t(maxSamples) * reader.getNumChannels());
+            sampleNumbers.resize(maxSamples);
+            ttlWords.resize(maxSamples);
+            publishNs.resize(maxSamples);
+        }
+
+        // (a controller would act on the edges here; each is published before its sample)
+        int numEdges = reader.readEdges(edges.data(), int(edges.size()));
+        if (numEdges > 0)
+        {
+            edgesSinceReport += uint64_t(numEdges);
+            lastEdge = edges[numEdges - 1];
+        }
+
+        int n = reader.read(samples.data(), sampleNumbers.data(), ttlWords.data(), publishNs.data(),
+            int(sampleNumbers.size()));
+        if (n > 0)
+        {
+            // (a controller would act on the samples here)
+            uint64_t nowNs = SharedMemoryRing::getMonotonicNs();
+            latenciesNs.push_back(uint32_t(std::min<uint64_t>(nowNs - publishNs[n - 1], UINT32_MAX)));
+            samplesSinceReport += uint64_t(n);
+            for (int i = 0; i < n; ++i)
+            {
+                outageSamples += (ttlWords[i] & outageBit) != 0 ? 1 : 0;
+            }
+            lastSample = sampleNumbers[n - 1];
+            lastTtl = ttlWords[n - 1];
+        }
+        else if (!opt.spin && numEdges == 0)
+        {
+            std::this_thread::yield();
+        }
+
+        if (Clock::now() >= nextReport)
+        {
+            uint64_t lost = reader.getNumLost() - lostAtLastReport;
+            lostAtLastReport = reader.getNumLost();
+            uint64_t edgesLost = reader.getNumEdgesLost() - edgesLostAtLastReport;
+            edgesLostAtLastReport = reader.getNumEdgesLost();
+
+            std::printf("%llu samples/s, %llu lost", (unsigned long long)samplesSinceReport, (unsigned long long)lost);
+            if (outageSamples > 0)
+            {
+                std::printf(", %llu filled in for outages", (unsigned long long)outageSamples);
+            }
+            if (!latenciesNs.empty())
+            {
+                std::sort(latenciesNs.begin(), latenciesNs.end());
+                std::printf(", latency p50 %.1f us, p99 %.1f us, max %.1f us, last sample %lld, TTL 0x%llx",
+                    percentileUs(latenciesNs, 50), percentileUs(latenciesNs, 99), latenciesNs.back() / 1000.0,
+                    (long long)lastSample, (unsigned long long)lastTtl);
+            }
+            if (edgesSinceReport > 0 || edgesLost > 0)
+            {
+                std::printf(", %llu TTL edges (%llu lost), last at sample %lld to 0x%llx (lines 0x%llx changed)",
+                    (unsigned long long)edgesSinceReport, (unsigned long long)edgesLost, (long long)lastEdge.sampleNumber, (unsigned long long)lastEdge.word,
+                    (unsigned long long)lastEdge.changed);
+            }
+            std::printf("\n");
+            std::fflush(stdout);
+
+            latenciesNs.clear();
+            samplesSinceReport = 0;
+            outageSamples = 0;
+            edgesSinceReport = 0;
+            nextReport += std::chrono::seconds(1);
+        }
+    }
+    return 0;
+}
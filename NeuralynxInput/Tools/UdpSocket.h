@@ -0,0 +1,135 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2018 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+We hope that this plugin will be useful to others, but its source code
+and functionality are subject to a non-disclosure agreement (NDA) with
+Neuralynx, Inc. If you or your institution have not signed the appropriate
+NDA, STOP and do not read or execute this plugin until you have done so.
+Do not share this plugin with other parties who have not signed the NDA.
+
+*/
+
+#ifndef UDP_SOCKET_H_INCLUDED
+#define UDP_SOCKET_H_INCLUDED
+
+// Minimal UDP socket for the command-line tools, which don't link to JUCE.
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+class UdpSocket
+{
+public:
+    UdpSocket()
+        : fd(invalid)
+    {
+#ifdef _WIN32
+        WSADATA wsaData;
+        WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
+        fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        std::memset(&dest, 0, sizeof(dest));
+    }
+
+    ~UdpSocket()
+    {
+        if (fd != invalid)
+        {
+#ifdef _WIN32
+            closesocket(fd);
+            WSACleanup();
+#else
+            close(fd);
+#endif
+        }
+    }
+
+    bool isValid() const { return fd != invalid; }
+
+    // Sets where send() sends to
+    bool setDestination(const std::string& host, uint16_t port)
+    {
+        dest.sin_family = AF_INET;
+        dest.sin_port = htons(port);
+        return inet_pton(AF_INET, host.c_str(), &dest.sin_addr) == 1;
+    }
+
+    bool bind(const std::string& host, uint16_t port)
+    {
+        sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1)
+        {
+            return false;
+        }
+        return ::bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0;
+    }
+
+    bool setBufferSizes(int bytes)
+    {
+        const char* value = reinterpret_cast<const char*>(&bytes);
+        return setsockopt(fd, SOL_SOCKET, SO_SNDBUF, value, sizeof(bytes)) == 0
+            && setsockopt(fd, SOL_SOCKET, SO_RCVBUF, value, sizeof(bytes)) == 0;
+    }
+
+    // Returns the number of bytes sent, or -1 on error (e.g. the send buffer is full)
+    int send(const void* data, int bytes)
+    {
+        return int(sendto(fd, static_cast<const char*>(data), bytes, 0,
+            reinterpret_cast<const sockaddr*>(&dest), sizeof(dest)));
+    }
+
+    // Waits up to timeoutMs for a datagram. Returns its length, 0 on timeout or -1 on error.
+    int receive(void* data, int maxBytes, int timeoutMs)
+    {
+#ifdef _WIN32
+        WSAPOLLFD pfd = { fd, POLLRDNORM, 0 };
+        int ready = WSAPoll(&pfd, 1, timeoutMs);
+#else
+        pollfd pfd = { fd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, timeoutMs);
+#endif
+        if (ready <= 0)
+        {
+            return ready;
+        }
+        return int(recv(fd, static_cast<char*>(data), maxBytes, 0));
+    }
+
+private:
+#ifdef _WIN32
+    typedef SOCKET Handle;
+    static const Handle invalid = INVALID_SOCKET;
+#else
+    typedef int Handle;
+    static const Handle invalid = -1;
+#endif
+
+    Handle fd;
+    sockaddr_in dest;
+
+    UdpSocket(const UdpSocket&) = delete;
+    UdpSocket& operator=(const UdpSocket&) = delete;
+};
+
+#endif // UDP_SOCKET_H_INCLUDED